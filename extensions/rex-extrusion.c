@@ -41,7 +41,7 @@ void compute_normal (float ux, float uy, float uz,
 struct rex_mesh* rex_extrude (float *points, uint32_t numpoints,
                               float height, uint64_t material_id, char* name)
 {
-    struct rex_mesh *mesh = malloc (sizeof (struct rex_mesh));
+    struct rex_mesh *mesh = rex_malloc (sizeof (struct rex_mesh));
     if (!mesh)
         die ("Allocating mesh failed");
     rex_mesh_init (mesh);
@@ -62,13 +62,13 @@ struct rex_mesh* rex_extrude (float *points, uint32_t numpoints,
     //eew and not null-terminated if overflow
     strncpy (mesh->name, name, strlen (name) + 1 < REX_MESH_NAME_MAX_SIZE? strlen (name) + 1 : REX_MESH_NAME_MAX_SIZE);
 
-    mesh->positions = malloc (3 * mesh->nr_vertices * sizeof (float));
+    mesh->positions = rex_malloc (3 * mesh->nr_vertices * sizeof (float));
     if (!mesh->positions)
         die ("Allocating extruded mesh failed");
 
     memcpy (mesh->positions, points, 3 * numpoints * sizeof (float));
 
-    mesh->triangles = malloc (3 * mesh->nr_triangles * sizeof (uint32_t));
+    mesh->triangles = rex_malloc (3 * mesh->nr_triangles * sizeof (uint32_t));
     if (!mesh->triangles)
         die ("Allocating extruded mesh failed");
 
@@ -157,7 +157,7 @@ struct rex_mesh* rex_extrude (float *points, uint32_t numpoints,
 
 struct rex_pointlist* create_anchors (float *anchorpoints, uint32_t numanchors)
 {    
-    struct rex_pointlist* pointlist = malloc (sizeof (struct rex_pointlist));
+    struct rex_pointlist* pointlist = rex_malloc (sizeof (struct rex_pointlist));
     if (!pointlist)
         die ("Allocating pointlist failed");
     rex_pointlist_init (pointlist);
@@ -165,7 +165,7 @@ struct rex_pointlist* create_anchors (float *anchorpoints, uint32_t numanchors)
     pointlist->nr_vertices = numanchors;
     pointlist->nr_colors = 0;
 
-    pointlist->positions = malloc (3 * numanchors * sizeof (float));
+    pointlist->positions = rex_malloc (3 * numanchors * sizeof (float));
     memcpy (pointlist->positions, anchorpoints, 3 * numanchors * sizeof (float));
 
     return pointlist;
@@ -200,24 +200,40 @@ void rex_extruded_with_material_write (float* points, uint32_t numpoints, float
     struct rex_mesh* mesh;
     mesh = rex_extrude (points, numpoints, height, material_id, name);
 
+    //repeated input points give duplicate vertices and degenerate walls
+    if (rex_mesh_weld (mesh, NULL) != REX_OK)
+        warn ("Welding extruded mesh failed");
+
     struct rex_pointlist* pointlist = NULL;
     if (numanchors > 0)
         pointlist = create_anchors (anchorpoints, numanchors);
 
-    //write to rex file
-    long mesh_sz;
-    uint8_t *mesh_ptr = rex_block_write_mesh (0 /*id*/, header, mesh, &mesh_sz);
-
+    //write to rex file, the blocks are created in file order (the header CRC depends on it)
     long pointlist_sz = 0;
     uint8_t *pointlist_ptr = NULL;
     if (numanchors > 0)
         pointlist_ptr = rex_block_write_pointlist (2 /*id*/, header, pointlist, &pointlist_sz);
 
+    long mesh_sz;
+    uint8_t *mesh_ptr = rex_block_write_mesh (0 /*id*/, header, mesh, &mesh_sz);
+
     long material_sz = 0;
     uint8_t *material_ptr = NULL;
     if (material != NULL)
         material_ptr = rex_block_write_material (material_id, header, material, &material_sz);
 
+    // index entries follow the file order
+    struct rex_index idx;
+    rex_index_init (&idx);
+    if (numanchors > 0)
+        rex_index_add_block (&idx, pointlist_ptr);
+    rex_index_add_block (&idx, mesh_ptr);
+    if (material != NULL)
+        rex_index_add_block (&idx, material_ptr);
+
+    long idx_sz;
+    uint8_t *idx_ptr = rex_block_write_index (header, &idx, &idx_sz);
+
     long header_sz;
     uint8_t *header_ptr = rex_header_write (header, &header_sz);
 
@@ -231,6 +247,8 @@ void rex_extruded_with_material_write (float* points, uint32_t numpoints, float
     if (material != NULL)
         fwrite (material_ptr, (size_t) material_sz, 1, fp);
 
+    fwrite (idx_ptr, (size_t) idx_sz, 1, fp);
+
     fclose (fp);
 
     //cleanup
@@ -241,6 +259,8 @@ void rex_extruded_with_material_write (float* points, uint32_t numpoints, float
     FREE (mesh_ptr);
     FREE (pointlist_ptr);
     FREE (header_ptr);
+    FREE (idx_ptr);
+    rex_index_free (&idx);
 }
 
 void rex_extruded_file_write(float* points, uint32_t numpoints, float height,
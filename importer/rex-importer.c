@@ -22,23 +22,39 @@
 #include <assimp/cimport.h>        // Plain-C interface
 #include <assimp/postprocess.h>    // Post processing flags
 #include <assimp/scene.h>          // Output data structure
-#include <stdbool.h>
 #include <string.h>
 
+// the levels of all meshes are kept on the stack
+#define MAX_LODS 16
+
 struct settings_s
 {
     char *input;
     char *output;
-    bool transform;
+    int transform;
     float scale;
+    int compress;
+    int optimize;
+    int weld;
+    int strip_normals;
+    int lods;
+    char *codec;
+    int mem_report;
 };
 
 struct settings_s settings =
 {
     .input = NULL,
     .output = NULL,
-    .transform = true,
-    .scale = 1.0f
+    .transform = 1,
+    .scale = 1.0f,
+    .compress = 0,
+    .optimize = 0,
+    .weld = 0,
+    .strip_normals = 0,
+    .lods = 0,
+    .codec = "none",
+    .mem_report = 0
 };
 
 struct argparse_option options[] =
@@ -50,6 +66,15 @@ struct argparse_option options[] =
     OPT_GROUP ("Geometric transformations"),
     OPT_BOOLEAN ('\0', "transform", &settings.transform, "apply transformation to have Z pointing upwards [default=true], use no- prefix to disable"),
     OPT_FLOAT ('s', "scale", &settings.scale, "apply coordinate scale (e.g. if input is not in unit meters)"),
+    OPT_GROUP ("Output"),
+    OPT_BOOLEAN ('c', "compress", &settings.compress, "write quantized mesh blocks (version 2) for mobile clients"),
+    OPT_BOOLEAN ('w', "weld", &settings.weld, "merge duplicate vertices and remove degenerate triangles"),
+    OPT_BOOLEAN ('O', "optimize", &settings.optimize, "reorder triangles and vertices for the vertex cache and overdraw of the GPU"),
+    OPT_BOOLEAN ('N', "strip-normals", &settings.strip_normals, "do not write vertex normals, readers regenerate smooth normals on load"),
+    OPT_INTEGER ('l', "lods", &settings.lods, "write the given number of simplified levels of detail for every mesh (at most 16)"),
+    OPT_STRING ('z', "codec", &settings.codec, "compress all blocks with the given codec (none, lz4 or zstd)"),
+    OPT_GROUP ("Diagnostics"),
+    OPT_BOOLEAN ('\0', "mem-report", &settings.mem_report, "print the memory accounting per subsystem on exit"),
     OPT_END(),
 };
 
@@ -78,7 +103,7 @@ void convert_mesh (struct aiMesh *input, struct rex_mesh *mesh)
     mesh->nr_vertices = input->mNumVertices;
     mesh->nr_triangles = input->mNumFaces;
 
-    mesh->positions = malloc (sizeof (float) * 3 * mesh->nr_vertices);
+    mesh->positions = rex_malloc (sizeof (float) * 3 * mesh->nr_vertices);
 
     mat4x4 mat =
     {
@@ -113,7 +138,7 @@ void convert_mesh (struct aiMesh *input, struct rex_mesh *mesh)
 
     if (input->mNormals != NULL)
     {
-        mesh->normals = malloc (sizeof (float) * 3 * mesh->nr_vertices);
+        mesh->normals = rex_malloc (sizeof (float) * 3 * mesh->nr_vertices);
         for (i = 0, j = 0; j < input->mNumVertices; i += 3, j++)
         {
             mesh->normals[i]     = input->mNormals[j].x;
@@ -123,7 +148,7 @@ void convert_mesh (struct aiMesh *input, struct rex_mesh *mesh)
     }
     if (input->mTextureCoords[0] != NULL)
     {
-        mesh->tex_coords = malloc (sizeof (float) * 2 * mesh->nr_vertices);
+        mesh->tex_coords = rex_malloc (sizeof (float) * 2 * mesh->nr_vertices);
         for (i = 0, j = 0; j < input->mNumVertices; i += 2, j++)
         {
             mesh->tex_coords[i] = input->mTextureCoords[0][j].x;
@@ -132,9 +157,9 @@ void convert_mesh (struct aiMesh *input, struct rex_mesh *mesh)
     }
 
     // TODO currently not supported by assimp
-    /* mesh->colors = malloc (sizeof (float) * 3 * mesh->nr_vertices); */
+    /* mesh->colors = rex_malloc (sizeof (float) * 3 * mesh->nr_vertices); */
 
-    mesh->triangles = malloc (sizeof (uint32_t) * 3 * mesh->nr_triangles);
+    mesh->triangles = rex_malloc (sizeof (uint32_t) * 3 * mesh->nr_triangles);
     for (i = 0, j = 0; j < input->mNumFaces; i += 3, j++)
     {
         mesh->triangles[i]     = input->mFaces[j].mIndices[0];
@@ -197,6 +222,12 @@ void convert_material (struct aiMaterial *mat, struct rex_material_standard *rex
     rex_mat->ns = 0;
 }
 
+void mem_report (void)
+{
+    printf ("\nmemory\n");
+    rex_mem_report (stdout);
+}
+
 int main (int argc, const char **argv)
 {
     printf ("═══════════════════════════════════════════\n");
@@ -215,7 +246,19 @@ int main (int argc, const char **argv)
         argparse_usage (&argparse);
         return 1;
     }
+
+    if (settings.mem_report)
+    {
+        rex_mem_tracking (1);
+        atexit (mem_report);
+    }
+
+    struct rex_codec_params codec;
+    rex_codec_params_init (&codec, REX_CODEC_NONE);
+    if (rex_codec_from_name (settings.codec, &codec.codec) != REX_OK)
+        die ("Codec %s is not supported\n", settings.codec);
     /* Import Assimp file and perform post-triangulation */
+    struct rex_trace_span span = rex_trace_begin ("import scene");
     const struct aiScene *scene = aiImportFile (settings.input,
                                   aiProcessPreset_TargetRealtime_Quality
                                   /* aiProcess_JoinIdenticalVertices | */
@@ -223,6 +266,7 @@ int main (int argc, const char **argv)
                                   /* aiProcess_SortByPType | */
                                   /* aiProcess_GenNormals */
                                                );
+    rex_trace_end (&span);
     if (!scene)
         die ("Cannot import scene: %s", aiGetErrorString());
 
@@ -231,13 +275,16 @@ int main (int argc, const char **argv)
 
     struct rex_header *header = rex_header_create();
 
+    // material and mesh blocks of every mesh, the header is updated after compression
     int i;
-    uint8_t *mesh_data[scene->mNumMeshes];
-    long mesh_data_sz[scene->mNumMeshes];
-    uint8_t *mat_data[scene->mNumMeshes];
-    long mat_data_sz[scene->mNumMeshes];
+    if (settings.lods < 0 || settings.lods > MAX_LODS)
+        die ("Invalid number of levels of detail: %d (at most %d)\n", settings.lods, MAX_LODS);
+    uint32_t nr_blocks = 0;
+    uint8_t *data[(2 + settings.lods) * scene->mNumMeshes];
+    long data_sz[(2 + settings.lods) * scene->mNumMeshes];
 
     long block_id = 0;
+    struct rex_thread_pool *pool = rex_thread_pool_create (0);
 
     for (i = 0; i < scene->mNumMeshes; i++)
     {
@@ -246,33 +293,109 @@ int main (int argc, const char **argv)
 
         rex_mesh_init (&rex_mesh);
 
+        span = rex_trace_begin ("convert_mesh");
+        int mem = rex_mem_enter (REX_MEM_APPLICATION);
         convert_material (scene->mMaterials[scene->mMeshes[i]->mMaterialIndex], &rex_mat);
         convert_mesh (scene->mMeshes[i], &rex_mesh);
+        rex_mem_leave (mem);
+        rex_trace_end (&span);
+
+        if (settings.weld)
+        {
+            uint32_t nr_vertices = rex_mesh.nr_vertices;
+            if (rex_mesh_weld (&rex_mesh, NULL) == REX_OK)
+                printf ("Mesh %d: %u -> %u vertices after welding\n", i, nr_vertices, rex_mesh.nr_vertices);
+            else
+                warn ("Cannot weld mesh %d", i);
+        }
 
-        uint8_t *mat_ptr = rex_block_write_material (block_id, header, &rex_mat, &mat_data_sz[i]);
+        struct rex_mesh lods[settings.lods + 1];
+        uint16_t nr_lods = 0;
+        if (settings.lods)
+        {
+            struct rex_mesh_lod_params params;
+            rex_mesh_lod_params_init (&params);
+            params.nr_lods = settings.lods;
+            if (rex_mesh_lods (&rex_mesh, &params, pool, lods, &nr_lods) != REX_OK)
+                warn ("Cannot simplify mesh %d", i);
+            for (int l = 0; l < nr_lods; l++)
+                printf ("Mesh %d: LOD %d with %u triangles\n", i, l + 1, lods[l].nr_triangles);
+        }
+
+        span = rex_trace_begin ("write mesh");
+        data[nr_blocks] = rex_block_write_material (block_id, NULL, &rex_mat, &data_sz[nr_blocks]);
+        nr_blocks++;
         rex_mesh.material_id = block_id;
         block_id++;
-        uint8_t *mesh_ptr = rex_block_write_mesh (block_id, header, &rex_mesh, &mesh_data_sz[i]);
-        block_id++;
-        rex_mesh_free (&rex_mesh);
-        mesh_data[i] = mesh_ptr;
-        mat_data[i] = mat_ptr;
+        rex_trace_end (&span);
+
+        // the original mesh is level 0, all levels share the material
+        for (int l = 0; l <= nr_lods; l++)
+        {
+            struct rex_mesh *mesh = l ? &lods[l - 1] : &rex_mesh;
+            mesh->material_id = rex_mesh.material_id;
+
+            if (settings.optimize)
+            {
+                struct rex_mesh_optimize_params params;
+                struct rex_mesh_cache_stats before, after;
+                rex_mesh_optimize_params_init (&params);
+                params.overdraw = 1;
+                if (rex_mesh_optimize (mesh, &params, &before, &after) == REX_OK)
+                    printf ("Mesh %d: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", i, before.acmr, after.acmr, before.atvr, after.atvr);
+                else
+                    warn ("Cannot optimize mesh %d", i);
+            }
+
+            // stripped after welding, so hard edges are kept as separate vertices
+            if (settings.strip_normals)
+                FREE (mesh->normals);
+
+            span = rex_trace_begin ("write mesh");
+            data[nr_blocks] = (settings.compress)
+                              ? rex_block_write_mesh_compressed (block_id, NULL, mesh, NULL, &data_sz[nr_blocks])
+                              : rex_block_write_mesh (block_id, NULL, mesh, &data_sz[nr_blocks]);
+            nr_blocks++;
+            block_id++;
+            rex_trace_end (&span);
+            rex_mesh_free (mesh);
+        }
     }
 
+    span = rex_trace_begin ("compress blocks");
+    if (rex_blocks_compress (pool, header, data, data_sz, nr_blocks, &codec) != REX_OK)
+        die ("Cannot compress blocks\n");
+    rex_thread_pool_destroy (pool);
+    rex_trace_end (&span);
+
+    // write index blob
+    struct rex_index idx;
+    rex_index_init (&idx);
+    for (i = 0; i < nr_blocks; i++)
+        rex_index_add_block (&idx, data[i]);
+    long idx_sz;
+    uint8_t *idx_ptr = rex_block_write_index (header, &idx, &idx_sz);
+
     // write header blob
     long header_sz;
     uint8_t *header_ptr = rex_header_write (header, &header_sz);
 
     // write data to file
+    span = rex_trace_begin ("write file");
     FILE *fp = fopen (settings.output, "wb");
     fwrite (header_ptr, header_sz, 1, fp);
 
     // write all mesh and material data
-    for (i = 0; i < scene->mNumMeshes; i++)
+    for (i = 0; i < nr_blocks; i++)
     {
-        fwrite (mat_data[i], mat_data_sz[i], 1, fp);
-        fwrite (mesh_data[i], mesh_data_sz[i], 1, fp);
+        fwrite (data[i], data_sz[i], 1, fp);
+        FREE (data[i]);
     }
+    fwrite (idx_ptr, idx_sz, 1, fp);
     fclose (fp);
+    rex_trace_end (&span);
+
+    rex_index_free (&idx);
+    FREE (idx_ptr);
     return 0;
 }
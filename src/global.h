@@ -18,12 +18,20 @@
 #define REX_FILE_MAGIC                  "REX1"
 #define REX_FILE_VERSION                1
 
+#define REX_HEADER_SIZE                 88 // header, coordinate system block and padding
 #define REX_BLOCK_HEADER_SIZE           16
+#define REX_BLOCK_ALIGNMENT             4
+#define REX_BLOCK_MAX_SIZE              0xffffffffUL
+#define REX_INDEX_ENTRY_SIZE            24
 #define REX_MESH_HEADER_SIZE            128
+#define REX_MESH_QUANT_HEADER_SIZE      48
 #define REX_MATERIAL_STANDARD_SIZE      68
 #define REX_MESH_NAME_MAX_SIZE          74
 #define REX_SCENENODE_NAME_MAX_SIZE     32
 #define REX_VERTEX_SIZE                 11
 
+// number of zero bytes which pad a block of sz bytes to the block alignment
+#define REX_BLOCK_PADDING(sz)           ((REX_BLOCK_ALIGNMENT - (sz) % REX_BLOCK_ALIGNMENT) % REX_BLOCK_ALIGNMENT)
+
 #define REX_NOT_SET                     0x7fffffffffffffffL
 #define REX_EPSILON_FLOAT               0.000001f
@@ -20,7 +20,7 @@
 
 struct list *list_create()
 {
-    struct list *l = (struct list *) malloc (sizeof (struct list));
+    struct list *l = (struct list *) rex_malloc (sizeof (struct list));
     l->head = NULL;
     l->tail = NULL;
     return l;
@@ -30,7 +30,7 @@ void list_insert (struct list *l, void *data)
 {
     if (l->head == NULL)
     {
-        l->head = (struct node *) malloc (sizeof (struct node));
+        l->head = (struct node *) rex_malloc (sizeof (struct node));
         l->head->data = data;
         l->head->prev = NULL;
         l->head->next = NULL;
@@ -38,7 +38,7 @@ void list_insert (struct list *l, void *data)
     }
     else
     {
-        struct node *new =  malloc (sizeof (struct node));
+        struct node *new =  rex_malloc (sizeof (struct node));
 
         new->data = data;
         new->next = NULL;
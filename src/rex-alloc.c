@@ -0,0 +1,129 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <stdlib.h>
+
+#include "rex-alloc.h"
+#include "rex-mem.h"
+#include "rex-stats.h"
+#include "status.h"
+
+static void *default_malloc (size_t sz, void *ctx)
+{
+    (void) ctx;
+    return malloc (sz);
+}
+
+static void *default_realloc (void *p, size_t sz, void *ctx)
+{
+    (void) ctx;
+    return realloc (p, sz);
+}
+
+static void default_free (void *p, void *ctx)
+{
+    (void) ctx;
+    free (p);
+}
+
+static void *default_aligned_alloc (size_t alignment, size_t sz, void *ctx)
+{
+    (void) ctx;
+#ifndef WIN32
+    void *p = NULL;
+    if (alignment < sizeof (void *))
+        alignment = sizeof (void *);
+    if (posix_memalign (&p, alignment, sz ? sz : 1) != 0)
+        return NULL;
+    return p;
+#else
+    // memory must be releasable with free, which rules out _aligned_malloc
+    (void) alignment;
+    return malloc (sz);
+#endif
+}
+
+static struct rex_allocator allocator =
+{
+    .malloc = default_malloc,
+    .realloc = default_realloc,
+    .free = default_free,
+    .aligned_alloc = default_aligned_alloc,
+    .ctx = NULL
+};
+
+int rex_set_allocator (const struct rex_allocator *a)
+{
+    if (!a)
+    {
+        allocator.malloc = default_malloc;
+        allocator.realloc = default_realloc;
+        allocator.free = default_free;
+        allocator.aligned_alloc = default_aligned_alloc;
+        allocator.ctx = NULL;
+        return REX_OK;
+    }
+
+    if (!a->malloc || !a->realloc || !a->free || !a->aligned_alloc)
+        return REX_MISSING_PARAMETER;
+
+    allocator = *a;
+    return REX_OK;
+}
+
+const struct rex_allocator *rex_get_allocator (void)
+{
+    return &allocator;
+}
+
+void *rex_malloc (size_t sz)
+{
+    REX_STATS_ALLOC (sz);
+    void *p = allocator.malloc (sz, allocator.ctx);
+    rex_mem_track (p, sz, -1);
+    return p;
+}
+
+void *rex_realloc (void *p, size_t sz)
+{
+    REX_STATS_ALLOC (sz);
+    if (!rex_mem_armed ())
+        return allocator.realloc (p, sz, allocator.ctx);
+
+    // p is untracked before it gets released, another thread may get the same address
+    uint64_t old_sz = 0;
+    int subsystem = rex_mem_untrack (p, &old_sz);
+    void *q = allocator.realloc (p, sz, allocator.ctx);
+    if (q)
+        rex_mem_track (q, sz, subsystem);
+    else if (p && sz && subsystem >= 0)
+        rex_mem_track (p, old_sz, subsystem);
+    return q;
+}
+
+void *rex_aligned_alloc (size_t alignment, size_t sz)
+{
+    REX_STATS_ALLOC (sz);
+    void *p = allocator.aligned_alloc (alignment, sz, allocator.ctx);
+    rex_mem_track (p, sz, -1);
+    return p;
+}
+
+void rex_free (void *p)
+{
+    if (p && rex_mem_armed ())
+        rex_mem_untrack (p, NULL);
+    allocator.free (p, allocator.ctx);
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Pluggable memory allocator used by all library functions
+ *
+ * All memory which is allocated or released by the library goes through the functions
+ * rex_malloc, rex_realloc, rex_aligned_alloc and rex_free (and the FREE macro). By default
+ * these functions use the C library. A custom allocator can be installed with
+ * rex_set_allocator, e.g. to use a different malloc implementation, memory pools or to
+ * account the memory per user. The ctx pointer is passed to every hook.
+ *
+ * The allocator must be set before any other library function is called and must not be
+ * changed while memory of the previous allocator is still in use. Memory which is released
+ * by the library (e.g. the arrays freed by rex_mesh_free or rex_block_free) must have been
+ * allocated with rex_malloc, and memory returned by the library must be released with
+ * rex_free. The hooks are called concurrently if blocks are decoded in parallel
+ * (see rex_block_read_all).
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The alignment of attribute arrays (positions, normals, ...) which are allocated by the library
+ */
+#define REX_ARRAY_ALIGNMENT 32
+
+/**
+ * Allocator hooks. All hooks are required. Memory of aligned_alloc and realloc must be
+ * releasable with free.
+ */
+struct rex_allocator
+{
+    void *(*malloc) (size_t sz, void *ctx);                         //<! allocates sz bytes
+    void *(*realloc) (void *p, size_t sz, void *ctx);               //<! resizes the allocation p
+    void (*free) (void *p, void *ctx);                              //<! releases p, must accept NULL
+    void *(*aligned_alloc) (size_t alignment, size_t sz, void *ctx); //<! allocates sz bytes with the given power of two alignment
+    void *ctx;                                                      //<! user context which is passed to all hooks
+};
+
+/**
+ * Installs the allocator. The hooks are copied. Passing NULL restores the default allocator.
+ *
+ * \param allocator the allocator or NULL
+ * \return REX_OK on success, REX_MISSING_PARAMETER if a hook is missing
+ */
+int rex_set_allocator (const struct rex_allocator *allocator);
+
+/**
+ * Returns the currently installed allocator
+ */
+const struct rex_allocator *rex_get_allocator (void);
+
+/**
+ * Allocates sz bytes with the installed allocator
+ */
+void *rex_malloc (size_t sz);
+
+/**
+ * Resizes memory which was allocated with the installed allocator
+ */
+void *rex_realloc (void *p, size_t sz);
+
+/**
+ * Allocates sz bytes aligned to alignment (power of two) with the installed allocator
+ */
+void *rex_aligned_alloc (size_t alignment, size_t sz);
+
+/**
+ * Releases memory which was allocated with the installed allocator
+ */
+void rex_free (void *p);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <stdlib.h>
+
+#include "rex-alloc.h"
+#include "rex-arena.h"
+#include "util.h"
+
+#define ALIGN_UP(x) (((x) + (REX_ARENA_ALIGNMENT - 1)) & ~((size_t) REX_ARENA_ALIGNMENT - 1))
+
+struct rex_arena_chunk
+{
+    struct rex_arena_chunk *next;
+    size_t sz;
+    size_t used;
+    size_t pad; // keeps data aligned to REX_ARENA_ALIGNMENT
+    uint8_t data[];
+};
+
+static struct rex_arena_chunk *chunk_create (size_t sz)
+{
+    struct rex_arena_chunk *chunk = rex_malloc (sizeof (struct rex_arena_chunk) + sz);
+    if (!chunk)
+        return NULL;
+
+    chunk->next = NULL;
+    chunk->sz = sz;
+    chunk->used = 0;
+    return chunk;
+}
+
+void rex_arena_init (struct rex_arena *arena, size_t chunk_sz)
+{
+    if (!arena) return;
+
+    arena->head = NULL;
+    arena->chunk_sz = chunk_sz ? ALIGN_UP (chunk_sz) : REX_ARENA_CHUNK_SIZE;
+}
+
+void *rex_arena_alloc (struct rex_arena *arena, size_t sz)
+{
+    if (!arena)
+        return rex_aligned_alloc (REX_ARRAY_ALIGNMENT, sz);
+
+    sz = ALIGN_UP (sz ? sz : 1);
+    struct rex_arena_chunk *head = arena->head;
+    if (head && head->sz - head->used >= sz)
+    {
+        void *p = head->data + head->used;
+        head->used += sz;
+        return p;
+    }
+
+    // large allocations get their own chunk behind the current one
+    if (sz > arena->chunk_sz / 4)
+    {
+        struct rex_arena_chunk *chunk = chunk_create (sz);
+        if (!chunk)
+            return NULL;
+        chunk->used = sz;
+        if (head)
+        {
+            chunk->next = head->next;
+            head->next = chunk;
+        }
+        else
+            arena->head = chunk;
+        return chunk->data;
+    }
+
+    struct rex_arena_chunk *chunk = chunk_create (arena->chunk_sz);
+    if (!chunk)
+        return NULL;
+    chunk->next = head;
+    chunk->used = sz;
+    arena->head = chunk;
+    return chunk->data;
+}
+
+void rex_arena_reset (struct rex_arena *arena)
+{
+    if (!arena || !arena->head) return;
+
+    // keep one regular chunk for the next round
+    struct rex_arena_chunk *keep = NULL;
+    struct rex_arena_chunk *chunk = arena->head;
+    while (chunk)
+    {
+        struct rex_arena_chunk *next = chunk->next;
+        if (chunk->sz == arena->chunk_sz && !keep)
+            keep = chunk;
+        else
+            FREE (chunk);
+        chunk = next;
+    }
+
+    if (keep)
+    {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    arena->head = keep;
+}
+
+void rex_arena_free (struct rex_arena *arena)
+{
+    if (!arena) return;
+
+    struct rex_arena_chunk *chunk = arena->head;
+    while (chunk)
+    {
+        struct rex_arena_chunk *next = chunk->next;
+        FREE (chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+}
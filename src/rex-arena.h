@@ -0,0 +1,94 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Bump allocator for decoding complete REX files
+ *
+ * All memory which is needed to decode the blocks of a file can be taken from an arena
+ * (see rex_block_read_arena). The arena allocates large chunks and hands out memory by
+ * bumping a pointer, so decoding a block costs no individual malloc calls. The memory
+ * of all blocks is released with a single call to rex_arena_free (or rex_arena_reset
+ * which keeps the first chunk for the next file). Block data which was taken from an
+ * arena must never be passed to free, rex_block_free or rex_mesh_free.
+ *
+ * An arena is not thread-safe. Use one arena per thread.
+ *
+ * \code
+ * struct rex_arena arena;
+ * rex_arena_init (&arena, 0);
+ * while (ptr < end)
+ *     ptr = rex_block_read_arena (ptr, &block, &arena);
+ * ...
+ * rex_arena_free (&arena);
+ * \endcode
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REX_ARENA_CHUNK_SIZE (1024 * 1024)
+#define REX_ARENA_ALIGNMENT  16
+
+struct rex_arena_chunk;
+
+/**
+ * A list of memory chunks from which the memory gets allocated
+ */
+struct rex_arena
+{
+    struct rex_arena_chunk *head; //<! the current chunk, followed by all other chunks
+    size_t chunk_sz;              //<! the default size of a new chunk
+};
+
+/**
+ * Initializes an empty arena. No memory is allocated before the first rex_arena_alloc.
+ *
+ * \param arena the arena
+ * \param chunk_sz the size of the chunks in bytes, 0 selects REX_ARENA_CHUNK_SIZE
+ */
+void rex_arena_init (struct rex_arena *arena, size_t chunk_sz);
+
+/**
+ * Allocates sz bytes aligned to REX_ARENA_ALIGNMENT. Allocations which are larger than
+ * a quarter of the chunk size get a dedicated chunk. If arena is NULL the memory is
+ * allocated with rex_aligned_alloc (REX_ARRAY_ALIGNMENT) instead and must be released with
+ * rex_free, which allows to use the same code path for both cases.
+ *
+ * \param arena the arena or NULL
+ * \param sz the number of bytes
+ * \return the memory or NULL if the allocation failed
+ */
+void *rex_arena_alloc (struct rex_arena *arena, size_t sz);
+
+/**
+ * Releases all allocations but keeps the first chunk for reuse
+ */
+void rex_arena_reset (struct rex_arena *arena);
+
+/**
+ * Releases all memory of the arena
+ */
+void rex_arena_free (struct rex_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
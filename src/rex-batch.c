@@ -0,0 +1,454 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#ifdef REX_WITH_IO_URING
+#define _DEFAULT_SOURCE // syscall
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef REX_WITH_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "global.h"
+#include "rex-batch.h"
+#include "rex-mem.h"
+#include "rex-trace.h"
+#include "status.h"
+#include "util.h"
+
+/**
+ * Reads a complete file on the calling thread
+ */
+static void file_read (struct rex_batch_file *file)
+{
+    file->data = NULL;
+    file->sz = 0;
+
+#ifndef WIN32
+    int fd = open (file->filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        file->status = REX_ERROR_FILE_OPEN;
+        return;
+    }
+
+    struct stat sb;
+    file->status = REX_ERROR_FILE_READ;
+    if (fstat (fd, &sb) == 0)
+    {
+        file->sz = sb.st_size;
+        file->data = rex_mem_alloc (REX_MEM_IO, file->sz ? file->sz : 1);
+        file->status = file->data ? REX_OK : REX_ERROR_MEMORY;
+    }
+
+    for (uint64_t pos = 0; file->status == REX_OK && pos < file->sz;)
+    {
+        ssize_t ret = pread (fd, file->data + pos, file->sz - pos, pos);
+        if (ret > 0)
+            pos += ret;
+        else if (ret == 0 || errno != EINTR)
+            file->status = REX_ERROR_FILE_READ;
+    }
+    close (fd);
+#else
+    long sz;
+    file->data = read_file_binary (file->filename, &sz);
+    file->sz = file->data ? sz : 0;
+    file->status = file->data ? REX_OK : REX_ERROR_FILE_OPEN;
+#endif
+
+    if (file->status != REX_OK)
+    {
+        FREE (file->data);
+        file->sz = 0;
+    }
+}
+
+struct batch_ctx
+{
+    struct rex_batch_file *files;
+    rex_batch_fn fn;
+    void *ctx;
+};
+
+static void read_task (void *arg, uint32_t i)
+{
+    struct batch_ctx *ctx = arg;
+    struct rex_trace_span span = rex_trace_begin ("read file");
+    file_read (&ctx->files[i]);
+    rex_trace_end (&span);
+    if (ctx->fn)
+        ctx->fn (ctx->ctx, &ctx->files[i]);
+}
+
+static void callback_task (void *arg, uint32_t i)
+{
+    struct batch_ctx *ctx = arg;
+    ctx->fn (ctx->ctx, &ctx->files[i]);
+}
+
+#ifdef REX_WITH_IO_URING
+
+// the number of files which are processed concurrently, every file has one request in flight
+#define URING_DEPTH 64
+
+// a single read returns at most 0x7ffff000 bytes
+#define URING_MAX_READ (1u << 30)
+
+struct uring
+{
+    int fd;
+    void *sq_ptr;
+    size_t sq_sz;
+    void *cq_ptr;
+    size_t cq_sz;
+    struct io_uring_sqe *sqes;
+    size_t sqes_sz;
+
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned to_submit; //<! prepared entries which have not been published yet
+    unsigned pending;   //<! published entries which have not been consumed by the kernel
+};
+
+enum uring_state { STATE_OPEN, STATE_READ, STATE_CLOSE, STATE_DONE };
+
+struct uring_file
+{
+    int fd;
+    uint8_t state;
+    uint64_t pos;
+};
+
+static void uring_exit (struct uring *r)
+{
+    if (r->sqes)
+        munmap (r->sqes, r->sqes_sz);
+    if (r->cq_ptr && r->cq_ptr != r->sq_ptr)
+        munmap (r->cq_ptr, r->cq_sz);
+    if (r->sq_ptr)
+        munmap (r->sq_ptr, r->sq_sz);
+    if (r->fd >= 0)
+        close (r->fd);
+}
+
+static int uring_init (struct uring *r, unsigned entries)
+{
+    memset (r, 0, sizeof (struct uring));
+    struct io_uring_params p;
+    memset (&p, 0, sizeof (p));
+
+    r->fd = syscall (__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+        return REX_NOT_IMPLEMENTED;
+
+    // openat, read and close are available since 5.6, fast poll has been added in 5.7
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_FAST_POLL))
+    {
+        uring_exit (r);
+        return REX_NOT_IMPLEMENTED;
+    }
+
+    r->sq_sz = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+    r->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+    if (r->cq_sz > r->sq_sz)
+        r->sq_sz = r->cq_sz;
+    r->sqes_sz = p.sq_entries * sizeof (struct io_uring_sqe);
+
+    r->sq_ptr = mmap (NULL, r->sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED)
+    {
+        r->sq_ptr = NULL;
+        uring_exit (r);
+        return REX_NOT_IMPLEMENTED;
+    }
+    r->cq_ptr = r->sq_ptr;
+
+    r->sqes = mmap (NULL, r->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+    {
+        r->sqes = NULL;
+        uring_exit (r);
+        return REX_NOT_IMPLEMENTED;
+    }
+
+    uint8_t *sq = r->sq_ptr;
+    uint8_t *cq = r->cq_ptr;
+    r->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *) (sq + p.sq_off.array);
+    r->cq_head = (unsigned *) (cq + p.cq_off.head);
+    r->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    return REX_OK;
+}
+
+/**
+ * Returns the next submission queue entry, the caller makes sure that the queue is not full
+ */
+static struct io_uring_sqe *uring_sqe (struct uring *r, uint64_t user_data)
+{
+    unsigned tail = *r->sq_tail + r->to_submit;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset (sqe, 0, sizeof (struct io_uring_sqe));
+    sqe->user_data = user_data;
+    r->sq_array[idx] = idx;
+    r->to_submit++;
+    return sqe;
+}
+
+/**
+ * Publishes all prepared entries and waits for at least one completion
+ */
+static int uring_submit_and_wait (struct uring *r)
+{
+    __atomic_store_n (r->sq_tail, *r->sq_tail + r->to_submit, __ATOMIC_RELEASE);
+    r->pending += r->to_submit;
+    r->to_submit = 0;
+
+    for (;;)
+    {
+        int ret = syscall (__NR_io_uring_enter, r->fd, r->pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret >= 0)
+        {
+            r->pending -= ret;
+            return REX_OK;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            return REX_ERROR_FILE_READ;
+    }
+}
+
+static void uring_prep_read (struct uring *r, uint32_t i, struct rex_batch_file *file, struct uring_file *uf)
+{
+    uint64_t len = file->sz - uf->pos;
+    struct io_uring_sqe *sqe = uring_sqe (r, i);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = uf->fd;
+    sqe->off = uf->pos;
+    sqe->addr = (uintptr_t) (file->data + uf->pos);
+    sqe->len = (len > URING_MAX_READ) ? URING_MAX_READ : len;
+    uf->state = STATE_READ;
+}
+
+static void uring_prep_close (struct uring *r, uint32_t i, struct uring_file *uf)
+{
+    struct io_uring_sqe *sqe = uring_sqe (r, i);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = uf->fd;
+    uf->state = STATE_CLOSE;
+}
+
+/**
+ * Advances the state of a file after a completion, returns != 0 if the file is finished
+ */
+static int uring_complete (struct uring *r, uint32_t i, struct rex_batch_file *file, struct uring_file *uf, int res)
+{
+    switch (uf->state)
+    {
+        case STATE_OPEN:
+            {
+                if (res < 0)
+                {
+                    file->status = REX_ERROR_FILE_OPEN;
+                    uf->state = STATE_DONE;
+                    return 1;
+                }
+                uf->fd = res;
+
+                // the metadata is cached after the open, fstat does not block on I/O
+                struct stat sb;
+                if (fstat (uf->fd, &sb) != 0)
+                    file->status = REX_ERROR_FILE_READ;
+                else if (!(file->data = rex_mem_alloc (REX_MEM_IO, sb.st_size ? sb.st_size : 1)))
+                    file->status = REX_ERROR_MEMORY;
+                else
+                    file->sz = sb.st_size;
+
+                if (file->status == REX_OK && file->sz > 0)
+                    uring_prep_read (r, i, file, uf);
+                else
+                    uring_prep_close (r, i, uf);
+                return 0;
+            }
+        case STATE_READ:
+            {
+                if (res > 0)
+                    uf->pos += res;
+                else
+                    file->status = REX_ERROR_FILE_READ;
+
+                if (file->status == REX_OK && uf->pos < file->sz)
+                    uring_prep_read (r, i, file, uf);
+                else
+                    uring_prep_close (r, i, uf);
+                return 0;
+            }
+        default:
+            uf->state = STATE_DONE;
+            return 1;
+    }
+}
+
+static int uring_read_all (struct rex_batch_file *files, uint32_t nr_files)
+{
+    struct uring r;
+    if (uring_init (&r, URING_DEPTH) != REX_OK)
+        return REX_NOT_IMPLEMENTED;
+
+    struct uring_file *ufiles = rex_malloc (nr_files * sizeof (struct uring_file));
+    if (!ufiles)
+    {
+        uring_exit (&r);
+        return REX_ERROR_MEMORY;
+    }
+
+    uint32_t next = 0;
+    uint32_t in_flight = 0;
+    uint32_t done = 0;
+    int ret = REX_OK;
+    while (done < nr_files)
+    {
+        for (; in_flight < URING_DEPTH && next < nr_files; next++, in_flight++)
+        {
+            struct rex_batch_file *file = &files[next];
+            file->data = NULL;
+            file->sz = 0;
+            file->status = REX_OK;
+            ufiles[next].fd = -1;
+            ufiles[next].pos = 0;
+            ufiles[next].state = STATE_OPEN;
+
+            struct io_uring_sqe *sqe = uring_sqe (&r, next);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t) file->filename;
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        }
+
+        ret = uring_submit_and_wait (&r);
+        if (ret != REX_OK)
+            break;
+
+        unsigned head = *r.cq_head;
+        unsigned tail = __atomic_load_n (r.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+            uint32_t i = cqe->user_data;
+            if (uring_complete (&r, i, &files[i], &ufiles[i], cqe->res))
+            {
+                if (files[i].status != REX_OK)
+                {
+                    FREE (files[i].data);
+                    files[i].sz = 0;
+                }
+                in_flight--;
+                done++;
+            }
+        }
+        __atomic_store_n (r.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // all unfinished files fail, the buffers of pending reads may still be written by the
+    // kernel until the ring is torn down and are intentionally not released
+    if (ret != REX_OK)
+    {
+        for (uint32_t i = 0; i < nr_files; i++)
+        {
+            if (i < next && ufiles[i].state == STATE_DONE)
+                continue;
+            if (i < next && ufiles[i].state == STATE_READ)
+                close (ufiles[i].fd);
+            else if (i < next && ufiles[i].state == STATE_CLOSE)
+                FREE (files[i].data);
+            files[i].data = NULL;
+            files[i].sz = 0;
+            files[i].status = REX_ERROR_FILE_READ;
+        }
+    }
+
+    FREE (ufiles);
+    uring_exit (&r);
+    return REX_OK;
+}
+
+#endif
+
+int rex_batch_uring_available (void)
+{
+#ifdef REX_WITH_IO_URING
+    struct uring r;
+    if (uring_init (&r, 1) != REX_OK)
+        return 0;
+    uring_exit (&r);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int rex_batch_read (struct rex_thread_pool *pool, struct rex_batch_file *files, uint32_t nr_files, uint32_t flags,
+                    rex_batch_fn fn, void *ctx)
+{
+    if (!files)
+        return REX_MISSING_PARAMETER;
+    for (uint32_t i = 0; i < nr_files; i++)
+        if (!files[i].filename)
+            return REX_MISSING_PARAMETER;
+
+    struct batch_ctx bctx = { .files = files, .fn = fn, .ctx = ctx };
+    int ret = REX_NOT_IMPLEMENTED;
+#ifdef REX_WITH_IO_URING
+    if (!(flags & REX_BATCH_NO_URING))
+    {
+        struct rex_trace_span span = rex_trace_begin ("io_uring read");
+        ret = uring_read_all (files, nr_files);
+        rex_trace_end (&span);
+    }
+#endif
+
+    if (ret == REX_OK)
+    {
+        if (fn)
+            rex_parallel_for (pool, nr_files, callback_task, &bctx);
+    }
+    else
+        rex_parallel_for (pool, nr_files, read_task, &bctx);
+
+    for (uint32_t i = 0; i < nr_files; i++)
+        if (files[i].status != REX_OK)
+            return files[i].status;
+    return REX_OK;
+}
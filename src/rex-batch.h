@@ -0,0 +1,99 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Batch loading of many REX files
+ *
+ * Loading thousands of small files with blocking open and read calls is dominated by the
+ * syscall latency. rex_batch_read reads a whole list of files into memory buffers and hands
+ * the buffers to a callback, which typically decodes them with rex_header_read and
+ * rex_block_read.
+ *
+ * On Linux the opens, reads and closes of all files are queued through io_uring, so many
+ * requests are in flight at the same time. Afterwards the callbacks run on the threads of the
+ * pool. If io_uring is not available (older kernels, other platforms, or disabled by the
+ * system) every file is read and handed to the callback on the threads of the pool instead.
+ *
+ * \code
+ * static void decode (void *ctx, struct rex_batch_file *file)
+ * {
+ *     struct rex_header header;
+ *     if (file->status == REX_OK && rex_header_read (file->data, &header))
+ *         ...
+ * }
+ *
+ * struct rex_batch_file files[n] = { { .filename = "0.rex" }, ... };
+ * rex_batch_read (pool, files, n, 0, decode, NULL);
+ * for (uint32_t i = 0; i < n; i++)
+ *     rex_free (files[i].data);
+ * \endcode
+ */
+
+#include <stdint.h>
+
+#include "rex-thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Flag for rex_batch_read which disables io_uring
+ */
+#define REX_BATCH_NO_URING 1
+
+/**
+ * A file of the batch
+ */
+struct rex_batch_file
+{
+    const char *filename; //<! the path of the file, must be set by the caller
+    uint8_t *data;        //<! the file content, allocated with rex_malloc, NULL in case of error
+    uint64_t sz;          //<! the size of the file content in bytes
+    int status;           //<! REX_OK if the file has been read, else an error code (see status.h)
+};
+
+/**
+ * The callback which gets a file after it has been read, called for every file of the
+ * batch (also for files which could not be read). The callback can be called concurrently.
+ */
+typedef void (*rex_batch_fn) (void *ctx, struct rex_batch_file *file);
+
+/**
+ * Returns != 0 if io_uring can be used on this system
+ */
+int rex_batch_uring_available (void);
+
+/**
+ * Reads all files of the batch. The caller must release the data of all files with rex_free,
+ * the callback can take over the ownership of the data by setting it to NULL.
+ *
+ * \param pool the thread pool which runs the fallback reads and the callbacks, can be NULL
+ * \param files the files of the batch
+ * \param nr_files the number of files
+ * \param flags 0 or REX_BATCH_NO_URING
+ * \param fn the callback, can be NULL
+ * \param ctx the context which is passed to the callback
+ * \return REX_OK if all files have been read, else the status of the first failed file
+ */
+int rex_batch_read (struct rex_thread_pool *pool, struct rex_batch_file *files, uint32_t nr_files, uint32_t flags,
+                    rex_batch_fn fn, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,440 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef REX_WITH_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+#ifdef REX_WITH_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+#include "global.h"
+#include "rex-block-compressed.h"
+#include "rex-block.h"
+#include "rex-mem.h"
+#include "rex-trace.h"
+#include "status.h"
+#include "util.h"
+
+struct codec_dict
+{
+    uint32_t id;
+    uint8_t *data;
+    size_t sz;
+};
+
+static struct codec_dict *dicts = NULL;
+static uint32_t nr_dicts = 0;
+
+static const struct codec_dict *dict_find (uint32_t dict_id)
+{
+    for (uint32_t i = 0; i < nr_dicts; i++)
+        if (dicts[i].id == dict_id)
+            return &dicts[i];
+    return NULL;
+}
+
+void rex_codec_params_init (struct rex_codec_params *params, uint16_t codec)
+{
+    if (!params) return;
+
+    params->codec = codec;
+    params->level = 0;
+    params->dict_id = 0;
+}
+
+int rex_codec_available (uint16_t codec)
+{
+    switch (codec)
+    {
+        case REX_CODEC_NONE:
+            return 1;
+#ifdef REX_WITH_LZ4
+        case REX_CODEC_LZ4:
+            return 1;
+#endif
+#ifdef REX_WITH_ZSTD
+        case REX_CODEC_ZSTD:
+            return 1;
+#endif
+        default:
+            return 0;
+    }
+}
+
+int rex_codec_from_name (const char *name, uint16_t *codec)
+{
+    if (!name || !codec)
+        return REX_MISSING_PARAMETER;
+
+    static const char *names[] = { "none", "lz4", "zstd" };
+    for (uint16_t i = 0; i < LEN (names); i++)
+    {
+        if (strcmp (name, names[i]) == 0 && rex_codec_available (i))
+        {
+            *codec = i;
+            return REX_OK;
+        }
+    }
+    return REX_NOT_IMPLEMENTED;
+}
+
+int rex_codec_add_dict (uint32_t dict_id, const uint8_t *dict, size_t sz)
+{
+    if (!dict_id || !dict || !sz)
+        return REX_MISSING_PARAMETER;
+
+    uint8_t *data = rex_malloc (sz);
+    if (!data)
+        return REX_ERROR_MEMORY;
+    memcpy (data, dict, sz);
+
+    struct codec_dict *d = (struct codec_dict *) dict_find (dict_id);
+    if (!d)
+    {
+        struct codec_dict *tmp = rex_realloc (dicts, (nr_dicts + 1) * sizeof (struct codec_dict));
+        if (!tmp)
+        {
+            FREE (data);
+            return REX_ERROR_MEMORY;
+        }
+        dicts = tmp;
+        d = &dicts[nr_dicts++];
+        d->id = dict_id;
+        d->data = NULL;
+    }
+    FREE (d->data);
+    d->data = data;
+    d->sz = sz;
+    return REX_OK;
+}
+
+void rex_codec_clear_dicts (void)
+{
+    for (uint32_t i = 0; i < nr_dicts; i++)
+        FREE (dicts[i].data);
+    FREE (dicts);
+    nr_dicts = 0;
+}
+
+int rex_codec_train_dict (const uint8_t *const *samples, const size_t *sizes, uint32_t nr_samples,
+                          uint8_t *dict, size_t *sz)
+{
+    if (!samples || !sizes || !nr_samples || !dict || !sz)
+        return REX_MISSING_PARAMETER;
+
+#ifdef REX_WITH_ZSTD
+    // the trainer expects all samples in one contiguous buffer
+    size_t total = 0;
+    for (uint32_t i = 0; i < nr_samples; i++)
+        total += sizes[i];
+
+    uint8_t *buf = rex_malloc (total);
+    if (!buf)
+        return REX_ERROR_MEMORY;
+    size_t pos = 0;
+    for (uint32_t i = 0; i < nr_samples; pos += sizes[i], i++)
+        memcpy (buf + pos, samples[i], sizes[i]);
+
+    size_t ret = ZDICT_trainFromBuffer (dict, *sz, buf, sizes, nr_samples);
+    FREE (buf);
+    if (ZDICT_isError (ret))
+    {
+        warn ("Cannot train dictionary: %s", ZDICT_getErrorName (ret));
+        return REX_ERROR_MEMORY;
+    }
+    *sz = ret;
+    return REX_OK;
+#else
+    return REX_NOT_IMPLEMENTED;
+#endif
+}
+
+/**
+ * Compresses src into dst, returns the compressed size or 0 if the data cannot be compressed
+ */
+static size_t codec_compress (const struct rex_codec_params *params, const struct codec_dict *dict,
+                              const uint8_t *src, size_t src_sz, uint8_t *dst, size_t dst_sz)
+{
+    switch (params->codec)
+    {
+#ifdef REX_WITH_LZ4
+        case REX_CODEC_LZ4:
+            {
+                int ret = 0;
+                if (params->level > 0)
+                {
+                    LZ4_streamHC_t *s = LZ4_createStreamHC();
+                    if (!s)
+                        return 0;
+                    LZ4_resetStreamHC_fast (s, params->level);
+                    if (dict)
+                        LZ4_loadDictHC (s, (const char *) dict->data, dict->sz);
+                    ret = LZ4_compress_HC_continue (s, (const char *) src, (char *) dst, src_sz, dst_sz);
+                    LZ4_freeStreamHC (s);
+                }
+                else
+                {
+                    LZ4_stream_t *s = LZ4_createStream();
+                    if (!s)
+                        return 0;
+                    if (dict)
+                        LZ4_loadDict (s, (const char *) dict->data, dict->sz);
+                    ret = LZ4_compress_fast_continue (s, (const char *) src, (char *) dst, src_sz, dst_sz, 1);
+                    LZ4_freeStream (s);
+                }
+                return (ret > 0) ? (size_t) ret : 0;
+            }
+#endif
+#ifdef REX_WITH_ZSTD
+        case REX_CODEC_ZSTD:
+            {
+                ZSTD_CCtx *cctx = ZSTD_createCCtx();
+                if (!cctx)
+                    return 0;
+                size_t ret = ZSTD_compress_usingDict (cctx, dst, dst_sz, src, src_sz,
+                                                      dict ? dict->data : NULL, dict ? dict->sz : 0,
+                                                      params->level ? params->level : ZSTD_CLEVEL_DEFAULT);
+                ZSTD_freeCCtx (cctx);
+                return ZSTD_isError (ret) ? 0 : ret;
+            }
+#endif
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Decompresses src into dst, returns != 0 if exactly dst_sz bytes have been decoded
+ */
+static int codec_decompress (uint16_t codec, const struct codec_dict *dict,
+                             const uint8_t *src, size_t src_sz, uint8_t *dst, size_t dst_sz)
+{
+    switch (codec)
+    {
+#ifdef REX_WITH_LZ4
+        case REX_CODEC_LZ4:
+            {
+                if (src_sz > LZ4_MAX_INPUT_SIZE || dst_sz > INT32_MAX)
+                    return 0;
+                int ret = (dict)
+                          ? LZ4_decompress_safe_usingDict ((const char *) src, (char *) dst, src_sz, dst_sz,
+                                                           (const char *) dict->data, dict->sz)
+                          : LZ4_decompress_safe ((const char *) src, (char *) dst, src_sz, dst_sz);
+                return ret >= 0 && (size_t) ret == dst_sz;
+            }
+#endif
+#ifdef REX_WITH_ZSTD
+        case REX_CODEC_ZSTD:
+            {
+                ZSTD_DCtx *dctx = ZSTD_createDCtx();
+                if (!dctx)
+                    return 0;
+                size_t ret = ZSTD_decompress_usingDict (dctx, dst, dst_sz, src, src_sz,
+                                                        dict ? dict->data : NULL, dict ? dict->sz : 0);
+                ZSTD_freeDCtx (dctx);
+                return !ZSTD_isError (ret) && ret == dst_sz;
+            }
+#endif
+        default:
+            return 0;
+    }
+}
+
+static size_t codec_bound (uint16_t codec, size_t sz)
+{
+    switch (codec)
+    {
+#ifdef REX_WITH_LZ4
+        case REX_CODEC_LZ4:
+            return (sz <= LZ4_MAX_INPUT_SIZE) ? (size_t) LZ4_compressBound (sz) : 0;
+#endif
+#ifdef REX_WITH_ZSTD
+        case REX_CODEC_ZSTD:
+            return ZSTD_compressBound (sz);
+#endif
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Compresses a single block, returns NULL if the block is kept as it is
+ */
+static uint8_t *block_compress (const uint8_t *block, long sz, const struct rex_codec_params *params, long *csz)
+{
+    struct rex_block inner;
+    rex_block_peek ((uint8_t *) block, &inner);
+
+    // groups are reassembled through the index and must keep their member types
+    if (inner.type == Compressed || inner.type == Index || inner.type == Group
+            || sz != (long) (REX_BLOCK_HEADER_SIZE + inner.sz))
+        return NULL;
+
+    const struct codec_dict *dict = NULL;
+    if (params->dict_id && !(dict = dict_find (params->dict_id)))
+    {
+        warn ("Dictionary %u is not registered", params->dict_id);
+        return NULL;
+    }
+
+    const uint8_t *payload = block + REX_BLOCK_HEADER_SIZE;
+    size_t bound = codec_bound (params->codec, inner.sz);
+    if (!bound)
+        return NULL;
+
+    uint8_t *ptr = rex_mem_alloc (REX_MEM_COMPRESSION, REX_BLOCK_HEADER_SIZE + REX_COMPRESSED_HEADER_SIZE + bound
+                                  + REX_BLOCK_ALIGNMENT);
+    if (!ptr)
+        return NULL;
+
+    size_t data_sz = codec_compress (params, dict, payload, inner.sz,
+                                     ptr + REX_BLOCK_HEADER_SIZE + REX_COMPRESSED_HEADER_SIZE, bound);
+    // the codecs need the exact size of the compressed data, the padding is stored
+    uint16_t padding = REX_BLOCK_PADDING (data_sz);
+    if (!data_sz || REX_COMPRESSED_HEADER_SIZE + data_sz + padding >= inner.sz)
+    {
+        FREE (ptr);
+        return NULL;
+    }
+    memset (ptr + REX_BLOCK_HEADER_SIZE + REX_COMPRESSED_HEADER_SIZE + data_sz, 0, padding);
+
+    uint8_t *addr = ptr;
+    struct rex_block outer = { .type = Compressed, .version = 1, .sz = REX_COMPRESSED_HEADER_SIZE + data_sz + padding,
+                               .id = inner.id };
+    ptr = rex_block_header_write (ptr, &outer);
+
+    rexcpyr (&params->codec, ptr, sizeof (uint16_t));
+    rexcpyr (&inner.type, ptr, sizeof (uint16_t));
+    rexcpyr (&inner.version, ptr, sizeof (uint16_t));
+    rexcpyr (&padding, ptr, sizeof (uint16_t));
+    rexcpyr (&params->dict_id, ptr, sizeof (uint32_t));
+    rexcpyr (&inner.sz, ptr, sizeof (uint32_t));
+
+    *csz = REX_BLOCK_HEADER_SIZE + outer.sz;
+    return addr;
+}
+
+int rex_block_compress (struct rex_header *header, uint8_t **block, long *sz, const struct rex_codec_params *params)
+{
+    return rex_blocks_compress (NULL, header, block, sz, 1, params);
+}
+
+struct compress_ctx
+{
+    uint8_t **blocks;
+    long *sz;
+    const struct rex_codec_params *params;
+};
+
+static void compress_task (void *arg, uint32_t i)
+{
+    struct compress_ctx *ctx = arg;
+
+    long csz;
+    struct rex_trace_span span = rex_trace_begin ("compress");
+    uint8_t *ptr = block_compress (ctx->blocks[i], ctx->sz[i], ctx->params, &csz);
+    rex_trace_end (&span);
+    if (ptr)
+    {
+        FREE (ctx->blocks[i]);
+        ctx->blocks[i] = ptr;
+        ctx->sz[i] = csz;
+    }
+}
+
+int rex_blocks_compress (struct rex_thread_pool *pool, struct rex_header *header, uint8_t **blocks, long *sz,
+                         uint32_t nr_blocks, const struct rex_codec_params *params)
+{
+    if (!blocks || !sz)
+        return REX_MISSING_PARAMETER;
+    for (uint32_t i = 0; i < nr_blocks; i++)
+        if (!blocks[i] || sz[i] < REX_BLOCK_HEADER_SIZE)
+            return REX_MISSING_PARAMETER;
+
+    if (params && params->codec != REX_CODEC_NONE)
+    {
+        if (!rex_codec_available (params->codec))
+            return REX_NOT_IMPLEMENTED;
+
+        struct compress_ctx ctx = { .blocks = blocks, .sz = sz, .params = params };
+        rex_parallel_for (pool, nr_blocks, compress_task, &ctx);
+    }
+
+    for (uint32_t i = 0; i < nr_blocks; i++)
+        rex_header_add_block (header, blocks[i], sz[i]);
+    return REX_OK;
+}
+
+uint8_t *rex_block_decompress (uint8_t *ptr, uint32_t sz, uint64_t id, long *inner_sz)
+{
+    MEM_CHECK (ptr)
+    MEM_CHECK (inner_sz)
+
+    if (sz < REX_COMPRESSED_HEADER_SIZE)
+    {
+        warn ("Invalid compressed block");
+        return NULL;
+    }
+
+    uint16_t codec, padding;
+    uint32_t dict_id;
+    struct rex_block inner = { .id = id };
+    rexcpy (&codec, ptr, sizeof (uint16_t));
+    rexcpy (&inner.type, ptr, sizeof (uint16_t));
+    rexcpy (&inner.version, ptr, sizeof (uint16_t));
+    rexcpy (&padding, ptr, sizeof (uint16_t));
+    rexcpy (&dict_id, ptr, sizeof (uint32_t));
+    rexcpy (&inner.sz, ptr, sizeof (uint32_t));
+
+    if (!rex_codec_available (codec) || codec == REX_CODEC_NONE)
+    {
+        warn ("Compression codec %u is not supported", codec);
+        return NULL;
+    }
+    if (inner.type == Compressed || padding > sz - REX_COMPRESSED_HEADER_SIZE)
+    {
+        warn ("Invalid compressed block");
+        return NULL;
+    }
+
+    const struct codec_dict *dict = NULL;
+    if (dict_id && !(dict = dict_find (dict_id)))
+    {
+        warn ("Dictionary %u is not registered", dict_id);
+        return NULL;
+    }
+
+    uint8_t *buf = rex_mem_alloc (REX_MEM_COMPRESSION, REX_BLOCK_HEADER_SIZE + (size_t) inner.sz);
+    if (!buf)
+        return NULL;
+    rex_block_header_write (buf, &inner);
+
+    if (!codec_decompress (codec, dict, ptr, sz - REX_COMPRESSED_HEADER_SIZE - padding, buf + REX_BLOCK_HEADER_SIZE, inner.sz))
+    {
+        warn ("Cannot decompress block %lu", (unsigned long) id);
+        FREE (buf);
+        return NULL;
+    }
+
+    *inner_sz = REX_BLOCK_HEADER_SIZE + (long) inner.sz;
+    return buf;
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief REX compressed block which wraps any data block with a LZ4 or Zstd compressed payload
+ *
+ * The compressed block stores the header fields of the original (inner) block and its payload
+ * compressed with a general purpose codec. The dataId of the compressed block is the dataId of
+ * the inner block. rex_block_read decompresses the payload and decodes the inner block, so the
+ * returned rex_block has the type, version and size of the inner block.
+ *
+ * | **size [bytes]** | **name**  | **type** | **description**                                  |
+ * |------------------|-----------|----------|--------------------------------------------------|
+ * | 2                | codec     | uint16_t | the codec (see enum rex_codec)                   |
+ * | 2                | type      | uint16_t | data type of the inner block                     |
+ * | 2                | version   | uint16_t | version of the inner block                       |
+ * | 2                | padding   | uint16_t | number of zero bytes after the compressed data   |
+ * | 4                | dictId    | uint32_t | id of the dictionary, 0 if no dictionary is used |
+ * | 4                | size      | uint32_t | size of the uncompressed payload                 |
+ * |                  | data      | bytes    | compressed payload                               |
+ *
+ * The padding aligns the next block (see REX_BLOCK_ALIGNMENT). The codecs need the exact
+ * size of the compressed payload, so the padding is stored instead of being derived from the
+ * block size.
+ *
+ * LZ4 and Zstd are optional dependencies, rex_codec_available tells if a codec has been
+ * compiled in. Small blocks of similar content compress much better with a dictionary,
+ * which can be trained from sample blocks (Zstd only) and has to be registered with
+ * rex_codec_add_dict before blocks are compressed or decompressed. The dictionaries are
+ * shared by all threads and must not be changed while blocks are processed.
+ *
+ * The members of a group block (see rex-group.h) are never compressed.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rex-header.h"
+#include "rex-thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REX_COMPRESSED_HEADER_SIZE 16
+
+/**
+ * The general purpose codecs of the compressed block
+ */
+enum rex_codec
+{
+    REX_CODEC_NONE = 0, //<! no compression, blocks are written as they are
+    REX_CODEC_LZ4  = 1, //<! LZ4 (fast decompression)
+    REX_CODEC_ZSTD = 2  //<! Zstandard (better ratio)
+};
+
+/**
+ * Compression parameters
+ */
+struct rex_codec_params
+{
+    uint16_t codec;   //<! the codec (see enum rex_codec)
+    int level;        //<! the compression level, 0 uses the default of the codec (LZ4 uses LZ4 HC for levels > 0)
+    uint32_t dict_id; //<! the id of a registered dictionary, 0 compresses without dictionary
+};
+
+/**
+ * Sets the parameters to the given codec with default level and without dictionary
+ */
+void rex_codec_params_init (struct rex_codec_params *params, uint16_t codec);
+
+/**
+ * Returns != 0 if the given codec has been compiled in. REX_CODEC_NONE is always available.
+ */
+int rex_codec_available (uint16_t codec);
+
+/**
+ * Looks up a codec by its name ("none", "lz4" or "zstd").
+ *
+ * \return REX_OK on success, REX_NOT_IMPLEMENTED if the codec is unknown or not available
+ */
+int rex_codec_from_name (const char *name, uint16_t *codec);
+
+/**
+ * Registers a dictionary for compression and decompression. The data is copied. An existing
+ * dictionary with the same id is replaced.
+ *
+ * \param dict_id the id of the dictionary which is stored in the compressed blocks, must not be 0
+ * \param dict the dictionary content
+ * \param sz the size of the dictionary
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_codec_add_dict (uint32_t dict_id, const uint8_t *dict, size_t sz);
+
+/**
+ * Releases all registered dictionaries
+ */
+void rex_codec_clear_dicts (void);
+
+/**
+ * Trains a dictionary from sample blocks (e.g. the serialized blocks of a collection of small
+ * files). Requires Zstd, the dictionary can be used with both codecs.
+ *
+ * \param samples the sample buffers
+ * \param sizes the sizes of the sample buffers
+ * \param nr_samples the number of samples
+ * \param dict the buffer which receives the dictionary
+ * \param sz the capacity of dict, returns the size of the dictionary
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_codec_train_dict (const uint8_t *const *samples, const size_t *sizes, uint32_t nr_samples,
+                          uint8_t *dict, size_t *sz);
+
+/**
+ * Compresses a serialized block (as returned by the rex_block_write functions, which must be
+ * called with header NULL). If the compressed block is smaller, *block is replaced by the
+ * compressed block and the original block is released. The final block is added to the header.
+ *
+ * \param header the REX header which gets modified according to the final block, can be NULL
+ * \param block pointer to the serialized block, gets replaced
+ * \param sz the total size of the block, gets updated
+ * \param params the compression parameters, NULL is the same as REX_CODEC_NONE
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_block_compress (struct rex_header *header, uint8_t **block, long *sz, const struct rex_codec_params *params);
+
+/**
+ * Same as rex_block_compress for an array of independent blocks. The blocks are compressed
+ * on the threads of the pool and added to the header in array order.
+ *
+ * \param pool the thread pool, NULL compresses on the calling thread
+ * \param header the REX header which gets modified according to the final blocks, can be NULL
+ * \param blocks the serialized blocks, get replaced
+ * \param sz the total sizes of the blocks, get updated
+ * \param nr_blocks the number of blocks
+ * \param params the compression parameters, NULL is the same as REX_CODEC_NONE
+ * \return REX_OK on success, else the error code of the first failed block (see status.h)
+ */
+int rex_blocks_compress (struct rex_thread_pool *pool, struct rex_header *header, uint8_t **blocks, long *sz,
+                         uint32_t nr_blocks, const struct rex_codec_params *params);
+
+/**
+ * Decompresses the payload of a compressed block into a new buffer which contains the inner
+ * block including its block header. The caller must release the buffer.
+ *
+ * \param ptr pointer to the beginning of the compressed block payload (after the block header)
+ * \param sz the size of the compressed block payload
+ * \param id the dataId of the block
+ * \param inner_sz returns the total size of the inner block
+ * \return the inner block or NULL in case of error
+ */
+uint8_t *rex_block_decompress (uint8_t *ptr, uint32_t sz, uint64_t id, long *inner_sz);
+
+#ifdef __cplusplus
+}
+#endif
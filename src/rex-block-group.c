@@ -0,0 +1,99 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include "global.h"
+#include "rex-block-group.h"
+#include "rex-block.h"
+#include "rex-mem.h"
+#include "status.h"
+#include "util.h"
+
+uint8_t *rex_block_write_group (uint64_t id, struct rex_header *header, struct rex_group *group, long *sz)
+{
+    MEM_CHECK (group)
+    if (group->nr_members)
+        MEM_CHECK (group->members)
+
+    *sz = rex_block_size_group (group);
+    BLOCK_SIZE_CHECK (*sz)
+
+    uint8_t *ptr = rex_mem_alloc (REX_MEM_ENCODE, *sz);
+    if (!ptr)
+        return NULL;
+    memset (ptr, 0, *sz);
+    uint8_t *addr = ptr;
+
+    struct rex_block block = { .type = Group, .version = 1, .sz = *sz - REX_BLOCK_HEADER_SIZE, .id = id };
+    ptr = rex_block_header_write (ptr, &block);
+
+    rexcpyr (&group->nr_members, ptr, sizeof (uint32_t));
+    if (group->nr_members)
+        rexcpyr (group->members, ptr, sizeof (uint64_t) * group->nr_members);
+
+    rex_header_add_block (header, addr, *sz);
+    return addr;
+}
+
+long rex_block_size_group (const struct rex_group *group)
+{
+    if (!group) return 0;
+
+    return REX_BLOCK_HEADER_SIZE
+           + sizeof (uint32_t)  // nr_members
+           + sizeof (uint64_t) * group->nr_members;
+}
+
+uint8_t *rex_block_read_group (uint8_t *ptr, struct rex_group *group)
+{
+    return rex_block_read_group_arena (ptr, group, NULL);
+}
+
+uint8_t *rex_block_read_group_arena (uint8_t *ptr, struct rex_group *group, struct rex_arena *arena)
+{
+    MEM_CHECK (ptr)
+    MEM_CHECK (group)
+
+    rex_group_init (group);
+    rexcpy (&group->nr_members, ptr, sizeof (uint32_t));
+
+    if (group->nr_members)
+    {
+        group->members = rex_arena_alloc (arena, sizeof (uint64_t) * group->nr_members);
+        if (!group->members)
+        {
+            warn ("Cannot allocate memory for the REX group block");
+            rex_group_init (group);
+            return NULL;
+        }
+        rexcpy (group->members, ptr, sizeof (uint64_t) * group->nr_members);
+    }
+    return ptr;
+}
+
+void rex_group_init (struct rex_group *group)
+{
+    if (!group) return;
+
+    group->nr_members = 0;
+    group->members = NULL;
+}
+
+void rex_group_free (struct rex_group *group)
+{
+    if (!group) return;
+
+    FREE (group->members);
+    rex_group_init (group);
+}
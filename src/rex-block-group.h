@@ -0,0 +1,100 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief REX group block which combines several data blocks into one logical object
+ *
+ * Geometry which exceeds the maximum block size of 4 GiB gets split into multiple
+ * spatially coherent blocks of the same type (see rex-group.h). The group block lists the
+ * dataIds of these member blocks, the dataId of the group block itself identifies the
+ * complete object. Readers which do not know the group block see the members as
+ * independent blocks.
+ *
+ * | **size [bytes]** | **name**     | **type** | **description**               |
+ * |------------------|--------------|----------|-------------------------------|
+ * | 4                | nrOfMembers  | uint32_t | number of member blocks       |
+ * | 8                | dataId       | uint64_t | dataId of the first member    |
+ * | 8                | dataId       | uint64_t | dataId of the second member   |
+ * | ...              |              |          |                               |
+ */
+
+#include <stdint.h>
+#include "rex-arena.h"
+#include "rex-header.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Stores the member list of a REX group
+ */
+struct rex_group
+{
+    uint32_t nr_members;    //<! the number of member blocks
+    uint64_t *members;      //<! the dataIds of the member blocks in file order
+};
+
+/**
+ * Sets all properties of the rex_group structure to initial values
+ */
+void rex_group_init (struct rex_group *group);
+
+/**
+ * Frees the member list of the group
+ */
+void rex_group_free (struct rex_group *group);
+
+/**
+ * Reads a group block from the given pointer. This call will allocate memory
+ * for the member list. The caller is responsible to free this memory!
+ *
+ * \param ptr pointer to the block start
+ * \param group the rex_group structure which gets filled
+ * \return the pointer to the memory block after the rex_group block, NULL if no memory
+ *         could be allocated
+ */
+uint8_t *rex_block_read_group (uint8_t *ptr, struct rex_group *group);
+
+/**
+ * Same as rex_block_read_group, but the member list is allocated from the given arena
+ * (see rex-arena.h). If arena is NULL, the installed allocator is used (see rex-alloc.h).
+ */
+uint8_t *rex_block_read_group_arena (uint8_t *ptr, struct rex_group *group, struct rex_arena *arena);
+
+/**
+ * Writes a group block to binary. Memory will be allocated and the caller
+ * must take care of releasing the memory.
+ *
+ * \param id the data block ID
+ * \param header the REX header which gets modified according the the new block, can be NULL
+ * \param group the group which should get serialized
+ * \param sz the total size of the of the data block which is returned
+ * \return a pointer to the data block, NULL if no memory could be allocated
+ */
+uint8_t *rex_block_write_group (uint64_t id, struct rex_header *header, struct rex_group *group, long *sz);
+
+/**
+ * Calculates the total size of the serialized group block including the block header,
+ * which is the same as the sz returned by rex_block_write_group.
+ */
+long rex_block_size_group (const struct rex_group *group);
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,6 +17,8 @@
 #include "global.h"
 #include "rex-block-image.h"
 #include "rex-block.h"
+#include "rex-mem.h"
+#include "status.h"
 #include "util.h"
 
 uint8_t *rex_block_write_image (uint64_t id, struct rex_header *header, struct rex_image *img, long *sz)
@@ -24,9 +26,10 @@ uint8_t *rex_block_write_image (uint64_t id, struct rex_header *header, struct r
     MEM_CHECK (img)
     MEM_CHECK (img->data)
 
-    *sz = REX_BLOCK_HEADER_SIZE + sizeof (uint32_t) + img->sz;
+    *sz = rex_block_size_image (img);
+    BLOCK_SIZE_CHECK (*sz)
 
-    uint8_t *ptr = malloc (*sz);
+    uint8_t *ptr = rex_mem_alloc (REX_MEM_ENCODE, *sz);
     memset (ptr, 0, *sz);
     uint8_t *addr = ptr;
 
@@ -36,22 +39,62 @@ uint8_t *rex_block_write_image (uint64_t id, struct rex_header *header, struct r
     rexcpyr (&img->compression, ptr, sizeof (uint32_t));
     rexcpyr (img->data, ptr, img->sz);
 
-    if (header)
-    {
-        header->nr_datablocks += 1;
-        header->sz_all_datablocks += *sz;
-    }
+    rex_header_add_block (header, addr, *sz);
     return addr;
 }
 
 
+long rex_block_size_image (const struct rex_image *img)
+{
+    if (!img) return 0;
+
+    long sz = REX_BLOCK_HEADER_SIZE + sizeof (uint32_t) + img->sz;
+    return sz + REX_BLOCK_PADDING (sz);
+}
+
+int rex_block_iov_image (uint64_t id, struct rex_header *header, struct rex_image *img, struct rex_block_iov *biov)
+{
+    if (!img || !img->data || !biov)
+        return REX_MISSING_PARAMETER;
+
+    rex_block_iov_init (biov);
+    long sz = rex_block_size_image (img);
+    if ((uint64_t) sz - REX_BLOCK_HEADER_SIZE > REX_BLOCK_MAX_SIZE)
+    {
+        warn ("Block exceeds the maximum block size of 4 GiB");
+        return REX_ERROR_BLOCK_SIZE;
+    }
+
+    uint8_t *ptr = biov->head;
+    struct rex_block block = { .type = Image, .version = 1, .sz = sz - REX_BLOCK_HEADER_SIZE, .id = id };
+    ptr = rex_block_header_write (ptr, &block);
+    rexcpyr (&img->compression, ptr, sizeof (uint32_t));
+
+    int ret = rex_block_iov_add (biov, biov->head, ptr - biov->head);
+    if (ret == REX_OK)
+        ret = rex_block_iov_add (biov, img->data, img->sz);
+    static const uint8_t padding[REX_BLOCK_ALIGNMENT];
+    if (ret == REX_OK)
+        ret = rex_block_iov_add (biov, padding, REX_BLOCK_PADDING (img->sz));
+    if (ret != REX_OK)
+        return ret;
+
+    rex_header_add_block_iov (header, biov);
+    return REX_OK;
+}
+
 uint8_t *rex_block_read_image (uint8_t *ptr, struct rex_image *img)
+{
+    return rex_block_read_image_arena (ptr, img, NULL);
+}
+
+uint8_t *rex_block_read_image_arena (uint8_t *ptr, struct rex_image *img, struct rex_arena *arena)
 {
     MEM_CHECK (ptr)
     MEM_CHECK (img)
 
     rexcpy (&img->compression, ptr, sizeof (uint32_t));
-    img->data = malloc (img->sz);
+    img->data = rex_arena_alloc (arena, img->sz);
 
     rexcpy (img->data, ptr, img->sz);
     return ptr;
@@ -31,7 +31,9 @@
  */
 
 #include <stdint.h>
+#include "rex-arena.h"
 #include "rex-header.h"
+#include "rex-iov.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -69,6 +71,12 @@ struct rex_image
  */
 uint8_t *rex_block_read_image (uint8_t *ptr, struct rex_image *img);
 
+/**
+ * Same as rex_block_read_image, but all arrays are allocated from the given arena
+ * (see rex-arena.h). If arena is NULL, the installed allocator is used (see rex-alloc.h).
+ */
+uint8_t *rex_block_read_image_arena (uint8_t *ptr, struct rex_image *img, struct rex_arena *arena);
+
 /**
  * Writes an image block to a binary stream. Memory will be allocated and the caller
  * must take care of releasing the memory.
@@ -81,6 +89,25 @@ uint8_t *rex_block_read_image (uint8_t *ptr, struct rex_image *img);
  */
 uint8_t *rex_block_write_image (uint64_t id, struct rex_header *header, struct rex_image *img, long *sz);
 
+/**
+ * Calculates the total size of the serialized image block including the block header,
+ * which is the same as the sz returned by rex_block_write_image.
+ */
+long rex_block_size_image (const struct rex_image *img);
+
+/**
+ * Describes the image block as list of memory segments (see rex-iov.h). Only the headers
+ * are serialized, the arrays of img are referenced and must stay valid until the block
+ * is written. The REX header gets updated like in rex_block_write_image.
+ *
+ * \param id the data id of the block
+ * \param header the REX header which gets modified (can be NULL)
+ * \param img the image which should get serialized
+ * \param biov the block which gets filled
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_block_iov_image (uint64_t id, struct rex_header *header, struct rex_image *img, struct rex_block_iov *biov);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,6 +17,8 @@
 #include "global.h"
 #include "rex-block-lineset.h"
 #include "rex-block.h"
+#include "rex-mem.h"
+#include "status.h"
 #include "util.h"
 
 
@@ -25,12 +27,10 @@ uint8_t *rex_block_write_lineset (uint64_t id, struct rex_header *header, struct
     MEM_CHECK (lineset)
     MEM_CHECK (lineset->vertices)
 
-    *sz = REX_BLOCK_HEADER_SIZE
-          + sizeof (uint32_t)  // nr_vertices
-          + sizeof (float) * 4 // RGBA
-          + lineset->nr_vertices * 3 * sizeof (float);
+    *sz = rex_block_size_lineset (lineset);
+    BLOCK_SIZE_CHECK (*sz)
 
-    uint8_t *ptr = malloc (*sz);
+    uint8_t *ptr = rex_mem_alloc (REX_MEM_ENCODE, *sz);
     memset (ptr, 0, *sz);
     uint8_t *addr = ptr;
 
@@ -44,16 +44,59 @@ uint8_t *rex_block_write_lineset (uint64_t id, struct rex_header *header, struct
     rexcpyr (&lineset->nr_vertices, ptr, sizeof (uint32_t));
     rexcpyr (lineset->vertices, ptr, sizeof (float) * lineset->nr_vertices * 3);
 
-    if (header)
-    {
-        header->nr_datablocks += 1;
-        header->sz_all_datablocks += *sz;
-    }
+    rex_header_add_block (header, addr, *sz);
     return addr;
 }
 
 
+long rex_block_size_lineset (const struct rex_lineset *lineset)
+{
+    if (!lineset) return 0;
+
+    return REX_BLOCK_HEADER_SIZE
+           + sizeof (uint32_t)  // nr_vertices
+           + sizeof (float) * 4 // RGBA
+           + sizeof (float) * 3 * lineset->nr_vertices;
+}
+
+int rex_block_iov_lineset (uint64_t id, struct rex_header *header, struct rex_lineset *lineset, struct rex_block_iov *biov)
+{
+    if (!lineset || !lineset->vertices || !biov)
+        return REX_MISSING_PARAMETER;
+
+    rex_block_iov_init (biov);
+    long sz = rex_block_size_lineset (lineset);
+    if ((uint64_t) sz - REX_BLOCK_HEADER_SIZE > REX_BLOCK_MAX_SIZE)
+    {
+        warn ("Block exceeds the maximum block size of 4 GiB");
+        return REX_ERROR_BLOCK_SIZE;
+    }
+
+    uint8_t *ptr = biov->head;
+    struct rex_block block = { .type = LineSet, .version = 1, .sz = sz - REX_BLOCK_HEADER_SIZE, .id = id };
+    ptr = rex_block_header_write (ptr, &block);
+    rexcpyr (&lineset->red, ptr, sizeof (float));
+    rexcpyr (&lineset->green, ptr, sizeof (float));
+    rexcpyr (&lineset->blue, ptr, sizeof (float));
+    rexcpyr (&lineset->alpha, ptr, sizeof (float));
+    rexcpyr (&lineset->nr_vertices, ptr, sizeof (uint32_t));
+
+    int ret = rex_block_iov_add (biov, biov->head, ptr - biov->head);
+    if (ret == REX_OK)
+        ret = rex_block_iov_add (biov, lineset->vertices, sizeof (float) * lineset->nr_vertices * 3);
+    if (ret != REX_OK)
+        return ret;
+
+    rex_header_add_block_iov (header, biov);
+    return REX_OK;
+}
+
 uint8_t *rex_block_read_lineset (uint8_t *ptr, struct rex_lineset *lineset)
+{
+    return rex_block_read_lineset_arena (ptr, lineset, NULL);
+}
+
+uint8_t *rex_block_read_lineset_arena (uint8_t *ptr, struct rex_lineset *lineset, struct rex_arena *arena)
 {
     MEM_CHECK (ptr)
     MEM_CHECK (lineset)
@@ -64,7 +107,7 @@ uint8_t *rex_block_read_lineset (uint8_t *ptr, struct rex_lineset *lineset)
     rexcpy (&lineset->alpha, ptr, sizeof (float));
     rexcpy (&lineset->nr_vertices, ptr, sizeof (uint32_t));
 
-    lineset->vertices = malloc (lineset->nr_vertices * sizeof (float) * 3);
+    lineset->vertices = rex_arena_alloc (arena, lineset->nr_vertices * sizeof (float) * 3);
 
     rexcpy (lineset->vertices, ptr, sizeof (float) * lineset->nr_vertices * 3);
     return ptr;
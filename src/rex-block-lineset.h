@@ -34,7 +34,9 @@
  */
 
 #include <stdint.h>
+#include "rex-arena.h"
 #include "rex-header.h"
+#include "rex-iov.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -63,6 +65,12 @@ struct rex_lineset
  */
 uint8_t *rex_block_read_lineset (uint8_t *ptr, struct rex_lineset *lineset);
 
+/**
+ * Same as rex_block_read_lineset, but all arrays are allocated from the given arena
+ * (see rex-arena.h). If arena is NULL, the installed allocator is used (see rex-alloc.h).
+ */
+uint8_t *rex_block_read_lineset_arena (uint8_t *ptr, struct rex_lineset *lineset, struct rex_arena *arena);
+
 /**
  * Writes a lineset block to binary. Memory will be allocated and the caller
  * must take care of releasing the memory.
@@ -75,6 +83,25 @@ uint8_t *rex_block_read_lineset (uint8_t *ptr, struct rex_lineset *lineset);
  */
 uint8_t *rex_block_write_lineset (uint64_t id, struct rex_header *header, struct rex_lineset *lineset, long *sz);
 
+/**
+ * Calculates the total size of the serialized lineset block including the block header,
+ * which is the same as the sz returned by rex_block_write_lineset.
+ */
+long rex_block_size_lineset (const struct rex_lineset *lineset);
+
+/**
+ * Describes the lineset block as list of memory segments (see rex-iov.h). Only the headers
+ * are serialized, the arrays of lineset are referenced and must stay valid until the block
+ * is written. The REX header gets updated like in rex_block_write_lineset.
+ *
+ * \param id the data id of the block
+ * \param header the REX header which gets modified (can be NULL)
+ * \param lineset the lineset which should get serialized
+ * \param biov the block which gets filled
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_block_iov_lineset (uint64_t id, struct rex_header *header, struct rex_lineset *lineset, struct rex_block_iov *biov);
+
 #ifdef __cplusplus
 }
 #endif
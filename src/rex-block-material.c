@@ -17,6 +17,7 @@
 #include "global.h"
 #include "rex-block-material.h"
 #include "rex-block.h"
+#include "rex-mem.h"
 #include "util.h"
 
 uint8_t *rex_block_write_material (uint64_t id, struct rex_header *header, struct rex_material_standard *mat, long *sz)
@@ -25,7 +26,7 @@ uint8_t *rex_block_write_material (uint64_t id, struct rex_header *header, struc
 
     *sz = REX_BLOCK_HEADER_SIZE + REX_MATERIAL_STANDARD_SIZE;
 
-    uint8_t *ptr = malloc (*sz);
+    uint8_t *ptr = rex_mem_alloc (REX_MEM_ENCODE, *sz);
     memset (ptr, 0, *sz);
     uint8_t *addr = ptr;
 
@@ -47,11 +48,7 @@ uint8_t *rex_block_write_material (uint64_t id, struct rex_header *header, struc
     rexcpyr (&mat->ns, ptr, sizeof (float));
     rexcpyr (&mat->alpha, ptr, sizeof (float));
 
-    if (header)
-    {
-        header->nr_datablocks += 1;
-        header->sz_all_datablocks += *sz;
-    }
+    rex_header_add_block (header, addr, *sz);
     return addr;
 }
 
@@ -0,0 +1,554 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <math.h>
+#include <string.h>
+
+#include "global.h"
+#include "rex-block-mesh-compressed.h"
+#include "rex-block.h"
+#include "rex-bounds.h"
+#include "rex-mem.h"
+#include "status.h"
+#include "util.h"
+
+/**
+ * The quantization header which follows the mesh header
+ */
+struct mesh_quant
+{
+    uint8_t position_bits;
+    uint8_t normal_bits;
+    uint8_t texcoord_bits;
+    uint8_t color_bits;
+    float pos_min[3];
+    float pos_max[3];
+    float tex_min[2];
+    float tex_max[2];
+};
+
+/**
+ * Returns the number of bytes which are used to store a component with the given bits
+ */
+static inline uint32_t quant_bytes (uint32_t bits)
+{
+    return (bits <= 8) ? 1 : (bits <= 16) ? 2 : 4;
+}
+
+static inline uint8_t *quant_put (uint8_t *ptr, uint32_t q, uint32_t bytes)
+{
+    if (bytes == 1)
+    {
+        *ptr = (uint8_t) q;
+    }
+    else if (bytes == 2)
+    {
+        uint16_t v = (uint16_t) q;
+        memcpy (ptr, &v, sizeof (uint16_t));
+    }
+    else
+        memcpy (ptr, &q, sizeof (uint32_t));
+    return ptr + bytes;
+}
+
+static inline uint8_t *varint_put (uint8_t *ptr, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *ptr++ = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    *ptr++ = (uint8_t) v;
+    return ptr;
+}
+
+static inline const uint8_t *varint_get (const uint8_t *ptr, const uint8_t *end, uint32_t *v)
+{
+    uint32_t r = 0;
+    for (uint32_t shift = 0; shift < 35 && ptr < end; shift += 7)
+    {
+        uint8_t b = *ptr++;
+        r |= (uint32_t) (b & 0x7f) << shift;
+        if (!(b & 0x80))
+        {
+            *v = r;
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+static void bbox (const float *data, uint32_t n, uint32_t comps, float *min, float *max)
+{
+    rex_attribute_range (data, n, comps, NULL, min, max);
+
+    // no values, NaN or infinite values only
+    for (uint32_t c = 0; c < comps; c++)
+        if (min[c] > max[c] || !isfinite (min[c]) || !isfinite (max[c]))
+            min[c] = max[c] = 0.0f;
+}
+
+/**
+ * Quantizes the attribute of all vertices in the given order relative to the bounding box
+ */
+static uint8_t *quantize (uint8_t *ptr, const float *data, const uint32_t *order, uint32_t n, uint32_t comps,
+                          const float *min, const float *max, uint32_t bits)
+{
+    uint32_t bytes = quant_bytes (bits);
+    double maxq = (double) ((1u << bits) - 1);
+    double scale[3];
+    for (uint32_t c = 0; c < comps; c++)
+        scale[c] = (max[c] > min[c]) ? maxq / ((double) max[c] - (double) min[c]) : 0.0;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const float *v = &data[(size_t) order[i] * comps];
+        for (uint32_t c = 0; c < comps; c++)
+        {
+            double t = ((double) v[c] - min[c]) * scale[c];
+            if (!(t > 0.0)) t = 0.0; // also catches NaN
+            if (t > maxq) t = maxq;
+            ptr = quant_put (ptr, (uint32_t) lrint (t), bytes);
+        }
+    }
+    return ptr;
+}
+
+static uint8_t *quantize_normals (uint8_t *ptr, const float *normals, const uint32_t *order, uint32_t n, uint32_t bits)
+{
+    uint32_t bytes = quant_bytes (bits);
+    float maxq = (float) ((1u << (bits - 1)) - 1);
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const float *v = &normals[(size_t) order[i] * 3];
+        float l1 = fabsf (v[0]) + fabsf (v[1]) + fabsf (v[2]);
+        float x = 0.0f;
+        float y = 0.0f;
+        if (l1 > 0.0f && isfinite (l1))
+        {
+            x = v[0] / l1;
+            y = v[1] / l1;
+            // fold the lower hemisphere
+            if (v[2] < 0.0f)
+            {
+                float ox = (1.0f - fabsf (y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+                y = (1.0f - fabsf (x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+                x = ox;
+            }
+        }
+        ptr = quant_put (ptr, (uint32_t) (int32_t) lrintf (x * maxq), bytes);
+        ptr = quant_put (ptr, (uint32_t) (int32_t) lrintf (y * maxq), bytes);
+    }
+    return ptr;
+}
+
+static uint8_t *quantize_colors (uint8_t *ptr, const float *colors, const uint32_t *order, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const float *v = &colors[(size_t) order[i] * 3];
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            float t = v[c];
+            if (!(t > 0.0f)) t = 0.0f;
+            if (t > 1.0f) t = 1.0f;
+            *ptr++ = (uint8_t) lrintf (t * 255.0f);
+        }
+    }
+    return ptr;
+}
+
+void rex_mesh_compression_init (struct rex_mesh_compression *params)
+{
+    if (!params) return;
+
+    params->position_bits = 16;
+    params->normal_bits = 8;
+    params->texcoord_bits = 12;
+}
+
+uint8_t *rex_block_write_mesh_compressed (uint64_t id, struct rex_header *header, struct rex_mesh *mesh,
+                                          const struct rex_mesh_compression *params, long *sz)
+{
+    MEM_CHECK (mesh)
+    MEM_CHECK (sz)
+
+    struct rex_mesh_compression defaults;
+    rex_mesh_compression_init (&defaults);
+    if (!params)
+        params = &defaults;
+
+    if (params->position_bits < 1 || params->position_bits > 24
+            || params->normal_bits < 2 || params->normal_bits > 16
+            || params->texcoord_bits < 1 || params->texcoord_bits > 16)
+    {
+        warn ("Invalid mesh quantization parameters");
+        return NULL;
+    }
+    if (mesh->nr_vertices && !mesh->positions)
+    {
+        warn ("Mesh without positions");
+        return NULL;
+    }
+    if (mesh->nr_triangles && !mesh->triangles)
+    {
+        warn ("Mesh without triangles");
+        return NULL;
+    }
+
+    uint32_t nv = mesh->nr_vertices;
+    size_t nr_indices = (size_t) mesh->nr_triangles * 3;
+    struct rex_mesh_layout layout = { .nr_normals = mesh->normals ? nv : 0,
+                                      .nr_texcoords = mesh->tex_coords ? nv : 0,
+                                      .nr_colors = mesh->colors ? nv : 0 };
+
+    // order vertices by first use, remap[old] = new, order[new] = old
+    uint32_t *remap = rex_malloc ((size_t) nv * sizeof (uint32_t) + 1);
+    uint32_t *order = rex_malloc ((size_t) nv * sizeof (uint32_t) + 1);
+    if (!remap || !order)
+    {
+        FREE (remap);
+        FREE (order);
+        return NULL;
+    }
+    memset (remap, 0xff, (size_t) nv * sizeof (uint32_t));
+
+    uint32_t next = 0;
+    for (size_t i = 0; i < nr_indices; i++)
+    {
+        uint32_t v = mesh->triangles[i];
+        if (v >= nv)
+        {
+            warn ("Triangle index %u exceeds the number of vertices", v);
+            FREE (remap);
+            FREE (order);
+            return NULL;
+        }
+        if (remap[v] == UINT32_MAX)
+        {
+            remap[v] = next;
+            order[next++] = v;
+        }
+    }
+    for (uint32_t v = 0; v < nv; v++)
+        if (remap[v] == UINT32_MAX)
+        {
+            remap[v] = next;
+            order[next++] = v;
+        }
+
+    struct mesh_quant q = { .position_bits = params->position_bits, .normal_bits = params->normal_bits,
+                            .texcoord_bits = params->texcoord_bits, .color_bits = 8 };
+    bbox (mesh->positions, nv, 3, q.pos_min, q.pos_max);
+    bbox (mesh->tex_coords, layout.nr_texcoords, 2, q.tex_min, q.tex_max);
+
+    // worst case, every index takes 5 bytes
+    size_t max_sz = REX_BLOCK_HEADER_SIZE + REX_MESH_HEADER_SIZE + REX_MESH_QUANT_HEADER_SIZE
+                    + (size_t) nv * 3 * quant_bytes (q.position_bits)
+                    + (size_t) layout.nr_normals * 2 * quant_bytes (q.normal_bits)
+                    + (size_t) layout.nr_texcoords * 2 * quant_bytes (q.texcoord_bits)
+                    + (size_t) layout.nr_colors * 3
+                    + nr_indices * 5
+                    + REX_BLOCK_ALIGNMENT;
+
+    uint8_t *addr = rex_mem_alloc (REX_MEM_ENCODE, max_sz);
+    if (!addr)
+    {
+        FREE (remap);
+        FREE (order);
+        return NULL;
+    }
+    memset (addr, 0, REX_BLOCK_HEADER_SIZE + REX_MESH_HEADER_SIZE + REX_MESH_QUANT_HEADER_SIZE);
+
+    // offsets are relative to the beginning of the block (without the block header)
+    uint8_t *base = addr + REX_BLOCK_HEADER_SIZE;
+    uint8_t *ptr = base + REX_MESH_HEADER_SIZE + REX_MESH_QUANT_HEADER_SIZE;
+
+    layout.start[REX_MESH_SECTION_POSITIONS] = (uint32_t) (ptr - base);
+    ptr = quantize (ptr, mesh->positions, order, nv, 3, q.pos_min, q.pos_max, q.position_bits);
+    layout.start[REX_MESH_SECTION_NORMALS] = (uint32_t) (ptr - base);
+    if (layout.nr_normals)
+        ptr = quantize_normals (ptr, mesh->normals, order, nv, q.normal_bits);
+    layout.start[REX_MESH_SECTION_TEX_COORDS] = (uint32_t) (ptr - base);
+    if (layout.nr_texcoords)
+        ptr = quantize (ptr, mesh->tex_coords, order, nv, 2, q.tex_min, q.tex_max, q.texcoord_bits);
+    layout.start[REX_MESH_SECTION_COLORS] = (uint32_t) (ptr - base);
+    if (layout.nr_colors)
+        ptr = quantize_colors (ptr, mesh->colors, order, nv);
+    layout.start[REX_MESH_SECTION_TRIANGLES] = (uint32_t) (ptr - base);
+
+    next = 0;
+    for (size_t i = 0; i < nr_indices; i++)
+    {
+        uint32_t v = remap[mesh->triangles[i]];
+        ptr = varint_put (ptr, next - v);
+        if (v == next)
+            next++;
+    }
+
+    FREE (remap);
+    FREE (order);
+
+    size_t padding = REX_BLOCK_PADDING ((size_t) (ptr - addr));
+    memset (ptr, 0, padding);
+    *sz = ptr + padding - addr;
+    if ((uint64_t) *sz - REX_BLOCK_HEADER_SIZE > REX_BLOCK_MAX_SIZE)
+    {
+        warn ("Block exceeds the maximum block size of 4 GiB");
+        FREE (addr);
+        return NULL;
+    }
+
+    // release the unused worst case reserve
+    uint8_t *shrunk = rex_realloc (addr, *sz);
+    if (shrunk)
+        addr = shrunk;
+
+    struct rex_block block = { .type = Mesh, .version = REX_MESH_VERSION_COMPRESSED,
+                               .sz = *sz - REX_BLOCK_HEADER_SIZE, .id = id };
+    ptr = rex_block_header_write (addr, &block);
+    ptr = rex_mesh_header_write (ptr, mesh, &layout);
+
+    rexcpyr (&q.position_bits, ptr, sizeof (uint8_t));
+    rexcpyr (&q.normal_bits, ptr, sizeof (uint8_t));
+    rexcpyr (&q.texcoord_bits, ptr, sizeof (uint8_t));
+    rexcpyr (&q.color_bits, ptr, sizeof (uint8_t));
+    rexcpyr (q.pos_min, ptr, sizeof (q.pos_min));
+    rexcpyr (q.pos_max, ptr, sizeof (q.pos_max));
+    rexcpyr (q.tex_min, ptr, sizeof (q.tex_min));
+    rexcpyr (q.tex_max, ptr, sizeof (q.tex_max));
+
+    rex_header_add_block (header, addr, *sz);
+    return addr;
+}
+
+/**
+ * Restores the attribute from the bounding box quantization
+ */
+static void dequantize (const uint8_t *ptr, uint32_t n, uint32_t comps, const float *min, const float *max,
+                        uint32_t bits, float *data)
+{
+    uint32_t bytes = quant_bytes (bits);
+    double maxq = (double) ((1u << bits) - 1);
+    float scale[3];
+    for (uint32_t c = 0; c < comps; c++)
+        scale[c] = (float) (((double) max[c] - (double) min[c]) / maxq);
+
+    // one loop per storage size, the inner loop has a constant trip count after inlining
+    size_t k = 0;
+    if (bytes == 1)
+    {
+        for (uint32_t i = 0; i < n; i++)
+            for (uint32_t c = 0; c < comps; c++, k++)
+                data[k] = min[c] + (float) ptr[k] * scale[c];
+    }
+    else if (bytes == 2)
+    {
+        for (uint32_t i = 0; i < n; i++)
+            for (uint32_t c = 0; c < comps; c++, k++)
+            {
+                uint16_t v;
+                memcpy (&v, ptr + k * 2, sizeof (uint16_t));
+                data[k] = min[c] + (float) v * scale[c];
+            }
+    }
+    else
+    {
+        for (uint32_t i = 0; i < n; i++)
+            for (uint32_t c = 0; c < comps; c++, k++)
+            {
+                uint32_t v;
+                memcpy (&v, ptr + k * 4, sizeof (uint32_t));
+                data[k] = min[c] + (float) v * scale[c];
+            }
+    }
+}
+
+static void dequantize_normals (const uint8_t *ptr, uint32_t n, uint32_t bits, float *normals)
+{
+    uint32_t bytes = quant_bytes (bits);
+    float inv = 1.0f / (float) ((1u << (bits - 1)) - 1);
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        float x, y;
+        if (bytes == 1)
+        {
+            x = (float) (int8_t) ptr[i * 2] * inv;
+            y = (float) (int8_t) ptr[i * 2 + 1] * inv;
+        }
+        else
+        {
+            int16_t v[2];
+            memcpy (v, ptr + i * 4, sizeof (v));
+            x = (float) v[0] * inv;
+            y = (float) v[1] * inv;
+        }
+
+        // unfold the lower hemisphere
+        float z = 1.0f - fabsf (x) - fabsf (y);
+        float t = (z < 0.0f) ? -z : 0.0f;
+        x += (x >= 0.0f) ? -t : t;
+        y += (y >= 0.0f) ? -t : t;
+
+        float len = sqrtf (x * x + y * y + z * z);
+        float s = (len > 0.0f) ? 1.0f / len : 0.0f;
+        normals[i * 3] = x * s;
+        normals[i * 3 + 1] = y * s;
+        normals[i * 3 + 2] = z * s;
+    }
+}
+
+static void dequantize_colors (const uint8_t *ptr, uint32_t n, float *colors)
+{
+    for (size_t i = 0; i < (size_t) n * 3; i++)
+        colors[i] = (float) ptr[i] * (1.0f / 255.0f);
+}
+
+/**
+ * Decodes the triangle section, returns REX_OK if all indices are valid
+ */
+static int decode_triangles (const uint8_t *ptr, const uint8_t *end, uint32_t nr_vertices,
+                             size_t nr_indices, uint32_t *triangles)
+{
+    uint32_t next = 0;
+    for (size_t i = 0; i < nr_indices; i++)
+    {
+        uint32_t v;
+        if (ptr < end && *ptr < 0x80)
+            v = *ptr++;
+        else if ((ptr = varint_get (ptr, end, &v)) == NULL)
+            return REX_ERROR_FILE_READ;
+
+        if (v == 0)
+        {
+            if (next == nr_vertices)
+                return REX_ERROR_FILE_READ;
+            triangles[i] = next++;
+        }
+        else
+        {
+            if (v > next)
+                return REX_ERROR_FILE_READ;
+            triangles[i] = next - v;
+        }
+    }
+    return REX_OK;
+}
+
+static uint8_t *mesh_compressed_fail (struct rex_mesh *mesh, struct rex_arena *arena)
+{
+    warn ("Invalid compressed mesh block");
+    if (!arena)
+        rex_mesh_free (mesh);
+    rex_mesh_init (mesh);
+    return NULL;
+}
+
+uint8_t *rex_block_read_mesh_compressed (uint8_t *ptr, uint32_t sz, struct rex_mesh *mesh)
+{
+    return rex_block_read_mesh_compressed_arena (ptr, sz, mesh, NULL);
+}
+
+uint8_t *rex_block_read_mesh_compressed_arena (uint8_t *ptr, uint32_t sz, struct rex_mesh *mesh,
+                                               struct rex_arena *arena)
+{
+    MEM_CHECK (ptr)
+    MEM_CHECK (mesh)
+
+    rex_mesh_init (mesh);
+    if (sz < REX_MESH_HEADER_SIZE + REX_MESH_QUANT_HEADER_SIZE)
+        return mesh_compressed_fail (mesh, arena);
+
+    uint8_t *base = ptr;
+    struct rex_mesh_layout layout;
+    ptr = rex_mesh_header_read (ptr, mesh, &layout);
+
+    struct mesh_quant q;
+    rexcpy (&q.position_bits, ptr, sizeof (uint8_t));
+    rexcpy (&q.normal_bits, ptr, sizeof (uint8_t));
+    rexcpy (&q.texcoord_bits, ptr, sizeof (uint8_t));
+    rexcpy (&q.color_bits, ptr, sizeof (uint8_t));
+    rexcpy (q.pos_min, ptr, sizeof (q.pos_min));
+    rexcpy (q.pos_max, ptr, sizeof (q.pos_max));
+    rexcpy (q.tex_min, ptr, sizeof (q.tex_min));
+    rexcpy (q.tex_max, ptr, sizeof (q.tex_max));
+
+    uint32_t nv = mesh->nr_vertices;
+    uint64_t sec_sz[4] = { (uint64_t) nv * 3 * quant_bytes (q.position_bits),
+                           (uint64_t) layout.nr_normals * 2 * quant_bytes (q.normal_bits),
+                           (uint64_t) layout.nr_texcoords * 2 * quant_bytes (q.texcoord_bits),
+                           (uint64_t) layout.nr_colors * 3 };
+
+    if (q.position_bits < 1 || q.position_bits > 24
+            || q.normal_bits < 2 || q.normal_bits > 16
+            || q.texcoord_bits < 1 || q.texcoord_bits > 16
+            || q.color_bits != 8
+            || (layout.nr_normals && layout.nr_normals != nv)
+            || (layout.nr_texcoords && layout.nr_texcoords != nv)
+            || (layout.nr_colors && layout.nr_colors != nv)
+            || layout.start[REX_MESH_SECTION_TRIANGLES] > sz)
+        return mesh_compressed_fail (mesh, arena);
+    for (int s = REX_MESH_SECTION_POSITIONS; s < REX_MESH_SECTION_TRIANGLES; s++)
+        if ((uint64_t) layout.start[s] + sec_sz[s] > sz)
+            return mesh_compressed_fail (mesh, arena);
+
+    // every index takes at least one byte
+    uint64_t nr_indices = (uint64_t) mesh->nr_triangles * 3;
+    if (nr_indices > sz - layout.start[REX_MESH_SECTION_TRIANGLES])
+        return mesh_compressed_fail (mesh, arena);
+
+    if (nv)
+    {
+        mesh->positions = rex_arena_alloc (arena, (size_t) nv * 12);
+        if (!mesh->positions)
+            return mesh_compressed_fail (mesh, arena);
+        dequantize (base + layout.start[REX_MESH_SECTION_POSITIONS], nv, 3, q.pos_min, q.pos_max,
+                    q.position_bits, mesh->positions);
+    }
+    if (layout.nr_normals)
+    {
+        mesh->normals = rex_arena_alloc (arena, (size_t) nv * 12);
+        if (!mesh->normals)
+            return mesh_compressed_fail (mesh, arena);
+        dequantize_normals (base + layout.start[REX_MESH_SECTION_NORMALS], nv, q.normal_bits, mesh->normals);
+    }
+    if (layout.nr_texcoords)
+    {
+        mesh->tex_coords = rex_arena_alloc (arena, (size_t) nv * 8);
+        if (!mesh->tex_coords)
+            return mesh_compressed_fail (mesh, arena);
+        dequantize (base + layout.start[REX_MESH_SECTION_TEX_COORDS], nv, 2, q.tex_min, q.tex_max,
+                    q.texcoord_bits, mesh->tex_coords);
+    }
+    if (layout.nr_colors)
+    {
+        mesh->colors = rex_arena_alloc (arena, (size_t) nv * 12);
+        if (!mesh->colors)
+            return mesh_compressed_fail (mesh, arena);
+        dequantize_colors (base + layout.start[REX_MESH_SECTION_COLORS], nv, mesh->colors);
+    }
+    if (nr_indices)
+    {
+        mesh->triangles = rex_arena_alloc (arena, nr_indices * sizeof (uint32_t));
+        if (!mesh->triangles
+                || decode_triangles (base + layout.start[REX_MESH_SECTION_TRIANGLES], base + sz, nv,
+                                     nr_indices, mesh->triangles) != REX_OK)
+            return mesh_compressed_fail (mesh, arena);
+    }
+
+    return base + sz;
+}
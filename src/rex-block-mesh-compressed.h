@@ -0,0 +1,118 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief REX mesh block version 2 with quantized attributes and compressed triangles
+ *
+ * Version 2 of the mesh block is meant for the transfer to mobile clients. It uses the same
+ * 128 byte mesh header as version 1 (see rex-block-mesh.h), but the start offsets point to
+ * the encoded sections. The mesh header is followed by the quantization header:
+ *
+ * | **size [bytes]** | **name** | **type** | **description**                                     |
+ * |------------------|----------|----------|-----------------------------------------------------|
+ * | 1                | posBits  | uint8_t  | bits per position component (1-24)                  |
+ * | 1                | norBits  | uint8_t  | bits per octahedral normal component (2-16)         |
+ * | 1                | texBits  | uint8_t  | bits per texture coordinate component (1-16)        |
+ * | 1                | colBits  | uint8_t  | bits per color component (always 8)                 |
+ * | 12               | posMin   | float[3] | minimum of the position bounding box                |
+ * | 12               | posMax   | float[3] | maximum of the position bounding box                |
+ * | 8                | texMin   | float[2] | minimum of the texture coordinates                  |
+ * | 8                | texMax   | float[2] | maximum of the texture coordinates                  |
+ * | 4                | reserved | uint32_t | reserved (0)                                        |
+ *
+ * Every quantized component is stored as integer of 1, 2 or 4 bytes, depending on the
+ * number of bits (up to 8, up to 16, more than 16).
+ *
+ * - Positions: q = round ((p - posMin) / (posMax - posMin) * (2^posBits - 1))
+ * - Normals: octahedral projection onto the plane |x| + |y| = 1, two signed components
+ *   per normal, q = round (x * (2^(norBits-1) - 1))
+ * - Texture coordinates: same as positions with the texture coordinate bounding box
+ * - Colors: one byte per component, q = round (clamp (c, 0, 1) * 255)
+ *
+ * The vertices are reordered by their first use in the triangle list (unreferenced
+ * vertices are appended), the triangle order is kept. Every index is stored as LEB128
+ * varint of next - index, where next is the number of distinct vertices which have been
+ * referenced before. A 0 introduces the next new vertex. In a mesh which is optimized for
+ * the vertex cache most indices refer to new or recently introduced vertices and take a
+ * single byte. The triangle section extends to the end of the block.
+ */
+
+#include <stdint.h>
+
+#include "rex-arena.h"
+#include "rex-block-mesh.h"
+#include "rex-header.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REX_MESH_VERSION_COMPRESSED 2
+
+/**
+ * The quantization parameters of a compressed mesh block
+ */
+struct rex_mesh_compression
+{
+    uint8_t position_bits;  //<! bits per position component (1-24, default 16)
+    uint8_t normal_bits;    //<! bits per octahedral normal component (2-16, default 8)
+    uint8_t texcoord_bits;  //<! bits per texture coordinate component (1-16, default 12)
+};
+
+/**
+ * Sets the default quantization parameters
+ */
+void rex_mesh_compression_init (struct rex_mesh_compression *params);
+
+/**
+ * Writes the mesh as compressed mesh block (version 2). The buffer will be allocated, so the
+ * caller must take care of releasing the memory. The mesh is not modified, the vertex order
+ * of the block differs from the mesh (see above).
+ *
+ * \param id the data block ID
+ * \param header the REX header which gets modified according the the new block, can be NULL
+ * \param mesh the mesh which should get serialized
+ * \param params the quantization parameters or NULL for the defaults
+ * \param sz the total size of the of the data block which is returned
+ * \return a pointer to the data block or NULL in case of invalid parameters
+ */
+uint8_t *rex_block_write_mesh_compressed (uint64_t id, struct rex_header *header, struct rex_mesh *mesh,
+                                          const struct rex_mesh_compression *params, long *sz);
+
+/**
+ * Reads a compressed mesh block (version 2). The ptr must point to the beginning of the block
+ * (after the block header). The decoded mesh has float attributes and uint32_t indices like
+ * a mesh of version 1. Memory will be allocated for the mesh data.
+ *
+ * \param ptr pointer to the block start
+ * \param sz the size of the block (without block header)
+ * \param mesh the rex_mesh structure which gets filled
+ * \return the pointer to the memory block after the block or NULL if the block is invalid
+ */
+uint8_t *rex_block_read_mesh_compressed (uint8_t *ptr, uint32_t sz, struct rex_mesh *mesh);
+
+/**
+ * Same as rex_block_read_mesh_compressed, but all arrays are allocated from the given arena
+ * (see rex-arena.h). If arena is NULL, the installed allocator is used (see rex-alloc.h).
+ */
+uint8_t *rex_block_read_mesh_compressed_arena (uint8_t *ptr, uint32_t sz, struct rex_mesh *mesh,
+                                               struct rex_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,13 +15,81 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "global.h"
 #include "rex-block-mesh.h"
 #include "rex-block.h"
+#include "rex-crc.h"
+#include "rex-mem.h"
+#include "rex-stats.h"
 #include "status.h"
 #include "util.h"
 
+uint8_t *rex_mesh_header_write (uint8_t *ptr, const struct rex_mesh *mesh, const struct rex_mesh_layout *layout)
+{
+    rexcpyr (&mesh->lod, ptr, sizeof (uint16_t));
+    rexcpyr (&mesh->max_lod, ptr, sizeof (uint16_t));
+    rexcpyr (&mesh->nr_vertices, ptr, sizeof (uint32_t));
+
+    rexcpyr (&layout->nr_normals, ptr, sizeof (uint32_t));
+    rexcpyr (&layout->nr_texcoords, ptr, sizeof (uint32_t));
+    rexcpyr (&layout->nr_colors, ptr, sizeof (uint32_t));
+
+    rexcpyr (&mesh->nr_triangles, ptr, sizeof (uint32_t));
+
+    rexcpyr (layout->start, ptr, sizeof (layout->start));
+
+    rexcpyr (&mesh->material_id, ptr, sizeof (uint64_t));
+
+    uint16_t name_sz = (uint16_t) strnlen (mesh->name, REX_MESH_NAME_MAX_SIZE);
+    rexcpyr (&name_sz, ptr, sizeof (uint16_t));
+    rexcpyr (mesh->name, ptr, REX_MESH_NAME_MAX_SIZE);
+    return ptr;
+}
+
+uint8_t *rex_mesh_header_read (uint8_t *ptr, struct rex_mesh *mesh, struct rex_mesh_layout *layout)
+{
+    rex_mesh_init (mesh);
+
+    rexcpy (&mesh->lod, ptr, sizeof (uint16_t));
+    rexcpy (&mesh->max_lod, ptr, sizeof (uint16_t));
+    rexcpy (&mesh->nr_vertices, ptr, sizeof (uint32_t));
+
+    rexcpy (&layout->nr_normals, ptr, sizeof (uint32_t));
+    rexcpy (&layout->nr_texcoords, ptr, sizeof (uint32_t));
+    rexcpy (&layout->nr_colors, ptr, sizeof (uint32_t));
+
+    rexcpy (&mesh->nr_triangles, ptr, sizeof (uint32_t));
+
+    rexcpy (layout->start, ptr, sizeof (layout->start));
+
+    rexcpy (&mesh->material_id, ptr, sizeof (uint64_t));
+
+    uint16_t sz; // not used anymore since string is fixed size
+    rexcpy (&sz, ptr, sizeof (uint16_t));
+    rexcpy (mesh->name, ptr, REX_MESH_NAME_MAX_SIZE);
+    return ptr;
+}
+
+/**
+ * Writes the mesh header of a version 1 block. The attribute arrays are expected to follow
+ * in the order positions, normals, texture coordinates, colors and triangles.
+ */
+static uint8_t *mesh_header_write (uint8_t *ptr, struct rex_mesh *mesh, uint32_t nr_normals,
+                                   uint32_t nr_texcoords, uint32_t nr_colors)
+{
+    struct rex_mesh_layout layout = { .nr_normals = nr_normals, .nr_texcoords = nr_texcoords, .nr_colors = nr_colors };
+
+    // offset is relative from the beginning of the block (without the block header)
+    layout.start[REX_MESH_SECTION_POSITIONS] = REX_MESH_HEADER_SIZE;
+    layout.start[REX_MESH_SECTION_NORMALS] = REX_MESH_HEADER_SIZE + mesh->nr_vertices * 12;
+    layout.start[REX_MESH_SECTION_TEX_COORDS] = layout.start[REX_MESH_SECTION_NORMALS] + nr_normals * 12;
+    layout.start[REX_MESH_SECTION_COLORS] = layout.start[REX_MESH_SECTION_TEX_COORDS] + nr_texcoords * 8;
+    layout.start[REX_MESH_SECTION_TRIANGLES] = layout.start[REX_MESH_SECTION_COLORS] + nr_colors * 12;
+    return rex_mesh_header_write (ptr, mesh, &layout);
+}
+
 uint8_t *rex_block_write_mesh (uint64_t id, struct rex_header *header, struct rex_mesh *mesh, long *sz)
 {
     MEM_CHECK (mesh)
@@ -31,15 +99,10 @@ uint8_t *rex_block_write_mesh (uint64_t id, struct rex_header *header, struct re
     uint32_t nr_colors = (mesh->colors == NULL) ? 0 : mesh->nr_vertices;
 
     // calculate total memory requirement
-    *sz = REX_BLOCK_HEADER_SIZE
-          + REX_MESH_HEADER_SIZE
-          + mesh->nr_vertices * 12
-          + nr_normals * 12
-          + nr_texcoords * 8
-          + nr_colors * 12
-          + mesh->nr_triangles * 12;
-
-    uint8_t *ptr = malloc (*sz);
+    *sz = rex_block_size_mesh (mesh);
+    BLOCK_SIZE_CHECK (*sz)
+
+    uint8_t *ptr = rex_mem_alloc (REX_MEM_ENCODE, *sz);
     memset (ptr, 0, *sz);
     uint8_t *addr = ptr;
 
@@ -47,128 +110,276 @@ uint8_t *rex_block_write_mesh (uint64_t id, struct rex_header *header, struct re
     ptr = rex_block_header_write (ptr, &block);
 
     // block data
-    rexcpyr (&mesh->lod, ptr, sizeof (uint16_t));
-    rexcpyr (&mesh->max_lod, ptr, sizeof (uint16_t));
-    rexcpyr (&mesh->nr_vertices, ptr, sizeof (uint32_t));
-
-    rexcpyr (&nr_normals, ptr, sizeof (uint32_t));
-    rexcpyr (&nr_texcoords, ptr, sizeof (uint32_t));
-    rexcpyr (&nr_colors, ptr, sizeof (uint32_t));
-
-    rexcpyr (&mesh->nr_triangles, ptr, sizeof (uint32_t));
-
-    // offset is relative from the beginning of the block (without the block header)
-    uint32_t start_coords = REX_MESH_HEADER_SIZE;
-    uint32_t start_normals = REX_MESH_HEADER_SIZE + mesh->nr_vertices * 12;
-    uint32_t start_texcoords = start_normals + nr_normals * 12;
-    uint32_t start_colors = start_texcoords + nr_texcoords * 8;
-    uint32_t start_triangles = start_colors + nr_colors * 12;
-
-    rexcpyr (&start_coords, ptr, sizeof (uint32_t));
-    rexcpyr (&start_normals, ptr, sizeof (uint32_t));
-    rexcpyr (&start_texcoords, ptr, sizeof (uint32_t));
-    rexcpyr (&start_colors, ptr, sizeof (uint32_t));
-    rexcpyr (&start_triangles, ptr, sizeof (uint32_t));
-
-    rexcpyr (&mesh->material_id, ptr, sizeof (uint64_t));
-
-    uint16_t name_sz = (uint16_t) strlen (mesh->name);
-    rexcpyr (&name_sz, ptr, sizeof (uint16_t));
-    rexcpyr (mesh->name, ptr, 74);
+    ptr = mesh_header_write (ptr, mesh, nr_normals, nr_texcoords, nr_colors);
 
     if (mesh->nr_vertices)
-        rexcpyr (mesh->positions, ptr, mesh->nr_vertices * 12);
+        rexcpyr (mesh->positions, ptr, (size_t) mesh->nr_vertices * 12);
     if (nr_normals)
-        rexcpyr (mesh->normals, ptr, nr_normals * 12);
+        rexcpyr (mesh->normals, ptr, (size_t) nr_normals * 12);
     if (nr_texcoords)
-        rexcpyr (mesh->tex_coords, ptr, nr_texcoords * 8);
+        rexcpyr (mesh->tex_coords, ptr, (size_t) nr_texcoords * 8);
     if (nr_colors)
-        rexcpyr (mesh->colors, ptr, nr_colors * 12);
+        rexcpyr (mesh->colors, ptr, (size_t) nr_colors * 12);
     if (mesh->nr_triangles)
-        rexcpyr (mesh->triangles, ptr, mesh->nr_triangles * 12);
+        rexcpyr (mesh->triangles, ptr, (size_t) mesh->nr_triangles * 12);
 
-    if (header)
+    rex_header_add_block (header, addr, *sz);
+
+    return addr;
+}
+
+long rex_block_size_mesh (const struct rex_mesh *mesh)
+{
+    if (!mesh) return 0;
+
+    uint32_t nr_normals = (mesh->normals == NULL) ? 0 : mesh->nr_vertices;
+    uint32_t nr_texcoords = (mesh->tex_coords == NULL) ? 0 : mesh->nr_vertices;
+    uint32_t nr_colors = (mesh->colors == NULL) ? 0 : mesh->nr_vertices;
+
+    return REX_BLOCK_HEADER_SIZE
+           + REX_MESH_HEADER_SIZE
+           + (size_t) mesh->nr_vertices * 12
+           + (size_t) nr_normals * 12
+           + (size_t) nr_texcoords * 8
+           + (size_t) nr_colors * 12
+           + (size_t) mesh->nr_triangles * 12;
+}
+
+int rex_block_iov_mesh (uint64_t id, struct rex_header *header, struct rex_mesh *mesh, struct rex_block_iov *biov)
+{
+    if (!mesh || !biov)
+        return REX_MISSING_PARAMETER;
+
+    uint32_t nr_normals = (mesh->normals == NULL) ? 0 : mesh->nr_vertices;
+    uint32_t nr_texcoords = (mesh->tex_coords == NULL) ? 0 : mesh->nr_vertices;
+    uint32_t nr_colors = (mesh->colors == NULL) ? 0 : mesh->nr_vertices;
+
+    rex_block_iov_init (biov);
+    long sz = rex_block_size_mesh (mesh);
+    if ((uint64_t) sz - REX_BLOCK_HEADER_SIZE > REX_BLOCK_MAX_SIZE)
     {
-        header->nr_datablocks += 1;
-        header->sz_all_datablocks += *sz;
+        warn ("Block exceeds the maximum block size of 4 GiB");
+        return REX_ERROR_BLOCK_SIZE;
     }
 
-    return addr;
+    uint8_t *ptr = biov->head;
+    struct rex_block block = { .type = Mesh, .version = 1, .sz = sz - REX_BLOCK_HEADER_SIZE, .id = id };
+    ptr = rex_block_header_write (ptr, &block);
+    ptr = mesh_header_write (ptr, mesh, nr_normals, nr_texcoords, nr_colors);
+
+    int ret = rex_block_iov_add (biov, biov->head, ptr - biov->head);
+    if (ret == REX_OK)
+        ret = rex_block_iov_add (biov, mesh->positions, (size_t) mesh->nr_vertices * 12);
+    if (ret == REX_OK)
+        ret = rex_block_iov_add (biov, mesh->normals, (size_t) nr_normals * 12);
+    if (ret == REX_OK)
+        ret = rex_block_iov_add (biov, mesh->tex_coords, (size_t) nr_texcoords * 8);
+    if (ret == REX_OK)
+        ret = rex_block_iov_add (biov, mesh->colors, (size_t) nr_colors * 12);
+    if (ret == REX_OK)
+        ret = rex_block_iov_add (biov, mesh->triangles, (size_t) mesh->nr_triangles * 12);
+    if (ret != REX_OK)
+        return ret;
+
+    rex_header_add_block_iov (header, biov);
+    return REX_OK;
 }
 
+/**
+ * Appends a chunk of the given section. Sections can only be appended in increasing order.
+ */
+static int mesh_writer_append (struct rex_mesh_writer *w, enum rex_mesh_section section,
+                               const void *data, uint32_t nr, uint32_t elem_sz, uint32_t *count)
+{
+    if (!w || !w->fp)
+        return REX_MISSING_PARAMETER;
+    if (w->status != REX_OK)
+        return w->status;
 
-uint8_t *rex_block_read_mesh (uint8_t *ptr, struct rex_mesh *mesh)
+    if (section < w->section)
+    {
+        warn ("Mesh sections must be appended in the order positions, normals, texture coordinates, colors, triangles");
+        return w->status = REX_ERROR_WRONG_ORDER;
+    }
+    w->section = section;
+
+    if (!nr)
+        return REX_OK;
+    if (!data)
+        return REX_MISSING_PARAMETER;
+
+    uint64_t sz = (uint64_t) nr * elem_sz;
+    if (w->sz + sz > UINT32_MAX || (uint64_t) *count + nr > UINT32_MAX)
+    {
+        warn ("Mesh block exceeds the maximum block size");
+        return w->status = REX_ERROR_FILE_WRITE;
+    }
+
+    if (fwrite (data, sz, 1, w->fp) != 1)
+        return w->status = REX_ERROR_FILE_WRITE;
+
+    w->sz += sz;
+    w->crc = rex_crc32c (w->crc, data, sz);
+    *count += nr;
+    return REX_OK;
+}
+
+int rex_mesh_writer_begin (struct rex_mesh_writer *w, FILE *fp, uint64_t id, struct rex_header *header,
+                           const struct rex_mesh *props)
 {
-    MEM_CHECK (ptr)
-    MEM_CHECK (mesh)
+    if (!w || !fp)
+        return REX_MISSING_PARAMETER;
+
+    memset (w, 0, sizeof (struct rex_mesh_writer));
+    w->fp = fp;
+    w->id = id;
+    w->header = header;
+    w->section = REX_MESH_SECTION_POSITIONS;
+    w->sz = REX_MESH_HEADER_SIZE;
+    w->material_id = REX_NOT_SET;
+    w->status = REX_OK;
+    if (props)
+    {
+        w->lod = props->lod;
+        w->max_lod = props->max_lod;
+        w->material_id = props->material_id;
+        memcpy (w->name, props->name, REX_MESH_NAME_MAX_SIZE);
+    }
 
-    rex_mesh_init (mesh);
+    w->block_start = ftell (fp);
+    if (w->block_start < 0)
+        return w->status = REX_ERROR_FILE_WRITE;
 
-    rexcpy (&mesh->lod, ptr, sizeof (uint16_t));
-    rexcpy (&mesh->max_lod, ptr, sizeof (uint16_t));
-    rexcpy (&mesh->nr_vertices, ptr, sizeof (uint32_t));
+    // placeholder for block header and mesh header, gets patched in rex_mesh_writer_end
+    uint8_t placeholder[REX_BLOCK_HEADER_SIZE + REX_MESH_HEADER_SIZE] = { 0 };
+    if (fwrite (placeholder, sizeof (placeholder), 1, fp) != 1)
+        return w->status = REX_ERROR_FILE_WRITE;
+    return REX_OK;
+}
 
-    uint32_t nr_normals;
-    uint32_t nr_texcoords;
-    uint32_t nr_colors;
+int rex_mesh_writer_append_positions (struct rex_mesh_writer *w, const float *positions, uint32_t nr_vertices)
+{
+    return mesh_writer_append (w, REX_MESH_SECTION_POSITIONS, positions, nr_vertices, 12, &w->nr_vertices);
+}
 
-    rexcpy (&nr_normals, ptr, sizeof (uint32_t));
-    rexcpy (&nr_texcoords, ptr, sizeof (uint32_t));
-    rexcpy (&nr_colors, ptr, sizeof (uint32_t));
+int rex_mesh_writer_append_normals (struct rex_mesh_writer *w, const float *normals, uint32_t nr_normals)
+{
+    return mesh_writer_append (w, REX_MESH_SECTION_NORMALS, normals, nr_normals, 12, &w->nr_normals);
+}
 
-    rexcpy (&mesh->nr_triangles, ptr, sizeof (uint32_t));
+int rex_mesh_writer_append_tex_coords (struct rex_mesh_writer *w, const float *tex_coords, uint32_t nr_tex_coords)
+{
+    return mesh_writer_append (w, REX_MESH_SECTION_TEX_COORDS, tex_coords, nr_tex_coords, 8, &w->nr_texcoords);
+}
 
-    uint32_t start_coords;
-    uint32_t start_normals;
-    uint32_t start_texcoords;
-    uint32_t start_colors;
-    uint32_t start_triangles;
+int rex_mesh_writer_append_colors (struct rex_mesh_writer *w, const float *colors, uint32_t nr_colors)
+{
+    return mesh_writer_append (w, REX_MESH_SECTION_COLORS, colors, nr_colors, 12, &w->nr_colors);
+}
 
-    rexcpy (&start_coords, ptr, sizeof (uint32_t));
-    rexcpy (&start_normals, ptr, sizeof (uint32_t));
-    rexcpy (&start_texcoords, ptr, sizeof (uint32_t));
-    rexcpy (&start_colors, ptr, sizeof (uint32_t));
-    rexcpy (&start_triangles, ptr, sizeof (uint32_t));
+int rex_mesh_writer_append_triangles (struct rex_mesh_writer *w, const uint32_t *triangles, uint32_t nr_triangles)
+{
+    return mesh_writer_append (w, REX_MESH_SECTION_TRIANGLES, triangles, nr_triangles, 12, &w->nr_triangles);
+}
 
-    rexcpy (&mesh->material_id, ptr, sizeof (uint64_t));
+int rex_mesh_writer_end (struct rex_mesh_writer *w, long *sz)
+{
+    if (!w || !w->fp)
+        return REX_MISSING_PARAMETER;
+    if (w->status != REX_OK)
+        return w->status;
+
+    if ((w->nr_normals && w->nr_normals != w->nr_vertices)
+            || (w->nr_texcoords && w->nr_texcoords != w->nr_vertices)
+            || (w->nr_colors && w->nr_colors != w->nr_vertices))
+    {
+        warn ("Mesh attributes must have the same number of entries as positions");
+        return w->status = REX_ERROR_WRONG_ORDER;
+    }
 
-    uint16_t sz; // not used anymore since string is fixed size
-    rexcpy (&sz, ptr, sizeof (uint16_t));
-    rexcpy (mesh->name, ptr, REX_MESH_NAME_MAX_SIZE);
+    struct rex_mesh mesh;
+    rex_mesh_init (&mesh);
+    mesh.lod = w->lod;
+    mesh.max_lod = w->max_lod;
+    mesh.nr_vertices = w->nr_vertices;
+    mesh.nr_triangles = w->nr_triangles;
+    mesh.material_id = w->material_id;
+    memcpy (mesh.name, w->name, REX_MESH_NAME_MAX_SIZE);
+
+    uint8_t buf[REX_BLOCK_HEADER_SIZE + REX_MESH_HEADER_SIZE] = { 0 };
+    struct rex_block block = { .type = Mesh, .version = 1, .sz = (uint32_t) w->sz, .id = w->id };
+    uint8_t *ptr = rex_block_header_write (buf, &block);
+    mesh_header_write (ptr, &mesh, w->nr_normals, w->nr_texcoords, w->nr_colors);
+
+    long end = ftell (w->fp);
+    if (end < 0
+            || fseek (w->fp, w->block_start, SEEK_SET) != 0
+            || fwrite (buf, sizeof (buf), 1, w->fp) != 1
+            || fseek (w->fp, end, SEEK_SET) != 0)
+        return w->status = REX_ERROR_FILE_WRITE;
+
+    // the data was already checksummed while appending, only the patched headers are missing
+    long total = REX_BLOCK_HEADER_SIZE + (long) w->sz;
+    uint32_t crc = rex_crc32c_combine (rex_crc32c (0, buf, sizeof (buf)), w->crc, w->sz - REX_MESH_HEADER_SIZE);
+    if (w->header)
+        REX_STATS_WRITE_END (buf, total);
+    rex_header_add_block_crc (w->header, total, crc);
+    if (sz)
+        *sz = total;
+
+    w->fp = NULL;
+    return REX_OK;
+}
+
+uint8_t *rex_block_read_mesh (uint8_t *ptr, struct rex_mesh *mesh)
+{
+    return rex_block_read_mesh_arena (ptr, mesh, NULL);
+}
+
+uint8_t *rex_block_read_mesh_arena (uint8_t *ptr, struct rex_mesh *mesh, struct rex_arena *arena)
+{
+    MEM_CHECK (ptr)
+    MEM_CHECK (mesh)
+
+    struct rex_mesh_layout layout;
+    ptr = rex_mesh_header_read (ptr, mesh, &layout);
+    uint32_t nr_normals = layout.nr_normals;
+    uint32_t nr_texcoords = layout.nr_texcoords;
+    uint32_t nr_colors = layout.nr_colors;
 
     // read positions
     if (mesh->nr_vertices)
     {
-        mesh->positions = malloc (mesh->nr_vertices * 12);
-        rexcpy (mesh->positions, ptr, mesh->nr_vertices * 12);
+        mesh->positions = rex_arena_alloc (arena, (size_t) mesh->nr_vertices * 12);
+        rexcpy (mesh->positions, ptr, (size_t) mesh->nr_vertices * 12);
     }
 
     // read normals
     if (nr_normals)
     {
-        mesh->normals = malloc (nr_normals * 12);
-        rexcpy (mesh->normals, ptr, nr_normals * 12);
+        mesh->normals = rex_arena_alloc (arena, (size_t) nr_normals * 12);
+        rexcpy (mesh->normals, ptr, (size_t) nr_normals * 12);
     }
 
     // read texture coords
     if (nr_texcoords)
     {
-        mesh->tex_coords = malloc (nr_texcoords * 8);
-        rexcpy (mesh->tex_coords, ptr, nr_texcoords * 8);
+        mesh->tex_coords = rex_arena_alloc (arena, (size_t) nr_texcoords * 8);
+        rexcpy (mesh->tex_coords, ptr, (size_t) nr_texcoords * 8);
     }
 
     // read colors
     if (nr_colors)
     {
-        mesh->colors = malloc (nr_colors * 12);
-        rexcpy (mesh->colors, ptr, nr_colors * 12);
+        mesh->colors = rex_arena_alloc (arena, (size_t) nr_colors * 12);
+        rexcpy (mesh->colors, ptr, (size_t) nr_colors * 12);
     }
 
     // read triangles
     if (mesh->nr_triangles)
     {
-        mesh->triangles = malloc (mesh->nr_triangles * 12);
-        rexcpy (mesh->triangles, ptr, mesh->nr_triangles * 12);
+        mesh->triangles = rex_arena_alloc (arena, (size_t) mesh->nr_triangles * 12);
+        rexcpy (mesh->triangles, ptr, (size_t) mesh->nr_triangles * 12);
     }
 
     return ptr;
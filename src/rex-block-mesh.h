@@ -52,7 +52,10 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
+#include "rex-arena.h"
 #include "rex-header.h"
+#include "rex-iov.h"
 #include "global.h"
 
 #ifdef __cplusplus
@@ -94,6 +97,12 @@ struct rex_mesh
  */
 uint8_t *rex_block_read_mesh (uint8_t *ptr, struct rex_mesh *mesh);
 
+/**
+ * Same as rex_block_read_mesh, but all arrays are allocated from the given arena
+ * (see rex-arena.h). If arena is NULL, the installed allocator is used (see rex-alloc.h).
+ */
+uint8_t *rex_block_read_mesh_arena (uint8_t *ptr, struct rex_mesh *mesh, struct rex_arena *arena);
+
 /**
  * Writes the given rex_mesh block in a buffer. The buffer will be allocated, so the caller
  * must take care of releasing the memory.
@@ -106,6 +115,173 @@ uint8_t *rex_block_read_mesh (uint8_t *ptr, struct rex_mesh *mesh);
  */
 uint8_t *rex_block_write_mesh (uint64_t id, struct rex_header *header, struct rex_mesh *mesh, long *sz);
 
+/**
+ * Calculates the total size of the serialized mesh block including the block header,
+ * which is the same as the sz returned by rex_block_write_mesh.
+ */
+long rex_block_size_mesh (const struct rex_mesh *mesh);
+
+/**
+ * Describes the mesh block as list of memory segments (see rex-iov.h). Only the headers
+ * are serialized, the arrays of mesh are referenced and must stay valid until the block
+ * is written. The REX header gets updated like in rex_block_write_mesh.
+ *
+ * \param id the data id of the block
+ * \param header the REX header which gets modified (can be NULL)
+ * \param mesh the mesh which should get serialized
+ * \param biov the block which gets filled
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_block_iov_mesh (uint64_t id, struct rex_header *header, struct rex_mesh *mesh, struct rex_block_iov *biov);
+
+/**
+ * The sections of a mesh block in the order they are stored in the file
+ */
+enum rex_mesh_section
+{
+    REX_MESH_SECTION_POSITIONS = 0,
+    REX_MESH_SECTION_NORMALS,
+    REX_MESH_SECTION_TEX_COORDS,
+    REX_MESH_SECTION_COLORS,
+    REX_MESH_SECTION_TRIANGLES
+};
+
+/**
+ * The counts and section offsets of the mesh header. The offsets are relative to the
+ * beginning of the mesh block (without block header) and indexed by rex_mesh_section.
+ */
+struct rex_mesh_layout
+{
+    uint32_t nr_normals;    //<! number of normals (0 or nr_vertices)
+    uint32_t nr_texcoords;  //<! number of texture coordinates (0 or nr_vertices)
+    uint32_t nr_colors;     //<! number of colors (0 or nr_vertices)
+    uint32_t start[5];      //<! the start offset of every section
+};
+
+/**
+ * Writes the 128 byte mesh header with the given layout. This is used by the different
+ * versions of the mesh block, which share the header (see rex-block-mesh-compressed.h).
+ *
+ * \param ptr pointer to the beginning of the mesh block (after the block header)
+ * \param mesh the mesh providing lod, max_lod, the counts, material_id and name
+ * \param layout the counts of the optional attributes and the section offsets
+ * \return the pointer after the mesh header
+ */
+uint8_t *rex_mesh_header_write (uint8_t *ptr, const struct rex_mesh *mesh, const struct rex_mesh_layout *layout);
+
+/**
+ * Reads the 128 byte mesh header. The mesh gets initialized, all arrays are NULL.
+ *
+ * \param ptr pointer to the beginning of the mesh block (after the block header)
+ * \param mesh the mesh which gets filled
+ * \param layout the counts of the optional attributes and the section offsets
+ * \return the pointer after the mesh header
+ */
+uint8_t *rex_mesh_header_read (uint8_t *ptr, struct rex_mesh *mesh, struct rex_mesh_layout *layout);
+
+/**
+ * Streaming writer for mesh blocks which are too large to be kept in memory. The attribute
+ * arrays are written directly to the file in chunks, the block header and the mesh header
+ * are written as placeholder first and get patched in rex_mesh_writer_end. Memory usage is
+ * constant and independent of the mesh size.
+ *
+ * The sections must be appended in the order of the file layout: positions, normals,
+ * texture coordinates, colors and triangles. Each section can be appended in an arbitrary
+ * number of chunks, optional sections can be skipped. Appending to a previous section fails.
+ *
+ * \code
+ * struct rex_mesh_writer w;
+ * rex_mesh_writer_begin (&w, fp, id, header, &props);
+ * while (...)
+ *     rex_mesh_writer_append_positions (&w, chunk, nr);
+ * while (...)
+ *     rex_mesh_writer_append_triangles (&w, chunk, nr);
+ * rex_mesh_writer_end (&w, &sz);
+ * \endcode
+ */
+struct rex_mesh_writer
+{
+    FILE *fp;                           //<! the file which gets written
+    long block_start;                   //<! file position of the block header
+    uint64_t id;                        //<! the id of the block
+    struct rex_header *header;          //<! the REX header which gets updated in rex_mesh_writer_end (can be NULL)
+
+    uint16_t lod;                       //<! level of detail of the geometry
+    uint16_t max_lod;                   //<! the maximal level of detail for this geometry
+    uint64_t material_id;               //<! id of the material block
+    char name[REX_MESH_NAME_MAX_SIZE];  //<! the mesh name
+
+    uint32_t nr_vertices;               //<! number of positions written so far
+    uint32_t nr_normals;                //<! number of normals written so far
+    uint32_t nr_texcoords;              //<! number of texture coordinates written so far
+    uint32_t nr_colors;                 //<! number of colors written so far
+    uint32_t nr_triangles;              //<! number of triangles written so far
+
+    enum rex_mesh_section section;      //<! the current section
+    uint64_t sz;                        //<! block size w/o block header written so far
+    uint32_t crc;                       //<! CRC-32C of the appended data (see rex-crc.h)
+    int status;                         //<! REX_OK or the first error which occurred
+};
+
+/**
+ * Starts a new mesh block at the current position of the file. The properties lod, max_lod,
+ * material_id and name are taken from props, all arrays and counters of props are ignored.
+ *
+ * \param w the writer
+ * \param fp the file which must be opened for writing (and seeking)
+ * \param id the id of the mesh block
+ * \param header the REX header which gets updated at the end (can be NULL)
+ * \param props the mesh properties or NULL for default values
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_writer_begin (struct rex_mesh_writer *w, FILE *fp, uint64_t id, struct rex_header *header,
+                           const struct rex_mesh *props);
+
+/**
+ * Appends a chunk of positions (xyzxyz...)
+ *
+ * \param w the writer
+ * \param positions the position array
+ * \param nr_vertices the number of vertices (not floats) in the array
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_writer_append_positions (struct rex_mesh_writer *w, const float *positions, uint32_t nr_vertices);
+
+/**
+ * Appends a chunk of normals (xyzxyz...). In total the number of normals must match the number of positions.
+ */
+int rex_mesh_writer_append_normals (struct rex_mesh_writer *w, const float *normals, uint32_t nr_normals);
+
+/**
+ * Appends a chunk of texture coordinates (uvuv...). In total the number must match the number of positions.
+ */
+int rex_mesh_writer_append_tex_coords (struct rex_mesh_writer *w, const float *tex_coords, uint32_t nr_tex_coords);
+
+/**
+ * Appends a chunk of colors (rgbrgb...). In total the number of colors must match the number of positions.
+ */
+int rex_mesh_writer_append_colors (struct rex_mesh_writer *w, const float *colors, uint32_t nr_colors);
+
+/**
+ * Appends a chunk of triangles. Indices refer to all positions of the block, not to the chunk.
+ *
+ * \param w the writer
+ * \param triangles the index array
+ * \param nr_triangles the number of triangles (not indices) in the array
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_writer_append_triangles (struct rex_mesh_writer *w, const uint32_t *triangles, uint32_t nr_triangles);
+
+/**
+ * Finishes the mesh block. The block header and mesh header get patched and the REX header
+ * is updated. The file position is at the end of the block afterwards.
+ *
+ * \param w the writer
+ * \param sz the total size of the written block including the block header (can be NULL)
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_writer_end (struct rex_mesh_writer *w, long *sz);
+
 /**
  * Sets all properties of the rex_mesh structure to initial values
  */
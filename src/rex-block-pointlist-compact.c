@@ -0,0 +1,417 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "global.h"
+#include "rex-block-pointlist-compact.h"
+#include "rex-block.h"
+#include "rex-bounds.h"
+#include "rex-mem.h"
+#include "status.h"
+#include "util.h"
+
+// largest float below 2^32
+#define MAX_U32_FLOAT 4294967040.0f
+
+/**
+ * The per-axis conversion between the float positions and the integers
+ */
+struct quant
+{
+    float scale[3];   //<! float scale for decoding
+    float inv[3];     //<! inverse scale for encoding
+    float offset[3];  //<! float offset
+};
+
+static void quant_init (struct quant *q, const double *scale, const double *offset)
+{
+    for (int c = 0; c < 3; c++)
+    {
+        q->scale[c] = (float) scale[c];
+        q->inv[c] = (scale[c] > 0.0) ? (float) (1.0 / scale[c]) : 0.0f;
+        q->offset[c] = (float) offset[c];
+    }
+}
+
+static inline float quant_encode (float p, const struct quant *q, int c, float maxq)
+{
+    float t = (p - q->offset[c]) * q->inv[c] + 0.5f;
+    if (!(t > 0.0f)) t = 0.0f; // also catches NaN
+    return (t > maxq) ? maxq : t;
+}
+
+static void encode_u16 (const float *positions, uint32_t n, const struct quant *q, uint8_t *dst)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    // 8 points (24 components) per iteration, the component pattern repeats every 3 vectors
+    const __m128 inv[3] = { _mm_setr_ps (q->inv[0], q->inv[1], q->inv[2], q->inv[0]),
+                            _mm_setr_ps (q->inv[1], q->inv[2], q->inv[0], q->inv[1]),
+                            _mm_setr_ps (q->inv[2], q->inv[0], q->inv[1], q->inv[2]) };
+    const __m128 off[3] = { _mm_setr_ps (q->offset[0], q->offset[1], q->offset[2], q->offset[0]),
+                            _mm_setr_ps (q->offset[1], q->offset[2], q->offset[0], q->offset[1]),
+                            _mm_setr_ps (q->offset[2], q->offset[0], q->offset[1], q->offset[2]) };
+    const __m128 half = _mm_set1_ps (0.5f);
+    const __m128 zero = _mm_setzero_ps ();
+    const __m128 maxq = _mm_set1_ps (65535.0f);
+    const __m128i bias32 = _mm_set1_epi32 (32768);
+    const __m128i bias16 = _mm_set1_epi16 ((short) 0x8000);
+    for (; i + 8 <= n; i += 8)
+    {
+        const float *src = positions + (size_t) i * 3;
+        __m128i v[6];
+        for (int k = 0; k < 6; k++)
+        {
+            __m128 t = _mm_add_ps (_mm_mul_ps (_mm_sub_ps (_mm_loadu_ps (src + k * 4), off[k % 3]), inv[k % 3]), half);
+            t = _mm_min_ps (_mm_max_ps (t, zero), maxq);
+            // there is no unsigned 32 to 16 bit pack in SSE2, pack signed around 32768
+            v[k] = _mm_sub_epi32 (_mm_cvttps_epi32 (t), bias32);
+        }
+        uint8_t *out = dst + (size_t) i * 6;
+        _mm_storeu_si128 ((__m128i *) out, _mm_xor_si128 (_mm_packs_epi32 (v[0], v[1]), bias16));
+        _mm_storeu_si128 ((__m128i *) (out + 16), _mm_xor_si128 (_mm_packs_epi32 (v[2], v[3]), bias16));
+        _mm_storeu_si128 ((__m128i *) (out + 32), _mm_xor_si128 (_mm_packs_epi32 (v[4], v[5]), bias16));
+    }
+#endif
+    for (; i < n; i++)
+        for (int c = 0; c < 3; c++)
+        {
+            uint16_t v = (uint16_t) quant_encode (positions[(size_t) i * 3 + c], q, c, 65535.0f);
+            memcpy (dst + ((size_t) i * 3 + c) * 2, &v, sizeof (uint16_t));
+        }
+}
+
+static void encode_u32 (const float *positions, uint32_t n, const struct quant *q, uint8_t *dst)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    const __m128 inv[3] = { _mm_setr_ps (q->inv[0], q->inv[1], q->inv[2], q->inv[0]),
+                            _mm_setr_ps (q->inv[1], q->inv[2], q->inv[0], q->inv[1]),
+                            _mm_setr_ps (q->inv[2], q->inv[0], q->inv[1], q->inv[2]) };
+    const __m128 off[3] = { _mm_setr_ps (q->offset[0], q->offset[1], q->offset[2], q->offset[0]),
+                            _mm_setr_ps (q->offset[1], q->offset[2], q->offset[0], q->offset[1]),
+                            _mm_setr_ps (q->offset[2], q->offset[0], q->offset[1], q->offset[2]) };
+    const __m128 half = _mm_set1_ps (0.5f);
+    const __m128 zero = _mm_setzero_ps ();
+    const __m128 maxq = _mm_set1_ps (MAX_U32_FLOAT);
+    const __m128 bias = _mm_set1_ps (2147483648.0f);
+    const __m128i sign = _mm_set1_epi32 ((int) 0x80000000u);
+    for (; i + 4 <= n; i += 4)
+    {
+        const float *src = positions + (size_t) i * 3;
+        for (int k = 0; k < 3; k++)
+        {
+            __m128 t = _mm_add_ps (_mm_mul_ps (_mm_sub_ps (_mm_loadu_ps (src + k * 4), off[k]), inv[k]), half);
+            t = _mm_min_ps (_mm_max_ps (t, zero), maxq);
+            // there is no unsigned conversion in SSE2, convert signed around 2^31
+            __m128i v = _mm_xor_si128 (_mm_cvttps_epi32 (_mm_sub_ps (t, bias)), sign);
+            _mm_storeu_si128 ((__m128i *) (dst + ((size_t) i * 3 + k * 4) * 4), v);
+        }
+    }
+#endif
+    for (; i < n; i++)
+        for (int c = 0; c < 3; c++)
+        {
+            uint32_t v = (uint32_t) quant_encode (positions[(size_t) i * 3 + c], q, c, MAX_U32_FLOAT);
+            memcpy (dst + ((size_t) i * 3 + c) * 4, &v, sizeof (uint32_t));
+        }
+}
+
+static void decode_u16 (const uint8_t *src, uint32_t n, const struct quant *q, float *positions)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    const __m128 scale[3] = { _mm_setr_ps (q->scale[0], q->scale[1], q->scale[2], q->scale[0]),
+                              _mm_setr_ps (q->scale[1], q->scale[2], q->scale[0], q->scale[1]),
+                              _mm_setr_ps (q->scale[2], q->scale[0], q->scale[1], q->scale[2]) };
+    const __m128 off[3] = { _mm_setr_ps (q->offset[0], q->offset[1], q->offset[2], q->offset[0]),
+                            _mm_setr_ps (q->offset[1], q->offset[2], q->offset[0], q->offset[1]),
+                            _mm_setr_ps (q->offset[2], q->offset[0], q->offset[1], q->offset[2]) };
+    const __m128i zero = _mm_setzero_si128 ();
+    for (; i + 8 <= n; i += 8)
+    {
+        const uint8_t *in = src + (size_t) i * 6;
+        float *out = positions + (size_t) i * 3;
+        for (int k = 0; k < 3; k++)
+        {
+            __m128i v = _mm_loadu_si128 ((const __m128i *) (in + k * 16));
+            __m128 lo = _mm_cvtepi32_ps (_mm_unpacklo_epi16 (v, zero));
+            __m128 hi = _mm_cvtepi32_ps (_mm_unpackhi_epi16 (v, zero));
+            int a = (2 * k) % 3;
+            int b = (2 * k + 1) % 3;
+            _mm_storeu_ps (out + k * 8, _mm_add_ps (_mm_mul_ps (lo, scale[a]), off[a]));
+            _mm_storeu_ps (out + k * 8 + 4, _mm_add_ps (_mm_mul_ps (hi, scale[b]), off[b]));
+        }
+    }
+#endif
+    for (; i < n; i++)
+        for (int c = 0; c < 3; c++)
+        {
+            uint16_t v;
+            memcpy (&v, src + ((size_t) i * 3 + c) * 2, sizeof (uint16_t));
+            positions[(size_t) i * 3 + c] = (float) v * q->scale[c] + q->offset[c];
+        }
+}
+
+static void decode_u32 (const uint8_t *src, uint32_t n, const struct quant *q, float *positions)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    const __m128 scale[3] = { _mm_setr_ps (q->scale[0], q->scale[1], q->scale[2], q->scale[0]),
+                              _mm_setr_ps (q->scale[1], q->scale[2], q->scale[0], q->scale[1]),
+                              _mm_setr_ps (q->scale[2], q->scale[0], q->scale[1], q->scale[2]) };
+    const __m128 off[3] = { _mm_setr_ps (q->offset[0], q->offset[1], q->offset[2], q->offset[0]),
+                            _mm_setr_ps (q->offset[1], q->offset[2], q->offset[0], q->offset[1]),
+                            _mm_setr_ps (q->offset[2], q->offset[0], q->offset[1], q->offset[2]) };
+    const __m128 bias = _mm_set1_ps (2147483648.0f);
+    const __m128i sign = _mm_set1_epi32 ((int) 0x80000000u);
+    for (; i + 4 <= n; i += 4)
+    {
+        const uint8_t *in = src + (size_t) i * 12;
+        float *out = positions + (size_t) i * 3;
+        for (int k = 0; k < 3; k++)
+        {
+            __m128i v = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) (in + k * 16)), sign);
+            __m128 f = _mm_add_ps (_mm_cvtepi32_ps (v), bias);
+            _mm_storeu_ps (out + k * 4, _mm_add_ps (_mm_mul_ps (f, scale[k]), off[k]));
+        }
+    }
+#endif
+    for (; i < n; i++)
+        for (int c = 0; c < 3; c++)
+        {
+            uint32_t v;
+            memcpy (&v, src + ((size_t) i * 3 + c) * 4, sizeof (uint32_t));
+            positions[(size_t) i * 3 + c] = (float) v * q->scale[c] + q->offset[c];
+        }
+}
+
+static void encode_colors (const float *colors, size_t n, uint8_t *dst)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 s = _mm_set1_ps (255.0f);
+    const __m128 half = _mm_set1_ps (0.5f);
+    const __m128 zero = _mm_setzero_ps ();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v[4];
+        for (int k = 0; k < 4; k++)
+        {
+            __m128 t = _mm_add_ps (_mm_mul_ps (_mm_loadu_ps (colors + i + k * 4), s), half);
+            v[k] = _mm_cvttps_epi32 (_mm_min_ps (_mm_max_ps (t, zero), s));
+        }
+        __m128i lo = _mm_packs_epi32 (v[0], v[1]);
+        __m128i hi = _mm_packs_epi32 (v[2], v[3]);
+        _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packus_epi16 (lo, hi));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        float t = colors[i] * 255.0f + 0.5f;
+        if (!(t > 0.0f)) t = 0.0f;
+        dst[i] = (uint8_t) ((t > 255.0f) ? 255.0f : t);
+    }
+}
+
+static void decode_colors (const uint8_t *src, size_t n, float *colors)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 s = _mm_set1_ps (1.0f / 255.0f);
+    const __m128i zero = _mm_setzero_si128 ();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i));
+        __m128i lo = _mm_unpacklo_epi8 (v, zero);
+        __m128i hi = _mm_unpackhi_epi8 (v, zero);
+        _mm_storeu_ps (colors + i, _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpacklo_epi16 (lo, zero)), s));
+        _mm_storeu_ps (colors + i + 4, _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpackhi_epi16 (lo, zero)), s));
+        _mm_storeu_ps (colors + i + 8, _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpacklo_epi16 (hi, zero)), s));
+        _mm_storeu_ps (colors + i + 12, _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpackhi_epi16 (hi, zero)), s));
+    }
+#endif
+    for (; i < n; i++)
+        colors[i] = (float) src[i] * (1.0f / 255.0f);
+}
+
+long rex_block_size_pointlist_compact (const struct rex_pointlist *plist, uint8_t position_bits)
+{
+    if (!plist) return 0;
+
+    long sz = REX_BLOCK_HEADER_SIZE
+              + REX_POINTLIST_COMPACT_HEADER_SIZE
+              + (size_t) plist->nr_vertices * 3 * (position_bits / 8)
+              + (size_t) plist->nr_colors * 3;
+    return sz + REX_BLOCK_PADDING (sz);
+}
+
+uint8_t *rex_block_write_pointlist_compact (uint64_t id, struct rex_header *header, struct rex_pointlist *plist,
+                                            uint8_t position_bits, long *sz)
+{
+    MEM_CHECK (plist)
+    MEM_CHECK (sz)
+
+    if (position_bits != 16 && position_bits != 32)
+    {
+        warn ("Only 16 and 32 bit positions are supported");
+        return NULL;
+    }
+    if (plist->nr_colors && plist->nr_colors != plist->nr_vertices)
+    {
+        warn ("Number of colors does not match number of vertices");
+        return NULL;
+    }
+    if ((plist->nr_vertices && !plist->positions) || (plist->nr_colors && !plist->colors))
+    {
+        warn ("Pointlist without data");
+        return NULL;
+    }
+
+    *sz = rex_block_size_pointlist_compact (plist, position_bits);
+    BLOCK_SIZE_CHECK (*sz)
+
+    // the bounding box minimum is the offset, the extent covers the full integer range;
+    // NaN values are skipped by rex_attribute_range
+    float fmin[3], fmax[3];
+    rex_attribute_range (plist->positions, plist->nr_vertices, 3, NULL, fmin, fmax);
+
+    double maxq = (position_bits == 16) ? 65535.0 : MAX_U32_FLOAT;
+    double min[3], max[3], scale[3];
+    for (int c = 0; c < 3; c++)
+    {
+        min[c] = fmin[c];
+        max[c] = fmax[c];
+        // no points, NaN or infinite values only
+        if (min[c] > max[c] || !isfinite (min[c]) || !isfinite (max[c]))
+            min[c] = max[c] = 0.0;
+        scale[c] = (max[c] - min[c]) / maxq;
+    }
+
+    uint8_t *ptr = rex_mem_alloc (REX_MEM_ENCODE, *sz);
+    if (!ptr)
+        return NULL;
+    memset (ptr, 0, REX_BLOCK_HEADER_SIZE + REX_POINTLIST_COMPACT_HEADER_SIZE);
+    uint8_t *addr = ptr;
+
+    struct rex_block block = { .type = PointList, .version = REX_POINTLIST_VERSION_COMPACT,
+                               .sz = *sz - REX_BLOCK_HEADER_SIZE, .id = id };
+    ptr = rex_block_header_write (ptr, &block);
+
+    uint8_t color_bits = 8;
+    uint16_t reserved = 0;
+    rexcpyr (&plist->nr_vertices, ptr, sizeof (uint32_t));
+    rexcpyr (&plist->nr_colors, ptr, sizeof (uint32_t));
+    rexcpyr (&position_bits, ptr, sizeof (uint8_t));
+    rexcpyr (&color_bits, ptr, sizeof (uint8_t));
+    rexcpyr (&reserved, ptr, sizeof (uint16_t));
+    rexcpyr (scale, ptr, sizeof (scale));
+    rexcpyr (min, ptr, sizeof (min));
+
+    struct quant q;
+    quant_init (&q, scale, min);
+    if (position_bits == 16)
+        encode_u16 (plist->positions, plist->nr_vertices, &q, ptr);
+    else
+        encode_u32 (plist->positions, plist->nr_vertices, &q, ptr);
+    ptr += (size_t) plist->nr_vertices * 3 * (position_bits / 8);
+
+    if (plist->nr_colors)
+        encode_colors (plist->colors, (size_t) plist->nr_colors * 3, ptr);
+    ptr += (size_t) plist->nr_colors * 3;
+    memset (ptr, 0, addr + *sz - ptr);
+
+    rex_header_add_block (header, addr, *sz);
+    return addr;
+}
+
+uint8_t *rex_block_read_pointlist_compact (uint8_t *ptr, uint32_t sz, struct rex_pointlist *plist)
+{
+    return rex_block_read_pointlist_compact_arena (ptr, sz, plist, NULL);
+}
+
+uint8_t *rex_block_read_pointlist_compact_arena (uint8_t *ptr, uint32_t sz, struct rex_pointlist *plist,
+                                                 struct rex_arena *arena)
+{
+    MEM_CHECK (ptr)
+    MEM_CHECK (plist)
+
+    rex_pointlist_init (plist);
+    if (sz < REX_POINTLIST_COMPACT_HEADER_SIZE)
+    {
+        warn ("Invalid compact pointlist block");
+        return NULL;
+    }
+
+    uint8_t *end = ptr + sz;
+    uint32_t nr_vertices, nr_colors;
+    uint8_t position_bits, color_bits;
+    uint16_t reserved;
+    double scale[3], offset[3];
+    rexcpy (&nr_vertices, ptr, sizeof (uint32_t));
+    rexcpy (&nr_colors, ptr, sizeof (uint32_t));
+    rexcpy (&position_bits, ptr, sizeof (uint8_t));
+    rexcpy (&color_bits, ptr, sizeof (uint8_t));
+    rexcpy (&reserved, ptr, sizeof (uint16_t));
+    rexcpy (scale, ptr, sizeof (scale));
+    rexcpy (offset, ptr, sizeof (offset));
+
+    uint64_t positions_sz = (uint64_t) nr_vertices * 3 * (position_bits / 8);
+    uint64_t colors_sz = (uint64_t) nr_colors * 3;
+    if ((position_bits != 16 && position_bits != 32)
+            || color_bits != 8
+            || (nr_colors && nr_colors != nr_vertices)
+            || REX_POINTLIST_COMPACT_HEADER_SIZE + positions_sz + colors_sz > sz)
+    {
+        warn ("Invalid compact pointlist block");
+        return NULL;
+    }
+
+    if (nr_vertices)
+    {
+        plist->positions = rex_arena_alloc (arena, (size_t) nr_vertices * 12);
+        if (!plist->positions)
+            return NULL;
+        struct quant q;
+        quant_init (&q, scale, offset);
+        if (position_bits == 16)
+            decode_u16 (ptr, nr_vertices, &q, plist->positions);
+        else
+            decode_u32 (ptr, nr_vertices, &q, plist->positions);
+        plist->nr_vertices = nr_vertices;
+    }
+    ptr += positions_sz;
+
+    if (nr_colors)
+    {
+        plist->colors = rex_arena_alloc (arena, (size_t) nr_colors * 12);
+        if (!plist->colors)
+        {
+            if (!arena)
+                rex_pointlist_free (plist);
+            rex_pointlist_init (plist);
+            return NULL;
+        }
+        decode_colors (ptr, (size_t) nr_colors * 3, plist->colors);
+        plist->nr_colors = nr_colors;
+    }
+    return end;
+}
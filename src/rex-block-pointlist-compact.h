@@ -0,0 +1,103 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief REX pointlist block version 2 with integer positions and 8 bit colors
+ *
+ * Version 2 of the pointlist block stores the positions as integers with a per-block
+ * scale and offset (like LAS files) and the colors with 8 bits per component. A colored
+ * point takes 9 bytes (16 bit positions) or 15 bytes (32 bit positions) instead of 24 bytes.
+ *
+ * | **size [bytes]** | **name**     | **type**  | **description**                               |
+ * |------------------|--------------|-----------|-----------------------------------------------|
+ * | 4                | nrOfVertices | uint32_t  | number of vertices                            |
+ * | 4                | nrOfColors   | uint32_t  | number of colors (0 or nrOfVertices)          |
+ * | 1                | posBits      | uint8_t   | bits per position component (16 or 32)        |
+ * | 1                | colBits      | uint8_t   | bits per color component (always 8)           |
+ * | 2                | reserved     | uint16_t  | reserved (0)                                  |
+ * | 24               | scale        | double[3] | scale of the x, y and z component             |
+ * | 24               | offset       | double[3] | offset of the x, y and z component            |
+ * | 2 or 4           | x            | uint      | x-coordinate of first vertex                  |
+ * | 2 or 4           | y            | uint      | y-coordinate of first vertex                  |
+ * | 2 or 4           | z            | uint      | z-coordinate of first vertex                  |
+ * | ...              |              |           |                                               |
+ * | 1                | red          | uint8_t   | red component of the first vertex             |
+ * | 1                | green        | uint8_t   | green component of the first vertex           |
+ * | 1                | blue         | uint8_t   | blue component of the first vertex            |
+ * | ...              |              |           |                                               |
+ *
+ * The coordinates are unsigned integers, the position is offset + q * scale. The writer
+ * uses the bounding box minimum as offset and spreads the extent over the full integer range.
+ * A color component is q / 255. The conversion from and to the float arrays of
+ * struct rex_pointlist uses SSE2 if available.
+ */
+
+#include <stdint.h>
+
+#include "rex-arena.h"
+#include "rex-block-pointlist.h"
+#include "rex-header.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REX_POINTLIST_VERSION_COMPACT 2
+#define REX_POINTLIST_COMPACT_HEADER_SIZE 60
+
+/**
+ * Writes the pointlist as compact pointlist block (version 2). The buffer will be allocated,
+ * so the caller must take care of releasing the memory.
+ *
+ * \param id the data block ID
+ * \param header the REX header which gets modified according the the new block, can be NULL
+ * \param plist the pointlist which should get serialized
+ * \param position_bits the bits per position component, 16 or 32
+ * \param sz the total size of the of the data block which is returned
+ * \return a pointer to the data block or NULL in case of invalid parameters
+ */
+uint8_t *rex_block_write_pointlist_compact (uint64_t id, struct rex_header *header, struct rex_pointlist *plist,
+                                            uint8_t position_bits, long *sz);
+
+/**
+ * Calculates the total size of the compact pointlist block including the block header,
+ * which is the same as the sz returned by rex_block_write_pointlist_compact.
+ */
+long rex_block_size_pointlist_compact (const struct rex_pointlist *plist, uint8_t position_bits);
+
+/**
+ * Reads a compact pointlist block (version 2). The ptr must point to the beginning of the
+ * block (after the block header). Memory will be allocated for the float arrays.
+ *
+ * \param ptr pointer to the block start
+ * \param sz the size of the block (without block header)
+ * \param plist the rex_pointlist structure which gets filled
+ * \return the pointer to the memory block after the block or NULL if the block is invalid
+ */
+uint8_t *rex_block_read_pointlist_compact (uint8_t *ptr, uint32_t sz, struct rex_pointlist *plist);
+
+/**
+ * Same as rex_block_read_pointlist_compact, but all arrays are allocated from the given arena
+ * (see rex-arena.h). If arena is NULL, the installed allocator is used (see rex-alloc.h).
+ */
+uint8_t *rex_block_read_pointlist_compact_arena (uint8_t *ptr, uint32_t sz, struct rex_pointlist *plist,
+                                                 struct rex_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
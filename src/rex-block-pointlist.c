@@ -17,19 +17,18 @@
 #include "global.h"
 #include "rex-block-pointlist.h"
 #include "rex-block.h"
+#include "rex-mem.h"
+#include "status.h"
 #include "util.h"
 
 uint8_t *rex_block_write_pointlist (uint64_t id, struct rex_header *header, struct rex_pointlist *plist, long *sz)
 {
     MEM_CHECK (plist)
 
-    *sz = REX_BLOCK_HEADER_SIZE
-          + sizeof (uint32_t)
-          + sizeof (uint32_t)
-          + plist->nr_vertices * 12
-          + plist->nr_colors * 12;
+    *sz = rex_block_size_pointlist (plist);
+    BLOCK_SIZE_CHECK (*sz)
 
-    uint8_t *ptr = malloc (*sz);
+    uint8_t *ptr = rex_mem_alloc (REX_MEM_ENCODE, *sz);
     memset (ptr, 0, *sz);
     uint8_t *addr = ptr;
 
@@ -40,7 +39,7 @@ uint8_t *rex_block_write_pointlist (uint64_t id, struct rex_header *header, stru
     rexcpyr (&plist->nr_colors, ptr, sizeof (uint32_t));
 
     if (plist->nr_vertices)
-        rexcpyr (plist->positions, ptr, plist->nr_vertices * 12);
+        rexcpyr (plist->positions, ptr, (size_t) plist->nr_vertices * 12);
 
     // check if length are matching
     if (plist->nr_colors && plist->nr_colors != plist->nr_vertices)
@@ -51,17 +50,66 @@ uint8_t *rex_block_write_pointlist (uint64_t id, struct rex_header *header, stru
     }
 
     if (plist->nr_colors)
-        rexcpyr (plist->colors, ptr, plist->nr_colors * 12);
+        rexcpyr (plist->colors, ptr, (size_t) plist->nr_colors * 12);
 
-    if (header)
+    rex_header_add_block (header, addr, *sz);
+    return addr;
+}
+
+long rex_block_size_pointlist (const struct rex_pointlist *plist)
+{
+    if (!plist) return 0;
+
+    return REX_BLOCK_HEADER_SIZE
+           + sizeof (uint32_t)
+           + sizeof (uint32_t)
+           + (size_t) plist->nr_vertices * 12
+           + (size_t) plist->nr_colors * 12;
+}
+
+int rex_block_iov_pointlist (uint64_t id, struct rex_header *header, struct rex_pointlist *plist, struct rex_block_iov *biov)
+{
+    if (!plist || !biov)
+        return REX_MISSING_PARAMETER;
+
+    if (plist->nr_colors && plist->nr_colors != plist->nr_vertices)
     {
-        header->nr_datablocks += 1;
-        header->sz_all_datablocks += *sz;
+        warn ("Number of colors does not match number of vertices");
+        return REX_MISSING_PARAMETER;
     }
-    return addr;
+
+    rex_block_iov_init (biov);
+    long sz = rex_block_size_pointlist (plist);
+    if ((uint64_t) sz - REX_BLOCK_HEADER_SIZE > REX_BLOCK_MAX_SIZE)
+    {
+        warn ("Block exceeds the maximum block size of 4 GiB");
+        return REX_ERROR_BLOCK_SIZE;
+    }
+
+    uint8_t *ptr = biov->head;
+    struct rex_block block = { .type = PointList, .version = 1, .sz = sz - REX_BLOCK_HEADER_SIZE, .id = id };
+    ptr = rex_block_header_write (ptr, &block);
+    rexcpyr (&plist->nr_vertices, ptr, sizeof (uint32_t));
+    rexcpyr (&plist->nr_colors, ptr, sizeof (uint32_t));
+
+    int ret = rex_block_iov_add (biov, biov->head, ptr - biov->head);
+    if (ret == REX_OK)
+        ret = rex_block_iov_add (biov, plist->positions, (size_t) plist->nr_vertices * 12);
+    if (ret == REX_OK)
+        ret = rex_block_iov_add (biov, plist->colors, (size_t) plist->nr_colors * 12);
+    if (ret != REX_OK)
+        return ret;
+
+    rex_header_add_block_iov (header, biov);
+    return REX_OK;
 }
 
 uint8_t *rex_block_read_pointlist (uint8_t *ptr, struct rex_pointlist *plist)
+{
+    return rex_block_read_pointlist_arena (ptr, plist, NULL);
+}
+
+uint8_t *rex_block_read_pointlist_arena (uint8_t *ptr, struct rex_pointlist *plist, struct rex_arena *arena)
 {
     MEM_CHECK (ptr)
     MEM_CHECK (plist)
@@ -72,15 +120,15 @@ uint8_t *rex_block_read_pointlist (uint8_t *ptr, struct rex_pointlist *plist)
     // read positions
     if (plist->nr_vertices)
     {
-        plist->positions = malloc (plist->nr_vertices * 12);
-        rexcpy (plist->positions, ptr, plist->nr_vertices * 12);
+        plist->positions = rex_arena_alloc (arena, (size_t) plist->nr_vertices * 12);
+        rexcpy (plist->positions, ptr, (size_t) plist->nr_vertices * 12);
     }
 
     // read colors
     if (plist->nr_colors)
     {
-        plist->colors = malloc (plist->nr_colors * 12);
-        rexcpy (plist->colors, ptr, plist->nr_colors * 12);
+        plist->colors = rex_arena_alloc (arena, (size_t) plist->nr_colors * 12);
+        rexcpy (plist->colors, ptr, (size_t) plist->nr_colors * 12);
     }
 
     return ptr;
@@ -43,7 +43,9 @@
  */
 
 #include <stdint.h>
+#include "rex-arena.h"
 #include "rex-header.h"
+#include "rex-iov.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -71,6 +73,12 @@ struct rex_pointlist
  */
 uint8_t *rex_block_read_pointlist (uint8_t *ptr, struct rex_pointlist *plist);
 
+/**
+ * Same as rex_block_read_pointlist, but all arrays are allocated from the given arena
+ * (see rex-arena.h). If arena is NULL, the installed allocator is used (see rex-alloc.h).
+ */
+uint8_t *rex_block_read_pointlist_arena (uint8_t *ptr, struct rex_pointlist *plist, struct rex_arena *arena);
+
 /**
  * Writes a pointlist block to a binary stream. Memory will be allocated and the caller
  * must take care of releasing the memory.
@@ -83,6 +91,25 @@ uint8_t *rex_block_read_pointlist (uint8_t *ptr, struct rex_pointlist *plist);
  */
 uint8_t *rex_block_write_pointlist (uint64_t id, struct rex_header *header, struct rex_pointlist *plist, long *sz);
 
+/**
+ * Calculates the total size of the serialized pointlist block including the block header,
+ * which is the same as the sz returned by rex_block_write_pointlist.
+ */
+long rex_block_size_pointlist (const struct rex_pointlist *plist);
+
+/**
+ * Describes the pointlist block as list of memory segments (see rex-iov.h). Only the headers
+ * are serialized, the arrays of plist are referenced and must stay valid until the block
+ * is written. The REX header gets updated like in rex_block_write_pointlist.
+ *
+ * \param id the data id of the block
+ * \param header the REX header which gets modified (can be NULL)
+ * \param plist the pointlist which should get serialized
+ * \param biov the block which gets filled
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_block_iov_pointlist (uint64_t id, struct rex_header *header, struct rex_pointlist *plist, struct rex_block_iov *biov);
+
 /**
  * Sets all properties of the rex_lineset structure to initial values
  */
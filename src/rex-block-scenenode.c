@@ -17,6 +17,7 @@
 #include "global.h"
 #include "rex-block-scenenode.h"
 #include "rex-block.h"
+#include "rex-mem.h"
 #include "util.h"
 
 
@@ -29,7 +30,7 @@ uint8_t* rex_block_write_scenenode(uint64_t id, struct rex_header* header, struc
         + sizeof(REX_SCENENODE_NAME_MAX_SIZE) // name
         + sizeof(float) * 10;                 // translation, rotation, scale
 
-    uint8_t* ptr = malloc(*sz);
+    uint8_t* ptr = rex_mem_alloc(REX_MEM_ENCODE, *sz);
     memset(ptr, 0, *sz);
     uint8_t* addr = ptr;
 
@@ -49,11 +50,7 @@ uint8_t* rex_block_write_scenenode(uint64_t id, struct rex_header* header, struc
     rexcpyr(&scenenode->sy, ptr, sizeof(float));
     rexcpyr(&scenenode->sz, ptr, sizeof(float));
 
-    if (header)
-    {
-        header->nr_datablocks += 1;
-        header->sz_all_datablocks += *sz;
-    }
+    rex_header_add_block (header, addr, *sz);
     return addr;
 }
 
@@ -17,6 +17,7 @@
 #include "global.h"
 #include "rex-block-text.h"
 #include "rex-block.h"
+#include "rex-mem.h"
 #include "util.h"
 
 uint8_t *rex_block_write_text (uint64_t id, struct rex_header *header, struct rex_text *text, long *sz)
@@ -32,8 +33,9 @@ uint8_t *rex_block_write_text (uint64_t id, struct rex_header *header, struct re
           + sizeof (float)     // font size
           + sizeof (uint16_t)  // text size
           + text_len;
+    *sz += REX_BLOCK_PADDING (*sz);
 
-    uint8_t *ptr = malloc (*sz);
+    uint8_t *ptr = rex_mem_alloc (REX_MEM_ENCODE, *sz);
     memset (ptr, 0, *sz);
     uint8_t *addr = ptr;
 
@@ -49,16 +51,17 @@ uint8_t *rex_block_write_text (uint64_t id, struct rex_header *header, struct re
     rexcpyr (&text_len, ptr, sizeof (uint16_t));
     rexcpyr (text->data, ptr, text_len);
 
-    if (header)
-    {
-        header->nr_datablocks += 1;
-        header->sz_all_datablocks += *sz;
-    }
+    rex_header_add_block (header, addr, *sz);
     return addr;
 }
 
 
 uint8_t *rex_block_read_text (uint8_t *ptr, struct rex_text *text)
+{
+    return rex_block_read_text_arena (ptr, text, NULL);
+}
+
+uint8_t *rex_block_read_text_arena (uint8_t *ptr, struct rex_text *text, struct rex_arena *arena)
 {
     MEM_CHECK (ptr)
     MEM_CHECK (text)
@@ -72,7 +75,7 @@ uint8_t *rex_block_read_text (uint8_t *ptr, struct rex_text *text)
     rexcpy (&text->font_size, ptr, sizeof (float));
     rexcpy (&text_len, ptr, sizeof (uint16_t));
 
-    text->data = malloc (text_len + 1);
+    text->data = rex_arena_alloc (arena, text_len + 1);
 
     rexcpy (text->data, ptr, text_len);
     text->data[text_len] = '\0';
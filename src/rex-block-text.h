@@ -34,6 +34,7 @@
 
 #include <stdint.h>
 #include "linmath.h"
+#include "rex-arena.h"
 #include "rex-header.h"
 
 #ifdef __cplusplus
@@ -64,6 +65,12 @@ struct rex_text
  */
 uint8_t *rex_block_read_text (uint8_t *ptr, struct rex_text *text);
 
+/**
+ * Same as rex_block_read_text, but all arrays are allocated from the given arena
+ * (see rex-arena.h). If arena is NULL, the installed allocator is used (see rex-alloc.h).
+ */
+uint8_t *rex_block_read_text_arena (uint8_t *ptr, struct rex_text *text, struct rex_arena *arena);
+
 /**
  * Writes a text block to binary. Memory will be allocated and the caller
  * must take care of releasing the memory.
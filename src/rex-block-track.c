@@ -14,11 +14,137 @@
  * limitations under the License.*
  */
 
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "global.h"
 #include "rex-block-track.h"
 #include "rex-block.h"
+#include "rex-mem.h"
+#include "status.h"
 #include "util.h"
 
+// number of floats of a point record in the file (xyz, normal, confidence)
+#define TRACK_RECORD 7
+
+#ifdef __SSE2__
+// picks a[i0], a[i1], b[i2], b[i3]
+#define SHUF(a, b, i0, i1, i2, i3) _mm_shuffle_ps(a, b, _MM_SHUFFLE(i3, i2, i1, i0))
+#endif
+
+/**
+ * Scalar reference for the interleaving of the points first..n-1 into the records at dst
+ */
+static void track_interleave_scalar(float* dst, const float* points, const float* normals,
+                                    const float* confidences, uint32_t first, uint32_t n)
+{
+    for (uint32_t i = first; i < n; i++)
+    {
+        float* r = dst + (size_t)i * TRACK_RECORD;
+        memcpy(r, &points[(size_t)i * 3], sizeof(float) * 3);
+        memcpy(r + 3, &normals[(size_t)i * 3], sizeof(float) * 3);
+        r[6] = confidences[i];
+    }
+}
+
+/**
+ * Scalar reference for the deinterleaving of the records first..n-1 at src
+ */
+static void track_deinterleave_scalar(const float* src, float* points, float* normals,
+                                      float* confidences, uint32_t first, uint32_t n)
+{
+    for (uint32_t i = first; i < n; i++)
+    {
+        const float* r = src + (size_t)i * TRACK_RECORD;
+        memcpy(&points[(size_t)i * 3], r, sizeof(float) * 3);
+        memcpy(&normals[(size_t)i * 3], r + 3, sizeof(float) * 3);
+        confidences[i] = r[6];
+    }
+}
+
+/**
+ * Interleaves the planar arrays into the on-disk records. dst has no alignment requirements
+ * since the records start at an arbitrary offset inside the block.
+ */
+static void track_interleave(void* dst, const float* points, const float* normals,
+                             const float* confidences, uint32_t n)
+{
+    float* out = dst;
+    uint32_t i = 0;
+#ifdef __SSE2__
+    // 4 points are 3 vectors of points, 3 vectors of normals, 1 of confidences and 7 of records
+    for (; i + 4 <= n; i += 4)
+    {
+        const float* p = points + (size_t)i * 3;
+        const float* nr = normals + (size_t)i * 3;
+        float* o = out + (size_t)i * TRACK_RECORD;
+        __m128 p0 = _mm_loadu_ps(p), p1 = _mm_loadu_ps(p + 4), p2 = _mm_loadu_ps(p + 8);
+        __m128 n0 = _mm_loadu_ps(nr), n1 = _mm_loadu_ps(nr + 4), n2 = _mm_loadu_ps(nr + 8);
+        __m128 c = _mm_loadu_ps(confidences + i);
+
+        __m128 t = SHUF(p0, n0, 2, 2, 0, 0);                        // z0 z0 nx0 nx0
+        _mm_storeu_ps(o, SHUF(p0, t, 0, 1, 0, 2));                  // x0 y0 z0 nx0
+        t = SHUF(c, p0, 0, 0, 3, 3);                                // c0 c0 x1 x1
+        _mm_storeu_ps(o + 4, SHUF(n0, t, 1, 2, 0, 2));              // ny0 nz0 c0 x1
+        t = SHUF(n0, n1, 3, 3, 0, 0);                               // nx1 nx1 ny1 ny1
+        _mm_storeu_ps(o + 8, SHUF(p1, t, 0, 1, 0, 2));              // y1 z1 nx1 ny1
+        t = SHUF(n1, c, 1, 1, 1, 1);                                // nz1 nz1 c1 c1
+        _mm_storeu_ps(o + 12, SHUF(t, p1, 0, 2, 2, 3));             // nz1 c1 x2 y2
+        t = SHUF(p2, n1, 0, 0, 2, 2);                               // z2 z2 nx2 nx2
+        __m128 u = SHUF(n1, n2, 3, 3, 0, 0);                        // ny2 ny2 nz2 nz2
+        _mm_storeu_ps(o + 16, SHUF(t, u, 0, 2, 0, 2));              // z2 nx2 ny2 nz2
+        t = SHUF(c, p2, 2, 2, 1, 1);                                // c2 c2 x3 x3
+        _mm_storeu_ps(o + 20, SHUF(t, p2, 0, 2, 2, 3));             // c2 x3 y3 z3
+        t = SHUF(n2, c, 3, 3, 3, 3);                                // nz3 nz3 c3 c3
+        _mm_storeu_ps(o + 24, SHUF(n2, t, 1, 2, 0, 2));             // nx3 ny3 nz3 c3
+    }
+#endif
+    track_interleave_scalar(out, points, normals, confidences, i, n);
+}
+
+/**
+ * Deinterleaves the on-disk records into the planar arrays, inverse of track_interleave
+ */
+static void track_deinterleave(const void* src, float* points, float* normals,
+                               float* confidences, uint32_t n)
+{
+    const float* in = src;
+    uint32_t i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4)
+    {
+        const float* r = in + (size_t)i * TRACK_RECORD;
+        float* p = points + (size_t)i * 3;
+        float* nr = normals + (size_t)i * 3;
+        __m128 o0 = _mm_loadu_ps(r), o1 = _mm_loadu_ps(r + 4), o2 = _mm_loadu_ps(r + 8);
+        __m128 o3 = _mm_loadu_ps(r + 12), o4 = _mm_loadu_ps(r + 16), o5 = _mm_loadu_ps(r + 20);
+        __m128 o6 = _mm_loadu_ps(r + 24);
+
+        __m128 t = SHUF(o0, o1, 2, 2, 3, 3);                        // z0 z0 x1 x1
+        _mm_storeu_ps(p, SHUF(o0, t, 0, 1, 0, 2));                  // x0 y0 z0 x1
+        _mm_storeu_ps(p + 4, SHUF(o2, o3, 0, 1, 2, 3));             // y1 z1 x2 y2
+        t = SHUF(o4, o5, 0, 0, 1, 1);                               // z2 z2 x3 x3
+        _mm_storeu_ps(p + 8, SHUF(t, o5, 0, 2, 2, 3));              // z2 x3 y3 z3
+
+        t = SHUF(o0, o1, 3, 3, 0, 0);                               // nx0 nx0 ny0 ny0
+        __m128 u = SHUF(o1, o2, 1, 1, 2, 2);                        // nz0 nz0 nx1 nx1
+        _mm_storeu_ps(nr, SHUF(t, u, 0, 2, 0, 2));                  // nx0 ny0 nz0 nx1
+        t = SHUF(o2, o3, 3, 3, 0, 0);                               // ny1 ny1 nz1 nz1
+        _mm_storeu_ps(nr + 4, SHUF(t, o4, 0, 2, 1, 2));             // ny1 nz1 nx2 ny2
+        t = SHUF(o4, o6, 3, 3, 0, 0);                               // nz2 nz2 nx3 nx3
+        _mm_storeu_ps(nr + 8, SHUF(t, o6, 0, 2, 1, 2));             // nz2 nx3 ny3 nz3
+
+        t = SHUF(o1, o3, 2, 2, 1, 1);                               // c0 c0 c1 c1
+        u = SHUF(o5, o6, 0, 0, 3, 3);                               // c2 c2 c3 c3
+        _mm_storeu_ps(confidences + i, SHUF(t, u, 0, 2, 0, 2));     // c0 c1 c2 c3
+    }
+#endif
+    track_deinterleave_scalar(in, points, normals, confidences, i, n);
+}
+
 
 uint8_t* rex_block_write_track(uint64_t id, struct rex_header* header, struct rex_track* track, long* sz)
 {
@@ -27,12 +153,12 @@ uint8_t* rex_block_write_track(uint64_t id, struct rex_header* header, struct re
     MEM_CHECK(track->normals)
     MEM_CHECK(track->confidences)
 
-    * sz = REX_BLOCK_HEADER_SIZE
-        + sizeof(uint32_t)  // nr_points
-        + sizeof(uint64_t)  // timestamp
-        + track->nr_points * 7 * sizeof(float);
+    * sz = rex_block_size_track(track);
+    BLOCK_SIZE_CHECK(*sz)
 
-    uint8_t* ptr = malloc(*sz);
+    uint8_t* ptr = rex_mem_alloc(REX_MEM_ENCODE, *sz);
+    if (!ptr)
+        return NULL;
     memset(ptr, 0, *sz);
     uint8_t* addr = ptr;
 
@@ -42,23 +168,74 @@ uint8_t* rex_block_write_track(uint64_t id, struct rex_header* header, struct re
     rexcpyr(&track->nr_points, ptr, sizeof(uint32_t));
     rexcpyr(&track->timestamp, ptr, sizeof(uint64_t));
 
-    for (int i = 0; i < track->nr_points; i++)
+    track_interleave(ptr, track->points, track->normals, track->confidences, track->nr_points);
+
+    rex_header_add_block(header, addr, *sz);
+    return addr;
+}
+
+
+long rex_block_size_track(const struct rex_track* track)
+{
+    if (!track) return 0;
+
+    return REX_BLOCK_HEADER_SIZE
+        + sizeof(uint32_t)  // nr_points
+        + sizeof(uint64_t)  // timestamp
+        + sizeof(float) * TRACK_RECORD * (uint64_t)track->nr_points;
+}
+
+int rex_block_iov_track(uint64_t id, struct rex_header* header, struct rex_track* track, struct rex_block_iov* biov)
+{
+    if (!track || !biov)
+        return REX_MISSING_PARAMETER;
+    if (track->nr_points && (!track->points || !track->normals || !track->confidences))
+        return REX_MISSING_PARAMETER;
+
+    rex_block_iov_init(biov);
+    long sz = rex_block_size_track(track);
+    if ((uint64_t)sz - REX_BLOCK_HEADER_SIZE > REX_BLOCK_MAX_SIZE)
     {
-        rexcpyr(track->points, ptr, sizeof(float) * 3);
-        rexcpyr(track->normals, ptr, sizeof(float) * 3);
-        rexcpyr(track->confidences, ptr, sizeof(float));
+        warn("Block exceeds the maximum block size of 4 GiB");
+        return REX_ERROR_BLOCK_SIZE;
     }
 
-    if (header)
+    uint8_t* ptr = biov->head;
+    struct rex_block block = { .type = Track,.version = 1,.sz = sz - REX_BLOCK_HEADER_SIZE,.id = id };
+    ptr = rex_block_header_write(ptr, &block);
+    rexcpyr(&track->nr_points, ptr, sizeof(uint32_t));
+    rexcpyr(&track->timestamp, ptr, sizeof(uint64_t));
+
+    // points are interleaved in the file (xyz, normal, confidence)
+    size_t data_sz = sizeof(float) * TRACK_RECORD * (size_t)track->nr_points;
+    if (data_sz)
     {
-        header->nr_datablocks += 1;
-        header->sz_all_datablocks += *sz;
+        float* data = rex_mem_alloc(REX_MEM_ENCODE, data_sz);
+        if (!data)
+            return REX_ERROR_MEMORY;
+        track_interleave(data, track->points, track->normals, track->confidences, track->nr_points);
+        biov->scratch = data;
     }
-    return addr;
-}
 
+    int ret = rex_block_iov_add(biov, biov->head, ptr - biov->head);
+    if (ret == REX_OK)
+        ret = rex_block_iov_add(biov, biov->scratch, data_sz);
+    if (ret != REX_OK)
+    {
+        rex_block_iov_free(biov);
+        return ret;
+    }
+
+    rex_header_add_block_iov(header, biov);
+    return REX_OK;
+}
 
 uint8_t* rex_block_read_track(uint8_t* ptr, struct rex_track* track)
+{
+    return rex_block_read_track_arena(ptr, track, NULL);
+}
+
+uint8_t* rex_block_read_track_arena(uint8_t* ptr, struct rex_track* track, struct rex_arena* arena)
 {
     MEM_CHECK(ptr)
     MEM_CHECK(track)
@@ -66,16 +243,24 @@ uint8_t* rex_block_read_track(uint8_t* ptr, struct rex_track* track)
     rexcpy(&track->nr_points, ptr, sizeof(uint32_t));
     rexcpy(&track->timestamp, ptr, sizeof(uint64_t));
 
-    track->points = malloc(track->nr_points * sizeof(float) * 3);
-    track->normals = malloc(track->nr_points * sizeof(float) * 3);
-    track->confidences = malloc(track->nr_points * sizeof(float));
-
-    for (int i = 0; i < track->nr_points; i++)
+    track->points = rex_arena_alloc(arena, track->nr_points * sizeof(float) * 3);
+    track->normals = rex_arena_alloc(arena, track->nr_points * sizeof(float) * 3);
+    track->confidences = rex_arena_alloc(arena, track->nr_points * sizeof(float));
+    if (track->nr_points && (!track->points || !track->normals || !track->confidences))
     {
-        rexcpy(track->points, ptr, sizeof(float) * 3);
-        rexcpy(track->normals, ptr, sizeof(float) * 3);
-        rexcpy(track->confidences, ptr, sizeof(float));
+        // memory of an arena is released with the arena
+        if (!arena)
+        {
+            FREE(track->points);
+            FREE(track->normals);
+            FREE(track->confidences);
+        }
+        track->points = track->normals = track->confidences = NULL;
+        warn("Cannot allocate memory for the REX track block");
+        return NULL;
     }
-    
+
+    track_deinterleave(ptr, track->points, track->normals, track->confidences, track->nr_points);
+    ptr += sizeof(float) * TRACK_RECORD * (size_t)track->nr_points;
     return ptr;
 }
@@ -35,7 +35,9 @@
   */
 
 #include <stdint.h>
+#include "rex-arena.h"
 #include "rex-header.h"
+#include "rex-iov.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -59,10 +61,17 @@ struct rex_track
  *
  * \param ptr pointer to the block start
  * \param track the rex_track structure which gets filled
- * \return the pointer to the memory block after the rex_track block
+ * \return the pointer to the memory block after the rex_track block, NULL if no memory
+ *         could be allocated
  */
 uint8_t* rex_block_read_track(uint8_t* ptr, struct rex_track* track);
 
+/**
+ * Same as rex_block_read_track, but all arrays are allocated from the given arena
+ * (see rex-arena.h). If arena is NULL, the installed allocator is used (see rex-alloc.h).
+ */
+uint8_t* rex_block_read_track_arena(uint8_t* ptr, struct rex_track* track, struct rex_arena* arena);
+
 /**
  * Writes a track block to binary. Memory will be allocated and the caller
  * must take care of releasing the memory.
@@ -71,10 +80,29 @@ uint8_t* rex_block_read_track(uint8_t* ptr, struct rex_track* track);
  * \param header the REX header which gets modified according the the new block, can be NULL
  * \param track the track which should get serialized
  * \param sz the total size of the of the data block which is returned
- * \return a pointer to the data block
+ * \return a pointer to the data block, NULL if no memory could be allocated
  */
 uint8_t* rex_block_write_track(uint64_t id, struct rex_header* header, struct rex_track* track, long* sz);
 
+/**
+ * Calculates the total size of the serialized track block including the block header,
+ * which is the same as the sz returned by rex_block_write_track.
+ */
+long rex_block_size_track(const struct rex_track* track);
+
+/**
+ * Describes the track block as list of memory segments (see rex-iov.h). The points are
+ * stored interleaved in the file, therefore they are copied into the owned scratch memory
+ * of biov. The REX header gets updated like in rex_block_write_track.
+ *
+ * \param id the data id of the block
+ * \param header the REX header which gets modified (can be NULL)
+ * \param track the track which should get serialized
+ * \param biov the block which gets filled
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_block_iov_track(uint64_t id, struct rex_header* header, struct rex_track* track, struct rex_block_iov* biov);
+
 #ifdef __cplusplus
 }
 #endif
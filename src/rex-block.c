@@ -15,23 +15,41 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "global.h"
+#include "rex-arena.h"
+#include "rex-block-compressed.h"
+#include "rex-block-group.h"
 #include "rex-block-image.h"
 #include "rex-block-lineset.h"
 #include "rex-block-material.h"
+#include "rex-block-mesh-compressed.h"
 #include "rex-block-mesh.h"
+#include "rex-block-pointlist-compact.h"
 #include "rex-block-pointlist.h"
 #include "rex-block-scenenode.h"
 #include "rex-block-text.h"
 #include "rex-block-track.h"
 #include "rex-block.h"
+#include "rex-header.h"
+#include "rex-mem.h"
+#include "rex-stats.h"
+#include "rex-trace.h"
+#include "rex-validate.h"
 #include "status.h"
 #include "util.h"
 
+// trace span names of the block decoders, indexed by rex_block_type
+static const char *decode_names[]
+    = { "decode LineSet", "decode Text", "decode PointList", "decode Mesh", "decode Image",
+        "decode MaterialStandard", "decode SceneNode", "decode Track", "decode Index", "decode Group",
+        "decode Compressed" };
+
 uint8_t *rex_block_header_write (uint8_t *ptr, struct rex_block *block)
 {
     MEM_CHECK (block)
+    REX_STATS_WRITE_BEGIN (block->type);
     rexcpyr (&block->type, ptr, sizeof (uint16_t));
     rexcpyr (&block->version, ptr, sizeof (uint16_t));
     rexcpyr (&block->sz, ptr, sizeof (uint32_t));
@@ -40,6 +58,11 @@ uint8_t *rex_block_header_write (uint8_t *ptr, struct rex_block *block)
 }
 
 uint8_t *rex_block_read (uint8_t *ptr, struct rex_block *block)
+{
+    return rex_block_read_arena (ptr, block, NULL);
+}
+
+uint8_t *rex_block_read_arena (uint8_t *ptr, struct rex_block *block, struct rex_arena *arena)
 {
     MEM_CHECK (ptr);
     MEM_CHECK (block);
@@ -49,70 +72,293 @@ uint8_t *rex_block_read (uint8_t *ptr, struct rex_block *block)
     rexcpy (&block->sz,      ptr, sizeof (uint32_t));
     rexcpy (&block->id,      ptr, sizeof (uint64_t));
 
-    uint8_t *data_start = ptr;
+    uint8_t *data_end = ptr + block->sz;
+    block->data = NULL;
+    REX_STATS_READ_BEGIN (block->type, REX_BLOCK_HEADER_SIZE + block->sz);
+    struct rex_trace_span span = rex_trace_begin ((block->type <= Compressed) ? decode_names[block->type] : "decode");
+    int mem = rex_mem_enter (REX_MEM_DECODE);
 
     switch (block->type)
     {
         case LineSet:
             {
-                struct rex_lineset *lineset = malloc (sizeof (struct rex_lineset));
-                ptr = rex_block_read_lineset (ptr, lineset);
+                struct rex_lineset *lineset = rex_arena_alloc (arena, sizeof (struct rex_lineset));
+                ptr = rex_block_read_lineset_arena (ptr, lineset, arena);
                 block->data = lineset;
                 break;
             }
         case Text:
             {
-                struct rex_text *text = malloc (sizeof (struct rex_text));
-                ptr = rex_block_read_text (ptr, text);
+                struct rex_text *text = rex_arena_alloc (arena, sizeof (struct rex_text));
+                ptr = rex_block_read_text_arena (ptr, text, arena);
                 block->data = text;
                 break;
             }
         case PointList:
             {
-                struct rex_pointlist *p = malloc (sizeof (struct rex_pointlist));
-                ptr = rex_block_read_pointlist (ptr, p);
+                struct rex_pointlist *p = rex_arena_alloc (arena, sizeof (struct rex_pointlist));
+                if (block->version != REX_POINTLIST_VERSION_COMPACT)
+                    ptr = rex_block_read_pointlist_arena (ptr, p, arena);
+                else if (!rex_block_read_pointlist_compact_arena (ptr, block->sz, p, arena))
+                {
+                    if (!arena)
+                        FREE (p);
+                    p = NULL;
+                }
                 block->data = p;
                 break;
             }
         case Mesh:
             {
-                struct rex_mesh *mesh = malloc (sizeof (struct rex_mesh));
-                ptr = rex_block_read_mesh (ptr, mesh);
+                struct rex_mesh *mesh = rex_arena_alloc (arena, sizeof (struct rex_mesh));
+                if (block->version != REX_MESH_VERSION_COMPRESSED)
+                    ptr = rex_block_read_mesh_arena (ptr, mesh, arena);
+                else if (!rex_block_read_mesh_compressed_arena (ptr, block->sz, mesh, arena))
+                {
+                    if (!arena)
+                        FREE (mesh);
+                    mesh = NULL;
+                }
                 block->data = mesh;
                 break;
             }
         case Image:
             {
-                struct rex_image *img = malloc (sizeof (struct rex_image));
+                struct rex_image *img = rex_arena_alloc (arena, sizeof (struct rex_image));
                 img->sz = block->sz - sizeof (uint32_t); // subtract compression
-                ptr = rex_block_read_image (ptr, img);
+                ptr = rex_block_read_image_arena (ptr, img, arena);
                 block->data = img;
                 break;
             }
         case MaterialStandard:
             {
-                struct rex_material_standard *mat = malloc (sizeof (struct rex_material_standard));
+                struct rex_material_standard *mat = rex_arena_alloc (arena, sizeof (struct rex_material_standard));
                 ptr = rex_block_read_material (ptr, mat);
                 block->data = mat;
                 break;
             }
         case SceneNode:
             {
-                struct rex_scenenode *node = malloc(sizeof(struct rex_scenenode));
+                struct rex_scenenode *node = rex_arena_alloc (arena, sizeof (struct rex_scenenode));
                 ptr = rex_block_read_scenenode(ptr, node);
                 block->data = node;
                 break;
             }
         case Track:
             {
-                struct rex_track *track = malloc(sizeof(struct rex_track));
-                ptr = rex_block_read_track(ptr, track);
+                uint32_t nr_points;
+                if (block->sz < sizeof (uint32_t) + sizeof (uint64_t))
+                {
+                    warn ("Invalid REX track block, skipping.");
+                    break;
+                }
+                memcpy (&nr_points, ptr, sizeof (uint32_t));
+                if (nr_points > (block->sz - sizeof (uint32_t) - sizeof (uint64_t)) / (7 * sizeof (float)))
+                {
+                    warn ("Invalid REX track block, skipping.");
+                    break;
+                }
+                struct rex_track *track = rex_arena_alloc (arena, sizeof (struct rex_track));
+                if (track && !rex_block_read_track_arena (ptr, track, arena))
+                {
+                    if (!arena)
+                        FREE (track);
+                    track = NULL;
+                }
                 block->data = track;
                 break;
             }
+        case Group:
+            {
+                uint32_t nr_members;
+                if (block->sz < sizeof (uint32_t))
+                {
+                    warn ("Invalid REX group block, skipping.");
+                    break;
+                }
+                memcpy (&nr_members, ptr, sizeof (uint32_t));
+                if (nr_members > (block->sz - sizeof (uint32_t)) / sizeof (uint64_t))
+                {
+                    warn ("Invalid REX group block, skipping.");
+                    break;
+                }
+                struct rex_group *group = rex_arena_alloc (arena, sizeof (struct rex_group));
+                if (group && !rex_block_read_group_arena (ptr, group, arena))
+                {
+                    if (!arena)
+                        FREE (group);
+                    group = NULL;
+                }
+                block->data = group;
+                break;
+            }
+        case Compressed:
+            {
+                // the inner block replaces the block, its data never refers to the buffer; the
+                // inner block is not covered by rex_validate and gets validated here
+                long inner_sz;
+                struct rex_trace_span dspan = rex_trace_begin ("decompress");
+                uint8_t *inner = rex_block_decompress (ptr, block->sz, block->id, &inner_sz);
+                rex_trace_end (&dspan);
+                if (inner && rex_validate_block (inner, inner_sz) == REX_OK)
+                    rex_block_read_arena (inner, block, arena);
+                FREE (inner);
+                break;
+            }
         default:
             warn ("Not supported REX block, skipping.");
-            return  data_start + block->sz;
+            break;
     }
+
+    rex_mem_leave (mem);
+    REX_STATS_READ_END ();
+    rex_trace_end (&span);
+    // the block size is authoritative, the payload may contain data of newer versions
+    return data_end;
+}
+
+void rex_block_free (struct rex_block *block)
+{
+    if (!block || !block->data) return;
+
+    switch (block->type)
+    {
+        case LineSet:
+            {
+                struct rex_lineset *lineset = block->data;
+                FREE (lineset->vertices);
+                break;
+            }
+        case Text:
+            {
+                struct rex_text *text = block->data;
+                FREE (text->data);
+                break;
+            }
+        case PointList:
+            rex_pointlist_free (block->data);
+            break;
+        case Mesh:
+            rex_mesh_free (block->data);
+            break;
+        case Image:
+            {
+                struct rex_image *img = block->data;
+                FREE (img->data);
+                break;
+            }
+        case Track:
+            {
+                struct rex_track *track = block->data;
+                FREE (track->points);
+                FREE (track->normals);
+                FREE (track->confidences);
+                break;
+            }
+        case Group:
+            rex_group_free (block->data);
+            break;
+        default:
+            break;
+    }
+    FREE (block->data);
+}
+
+uint8_t *rex_block_peek (uint8_t *ptr, struct rex_block *block)
+{
+    MEM_CHECK (ptr);
+    MEM_CHECK (block);
+
+    rexcpy (&block->type,    ptr, sizeof (uint16_t));
+    rexcpy (&block->version, ptr, sizeof (uint16_t));
+    rexcpy (&block->sz,      ptr, sizeof (uint32_t));
+    rexcpy (&block->id,      ptr, sizeof (uint64_t));
+    block->data = NULL;
     return ptr;
 }
+
+uint8_t *rex_block_skip (uint8_t *ptr)
+{
+    MEM_CHECK (ptr);
+
+    uint32_t sz;
+    memcpy (&sz, ptr + 2 * sizeof (uint16_t), sizeof (uint32_t));
+    return ptr + REX_BLOCK_HEADER_SIZE + sz;
+}
+
+void rex_block_iter_init (struct rex_block_iter *it, uint8_t *buf, uint64_t sz, const struct rex_header *header)
+{
+    if (!it) return;
+
+    it->ptr = NULL;
+    it->end = NULL;
+    it->remaining = 0;
+    it->trusted = header && header->trusted;
+    if (buf && header && header->start_addr <= sz)
+    {
+        it->ptr = buf + header->start_addr;
+        it->end = buf + sz;
+        it->remaining = rex_header_nr_datablocks (header);
+    }
+    rex_block_iter_filter (it, REX_BLOCK_MASK_ALL, NULL, 0);
+}
+
+void rex_block_iter_filter (struct rex_block_iter *it, uint32_t type_mask, const uint64_t *ids, uint32_t nr_ids)
+{
+    if (!it) return;
+
+    it->type_mask = type_mask;
+    it->ids = ids;
+    it->nr_ids = nr_ids;
+}
+
+static int iter_has_id (const struct rex_block_iter *it, uint64_t id)
+{
+    if (!it->ids)
+        return 1;
+
+    uint32_t lo = 0;
+    uint32_t hi = it->nr_ids;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (it->ids[mid] < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < it->nr_ids && it->ids[lo] == id;
+}
+
+uint8_t *rex_block_iter_next (struct rex_block_iter *it, struct rex_block *block)
+{
+    MEM_CHECK (it);
+    MEM_CHECK (block);
+
+    while (it->remaining > 0 && it->ptr)
+    {
+        if (!it->trusted && it->end - it->ptr < REX_BLOCK_HEADER_SIZE)
+        {
+            warn ("REX block header exceeds the buffer");
+            break;
+        }
+
+        uint8_t *start = it->ptr;
+        rex_block_peek (start, block);
+        if (!it->trusted && (uint64_t) (it->end - start) - REX_BLOCK_HEADER_SIZE < block->sz)
+        {
+            warn ("REX block %lu exceeds the buffer", block->id);
+            break;
+        }
+        it->ptr = start + REX_BLOCK_HEADER_SIZE + block->sz;
+        it->remaining--;
+
+        int type_ok = (block->type < 32) ? (it->type_mask & REX_BLOCK_MASK (block->type)) != 0
+                                          : it->type_mask == REX_BLOCK_MASK_ALL;
+        if (type_ok && iter_has_id (it, block->id))
+            return start;
+    }
+
+    it->remaining = 0;
+    return NULL;
+}
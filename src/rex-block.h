@@ -39,6 +39,9 @@
 extern "C" {
 #endif
 
+struct rex_arena;
+struct rex_header;
+
 /**
  * List of currently supported REX data blocks
  */
@@ -51,7 +54,10 @@ enum rex_block_type
     Image            = 4,
     MaterialStandard = 5,
     SceneNode        = 6,
-    Track            = 7
+    Track            = 7,
+    Index            = 8, //<! table of contents, not counted as data block (see rex-index.h)
+    Group            = 9, //<! list of blocks which form one object (see rex-block-group.h)
+    Compressed       = 10 //<! any other block with compressed payload (see rex-block-compressed.h)
 };
 
 /**
@@ -80,6 +86,24 @@ struct rex_block
  */
 uint8_t *rex_block_read (uint8_t *ptr, struct rex_block *block);
 
+/**
+ * Same as rex_block_read, but the block data and all of its arrays are allocated from
+ * the given arena (see rex-arena.h). The memory is released together with the arena,
+ * rex_block_free must not be called for such blocks. If arena is NULL, the installed allocator is used (see rex-alloc.h).
+ *
+ * \param ptr the pointer which points to the beginning of a block
+ * \param block the actual REX block which contains the block payload data
+ * \param arena the arena for all allocations or NULL
+ * \return the pointer to the end of this block
+ */
+uint8_t *rex_block_read_arena (uint8_t *ptr, struct rex_block *block, struct rex_arena *arena);
+
+/**
+ * Frees the block data which was allocated by rex_block_read, including all arrays
+ * of the block payload. Afterwards block->data is NULL.
+ */
+void rex_block_free (struct rex_block *block);
+
 /**
  * Writes the block header to the given pointer and returns the pointer to the
  * data after the block. The ptr must point to allocated memory. The data pointer
@@ -91,6 +115,83 @@ uint8_t *rex_block_read (uint8_t *ptr, struct rex_block *block);
  */
 uint8_t *rex_block_header_write (uint8_t *ptr, struct rex_block *block);
 
+/**
+ * Reads only the block header from the given data block pointer. The payload is not
+ * touched and block->data is set to NULL.
+ *
+ * \param ptr the pointer which points to the beginning of a block
+ * \param block the block which gets the header information
+ * \return the pointer to the beginning of the block payload
+ */
+uint8_t *rex_block_peek (uint8_t *ptr, struct rex_block *block);
+
+/**
+ * Skips the complete block without touching the payload.
+ *
+ * \param ptr the pointer which points to the beginning of a block
+ * \return the pointer to the next block
+ */
+uint8_t *rex_block_skip (uint8_t *ptr);
+
+/**
+ * Bit mask for the given rex_block_type which can be used as filter for rex_block_iter
+ */
+#define REX_BLOCK_MASK(type) (1u << (type))
+
+/**
+ * Filter which matches all block types
+ */
+#define REX_BLOCK_MASK_ALL 0xffffffffu
+
+/**
+ * Iterator over the data blocks of a REX file in memory. Only the 16 byte block headers
+ * are read, the iterator advances by the block size and never touches payload bytes.
+ * Therefore the cost of a scan is bounded by the number of blocks, not by the file size,
+ * which makes it a good fit for memory-mapped files (see rex-map.h).
+ */
+struct rex_block_iter
+{
+    uint8_t *ptr;          //<! the next block header
+    uint8_t *end;          //<! the end of the buffer
+    uint32_t remaining;    //<! the number of blocks which are not visited yet
+    uint32_t type_mask;    //<! the accepted block types (see REX_BLOCK_MASK)
+    const uint64_t *ids;   //<! the accepted block ids in ascending order, NULL accepts all ids
+    uint32_t nr_ids;       //<! the number of ids
+    int trusted;           //<! the buffer has been validated, the bounds checks are skipped (see rex-validate.h)
+};
+
+/**
+ * Initializes the iterator with the first data block of the file. No filter is set.
+ *
+ * \param it the iterator
+ * \param buf pointer to the beginning of the REX file
+ * \param sz size of the buffer
+ * \param header the REX header which has already been read from buf
+ */
+void rex_block_iter_init (struct rex_block_iter *it, uint8_t *buf, uint64_t sz, const struct rex_header *header);
+
+/**
+ * Sets the filter of the iterator. Only blocks whose type is contained in type_mask
+ * and whose id is contained in ids are returned.
+ *
+ * \param it the iterator
+ * \param type_mask combination of REX_BLOCK_MASK values, use REX_BLOCK_MASK_ALL to accept all types
+ * \param ids array of ids sorted in ascending order, NULL accepts all ids
+ * \param nr_ids the number of ids
+ */
+void rex_block_iter_filter (struct rex_block_iter *it, uint32_t type_mask, const uint64_t *ids, uint32_t nr_ids);
+
+/**
+ * Advances to the next block which matches the filter. The block gets filled with the
+ * header information only (see rex_block_peek). Use rex_block_read on the returned
+ * pointer to decode the payload.
+ *
+ * \param it the iterator
+ * \param block the block which gets the header information
+ * \return the pointer to the beginning of the block or NULL if there are no more blocks
+ */
+uint8_t *rex_block_iter_next (struct rex_block_iter *it, struct rex_block *block);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,287 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <float.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "global.h"
+#include "rex-bounds.h"
+#include "status.h"
+#include "util.h"
+
+// number of elements which are reduced by one task
+#define BOUNDS_CHUNK (1u << 20)
+
+// the maximum number of components of an attribute
+#define MAX_COMPONENTS 4
+
+struct reduce_ctx
+{
+    const float *data;
+    uint64_t n;
+    uint32_t comps;
+    float *min;        // MAX_COMPONENTS values per chunk
+    float *max;
+    double *sum;
+};
+
+static void range_init (uint32_t comps, float *min, float *max)
+{
+    for (uint32_t c = 0; c < comps; c++)
+    {
+        min[c] = FLT_MAX;
+        max[c] = -FLT_MAX;
+    }
+}
+
+#ifdef __SSE2__
+/**
+ * Reduces blocks of 4 * regs floats. Lane j of register r always holds component
+ * (4 * r + j) % comps, for 3 components the pattern repeats after 3 registers.
+ */
+static inline uint64_t range_sse (const float *data, uint64_t total, uint32_t comps, uint32_t regs,
+                                  float *min, float *max)
+{
+    __m128 lo[3], hi[3];
+    for (uint32_t r = 0; r < regs; r++)
+    {
+        lo[r] = _mm_set1_ps (FLT_MAX);
+        hi[r] = _mm_set1_ps (-FLT_MAX);
+    }
+
+    uint64_t i = 0;
+    for (; i + 4 * regs <= total; i += 4 * regs)
+        for (uint32_t r = 0; r < regs; r++)
+        {
+            // the accumulator is the second operand, so NaN values are skipped
+            __m128 v = _mm_loadu_ps (data + i + 4 * r);
+            lo[r] = _mm_min_ps (v, lo[r]);
+            hi[r] = _mm_max_ps (v, hi[r]);
+        }
+
+    float l[12], h[12];
+    for (uint32_t r = 0; r < regs; r++)
+    {
+        _mm_storeu_ps (l + 4 * r, lo[r]);
+        _mm_storeu_ps (h + 4 * r, hi[r]);
+    }
+    for (uint32_t k = 0; k < 4 * regs; k++)
+    {
+        uint32_t c = k % comps;
+        if (l[k] < min[c]) min[c] = l[k];
+        if (h[k] > max[c]) max[c] = h[k];
+    }
+    return i;
+}
+
+static inline uint64_t sum_sse (const float *data, uint64_t total, uint32_t comps, uint32_t regs, double *sum)
+{
+    __m128d s[6];
+    for (uint32_t r = 0; r < 2 * regs; r++)
+        s[r] = _mm_setzero_pd ();
+
+    uint64_t i = 0;
+    for (; i + 4 * regs <= total; i += 4 * regs)
+        for (uint32_t r = 0; r < regs; r++)
+        {
+            __m128 v = _mm_loadu_ps (data + i + 4 * r);
+            s[2 * r] = _mm_add_pd (s[2 * r], _mm_cvtps_pd (v));
+            s[2 * r + 1] = _mm_add_pd (s[2 * r + 1], _mm_cvtps_pd (_mm_movehl_ps (v, v)));
+        }
+
+    double d[12];
+    for (uint32_t r = 0; r < 2 * regs; r++)
+        _mm_storeu_pd (d + 2 * r, s[r]);
+    for (uint32_t k = 0; k < 4 * regs; k++)
+        sum[k % comps] += d[k];
+    return i;
+}
+#endif
+
+/**
+ * Computes the range of n elements, min and max must be initialized
+ */
+static void range_kernel (const float *data, uint64_t n, uint32_t comps, float *min, float *max)
+{
+    uint64_t total = n * comps;
+    uint64_t i = 0;
+#ifdef __SSE2__
+    i = (comps == 3) ? range_sse (data, total, 3, 3, min, max) : range_sse (data, total, comps, 1, min, max);
+#endif
+    for (; i < total; i++)
+    {
+        uint32_t c = i % comps;
+        if (data[i] < min[c]) min[c] = data[i];
+        if (data[i] > max[c]) max[c] = data[i];
+    }
+}
+
+/**
+ * Adds the components of n elements to sum
+ */
+static void sum_kernel (const float *data, uint64_t n, uint32_t comps, double *sum)
+{
+    uint64_t total = n * comps;
+    uint64_t i = 0;
+#ifdef __SSE2__
+    i = (comps == 3) ? sum_sse (data, total, 3, 3, sum) : sum_sse (data, total, comps, 1, sum);
+#endif
+    for (; i < total; i++)
+        sum[i % comps] += data[i];
+}
+
+static uint64_t chunk_size (const struct reduce_ctx *ctx, uint32_t i)
+{
+    uint64_t begin = (uint64_t) i * BOUNDS_CHUNK;
+    return (ctx->n - begin > BOUNDS_CHUNK) ? BOUNDS_CHUNK : ctx->n - begin;
+}
+
+static void range_task (void *arg, uint32_t i)
+{
+    struct reduce_ctx *ctx = arg;
+    float *min = &ctx->min[i * MAX_COMPONENTS];
+    float *max = &ctx->max[i * MAX_COMPONENTS];
+    range_init (ctx->comps, min, max);
+    range_kernel (ctx->data + (uint64_t) i * BOUNDS_CHUNK * ctx->comps, chunk_size (ctx, i), ctx->comps, min, max);
+}
+
+static void sum_task (void *arg, uint32_t i)
+{
+    struct reduce_ctx *ctx = arg;
+    double *sum = &ctx->sum[i * MAX_COMPONENTS];
+    memset (sum, 0, MAX_COMPONENTS * sizeof (double));
+    sum_kernel (ctx->data + (uint64_t) i * BOUNDS_CHUNK * ctx->comps, chunk_size (ctx, i), ctx->comps, sum);
+}
+
+/**
+ * Returns the number of chunks for a parallel reduction or 0 if the array is reduced serially
+ */
+static uint32_t chunks_count (uint64_t n, struct rex_thread_pool *pool)
+{
+    uint64_t nr_chunks = (n + BOUNDS_CHUNK - 1) / BOUNDS_CHUNK;
+    return (pool && nr_chunks > 1 && nr_chunks <= UINT32_MAX) ? (uint32_t) nr_chunks : 0;
+}
+
+void rex_bounds_init (struct rex_bounds *b)
+{
+    if (!b) return;
+    range_init (3, b->min, b->max);
+}
+
+int rex_bounds_is_empty (const struct rex_bounds *b)
+{
+    return !b || b->min[0] > b->max[0] || b->min[1] > b->max[1] || b->min[2] > b->max[2];
+}
+
+void rex_bounds_union (struct rex_bounds *r, const struct rex_bounds *a, const struct rex_bounds *b)
+{
+    if (!r || !a || !b) return;
+
+    for (int c = 0; c < 3; c++)
+    {
+        r->min[c] = (b->min[c] < a->min[c]) ? b->min[c] : a->min[c];
+        r->max[c] = (b->max[c] > a->max[c]) ? b->max[c] : a->max[c];
+    }
+}
+
+int rex_bounds_calc (const float *positions, uint64_t n, struct rex_thread_pool *pool, struct rex_bounds *b)
+{
+    if (!b)
+        return REX_MISSING_PARAMETER;
+    return rex_attribute_range (positions, n, 3, pool, b->min, b->max);
+}
+
+int rex_attribute_range (const float *data, uint64_t n, uint32_t comps, struct rex_thread_pool *pool,
+                         float *min, float *max)
+{
+    if ((!data && n) || !min || !max)
+        return REX_MISSING_PARAMETER;
+    if (comps < 1 || comps > MAX_COMPONENTS)
+    {
+        warn ("Invalid number of attribute components %u", comps);
+        return REX_ERROR_INVALID_DATA;
+    }
+
+    range_init (comps, min, max);
+    uint32_t nr_chunks = chunks_count (n, pool);
+    if (!nr_chunks)
+    {
+        range_kernel (data, n, comps, min, max);
+        return REX_OK;
+    }
+
+    struct reduce_ctx ctx = { .data = data, .n = n, .comps = comps };
+    ctx.min = rex_malloc ((size_t) nr_chunks * MAX_COMPONENTS * sizeof (float));
+    ctx.max = rex_malloc ((size_t) nr_chunks * MAX_COMPONENTS * sizeof (float));
+    if (!ctx.min || !ctx.max)
+    {
+        FREE (ctx.min);
+        FREE (ctx.max);
+        return REX_ERROR_MEMORY;
+    }
+
+    rex_parallel_for (pool, nr_chunks, range_task, &ctx);
+    for (uint32_t i = 0; i < nr_chunks; i++)
+        for (uint32_t c = 0; c < comps; c++)
+        {
+            if (ctx.min[i * MAX_COMPONENTS + c] < min[c]) min[c] = ctx.min[i * MAX_COMPONENTS + c];
+            if (ctx.max[i * MAX_COMPONENTS + c] > max[c]) max[c] = ctx.max[i * MAX_COMPONENTS + c];
+        }
+
+    FREE (ctx.min);
+    FREE (ctx.max);
+    return REX_OK;
+}
+
+int rex_centroid_calc (const float *positions, uint64_t n, struct rex_thread_pool *pool, float *centroid)
+{
+    if ((!positions && n) || !centroid)
+        return REX_MISSING_PARAMETER;
+
+    double sum[MAX_COMPONENTS] = { 0.0 };
+    struct reduce_ctx ctx = { .data = positions, .n = n, .comps = 3 };
+    uint32_t nr_chunks = chunks_count (n, pool);
+    if (!nr_chunks)
+    {
+        // the chunks are summed up separately as in the parallel case, so the result is the same
+        for (uint64_t begin = 0; begin < n; begin += BOUNDS_CHUNK)
+        {
+            double chunk[MAX_COMPONENTS] = { 0.0 };
+            sum_kernel (positions + begin * 3, chunk_size (&ctx, begin / BOUNDS_CHUNK), 3, chunk);
+            for (int c = 0; c < 3; c++)
+                sum[c] += chunk[c];
+        }
+    }
+    else
+    {
+        ctx.sum = rex_malloc ((size_t) nr_chunks * MAX_COMPONENTS * sizeof (double));
+        if (!ctx.sum)
+            return REX_ERROR_MEMORY;
+
+        rex_parallel_for (pool, nr_chunks, sum_task, &ctx);
+        for (uint32_t i = 0; i < nr_chunks; i++)
+            for (int c = 0; c < 3; c++)
+                sum[c] += ctx.sum[i * MAX_COMPONENTS + c];
+        FREE (ctx.sum);
+    }
+
+    for (int c = 0; c < 3; c++)
+        centroid[c] = n ? (float) (sum[c] / n) : 0.0f;
+    return REX_OK;
+}
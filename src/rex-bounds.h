@@ -0,0 +1,103 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Bounding boxes, centroids and value ranges of vertex attributes
+ *
+ * The reductions run over interleaved float arrays (e.g. 3 floats per position). With SSE2
+ * four floats are processed per instruction without deinterleaving the components, so the
+ * loops are limited by the memory bandwidth. Large arrays are split into chunks which are
+ * reduced on the threads of a pool; the chunk results are combined in a fixed order, so the
+ * result does not depend on the number of threads or on whether a pool is used at all.
+ *
+ * NaN values are ignored by the bounds and ranges. An empty bounding box has min = FLT_MAX
+ * and max = -FLT_MAX, so it can be extended with rex_bounds_union.
+ */
+
+#include <stdint.h>
+
+#include "rex-thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * An axis-aligned bounding box
+ */
+struct rex_bounds
+{
+    float min[3]; //<! the minimum of x, y and z
+    float max[3]; //<! the maximum of x, y and z
+};
+
+/**
+ * Sets the bounding box to empty
+ */
+void rex_bounds_init (struct rex_bounds *b);
+
+/**
+ * Returns != 0 if the bounding box does not contain any point
+ */
+int rex_bounds_is_empty (const struct rex_bounds *b);
+
+/**
+ * Computes the bounding box which contains both a and b, r can be the same as a or b.
+ */
+void rex_bounds_union (struct rex_bounds *r, const struct rex_bounds *a, const struct rex_bounds *b);
+
+/**
+ * Computes the bounding box of n positions.
+ *
+ * \param positions the array of 3 * n floats (x, y, z)
+ * \param n the number of positions
+ * \param pool the thread pool for large arrays, NULL runs on the calling thread
+ * \param b the bounding box which gets filled, empty if n is 0
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_bounds_calc (const float *positions, uint64_t n, struct rex_thread_pool *pool, struct rex_bounds *b);
+
+/**
+ * Computes the centroid (the mean) of n positions. The sums are accumulated in double precision.
+ *
+ * \param positions the array of 3 * n floats (x, y, z)
+ * \param n the number of positions
+ * \param pool the thread pool for large arrays, NULL runs on the calling thread
+ * \param centroid the 3 floats which get filled, (0, 0, 0) if n is 0
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_centroid_calc (const float *positions, uint64_t n, struct rex_thread_pool *pool, float *centroid);
+
+/**
+ * Computes the minimum and maximum of every component of an interleaved attribute
+ * (e.g. 2 for texture coordinates, 3 for colors).
+ *
+ * \param data the array of comps * n floats
+ * \param n the number of elements
+ * \param comps the number of components per element (1 to 4)
+ * \param pool the thread pool for large arrays, NULL runs on the calling thread
+ * \param min the comps floats which get the minimum, FLT_MAX if n is 0
+ * \param max the comps floats which get the maximum, -FLT_MAX if n is 0
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_attribute_range (const float *data, uint64_t n, uint32_t comps, struct rex_thread_pool *pool,
+                         float *min, float *max);
+
+#ifdef __cplusplus
+}
+#endif
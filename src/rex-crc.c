@@ -0,0 +1,219 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <pthread.h>
+#include <string.h>
+
+#include "global.h"
+#include "rex-crc.h"
+#include "status.h"
+#include "util.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define REX_CRC_SSE42 1
+#endif
+
+// CRC-32C polynomial in reversed bit order
+#define CRC32C_POLY 0x82f63b78u
+
+// the hardware path processes three independent lanes of this size to hide the latency
+#define CRC_LANE_SIZE 4096
+
+static uint32_t crc_table[8][256];
+static uint32_t x2n_table[32];
+static uint32_t lane_shift;
+static uint32_t (*crc_update) (uint32_t crc, const uint8_t *p, size_t sz);
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Multiplies a and b modulo the CRC polynomial (reversed bit order, x^0 is the top bit)
+ */
+static uint32_t multmodp (uint32_t a, uint32_t b)
+{
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+    for (;;)
+    {
+        if (a & m)
+        {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+/**
+ * Returns x^(n * 2^k) modulo the CRC polynomial
+ */
+static uint32_t x2nmodp (uint64_t n, unsigned k)
+{
+    uint32_t p = 1u << 31;
+    while (n)
+    {
+        if (n & 1)
+            p = multmodp (x2n_table[k & 31], p);
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
+
+/**
+ * Slicing-by-8, processes 8 bytes per table lookup round
+ */
+static uint32_t crc32c_sw (uint32_t crc, const uint8_t *p, size_t sz)
+{
+    while (sz && ((uintptr_t) p & 7))
+    {
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        sz--;
+    }
+
+    while (sz >= 8)
+    {
+        uint64_t w;
+        memcpy (&w, p, 8);
+        w ^= crc;
+        crc = crc_table[7][w & 0xff]
+              ^ crc_table[6][(w >> 8) & 0xff]
+              ^ crc_table[5][(w >> 16) & 0xff]
+              ^ crc_table[4][(w >> 24) & 0xff]
+              ^ crc_table[3][(w >> 32) & 0xff]
+              ^ crc_table[2][(w >> 40) & 0xff]
+              ^ crc_table[1][(w >> 48) & 0xff]
+              ^ crc_table[0][w >> 56];
+        p += 8;
+        sz -= 8;
+    }
+
+    while (sz--)
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef REX_CRC_SSE42
+__attribute__ ((target ("sse4.2")))
+static uint32_t crc32c_sse42 (uint32_t crc, const uint8_t *p, size_t sz)
+{
+    while (sz && ((uintptr_t) p & 7))
+    {
+        crc = _mm_crc32_u8 (crc, *p++);
+        sz--;
+    }
+
+    // the crc32 instruction has a latency of 3 cycles but a throughput of 1 per cycle,
+    // so three lanes are calculated in parallel and combined afterwards
+    while (sz >= 3 * CRC_LANE_SIZE)
+    {
+        uint64_t a = crc;
+        uint64_t b = 0;
+        uint64_t c = 0;
+        for (size_t i = 0; i < CRC_LANE_SIZE; i += 8)
+        {
+            uint64_t wa, wb, wc;
+            memcpy (&wa, p + i, 8);
+            memcpy (&wb, p + CRC_LANE_SIZE + i, 8);
+            memcpy (&wc, p + 2 * CRC_LANE_SIZE + i, 8);
+            a = _mm_crc32_u64 (a, wa);
+            b = _mm_crc32_u64 (b, wb);
+            c = _mm_crc32_u64 (c, wc);
+        }
+        crc = multmodp (lane_shift, (uint32_t) a) ^ (uint32_t) b;
+        crc = multmodp (lane_shift, crc) ^ (uint32_t) c;
+        p += 3 * CRC_LANE_SIZE;
+        sz -= 3 * CRC_LANE_SIZE;
+    }
+
+    uint64_t c64 = crc;
+    while (sz >= 8)
+    {
+        uint64_t w;
+        memcpy (&w, p, 8);
+        c64 = _mm_crc32_u64 (c64, w);
+        p += 8;
+        sz -= 8;
+    }
+    crc = (uint32_t) c64;
+
+    while (sz--)
+        crc = _mm_crc32_u8 (crc, *p++);
+    return crc;
+}
+#endif
+
+static void crc_init (void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (int t = 1; t < 8; t++)
+            crc_table[t][i] = (crc_table[t - 1][i] >> 8) ^ crc_table[0][crc_table[t - 1][i] & 0xff];
+
+    // x^1, x^2, x^4, ...
+    uint32_t p = 1u << 30;
+    x2n_table[0] = p;
+    for (int n = 1; n < 32; n++)
+        x2n_table[n] = p = multmodp (p, p);
+    lane_shift = x2nmodp (CRC_LANE_SIZE, 3);
+
+    crc_update = crc32c_sw;
+#ifdef REX_CRC_SSE42
+    if (__builtin_cpu_supports ("sse4.2"))
+        crc_update = crc32c_sse42;
+#endif
+}
+
+uint32_t rex_crc32c (uint32_t crc, const void *data, size_t sz)
+{
+    if (!data || !sz)
+        return crc;
+
+    pthread_once (&crc_once, crc_init);
+    return ~crc_update (~crc, data, sz);
+}
+
+uint32_t rex_crc32c_combine (uint32_t crc1, uint32_t crc2, uint64_t sz2)
+{
+    pthread_once (&crc_once, crc_init);
+    return multmodp (x2nmodp (sz2, 3), crc1) ^ crc2;
+}
+
+int rex_crc_verify (const uint8_t *buf, uint64_t sz, const struct rex_header *header)
+{
+    if (!buf || !header)
+        return REX_MISSING_PARAMETER;
+    if (!header->crc)
+        return REX_OK;
+    if (header->start_addr > sz || header->sz_all_datablocks > sz - header->start_addr)
+        return REX_ERROR_FILE_READ;
+
+    uint32_t crc = rex_crc32c (0, buf + header->start_addr, header->sz_all_datablocks);
+    if (crc != header->crc)
+    {
+        warn ("CRC mismatch, the file is corrupt");
+        return REX_ERROR_CRC;
+    }
+    return REX_OK;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief CRC-32C checksum of the REX data blocks
+ *
+ * The crc field of the REX header stores the CRC-32C (Castagnoli polynomial) of all data
+ * blocks, i.e. of the bytes from start_addr to start_addr + sz_all_datablocks. The header,
+ * the coordinate system block and the optional index block are not covered. A value of 0
+ * means that the checksum was not calculated (older files).
+ *
+ * The checksum is calculated with the SSE4.2 crc32 instruction if the processor supports
+ * it (detected at runtime), otherwise a slicing-by-8 table implementation is used.
+ * CRCs of adjacent pieces of data can be combined with rex_crc32c_combine, this is how
+ * the writers accumulate the checksum block by block.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rex-header.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Updates the CRC-32C with the given data. Start with crc = 0.
+ *
+ * \param crc the CRC of the preceding data (0 for the first call)
+ * \param data the data
+ * \param sz the size of the data in bytes
+ * \return the CRC of the preceding data and data
+ */
+uint32_t rex_crc32c (uint32_t crc, const void *data, size_t sz);
+
+/**
+ * Combines two CRCs. crc1 is the CRC of a sequence A, crc2 the CRC of a sequence B
+ * with the length sz2. The result is the CRC of A followed by B.
+ */
+uint32_t rex_crc32c_combine (uint32_t crc1, uint32_t crc2, uint64_t sz2);
+
+/**
+ * Verifies the crc field of the header against the data blocks of a complete file.
+ *
+ * \param buf pointer to the beginning of the REX file
+ * \param sz size of the buffer
+ * \param header the REX header which has already been read from buf
+ * \return REX_OK if the CRC matches or is not set, REX_ERROR_CRC if it does not match,
+ *         else an error code (see status.h)
+ */
+int rex_crc_verify (const uint8_t *buf, uint64_t sz, const struct rex_header *header);
+
+#ifdef __cplusplus
+}
+#endif
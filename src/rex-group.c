@@ -0,0 +1,773 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <string.h>
+
+#include "global.h"
+#include "rex-block-mesh-compressed.h"
+#include "rex-block-pointlist-compact.h"
+#include "rex-bounds.h"
+#include "rex-group.h"
+#include "rex-iov.h"
+#include "status.h"
+#include "util.h"
+
+/**
+ * Elements which get partitioned spatially. Every element has a position (3 floats) and
+ * optionally 12 bytes of attached data (a color or the triangle indices) which are moved
+ * together with the position.
+ */
+struct partition
+{
+    float *pos;         //<! the positions, 3 floats per element
+    uint8_t *extra;     //<! the attached data, 12 bytes per element (can be NULL)
+    uint32_t max;       //<! the maximum number of elements per part
+    uint32_t *bounds;   //<! bounds[i] is the first element of part i, bounds[nr_parts] the end
+    uint32_t nr_parts;  //<! the number of parts
+};
+
+static void partition_swap (struct partition *p, int64_t i, int64_t j)
+{
+    uint8_t tmp[12];
+    memcpy (tmp, p->pos + 3 * i, 12);
+    memcpy (p->pos + 3 * i, p->pos + 3 * j, 12);
+    memcpy (p->pos + 3 * j, tmp, 12);
+    if (p->extra)
+    {
+        memcpy (tmp, p->extra + 12 * i, 12);
+        memcpy (p->extra + 12 * i, p->extra + 12 * j, 12);
+        memcpy (p->extra + 12 * j, tmp, 12);
+    }
+}
+
+/**
+ * Reorders the elements [lo, hi) such that no element before k has a larger and no element
+ * after k has a smaller coordinate on the given axis than element k (quickselect)
+ */
+static void partition_select (struct partition *p, int64_t lo, int64_t hi, int64_t k, int axis)
+{
+    const float *pos = p->pos;
+    while (hi - lo > 1)
+    {
+        // median of three, the pivot value is always part of the range
+        float a = pos[3 * lo + axis];
+        float b = pos[3 * (lo + (hi - lo) / 2) + axis];
+        float c = pos[3 * (hi - 1) + axis];
+        float pivot = (a < b) ? ((b < c) ? b : (a < c) ? c : a) : ((a < c) ? a : (b < c) ? c : b);
+
+        int64_t i = lo;
+        int64_t j = hi - 1;
+        while (i <= j)
+        {
+            while (pos[3 * i + axis] < pivot)
+                i++;
+            while (pos[3 * j + axis] > pivot)
+                j--;
+            if (i <= j)
+                partition_swap (p, i++, j--);
+        }
+
+        if (k <= j)
+            hi = j + 1;
+        else if (k >= i)
+            lo = i;
+        else
+            return;
+    }
+}
+
+/**
+ * Returns the axis with the largest extent of the elements [begin, end)
+ */
+static int partition_axis (const struct partition *p, uint32_t begin, uint32_t end)
+{
+    struct rex_bounds b;
+    rex_bounds_calc (p->pos + 3 * (uint64_t) begin, end - begin, NULL, &b);
+
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+        if (b.max[a] - b.min[a] > b.max[axis] - b.min[axis])
+            axis = a;
+    return axis;
+}
+
+/**
+ * Splits the elements [begin, end) at the median of the longest axis until every part
+ * has at most max elements. The split position is chosen such that the parts are filled
+ * evenly and the minimum number of parts is created.
+ */
+static void partition_split (struct partition *p, uint32_t begin, uint32_t end)
+{
+    uint64_t count = end - begin;
+    if (count <= p->max)
+    {
+        p->bounds[++p->nr_parts] = end;
+        return;
+    }
+
+    uint64_t leaves = (count + p->max - 1) / p->max;
+    uint32_t k = begin + (uint32_t) (count * (leaves / 2) / leaves);
+    partition_select (p, begin, end, k, partition_axis (p, begin, end));
+    partition_split (p, begin, k);
+    partition_split (p, k, end);
+}
+
+static int partition_run (struct partition *p, float *pos, void *extra, uint32_t n, uint32_t max)
+{
+    p->pos = pos;
+    p->extra = extra;
+    p->max = max;
+    p->nr_parts = 0;
+
+    uint64_t nr = ((uint64_t) n + max - 1) / max;
+    p->bounds = rex_malloc ((nr + 2) * sizeof (uint32_t));
+    if (!p->bounds)
+        return REX_ERROR_MEMORY;
+
+    p->bounds[0] = 0;
+    partition_split (p, 0, n);
+    return REX_OK;
+}
+
+int rex_pointlist_split (struct rex_pointlist *plist, uint32_t max_points, struct rex_pointlist **parts, uint32_t *nr_parts)
+{
+    if (!plist || !max_points || !parts || !nr_parts)
+        return REX_MISSING_PARAMETER;
+    if ((plist->nr_vertices && !plist->positions)
+            || (plist->nr_colors && (plist->nr_colors != plist->nr_vertices || !plist->colors)))
+    {
+        warn ("Number of colors does not match number of vertices");
+        return REX_MISSING_PARAMETER;
+    }
+
+    struct partition p;
+    int ret = partition_run (&p, plist->positions, plist->nr_colors ? plist->colors : NULL,
+                             plist->nr_vertices, max_points);
+    if (ret != REX_OK)
+        return ret;
+
+    *parts = rex_malloc (p.nr_parts * sizeof (struct rex_pointlist));
+    if (!*parts)
+    {
+        FREE (p.bounds);
+        return REX_ERROR_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < p.nr_parts; i++)
+    {
+        struct rex_pointlist *part = &(*parts)[i];
+        uint32_t begin = p.bounds[i];
+
+        rex_pointlist_init (part);
+        part->nr_vertices = p.bounds[i + 1] - begin;
+        part->positions = plist->positions + (size_t) 3 * begin;
+        if (plist->nr_colors)
+        {
+            part->nr_colors = part->nr_vertices;
+            part->colors = plist->colors + (size_t) 3 * begin;
+        }
+    }
+
+    *nr_parts = p.nr_parts;
+    FREE (p.bounds);
+    return REX_OK;
+}
+
+/**
+ * Partitions the triangles of the mesh by their centroids
+ */
+static int mesh_partition (struct rex_mesh *mesh, uint32_t max_triangles, struct partition *p)
+{
+    if (!mesh->positions || !mesh->triangles)
+        return REX_MISSING_PARAMETER;
+
+    for (uint64_t i = 0; i < (uint64_t) mesh->nr_triangles * 3; i++)
+    {
+        if (mesh->triangles[i] >= mesh->nr_vertices)
+        {
+            warn ("Triangle index exceeds the number of vertices");
+            return REX_MISSING_PARAMETER;
+        }
+    }
+
+    float *centroids = rex_malloc ((size_t) mesh->nr_triangles * 12);
+    if (!centroids)
+        return REX_ERROR_MEMORY;
+
+    // the sum of the corners is sufficient, the order is not affected by the scale
+    for (uint64_t t = 0; t < mesh->nr_triangles; t++)
+    {
+        const uint32_t *tri = mesh->triangles + 3 * t;
+        for (int a = 0; a < 3; a++)
+            centroids[3 * t + a] = mesh->positions[3 * (size_t) tri[0] + a]
+                                   + mesh->positions[3 * (size_t) tri[1] + a]
+                                   + mesh->positions[3 * (size_t) tri[2] + a];
+    }
+
+    int ret = partition_run (p, centroids, mesh->triangles, mesh->nr_triangles, max_triangles);
+    FREE (centroids);
+    p->pos = NULL;
+    return ret;
+}
+
+/**
+ * Assigns new consecutive numbers to the vertices of the triangles [begin, end) and
+ * returns the number of vertices. Unassigned entries of remap are UINT32_MAX.
+ */
+static uint32_t mesh_remap (const struct rex_mesh *mesh, uint32_t begin, uint32_t end, uint32_t *remap)
+{
+    uint32_t nr = 0;
+    for (uint64_t i = 3 * (uint64_t) begin; i < 3 * (uint64_t) end; i++)
+    {
+        uint32_t v = mesh->triangles[i];
+        if (remap[v] == UINT32_MAX)
+            remap[v] = nr++;
+    }
+    return nr;
+}
+
+static void mesh_remap_reset (const struct rex_mesh *mesh, uint32_t begin, uint32_t end, uint32_t *remap)
+{
+    for (uint64_t i = 3 * (uint64_t) begin; i < 3 * (uint64_t) end; i++)
+        remap[mesh->triangles[i]] = UINT32_MAX;
+}
+
+/**
+ * Creates a mesh of the triangles [begin, end) containing the referenced vertices only
+ */
+static int mesh_extract (const struct rex_mesh *mesh, uint32_t begin, uint32_t end, uint32_t *remap, struct rex_mesh *part)
+{
+    rex_mesh_init (part);
+    part->lod = mesh->lod;
+    part->max_lod = mesh->max_lod;
+    part->material_id = mesh->material_id;
+    memcpy (part->name, mesh->name, REX_MESH_NAME_MAX_SIZE);
+
+    part->nr_vertices = mesh_remap (mesh, begin, end, remap);
+    part->nr_triangles = end - begin;
+
+    size_t nr = part->nr_vertices;
+    part->positions = rex_malloc (nr * 12);
+    part->triangles = rex_malloc ((size_t) part->nr_triangles * 12);
+    if (mesh->normals)
+        part->normals = rex_malloc (nr * 12);
+    if (mesh->tex_coords)
+        part->tex_coords = rex_malloc (nr * 8);
+    if (mesh->colors)
+        part->colors = rex_malloc (nr * 12);
+
+    if (!part->positions || !part->triangles
+            || (mesh->normals && !part->normals)
+            || (mesh->tex_coords && !part->tex_coords)
+            || (mesh->colors && !part->colors))
+    {
+        mesh_remap_reset (mesh, begin, end, remap);
+        rex_mesh_free (part);
+        return REX_ERROR_MEMORY;
+    }
+
+    for (uint64_t i = 3 * (uint64_t) begin; i < 3 * (uint64_t) end; i++)
+    {
+        size_t v = mesh->triangles[i];
+        size_t r = remap[v];
+        part->triangles[i - 3 * (uint64_t) begin] = (uint32_t) r;
+
+        memcpy (part->positions + 3 * r, mesh->positions + 3 * v, 12);
+        if (mesh->normals)
+            memcpy (part->normals + 3 * r, mesh->normals + 3 * v, 12);
+        if (mesh->tex_coords)
+            memcpy (part->tex_coords + 2 * r, mesh->tex_coords + 2 * v, 8);
+        if (mesh->colors)
+            memcpy (part->colors + 3 * r, mesh->colors + 3 * v, 12);
+    }
+
+    mesh_remap_reset (mesh, begin, end, remap);
+    return REX_OK;
+}
+
+static uint32_t *remap_create (uint32_t nr_vertices)
+{
+    uint32_t *remap = rex_malloc (((size_t) nr_vertices + 1) * sizeof (uint32_t));
+    if (remap)
+        memset (remap, 0xff, (size_t) nr_vertices * sizeof (uint32_t));
+    return remap;
+}
+
+int rex_mesh_split (struct rex_mesh *mesh, uint32_t max_triangles, struct rex_mesh **parts, uint32_t *nr_parts)
+{
+    if (!mesh || !max_triangles || !parts || !nr_parts)
+        return REX_MISSING_PARAMETER;
+
+    struct partition p;
+    int ret = mesh_partition (mesh, max_triangles, &p);
+    if (ret != REX_OK)
+        return ret;
+
+    uint32_t *remap = remap_create (mesh->nr_vertices);
+    *parts = rex_malloc (p.nr_parts * sizeof (struct rex_mesh));
+    if (!remap || !*parts)
+    {
+        FREE (remap);
+        FREE (*parts);
+        FREE (p.bounds);
+        return REX_ERROR_MEMORY;
+    }
+
+    uint32_t i;
+    for (i = 0; i < p.nr_parts && ret == REX_OK; i++)
+        ret = mesh_extract (mesh, p.bounds[i], p.bounds[i + 1], remap, &(*parts)[i]);
+
+    if (ret != REX_OK)
+    {
+        // the failed part is already released
+        for (uint32_t j = 0; j + 1 < i; j++)
+            rex_mesh_free (&(*parts)[j]);
+        FREE (*parts);
+    }
+    else
+        *nr_parts = p.nr_parts;
+
+    FREE (remap);
+    FREE (p.bounds);
+    return ret;
+}
+
+void rex_group_writer_init (struct rex_group_writer *w, int fd, struct rex_header *header, struct rex_index *idx)
+{
+    if (!w) return;
+
+    w->fd = fd;
+    w->header = header;
+    w->idx = idx;
+    w->offset = REX_HEADER_SIZE + (header ? header->sz_all_datablocks : 0);
+    w->max_block_sz = REX_BLOCK_MAX_SIZE;
+    w->pointlist_bits = 0;
+}
+
+/**
+ * Writes the block at the current offset and releases the block
+ */
+static int writer_write_iov (struct rex_group_writer *w, struct rex_block_iov *biov)
+{
+    int ret = rex_file_writev (w->fd, w->offset, biov->iov, biov->nr_iov);
+    if (ret == REX_OK)
+    {
+        rex_index_add_block (w->idx, biov->head);
+        w->offset += biov->sz;
+    }
+    rex_block_iov_free (biov);
+    return ret;
+}
+
+/**
+ * Writes a serialized block at the current offset and releases the buffer
+ */
+static int writer_write_buffer (struct rex_group_writer *w, uint8_t *ptr, long sz)
+{
+    struct rex_iov iov = { ptr, sz };
+    int ret = rex_file_writev (w->fd, w->offset, &iov, 1);
+    if (ret == REX_OK)
+    {
+        rex_index_add_block (w->idx, ptr);
+        w->offset += sz;
+    }
+    FREE (ptr);
+    return ret;
+}
+
+/**
+ * Writes a group block with the given id, the members have the following ids
+ */
+static int writer_write_group (struct rex_group_writer *w, uint64_t id, uint32_t nr_members)
+{
+    struct rex_group group;
+    group.nr_members = nr_members;
+    group.members = rex_malloc (nr_members * sizeof (uint64_t));
+    if (!group.members)
+        return REX_ERROR_MEMORY;
+    for (uint32_t i = 0; i < nr_members; i++)
+        group.members[i] = id + 1 + i;
+
+    long sz;
+    uint8_t *ptr = rex_block_write_group (id, w->header, &group, &sz);
+    rex_group_free (&group);
+    if (!ptr)
+        return REX_ERROR_MEMORY;
+    return writer_write_buffer (w, ptr, sz);
+}
+
+/**
+ * Writes a pointlist block, either referencing the arrays or as compact block
+ */
+static int writer_write_pointlist (struct rex_group_writer *w, uint64_t id, struct rex_pointlist *plist)
+{
+    if (w->pointlist_bits)
+    {
+        long sz;
+        uint8_t *ptr = rex_block_write_pointlist_compact (id, w->header, plist, w->pointlist_bits, &sz);
+        if (!ptr)
+            return REX_ERROR_BLOCK_SIZE;
+        return writer_write_buffer (w, ptr, sz);
+    }
+
+    struct rex_block_iov biov;
+    int ret = rex_block_iov_pointlist (id, w->header, plist, &biov);
+    if (ret == REX_OK)
+        ret = writer_write_iov (w, &biov);
+    return ret;
+}
+
+int rex_group_write_pointlist (struct rex_group_writer *w, uint64_t *id, struct rex_pointlist *plist)
+{
+    if (!w || !id || !plist)
+        return REX_MISSING_PARAMETER;
+
+    if (w->pointlist_bits != 0 && w->pointlist_bits != 16 && w->pointlist_bits != 32)
+        return REX_MISSING_PARAMETER;
+
+    uint64_t header_sz = 2 * sizeof (uint32_t);
+    uint64_t point_sz = 12;
+    uint64_t color_sz = 12;
+    if (w->pointlist_bits)
+    {
+        header_sz = REX_POINTLIST_COMPACT_HEADER_SIZE;
+        point_sz = 3 * (w->pointlist_bits / 8);
+        color_sz = 3;
+    }
+    if (plist->nr_colors)
+        point_sz += color_sz;
+
+    if (header_sz + (uint64_t) plist->nr_vertices * point_sz <= w->max_block_sz)
+    {
+        int ret = writer_write_pointlist (w, *id, plist);
+        if (ret == REX_OK)
+            (*id)++;
+        return ret;
+    }
+
+    if (w->max_block_sz < header_sz + point_sz)
+        return REX_ERROR_BLOCK_SIZE;
+
+    struct rex_pointlist *parts;
+    uint32_t nr_parts;
+    int ret = rex_pointlist_split (plist, (w->max_block_sz - header_sz) / point_sz, &parts, &nr_parts);
+    if (ret != REX_OK)
+        return ret;
+
+    ret = writer_write_group (w, *id, nr_parts);
+    for (uint32_t i = 0; i < nr_parts && ret == REX_OK; i++)
+        ret = writer_write_pointlist (w, *id + 1 + i, &parts[i]);
+
+    FREE (parts);
+    if (ret == REX_OK)
+        *id += 1 + nr_parts;
+    return ret;
+}
+
+int rex_group_write_mesh (struct rex_group_writer *w, uint64_t *id, struct rex_mesh *mesh)
+{
+    if (!w || !id || !mesh)
+        return REX_MISSING_PARAMETER;
+
+    struct rex_block_iov biov;
+    uint64_t payload = rex_block_size_mesh (mesh) - REX_BLOCK_HEADER_SIZE;
+    if (payload <= w->max_block_sz)
+    {
+        int ret = rex_block_iov_mesh (*id, w->header, mesh, &biov);
+        if (ret == REX_OK)
+            ret = writer_write_iov (w, &biov);
+        if (ret == REX_OK)
+            (*id)++;
+        return ret;
+    }
+
+    if (!mesh->nr_triangles || w->max_block_sz <= REX_MESH_HEADER_SIZE)
+    {
+        warn ("Mesh exceeds the maximum block size and cannot be split");
+        return REX_ERROR_BLOCK_SIZE;
+    }
+
+    uint64_t vertex_sz = 12 + (mesh->normals ? 12 : 0) + (mesh->tex_coords ? 8 : 0) + (mesh->colors ? 12 : 0);
+    uint64_t budget = w->max_block_sz - REX_MESH_HEADER_SIZE;
+
+    // estimate the triangles per part by the average number of vertices per triangle, the
+    // vertices at the borders of the parts get duplicated
+    double ratio = 1.25 * mesh->nr_vertices / mesh->nr_triangles;
+    if (ratio > 3.0)
+        ratio = 3.0;
+    uint64_t max_triangles = budget / (12 + vertex_sz * ratio);
+    if (max_triangles > UINT32_MAX)
+        max_triangles = UINT32_MAX;
+
+    uint32_t *remap = remap_create (mesh->nr_vertices);
+    if (!remap)
+        return REX_ERROR_MEMORY;
+
+    struct partition p = { .bounds = NULL };
+    int ret = REX_OK;
+    for (;;)
+    {
+        if (!max_triangles)
+        {
+            ret = REX_ERROR_BLOCK_SIZE;
+            break;
+        }
+
+        ret = mesh_partition (mesh, max_triangles, &p);
+        if (ret != REX_OK)
+            break;
+
+        int fits = 1;
+        for (uint32_t i = 0; i < p.nr_parts && fits; i++)
+        {
+            uint32_t nr_vertices = mesh_remap (mesh, p.bounds[i], p.bounds[i + 1], remap);
+            mesh_remap_reset (mesh, p.bounds[i], p.bounds[i + 1], remap);
+            fits = (uint64_t) nr_vertices * vertex_sz + (uint64_t) (p.bounds[i + 1] - p.bounds[i]) * 12 <= budget;
+        }
+        if (fits)
+            break;
+
+        FREE (p.bounds);
+        max_triangles /= 2;
+    }
+
+    if (ret == REX_OK)
+        ret = writer_write_group (w, *id, p.nr_parts);
+
+    // the parts are created one after the other to limit the memory usage
+    for (uint32_t i = 0; i < p.nr_parts && ret == REX_OK; i++)
+    {
+        struct rex_mesh part;
+        ret = mesh_extract (mesh, p.bounds[i], p.bounds[i + 1], remap, &part);
+        if (ret != REX_OK)
+            break;
+        ret = rex_block_iov_mesh (*id + 1 + i, w->header, &part, &biov);
+        if (ret == REX_OK)
+            ret = writer_write_iov (w, &biov);
+        rex_mesh_free (&part);
+    }
+
+    if (ret == REX_OK)
+        *id += 1 + p.nr_parts;
+    FREE (p.bounds);
+    FREE (remap);
+    return ret;
+}
+
+/**
+ * Returns the member block if it exists and has the given type, else NULL
+ */
+static uint8_t *group_member (uint8_t *buf, const struct rex_index *idx, uint64_t id, uint16_t type, uint32_t *sz,
+                              uint16_t *version)
+{
+    const struct rex_index_entry *e = rex_index_find (idx, id);
+    if (!e || e->type != type)
+    {
+        warn ("Group member %lu is missing or has a different type", (unsigned long) id);
+        return NULL;
+    }
+    *sz = e->sz;
+    *version = e->version;
+    return buf + e->offset;
+}
+
+static int group_read_pointlist (uint8_t *buf, const struct rex_index *idx, const struct rex_group *group, struct rex_pointlist *plist)
+{
+    // the counts are peeked from the member headers to allocate the final arrays once
+    uint64_t nr_vertices = 0;
+    int colors = 1;
+    for (uint32_t i = 0; i < group->nr_members; i++)
+    {
+        uint32_t sz;
+        uint16_t version;
+        uint8_t *ptr = group_member (buf, idx, group->members[i], PointList, &sz, &version);
+        if (!ptr || sz < 2 * sizeof (uint32_t))
+            return REX_ERROR_FILE_READ;
+
+        // compact blocks are validated by the decoder
+        uint32_t counts[2];
+        memcpy (counts, ptr + REX_BLOCK_HEADER_SIZE, sizeof (counts));
+        if (version != REX_POINTLIST_VERSION_COMPACT
+                && 2 * sizeof (uint32_t) + ((uint64_t) counts[0] + counts[1]) * 12 > sz)
+            return REX_ERROR_FILE_READ;
+        nr_vertices += counts[0];
+        colors &= (counts[1] == counts[0]);
+    }
+    if (nr_vertices > UINT32_MAX)
+        return REX_ERROR_BLOCK_SIZE;
+
+    plist->nr_vertices = nr_vertices;
+    plist->positions = rex_malloc ((size_t) nr_vertices * 12);
+    if (colors)
+    {
+        plist->nr_colors = nr_vertices;
+        plist->colors = rex_malloc ((size_t) nr_vertices * 12);
+    }
+    if (!plist->positions || (colors && !plist->colors))
+        return REX_ERROR_MEMORY;
+
+    size_t pos = 0;
+    for (uint32_t i = 0; i < group->nr_members; i++)
+    {
+        uint32_t sz;
+        uint16_t version;
+        struct rex_block block;
+        rex_block_read (group_member (buf, idx, group->members[i], PointList, &sz, &version), &block);
+        struct rex_pointlist *part = block.data;
+        if (!part || part->nr_vertices > nr_vertices - pos)
+        {
+            rex_block_free (&block);
+            return REX_ERROR_FILE_READ;
+        }
+
+        memcpy (plist->positions + 3 * pos, part->positions, (size_t) part->nr_vertices * 12);
+        if (colors)
+            memcpy (plist->colors + 3 * pos, part->colors, (size_t) part->nr_colors * 12);
+        pos += part->nr_vertices;
+        rex_block_free (&block);
+    }
+    return REX_OK;
+}
+
+static int group_read_mesh (uint8_t *buf, const struct rex_index *idx, const struct rex_group *group, struct rex_mesh *mesh)
+{
+    // nr_vertices, nr_normals, nr_texcoords, nr_colors and nr_triangles follow lod and max_lod
+    uint64_t nr_vertices = 0;
+    uint64_t nr_triangles = 0;
+    int normals = 1;
+    int tex_coords = 1;
+    int colors = 1;
+    for (uint32_t i = 0; i < group->nr_members; i++)
+    {
+        uint32_t sz;
+        uint16_t version;
+        uint8_t *ptr = group_member (buf, idx, group->members[i], Mesh, &sz, &version);
+        if (!ptr || sz < REX_MESH_HEADER_SIZE)
+            return REX_ERROR_FILE_READ;
+
+        // compressed blocks are validated by the decoder
+        uint32_t counts[5];
+        memcpy (counts, ptr + REX_BLOCK_HEADER_SIZE + 2 * sizeof (uint16_t), sizeof (counts));
+        if (version != REX_MESH_VERSION_COMPRESSED
+                && REX_MESH_HEADER_SIZE + ((uint64_t) counts[0] + counts[1] + counts[3] + counts[4]) * 12
+                + (uint64_t) counts[2] * 8 > sz)
+            return REX_ERROR_FILE_READ;
+        nr_vertices += counts[0];
+        normals &= (counts[1] == counts[0]);
+        tex_coords &= (counts[2] == counts[0]);
+        colors &= (counts[3] == counts[0]);
+        nr_triangles += counts[4];
+    }
+    if (nr_vertices > UINT32_MAX || nr_triangles > UINT32_MAX)
+        return REX_ERROR_BLOCK_SIZE;
+
+    mesh->nr_vertices = nr_vertices;
+    mesh->nr_triangles = nr_triangles;
+    mesh->positions = rex_malloc ((size_t) nr_vertices * 12);
+    mesh->triangles = rex_malloc ((size_t) nr_triangles * 12);
+    if (normals)
+        mesh->normals = rex_malloc ((size_t) nr_vertices * 12);
+    if (tex_coords)
+        mesh->tex_coords = rex_malloc ((size_t) nr_vertices * 8);
+    if (colors)
+        mesh->colors = rex_malloc ((size_t) nr_vertices * 12);
+    if (!mesh->positions || !mesh->triangles
+            || (normals && !mesh->normals)
+            || (tex_coords && !mesh->tex_coords)
+            || (colors && !mesh->colors))
+        return REX_ERROR_MEMORY;
+
+    size_t vtx = 0;
+    size_t tri = 0;
+    for (uint32_t i = 0; i < group->nr_members; i++)
+    {
+        uint32_t sz;
+        uint16_t version;
+        struct rex_block block;
+        rex_block_read (group_member (buf, idx, group->members[i], Mesh, &sz, &version), &block);
+        struct rex_mesh *part = block.data;
+        if (!part || part->nr_vertices > nr_vertices - vtx || part->nr_triangles > nr_triangles - tri)
+        {
+            rex_block_free (&block);
+            return REX_ERROR_FILE_READ;
+        }
+
+        if (i == 0)
+        {
+            mesh->lod = part->lod;
+            mesh->max_lod = part->max_lod;
+            mesh->material_id = part->material_id;
+            memcpy (mesh->name, part->name, REX_MESH_NAME_MAX_SIZE);
+        }
+
+        memcpy (mesh->positions + 3 * vtx, part->positions, (size_t) part->nr_vertices * 12);
+        if (normals)
+            memcpy (mesh->normals + 3 * vtx, part->normals, (size_t) part->nr_vertices * 12);
+        if (tex_coords)
+            memcpy (mesh->tex_coords + 2 * vtx, part->tex_coords, (size_t) part->nr_vertices * 8);
+        if (colors)
+            memcpy (mesh->colors + 3 * vtx, part->colors, (size_t) part->nr_vertices * 12);
+        for (size_t t = 0; t < (size_t) part->nr_triangles * 3; t++)
+            mesh->triangles[3 * tri + t] = part->triangles[t] + (uint32_t) vtx;
+
+        vtx += part->nr_vertices;
+        tri += part->nr_triangles;
+        rex_block_free (&block);
+    }
+    return REX_OK;
+}
+
+int rex_group_read (uint8_t *buf, const struct rex_index *idx, const struct rex_block *group, struct rex_block *block)
+{
+    if (!buf || !idx || !group || !block || group->type != Group || !group->data)
+        return REX_MISSING_PARAMETER;
+
+    const struct rex_group *g = group->data;
+    const struct rex_index_entry *first = g->nr_members ? rex_index_find (idx, g->members[0]) : NULL;
+    if (!first)
+        return REX_ERROR_FILE_READ;
+
+    block->type = first->type;
+    block->version = first->version;
+    block->sz = 0;
+    block->id = group->id;
+    block->data = NULL;
+
+    int ret = REX_NOT_IMPLEMENTED;
+    if (first->type == PointList)
+    {
+        struct rex_pointlist *plist = rex_malloc (sizeof (struct rex_pointlist));
+        if (!plist)
+            return REX_ERROR_MEMORY;
+        rex_pointlist_init (plist);
+        block->data = plist;
+        ret = group_read_pointlist (buf, idx, g, plist);
+    }
+    else if (first->type == Mesh)
+    {
+        struct rex_mesh *mesh = rex_malloc (sizeof (struct rex_mesh));
+        if (!mesh)
+            return REX_ERROR_MEMORY;
+        rex_mesh_init (mesh);
+        block->data = mesh;
+        ret = group_read_mesh (buf, idx, g, mesh);
+    }
+    else
+        warn ("Groups of this block type are not supported");
+
+    if (ret != REX_OK)
+        rex_block_free (block);
+    return ret;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Splitting of large meshes and pointlists into block groups and reassembly
+ *
+ * The size of a REX block is stored as 32 bit value, therefore a single block cannot
+ * hold more than 4 GiB. The group writer checks the size of a mesh or pointlist and writes
+ * it as one block if it fits. Otherwise the geometry is split into spatially coherent parts
+ * (recursive median split along the longest axis), every part is written as a regular block
+ * and a group block (see rex-block-group.h) is written in front of the parts.
+ *
+ * \code
+ * struct rex_group_writer w;
+ * rex_group_writer_init (&w, fd, header, &idx);
+ * uint64_t id = 0;
+ * if (rex_group_write_pointlist (&w, &id, &plist) != REX_OK)
+ *     die ("Cannot write pointlist");
+ * // w.offset now points behind the last block, id is the next unused dataId
+ * \endcode
+ *
+ * Readers use rex_group_read to reassemble the original mesh or pointlist.
+ */
+
+#include <stdint.h>
+
+#include "rex-block-group.h"
+#include "rex-block-mesh.h"
+#include "rex-block-pointlist.h"
+#include "rex-block.h"
+#include "rex-header.h"
+#include "rex-index.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * State of a file writer which splits geometry exceeding the block size limit
+ */
+struct rex_group_writer
+{
+    int fd;                     //<! the file descriptor of the REX file
+    uint64_t offset;            //<! the file offset of the next block
+    struct rex_header *header;  //<! the REX header which gets updated for every block
+    struct rex_index *idx;      //<! the index which gets updated for every block (can be NULL)
+    uint64_t max_block_sz;      //<! the maximum payload size of a block (REX_BLOCK_MAX_SIZE by default)
+    uint8_t pointlist_bits;     //<! 0 writes float pointlists (default), 16 or 32 compact pointlists (see rex-block-pointlist-compact.h)
+};
+
+/**
+ * Initializes the writer. The first block is written behind the blocks which
+ * are already accounted in the header.
+ *
+ * \param w the writer
+ * \param fd the file descriptor of the REX file, opened for writing
+ * \param header the REX header
+ * \param idx the index which gets the written blocks (can be NULL)
+ */
+void rex_group_writer_init (struct rex_group_writer *w, int fd, struct rex_header *header, struct rex_index *idx);
+
+/**
+ * Writes a pointlist as a single block or, if it exceeds the block size, as group of
+ * pointlist blocks. The arrays are written without copying (see rex-iov.h), unless compact
+ * pointlists are requested with pointlist_bits. Splitting changes the order of the points
+ * (and colors) in plist.
+ *
+ * \param w the writer
+ * \param id the dataId of the pointlist (or the group), gets advanced to the next unused dataId
+ * \param plist the pointlist
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_group_write_pointlist (struct rex_group_writer *w, uint64_t *id, struct rex_pointlist *plist);
+
+/**
+ * Writes a mesh as a single block or, if it exceeds the block size, as group of mesh
+ * blocks. Splitting changes the order of the triangles in mesh. Every part only contains
+ * the vertices which are referenced by its triangles, vertices shared by several parts are
+ * duplicated.
+ *
+ * \param w the writer
+ * \param id the dataId of the mesh (or the group), gets advanced to the next unused dataId
+ * \param mesh the mesh
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_group_write_mesh (struct rex_group_writer *w, uint64_t *id, struct rex_mesh *mesh);
+
+/**
+ * Splits a pointlist into spatially coherent parts with at most max_points points each.
+ * The points of plist are reordered in place, the parts refer to the arrays of plist and
+ * must not be freed with rex_pointlist_free. Only the parts array must be freed (rex_free).
+ *
+ * \param plist the pointlist which gets split
+ * \param max_points the maximum number of points per part (> 0)
+ * \param parts the array of parts which gets allocated
+ * \param nr_parts the number of parts
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_pointlist_split (struct rex_pointlist *plist, uint32_t max_points, struct rex_pointlist **parts, uint32_t *nr_parts);
+
+/**
+ * Splits a mesh into spatially coherent parts with at most max_triangles triangles each.
+ * The triangles of mesh are reordered in place. The parts own their arrays, every part
+ * must be released with rex_mesh_free and the parts array with rex_free.
+ *
+ * \param mesh the mesh which gets split
+ * \param max_triangles the maximum number of triangles per part (> 0)
+ * \param parts the array of parts which gets allocated
+ * \param nr_parts the number of parts
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_split (struct rex_mesh *mesh, uint32_t max_triangles, struct rex_mesh **parts, uint32_t *nr_parts);
+
+/**
+ * Reassembles the mesh or pointlist of a group. The member blocks are located with the
+ * index and get concatenated in the order of the group. The returned block has the type
+ * of the members and the dataId of the group; it must be released with rex_block_free.
+ *
+ * \param buf pointer to the beginning of the REX file
+ * \param idx the index of the file (see rex_index_read)
+ * \param group the group block as returned by rex_block_read
+ * \param block the block which gets filled
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_group_read (uint8_t *buf, const struct rex_index *idx, const struct rex_block *group, struct rex_block *block);
+
+#ifdef __cplusplus
+}
+#endif
@@ -19,18 +19,23 @@
 #include <assert.h>
 
 #include "global.h"
+#include "rex-crc.h"
 #include "rex-header.h"
+#include "rex-mem.h"
+#include "rex-stats.h"
+#include "rex-trace.h"
+#include "status.h"
 #include "util.h"
 
 uint8_t *rex_header_write (struct rex_header *header, long *sz)
 {
-    *sz = 64 + 22; // we also allocate for the CSB which is currently unused
-    uint8_t *buf = malloc (*sz);
+    *sz = REX_HEADER_SIZE; // we also allocate for the CSB which is currently unused
+    uint8_t *buf = rex_mem_alloc (REX_MEM_ENCODE, *sz);
     memset (buf, 0, *sz);
     uint8_t *addr = buf;
 
-    // fixed due to fixed CSB
-    header->start_addr = 86;
+    // fixed due to fixed CSB, the CSB is padded so that the data blocks start aligned
+    header->start_addr = REX_HEADER_SIZE;
 
     rexcpyr (header->magic, buf, 4);
     rexcpyr (&header->version, buf, sizeof (uint16_t));
@@ -38,7 +43,9 @@ uint8_t *rex_header_write (struct rex_header *header, long *sz)
     rexcpyr (&header->nr_datablocks, buf, sizeof (uint16_t));
     rexcpyr (&header->start_addr, buf, sizeof (uint16_t));
     rexcpyr (&header->sz_all_datablocks, buf, sizeof (uint64_t));
-    rexcpyr (header->reserved, buf, 42);
+    rexcpyr (&header->index_addr, buf, sizeof (uint64_t));
+    rexcpyr (&header->nr_datablocks_ext, buf, sizeof (uint32_t));
+    rexcpyr (header->reserved, buf, 30);
 
     // write dummy CSB
     uint32_t srid = 3876;
@@ -54,23 +61,80 @@ uint8_t *rex_header_write (struct rex_header *header, long *sz)
     rexcpyr (&ofs_x, buf, sizeof (float));
     rexcpyr (&ofs_y, buf, sizeof (float));
     rexcpyr (&ofs_z, buf, sizeof (float));
+    buf += REX_BLOCK_PADDING (buf - addr);
 
     assert ( (buf - *sz) == addr);
 
     return addr;
 }
 
+int rex_header_patch (FILE *fp, struct rex_header *header)
+{
+    if (!fp || !header)
+        return REX_MISSING_PARAMETER;
+
+    long header_sz;
+    uint8_t *header_ptr = rex_header_write (header, &header_sz);
+
+    int ret = REX_OK;
+    long pos = ftell (fp);
+    if (pos < 0
+            || fseek (fp, 0, SEEK_SET) != 0
+            || fwrite (header_ptr, header_sz, 1, fp) != 1
+            || fseek (fp, pos, SEEK_SET) != 0)
+        ret = REX_ERROR_FILE_WRITE;
+
+    FREE (header_ptr);
+    return ret;
+}
+
+void rex_header_add_block (struct rex_header *header, const uint8_t *block, uint64_t sz)
+{
+    if (!header || !block) return;
+
+    REX_STATS_WRITE_END (block, sz);
+    rex_header_add_block_crc (header, sz, rex_crc32c (0, block, sz));
+}
+
+void rex_header_add_block_crc (struct rex_header *header, uint64_t sz, uint32_t crc)
+{
+    if (!header) return;
+
+    uint32_t nr = rex_header_nr_datablocks (header);
+    if (nr == UINT32_MAX)
+    {
+        warn ("Maximum number of data blocks exceeded");
+        return;
+    }
+
+    // older readers see at most 65535 blocks
+    header->nr_datablocks_ext = nr + 1;
+    header->nr_datablocks = (nr + 1 > UINT16_MAX) ? UINT16_MAX : (uint16_t) (nr + 1);
+    header->sz_all_datablocks += sz;
+    header->crc = rex_crc32c_combine (header->crc, crc, sz);
+}
+
+uint32_t rex_header_nr_datablocks (const struct rex_header *header)
+{
+    if (!header) return 0;
+
+    return header->nr_datablocks_ext ? header->nr_datablocks_ext : header->nr_datablocks;
+}
+
 struct rex_header *rex_header_create ()
 {
-    struct rex_header *header = malloc (sizeof (struct rex_header));
+    struct rex_header *header = rex_malloc (sizeof (struct rex_header));
     header->version = REX_FILE_VERSION;
     header->crc = 0;
     header->nr_datablocks = 0;
     header->start_addr = 0;
     header->sz_all_datablocks = 0;
+    header->index_addr = 0;
+    header->nr_datablocks_ext = 0;
+    header->trusted = 0;
 
     memcpy (header->magic, REX_FILE_MAGIC, 4);
-    memset (header->reserved, 0, 42);
+    memset (header->reserved, 0, 30);
     return header;
 }
 
@@ -78,6 +142,7 @@ uint8_t *rex_header_read (uint8_t *buf, struct rex_header *header)
 {
     MEM_CHECK (buf);
     uint8_t *start = buf;
+    struct rex_trace_span span = rex_trace_begin ("read header");
 
     rexcpy (header->magic, buf, 4);
     rexcpy (&header->version, buf, sizeof (uint16_t));
@@ -85,7 +150,11 @@ uint8_t *rex_header_read (uint8_t *buf, struct rex_header *header)
     rexcpy (&header->nr_datablocks, buf, sizeof (uint16_t));
     rexcpy (&header->start_addr, buf, sizeof (uint16_t));
     rexcpy (&header->sz_all_datablocks, buf, sizeof (uint64_t));
-    rexcpy (header->reserved, buf, 42);
+    rexcpy (&header->index_addr, buf, sizeof (uint64_t));
+    rexcpy (&header->nr_datablocks_ext, buf, sizeof (uint32_t));
+    rexcpy (header->reserved, buf, 30);
+    header->trusted = 0;
+    rex_trace_end (&span);
 
     if (strncmp (header->magic, "REX1", 4) != 0)
         die ("This is not a valid REX file");
@@ -21,6 +21,7 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,10 +35,13 @@ struct rex_header
     char       magic[4];           //<! identifier for a valid REX file
     uint16_t   version;            //<! REX file version
     uint32_t   crc;                //<! a CRC check number (can be 0)
-    uint16_t   nr_datablocks;      //<! number of data blocks contained in this file/stream
+    uint16_t   nr_datablocks;      //<! number of data blocks, saturates at 65535 (see nr_datablocks_ext)
     uint16_t   start_addr;         //<! address of the first block in the file/stream
     uint64_t   sz_all_datablocks;  //<! size of all data blocks
-    char       reserved[42];       //<! for future fields
+    uint64_t   index_addr;         //<! address of the trailing index block (0 if there is none)
+    uint32_t   nr_datablocks_ext;  //<! number of data blocks without the 65535 limit (0 in older files)
+    char       reserved[30];       //<! for future fields
+    uint8_t    trusted;            //<! set by rex_validate, not part of the file (see rex-validate.h)
 };
 
 /**
@@ -64,6 +68,40 @@ uint8_t *rex_header_read (uint8_t *buf, struct rex_header *header);
  */
 uint8_t *rex_header_write (struct rex_header *header, long *sz);
 
+/**
+ * Accounts a serialized data block (including the block header) in the header. All block
+ * writers call this function, it keeps nr_datablocks, nr_datablocks_ext, sz_all_datablocks
+ * and the crc consistent. Blocks must be added in the same order as they are written.
+ *
+ * \param header the header, nothing happens if NULL
+ * \param block pointer to the serialized block
+ * \param sz the total size of the block in bytes
+ */
+void rex_header_add_block (struct rex_header *header, const uint8_t *block, uint64_t sz);
+
+/**
+ * Same as rex_header_add_block, but for writers which already know the CRC-32C of the
+ * block (see rex-crc.h), e.g. because the block is not available in a single buffer.
+ */
+void rex_header_add_block_crc (struct rex_header *header, uint64_t sz, uint32_t crc);
+
+/**
+ * Returns the number of data blocks. Files with more than 65535 blocks store the
+ * count in nr_datablocks_ext, older files only provide nr_datablocks.
+ */
+uint32_t rex_header_nr_datablocks (const struct rex_header *header);
+
+/**
+ * Writes the REX header to the beginning of an already written file. This is used by writers
+ * which write a placeholder header first and update it after all data blocks are written.
+ * The file position is restored afterwards.
+ *
+ * \param fp the file which must be opened for writing (and seeking)
+ * \param header the header which should get written
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_header_patch (FILE *fp, struct rex_header *header);
+
 #ifdef __cplusplus
 }
 #endif
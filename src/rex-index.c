@@ -0,0 +1,327 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "rex-block.h"
+#include "rex-index.h"
+#include "rex-mem.h"
+#include "rex-trace.h"
+#include "status.h"
+#include "util.h"
+
+struct id_pair
+{
+    uint64_t id;
+    uint32_t entry;
+};
+
+static int id_pair_cmp (const void *a, const void *b)
+{
+    const struct id_pair *pa = a;
+    const struct id_pair *pb = b;
+    if (pa->id != pb->id)
+        return (pa->id < pb->id) ? -1 : 1;
+    return (pa->entry < pb->entry) ? -1 : (pa->entry > pb->entry);
+}
+
+static struct rex_index_entry *index_append (struct rex_index *idx)
+{
+    if (idx->nr_entries == idx->capacity)
+    {
+        uint32_t capacity = idx->capacity ? idx->capacity * 2 : 16;
+        int mem = rex_mem_enter (REX_MEM_INDEX);
+        struct rex_index_entry *entries = rex_realloc (idx->entries, capacity * sizeof (struct rex_index_entry));
+        rex_mem_leave (mem);
+        if (!entries)
+            return NULL;
+        idx->entries = entries;
+        idx->capacity = capacity;
+    }
+    return &idx->entries[idx->nr_entries++];
+}
+
+static int index_sort (struct rex_index *idx)
+{
+    FREE (idx->by_id);
+    if (!idx->nr_entries)
+        return REX_OK;
+
+    struct id_pair *pairs = rex_mem_alloc (REX_MEM_INDEX, idx->nr_entries * sizeof (struct id_pair));
+    idx->by_id = rex_mem_alloc (REX_MEM_INDEX, idx->nr_entries * sizeof (uint32_t));
+    if (!pairs || !idx->by_id)
+    {
+        FREE (pairs);
+        FREE (idx->by_id);
+        return REX_ERROR_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < idx->nr_entries; i++)
+    {
+        pairs[i].id = idx->entries[i].id;
+        pairs[i].entry = i;
+    }
+    qsort (pairs, idx->nr_entries, sizeof (struct id_pair), id_pair_cmp);
+    for (uint32_t i = 0; i < idx->nr_entries; i++)
+        idx->by_id[i] = pairs[i].entry;
+
+    FREE (pairs);
+    return REX_OK;
+}
+
+void rex_index_init (struct rex_index *idx)
+{
+    if (!idx) return;
+
+    idx->nr_entries = 0;
+    idx->capacity = 0;
+    idx->entries = NULL;
+    idx->by_id = NULL;
+    idx->next_offset = REX_HEADER_SIZE;
+}
+
+void rex_index_free (struct rex_index *idx)
+{
+    if (!idx) return;
+
+    FREE (idx->entries);
+    FREE (idx->by_id);
+    rex_index_init (idx);
+}
+
+void rex_index_add_block (struct rex_index *idx, const uint8_t *block)
+{
+    if (!idx || !block) return;
+
+    struct rex_index_entry *e = index_append (idx);
+    if (!e)
+    {
+        warn ("Cannot allocate index entry");
+        return;
+    }
+
+    rexcpy (&e->type,    block, sizeof (uint16_t));
+    rexcpy (&e->version, block, sizeof (uint16_t));
+    rexcpy (&e->sz,      block, sizeof (uint32_t));
+    rexcpy (&e->id,      block, sizeof (uint64_t));
+    e->offset = idx->next_offset;
+    idx->next_offset += REX_BLOCK_HEADER_SIZE + e->sz;
+}
+
+uint8_t *rex_block_write_index (struct rex_header *header, struct rex_index *idx, long *sz)
+{
+    MEM_CHECK (header)
+    MEM_CHECK (idx)
+
+    *sz = REX_BLOCK_HEADER_SIZE
+          + sizeof (uint32_t)
+          + idx->nr_entries * REX_INDEX_ENTRY_SIZE;
+
+    uint8_t *ptr = rex_mem_alloc (REX_MEM_INDEX, *sz);
+    memset (ptr, 0, *sz);
+    uint8_t *addr = ptr;
+
+    struct rex_block block = { .type = Index, .version = 1, .sz = *sz - REX_BLOCK_HEADER_SIZE, .id = REX_NOT_SET };
+    ptr = rex_block_header_write (ptr, &block);
+
+    rexcpyr (&idx->nr_entries, ptr, sizeof (uint32_t));
+    for (uint32_t i = 0; i < idx->nr_entries; i++)
+    {
+        struct rex_index_entry *e = &idx->entries[i];
+        rexcpyr (&e->id, ptr, sizeof (uint64_t));
+        rexcpyr (&e->offset, ptr, sizeof (uint64_t));
+        rexcpyr (&e->sz, ptr, sizeof (uint32_t));
+        rexcpyr (&e->type, ptr, sizeof (uint16_t));
+        rexcpyr (&e->version, ptr, sizeof (uint16_t));
+    }
+
+    // the index is located right after the last data block
+    header->index_addr = REX_HEADER_SIZE + header->sz_all_datablocks;
+    return addr;
+}
+
+/**
+ * Reads the trailing index block, returns REX_OK if the index block is valid
+ */
+static int index_read_block (uint8_t *buf, uint64_t sz, struct rex_header *header, struct rex_index *idx)
+{
+    // all checks subtract from sz, so huge values from the file cannot wrap around
+    if (header->index_addr < header->start_addr || header->index_addr > sz
+            || sz - header->index_addr < REX_BLOCK_HEADER_SIZE + sizeof (uint32_t))
+        return REX_ERROR_FILE_READ;
+
+    uint8_t *ptr = buf + header->index_addr;
+    uint16_t type;
+    uint32_t block_sz;
+    uint32_t nr_entries;
+
+    rexcpy (&type, ptr, sizeof (uint16_t));
+    ptr += sizeof (uint16_t); // version
+    rexcpy (&block_sz, ptr, sizeof (uint32_t));
+    ptr += sizeof (uint64_t); // id
+    rexcpy (&nr_entries, ptr, sizeof (uint32_t));
+
+    if (type != Index
+            || (uint64_t) nr_entries * REX_INDEX_ENTRY_SIZE + sizeof (uint32_t) > block_sz
+            || sz - header->index_addr - REX_BLOCK_HEADER_SIZE < block_sz)
+        return REX_ERROR_FILE_READ;
+
+    for (uint32_t i = 0; i < nr_entries; i++)
+    {
+        struct rex_index_entry *e = index_append (idx);
+        if (!e)
+            return REX_ERROR_MEMORY;
+
+        rexcpy (&e->id, ptr, sizeof (uint64_t));
+        rexcpy (&e->offset, ptr, sizeof (uint64_t));
+        rexcpy (&e->sz, ptr, sizeof (uint32_t));
+        rexcpy (&e->type, ptr, sizeof (uint16_t));
+        rexcpy (&e->version, ptr, sizeof (uint16_t));
+
+        if (!header->trusted && (e->offset > sz || sz - e->offset < REX_BLOCK_HEADER_SIZE
+                                 || sz - e->offset - REX_BLOCK_HEADER_SIZE < e->sz))
+            return REX_ERROR_FILE_READ;
+        idx->next_offset = e->offset + REX_BLOCK_HEADER_SIZE + e->sz;
+    }
+    return REX_OK;
+}
+
+/**
+ * Builds the index by hopping over all block headers
+ */
+static int index_build (uint8_t *buf, uint64_t sz, struct rex_header *header, struct rex_index *idx)
+{
+    struct rex_block_iter it;
+    struct rex_block block;
+    uint8_t *ptr;
+
+    rex_block_iter_init (&it, buf, sz, header);
+    while ((ptr = rex_block_iter_next (&it, &block)) != NULL)
+    {
+        idx->next_offset = ptr - buf;
+        rex_index_add_block (idx, ptr);
+        if (idx->next_offset != (uint64_t) (it.ptr - buf))
+            return REX_ERROR_MEMORY;
+    }
+    return (idx->nr_entries == rex_header_nr_datablocks (header)) ? REX_OK : REX_ERROR_FILE_READ;
+}
+
+int rex_index_read (uint8_t *buf, uint64_t sz, struct rex_header *header, struct rex_index *idx)
+{
+    if (!buf || !header || !idx)
+        return REX_MISSING_PARAMETER;
+
+    rex_index_init (idx);
+    struct rex_trace_span span = rex_trace_begin ("read index");
+
+    int ret = REX_ERROR_FILE_READ;
+    if (header->index_addr)
+    {
+        ret = index_read_block (buf, sz, header, idx);
+        if (ret != REX_OK)
+        {
+            warn ("Invalid index block, building index from block headers");
+            rex_index_free (idx);
+        }
+    }
+
+    if (ret != REX_OK)
+        ret = index_build (buf, sz, header, idx);
+
+    if (ret == REX_OK)
+        ret = index_sort (idx);
+    if (ret != REX_OK)
+        rex_index_free (idx);
+    rex_trace_end (&span);
+    return ret;
+}
+
+const struct rex_index_entry *rex_index_find (const struct rex_index *idx, uint64_t id)
+{
+    if (!idx || !idx->by_id)
+        return NULL;
+
+    uint32_t lo = 0;
+    uint32_t hi = idx->nr_entries;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (idx->entries[idx->by_id[mid]].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < idx->nr_entries && idx->entries[idx->by_id[lo]].id == id)
+        return &idx->entries[idx->by_id[lo]];
+    return NULL;
+}
+
+struct read_all_ctx
+{
+    uint8_t *buf;
+    const struct rex_index *idx;
+    struct rex_block *blocks;
+};
+
+static void read_all_task (void *arg, uint32_t i)
+{
+    struct read_all_ctx *ctx = arg;
+    rex_block_read (ctx->buf + ctx->idx->entries[i].offset, &ctx->blocks[i]);
+}
+
+int rex_block_read_all (uint8_t *buf, uint64_t sz, struct rex_header *header, struct rex_thread_pool *pool,
+                        struct rex_block **blocks, uint32_t *nr_blocks)
+{
+    if (!buf || !header || !blocks || !nr_blocks)
+        return REX_MISSING_PARAMETER;
+
+    *blocks = NULL;
+    *nr_blocks = 0;
+
+    struct rex_index idx;
+    int ret = rex_index_read (buf, sz, header, &idx);
+    if (ret != REX_OK)
+        return ret;
+
+    if (idx.nr_entries)
+    {
+        struct read_all_ctx ctx = { .buf = buf, .idx = &idx };
+        ctx.blocks = rex_malloc (idx.nr_entries * sizeof (struct rex_block));
+        if (!ctx.blocks)
+        {
+            rex_index_free (&idx);
+            return REX_ERROR_MEMORY;
+        }
+
+        rex_parallel_for (pool, idx.nr_entries, read_all_task, &ctx);
+        *blocks = ctx.blocks;
+        *nr_blocks = idx.nr_entries;
+    }
+
+    rex_index_free (&idx);
+    return REX_OK;
+}
+
+void rex_blocks_free (struct rex_block *blocks, uint32_t nr_blocks)
+{
+    if (!blocks) return;
+
+    for (uint32_t i = 0; i < nr_blocks; i++)
+        rex_block_free (&blocks[i]);
+    rex_free (blocks);
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief REX index block (table of contents) for direct access to data blocks
+ *
+ * The optional index block is appended after the last data block. It is not counted in
+ * nr_datablocks and sz_all_datablocks of the REX header, so readers which are not aware of
+ * the index never get to see it. The address of the index block is stored in the index_addr
+ * field of the REX header.
+ *
+ * | **size [bytes]** | **name**     | **type** | **description**                            |
+ * |------------------|--------------|----------|--------------------------------------------|
+ * | 4                | nrOfEntries  | uint32_t | number of index entries                    |
+ * | 8                | dataId       | uint64_t | dataId of the first block                  |
+ * | 8                | offset       | uint64_t | absolute file offset of the block header   |
+ * | 4                | size         | uint32_t | data block size (without header)           |
+ * | 2                | type         | uint16_t | data type of the block                     |
+ * | 2                | version      | uint16_t | version of the block                       |
+ * | 8                | dataId       | uint64_t | dataId of the second block                 |
+ * | ...              |              |          |                                            |
+ *
+ * Every entry has a size of **24 bytes**. If a file does not contain an index block, the
+ * index can be built by hopping over the 16 byte block headers.
+ */
+
+#include <stdint.h>
+#include "rex-block.h"
+#include "rex-header.h"
+#include "rex-thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A single entry of the index
+ */
+struct rex_index_entry
+{
+    uint64_t id;      //<! the dataId of the block
+    uint64_t offset;  //<! absolute file offset of the block (pointing to the block header)
+    uint32_t sz;      //<! data block size w/o header
+    uint16_t type;    //<! the rex_block_type
+    uint16_t version; //<! the block version
+};
+
+/**
+ * The index of all data blocks of a REX file
+ */
+struct rex_index
+{
+    uint32_t nr_entries;              //<! the number of entries
+    uint32_t capacity;                //<! the number of allocated entries
+    struct rex_index_entry *entries;  //<! the entries in file order
+    uint32_t *by_id;                  //<! entry numbers sorted by id (available after rex_index_read)
+    uint64_t next_offset;             //<! offset of the next block which gets added
+};
+
+/**
+ * Sets all properties of the rex_index structure to initial values
+ */
+void rex_index_init (struct rex_index *idx);
+
+/**
+ * Frees any memory which is allocated for rex_index
+ */
+void rex_index_free (struct rex_index *idx);
+
+/**
+ * Adds a serialized block (as returned by the rex_block_write functions) to the index.
+ * The blocks must be added in the same order as they are written to the file.
+ *
+ * \param idx the index
+ * \param block pointer to the serialized block (starting with the block header)
+ */
+void rex_index_add_block (struct rex_index *idx, const uint8_t *block);
+
+/**
+ * Writes the index block. The block has to be written after all data blocks. The
+ * index_addr of the header gets set accordingly, the header is not modified otherwise.
+ * Memory will be allocated and the caller must take care of releasing the memory.
+ *
+ * \param header the REX header which gets the index address, must not be NULL
+ * \param idx the index which should get serialized
+ * \param sz the total size of the of the index block which is returned
+ * \return a pointer to the index block
+ */
+uint8_t *rex_block_write_index (struct rex_header *header, struct rex_index *idx, long *sz);
+
+/**
+ * Reads the index of a REX file. If the file contains an index block it is used directly,
+ * else the index is built by hopping over all block headers. No block payload is decoded.
+ *
+ * \param buf pointer to the beginning of the REX file
+ * \param sz size of the buffer
+ * \param header the REX header which has already been read from buf
+ * \param idx the index which gets filled
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_index_read (uint8_t *buf, uint64_t sz, struct rex_header *header, struct rex_index *idx);
+
+/**
+ * Finds the entry with the given dataId using a binary search. Returns NULL if not found.
+ */
+const struct rex_index_entry *rex_index_find (const struct rex_index *idx, uint64_t id);
+
+/**
+ * Decodes all data blocks of a REX file. The block offsets are taken from the index
+ * (see rex_index_read), afterwards the blocks are decoded independently on the threads
+ * of the pool. The installed allocator must be thread-safe (see rex-alloc.h), the
+ * default allocator is.
+ *
+ * \code
+ * struct rex_thread_pool *pool = rex_thread_pool_create (0);
+ * struct rex_block *blocks;
+ * uint32_t nr_blocks;
+ * if (rex_block_read_all (buf, sz, &header, pool, &blocks, &nr_blocks) == REX_OK)
+ * {
+ *     ...
+ *     rex_blocks_free (blocks, nr_blocks);
+ * }
+ * \endcode
+ *
+ * \param buf pointer to the beginning of the REX file
+ * \param sz size of the buffer
+ * \param header the REX header which has already been read from buf
+ * \param pool the thread pool which decodes the blocks, NULL decodes on the calling thread
+ * \param blocks the array of decoded blocks in file order, allocated by this function
+ * \param nr_blocks the number of blocks in the array
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_block_read_all (uint8_t *buf, uint64_t sz, struct rex_header *header, struct rex_thread_pool *pool,
+                        struct rex_block **blocks, uint32_t *nr_blocks);
+
+/**
+ * Frees an array of blocks which was returned by rex_block_read_all, including the block data.
+ */
+void rex_blocks_free (struct rex_block *blocks, uint32_t nr_blocks);
+
+#ifdef __cplusplus
+}
+#endif
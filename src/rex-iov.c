@@ -0,0 +1,143 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#define _DEFAULT_SOURCE // pwritev
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "rex-crc.h"
+#include "rex-iov.h"
+#include "rex-stats.h"
+#include "status.h"
+#include "util.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// number of segments which are converted to struct iovec at once
+#define WRITEV_BATCH 64
+
+void rex_block_iov_init (struct rex_block_iov *biov)
+{
+    if (!biov) return;
+
+    memset (biov->head, 0, sizeof (biov->head));
+    biov->nr_iov = 0;
+    biov->sz = 0;
+    biov->scratch = NULL;
+}
+
+void rex_block_iov_free (struct rex_block_iov *biov)
+{
+    if (!biov) return;
+
+    FREE (biov->scratch);
+    rex_block_iov_init (biov);
+}
+
+int rex_block_iov_add (struct rex_block_iov *biov, const void *base, size_t len)
+{
+    if (!biov)
+        return REX_MISSING_PARAMETER;
+    if (!len)
+        return REX_OK;
+    if (!base)
+        return REX_MISSING_PARAMETER;
+    if (biov->nr_iov == REX_BLOCK_IOV_MAX)
+        return REX_ERROR_MEMORY;
+
+    biov->iov[biov->nr_iov].base = base;
+    biov->iov[biov->nr_iov].len = len;
+    biov->nr_iov++;
+    biov->sz += (long) len;
+    return REX_OK;
+}
+
+void rex_header_add_block_iov (struct rex_header *header, const struct rex_block_iov *biov)
+{
+    if (!header || !biov) return;
+
+    REX_STATS_WRITE_END (biov->head, biov->sz);
+    uint32_t crc = 0;
+    for (int i = 0; i < biov->nr_iov; i++)
+        crc = rex_crc32c (crc, biov->iov[i].base, biov->iov[i].len);
+    rex_header_add_block_crc (header, biov->sz, crc);
+}
+
+#ifndef WIN32
+int rex_file_writev (int fd, uint64_t offset, const struct rex_iov *iov, int nr_iov)
+{
+    if (fd < 0 || (!iov && nr_iov))
+        return REX_MISSING_PARAMETER;
+
+    int max = (IOV_MAX < WRITEV_BATCH) ? IOV_MAX : WRITEV_BATCH;
+    struct iovec vec[WRITEV_BATCH];
+    size_t done = 0; // bytes of iov[0] which are already written
+
+    while (nr_iov > 0)
+    {
+        int n = (nr_iov < max) ? nr_iov : max;
+        for (int i = 0; i < n; i++)
+        {
+            vec[i].iov_base = (uint8_t *) iov[i].base;
+            vec[i].iov_len = iov[i].len;
+        }
+        vec[0].iov_base = (uint8_t *) vec[0].iov_base + done;
+        vec[0].iov_len -= done;
+
+        ssize_t written = pwritev (fd, vec, n, (off_t) offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            warn ("Cannot write to file: %s", strerror (errno));
+            return REX_ERROR_FILE_WRITE;
+        }
+        offset += written;
+
+        // skip all completely written segments
+        size_t left = written;
+        while (nr_iov > 0 && left >= iov[0].len - done)
+        {
+            left -= iov[0].len - done;
+            done = 0;
+            iov++;
+            nr_iov--;
+        }
+        done += left;
+        if (written == 0 && nr_iov > 0 && iov[0].len)
+            return REX_ERROR_FILE_WRITE;
+    }
+    return REX_OK;
+}
+#else
+int rex_file_writev (int fd, uint64_t offset, const struct rex_iov *iov, int nr_iov)
+{
+    (void) fd;
+    (void) offset;
+    (void) iov;
+    (void) nr_iov;
+    return REX_NOT_IMPLEMENTED;
+}
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Scatter-gather serialization of REX blocks
+ *
+ * The rex_block_write functions allocate a buffer for the complete block and copy all
+ * arrays into it before the caller writes the buffer to a file. The rex_block_iov functions
+ * instead describe a block as a list of memory segments: a small owned buffer containing
+ * the block header (and the type specific header) plus pointers to the caller's arrays.
+ * The segments are written with rex_file_writev without copying the arrays.
+ *
+ * The arrays of the source structure must stay valid and unchanged until the block is
+ * written. A rex_block_iov refers to its own header buffer and must not be copied
+ * after it has been filled.
+ *
+ * \code
+ * struct rex_block_iov b;
+ * long offset = REX_HEADER_SIZE;
+ * rex_block_iov_pointlist (0, header, &plist, &b);
+ * rex_file_writev (fd, offset, b.iov, b.nr_iov);
+ * offset += b.sz;
+ * rex_block_iov_free (&b);
+ * \endcode
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "rex-header.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REX_BLOCK_IOV_MAX 8
+
+/**
+ * A single memory segment
+ */
+struct rex_iov
+{
+    const void *base; //<! start of the segment
+    size_t len;       //<! length of the segment in bytes
+};
+
+/**
+ * A serialized REX block as list of memory segments
+ */
+struct rex_block_iov
+{
+    uint8_t head[REX_BLOCK_HEADER_SIZE + REX_MESH_HEADER_SIZE]; //<! block header and type specific header
+    struct rex_iov iov[REX_BLOCK_IOV_MAX];                        //<! the segments in file order
+    int nr_iov;                                                   //<! the number of segments
+    long sz;                                                      //<! total size of the block incl. block header
+    void *scratch;                                                //<! owned memory for data which is not stored contiguous in the source (can be NULL)
+};
+
+/**
+ * Resets the block, sz and the number of segments are set to zero
+ */
+void rex_block_iov_init (struct rex_block_iov *biov);
+
+/**
+ * Frees the owned scratch memory of the block. The caller's arrays are not touched.
+ */
+void rex_block_iov_free (struct rex_block_iov *biov);
+
+/**
+ * Appends a segment to the block and increases the block size. Empty segments are ignored.
+ *
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_block_iov_add (struct rex_block_iov *biov, const void *base, size_t len);
+
+/**
+ * Accounts the block in the REX header (see rex_header_add_block), the CRC is calculated
+ * over all segments. Nothing happens if header is NULL.
+ */
+void rex_header_add_block_iov (struct rex_header *header, const struct rex_block_iov *biov);
+
+/**
+ * Writes all segments to the file at the given offset using pwritev. Partial writes are
+ * continued and the number of segments per system call is limited to IOV_MAX. The file
+ * position of fd is not modified.
+ *
+ * \param fd the file descriptor opened for writing
+ * \param offset the absolute file offset of the first segment
+ * \param iov the segments
+ * \param nr_iov the number of segments
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_file_writev (int fd, uint64_t offset, const struct rex_iov *iov, int nr_iov);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,434 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "global.h"
+#include "rex-block-lineset.h"
+#include "rex-block-mesh-compressed.h"
+#include "rex-block-pointlist-compact.h"
+#include "rex-block-text.h"
+#include "rex-block-track.h"
+#include "rex-map.h"
+#include "status.h"
+#include "util.h"
+
+/**
+ * Checks if sz bytes starting at ptr are located inside the map
+ */
+static int map_contains (const struct rex_map *map, const uint8_t *ptr, uint64_t sz)
+{
+    if (ptr < map->data || ptr > map->data + map->sz)
+        return 0;
+    return sz <= (uint64_t) (map->data + map->sz - ptr);
+}
+
+/**
+ * Returns the float array at ptr. The array is borrowed if the memory is aligned,
+ * else an owned copy is returned.
+ */
+static float *view_floats (uint8_t *ptr, uint64_t sz)
+{
+    if (((uintptr_t) ptr % sizeof (float)) == 0)
+        return (float *) ptr;
+
+    float *copy = rex_malloc (sz);
+    if (copy)
+        memcpy (copy, ptr, sz);
+    return copy;
+}
+
+static void *materialize (const struct rex_map *map, void *p, uint64_t sz)
+{
+    if (!p || !rex_map_borrowed (map, p))
+        return p;
+
+    void *copy = rex_malloc (sz);
+    if (copy)
+        memcpy (copy, p, sz);
+    return copy;
+}
+
+#define RELEASE(map, p) do { if (p && !rex_map_borrowed (map, p)) rex_free (p); p = NULL; } while(0);
+
+static void advise_willneed (const struct rex_map *map, uint8_t *ptr, uint64_t sz)
+{
+#ifndef WIN32
+    if (!map->mapped || sz == 0)
+        return;
+
+    long page = sysconf (_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t) ptr & ~ (uintptr_t) (page - 1);
+    posix_madvise ((void *) start, (uintptr_t) ptr - start + sz, POSIX_MADV_WILLNEED);
+#endif
+}
+
+int rex_map_open (const char *filename, struct rex_map *map)
+{
+    if (!filename || !map)
+        return REX_MISSING_PARAMETER;
+
+    map->data = NULL;
+    map->sz = 0;
+    map->mapped = 0;
+
+#ifndef WIN32
+    int fd = open (filename, O_RDONLY);
+    if (fd < 0)
+        return REX_ERROR_FILE_OPEN;
+
+    struct stat sb;
+    if (fstat (fd, &sb) != 0 || sb.st_size == 0)
+    {
+        close (fd);
+        return REX_ERROR_FILE_READ;
+    }
+
+    void *addr = mmap (NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (addr == MAP_FAILED)
+        return REX_ERROR_FILE_READ;
+
+    posix_madvise (addr, sb.st_size, POSIX_MADV_SEQUENTIAL);
+
+    map->data = addr;
+    map->sz = sb.st_size;
+    map->mapped = 1;
+#else
+    long sz;
+    map->data = read_file_binary (filename, &sz);
+    if (!map->data)
+        return REX_ERROR_FILE_OPEN;
+    map->sz = sz;
+#endif
+    return REX_OK;
+}
+
+void rex_map_close (struct rex_map *map)
+{
+    if (!map || !map->data)
+        return;
+
+#ifndef WIN32
+    if (map->mapped)
+        munmap (map->data, map->sz);
+    else
+        FREE (map->data);
+#else
+    FREE (map->data);
+#endif
+    map->data = NULL;
+    map->sz = 0;
+    map->mapped = 0;
+}
+
+int rex_map_borrowed (const struct rex_map *map, const void *p)
+{
+    if (!map || !map->data || !p)
+        return 0;
+    const uint8_t *b = p;
+    return b >= map->data && b < map->data + map->sz;
+}
+
+uint8_t *rex_map_view_mesh (const struct rex_map *map, uint8_t *ptr, struct rex_mesh *mesh)
+{
+    MEM_CHECK (map)
+    MEM_CHECK (ptr)
+    MEM_CHECK (mesh)
+
+    if (!map_contains (map, ptr, REX_MESH_HEADER_SIZE))
+        return NULL;
+
+    struct rex_mesh_layout layout;
+    ptr = rex_mesh_header_read (ptr, mesh, &layout);
+    uint32_t nr_normals = layout.nr_normals;
+    uint32_t nr_texcoords = layout.nr_texcoords;
+    uint32_t nr_colors = layout.nr_colors;
+
+    // the attribute arrays of a rex_mesh have nr_vertices elements each
+    if ((nr_normals && nr_normals != mesh->nr_vertices)
+            || (nr_texcoords && nr_texcoords != mesh->nr_vertices)
+            || (nr_colors && nr_colors != mesh->nr_vertices))
+    {
+        warn ("Mesh attribute count does not match the number of vertices");
+        rex_mesh_init (mesh);
+        return NULL;
+    }
+
+    uint64_t sz_positions = (uint64_t) mesh->nr_vertices * 12;
+    uint64_t sz_normals = (uint64_t) nr_normals * 12;
+    uint64_t sz_texcoords = (uint64_t) nr_texcoords * 8;
+    uint64_t sz_colors = (uint64_t) nr_colors * 12;
+    uint64_t sz_triangles = (uint64_t) mesh->nr_triangles * 12;
+
+    if (!map_contains (map, ptr, sz_positions + sz_normals + sz_texcoords + sz_colors + sz_triangles))
+    {
+        warn ("Mesh block exceeds the mapped file");
+        rex_mesh_init (mesh);
+        return NULL;
+    }
+
+    if (mesh->nr_vertices)
+        mesh->positions = view_floats (ptr, sz_positions);
+    ptr += sz_positions;
+    if (nr_normals)
+        mesh->normals = view_floats (ptr, sz_normals);
+    ptr += sz_normals;
+    if (nr_texcoords)
+        mesh->tex_coords = view_floats (ptr, sz_texcoords);
+    ptr += sz_texcoords;
+    if (nr_colors)
+        mesh->colors = view_floats (ptr, sz_colors);
+    ptr += sz_colors;
+    if (mesh->nr_triangles)
+        mesh->triangles = (uint32_t *) view_floats (ptr, sz_triangles);
+    ptr += sz_triangles;
+
+    if ((mesh->nr_vertices && !mesh->positions) || (nr_normals && !mesh->normals)
+            || (nr_texcoords && !mesh->tex_coords) || (nr_colors && !mesh->colors)
+            || (mesh->nr_triangles && !mesh->triangles))
+    {
+        rex_map_release_mesh (map, mesh);
+        return NULL;
+    }
+
+    return ptr;
+}
+
+uint8_t *rex_map_view_pointlist (const struct rex_map *map, uint8_t *ptr, struct rex_pointlist *plist)
+{
+    MEM_CHECK (map)
+    MEM_CHECK (ptr)
+    MEM_CHECK (plist)
+
+    if (!map_contains (map, ptr, 2 * sizeof (uint32_t)))
+        return NULL;
+
+    rex_pointlist_init (plist);
+    rexcpy (&plist->nr_vertices, ptr, sizeof (uint32_t));
+    rexcpy (&plist->nr_colors, ptr, sizeof (uint32_t));
+
+    uint64_t sz_positions = (uint64_t) plist->nr_vertices * 12;
+    uint64_t sz_colors = (uint64_t) plist->nr_colors * 12;
+
+    if (!map_contains (map, ptr, sz_positions + sz_colors))
+    {
+        warn ("Pointlist block exceeds the mapped file");
+        rex_pointlist_init (plist);
+        return NULL;
+    }
+
+    if (plist->nr_vertices)
+        plist->positions = view_floats (ptr, sz_positions);
+    ptr += sz_positions;
+    if (plist->nr_colors)
+        plist->colors = view_floats (ptr, sz_colors);
+    ptr += sz_colors;
+
+    if ((plist->nr_vertices && !plist->positions) || (plist->nr_colors && !plist->colors))
+    {
+        rex_map_release_pointlist (map, plist);
+        return NULL;
+    }
+
+    return ptr;
+}
+
+uint8_t *rex_map_view_image (const struct rex_map *map, uint8_t *ptr, struct rex_image *img)
+{
+    MEM_CHECK (map)
+    MEM_CHECK (ptr)
+    MEM_CHECK (img)
+
+    if (!map_contains (map, ptr, sizeof (uint32_t) + img->sz))
+        return NULL;
+
+    rexcpy (&img->compression, ptr, sizeof (uint32_t));
+    img->data = ptr;
+    return ptr + img->sz;
+}
+
+uint8_t *rex_map_view_block (const struct rex_map *map, uint8_t *ptr, struct rex_block *block)
+{
+    MEM_CHECK (map)
+    MEM_CHECK (ptr)
+    MEM_CHECK (block)
+
+    if (!map_contains (map, ptr, REX_BLOCK_HEADER_SIZE))
+        return NULL;
+
+    uint8_t *start = ptr;
+    rexcpy (&block->type,    ptr, sizeof (uint16_t));
+    rexcpy (&block->version, ptr, sizeof (uint16_t));
+    rexcpy (&block->sz,      ptr, sizeof (uint32_t));
+    rexcpy (&block->id,      ptr, sizeof (uint64_t));
+    block->data = NULL;
+
+    if (!map_contains (map, ptr, block->sz))
+    {
+        warn ("Block exceeds the mapped file");
+        return NULL;
+    }
+    advise_willneed (map, ptr, block->sz);
+
+    switch (block->type)
+    {
+        case PointList:
+            {
+                // compact pointlists must be decoded
+                if (block->version == REX_POINTLIST_VERSION_COMPACT)
+                    return rex_block_read (start, block);
+
+                struct rex_pointlist *p = rex_malloc (sizeof (struct rex_pointlist));
+                if (!p || !rex_map_view_pointlist (map, ptr, p))
+                {
+                    FREE (p);
+                    return NULL;
+                }
+                block->data = p;
+                break;
+            }
+        case Mesh:
+            {
+                // compressed meshes must be decoded
+                if (block->version == REX_MESH_VERSION_COMPRESSED)
+                    return rex_block_read (start, block);
+
+                struct rex_mesh *mesh = rex_malloc (sizeof (struct rex_mesh));
+                if (!mesh || !rex_map_view_mesh (map, ptr, mesh))
+                {
+                    FREE (mesh);
+                    return NULL;
+                }
+                block->data = mesh;
+                break;
+            }
+        case Image:
+            {
+                if (block->sz < sizeof (uint32_t))
+                {
+                    warn ("Image block is too small");
+                    return NULL;
+                }
+                struct rex_image *img = rex_malloc (sizeof (struct rex_image));
+                if (!img)
+                    return NULL;
+                img->sz = block->sz - sizeof (uint32_t); // subtract compression
+                if (!rex_map_view_image (map, ptr, img))
+                {
+                    FREE (img);
+                    return NULL;
+                }
+                block->data = img;
+                break;
+            }
+        default:
+            return rex_block_read (start, block);
+    }
+    return ptr + block->sz;
+}
+
+void rex_map_release_block (const struct rex_map *map, struct rex_block *block)
+{
+    if (!block || !block->data)
+        return;
+
+    switch (block->type)
+    {
+        case PointList:
+            rex_map_release_pointlist (map, block->data);
+            break;
+        case Mesh:
+            rex_map_release_mesh (map, block->data);
+            break;
+        case Image:
+            rex_map_release_image (map, block->data);
+            break;
+        default:
+            // all other blocks are decoded with rex_block_read
+            rex_block_free (block);
+            return;
+    }
+    FREE (block->data);
+}
+
+void rex_map_materialize_mesh (const struct rex_map *map, struct rex_mesh *mesh)
+{
+    if (!map || !mesh)
+        return;
+
+    mesh->positions = materialize (map, mesh->positions, (uint64_t) mesh->nr_vertices * 12);
+    mesh->normals = materialize (map, mesh->normals, (uint64_t) mesh->nr_vertices * 12);
+    mesh->tex_coords = materialize (map, mesh->tex_coords, (uint64_t) mesh->nr_vertices * 8);
+    mesh->colors = materialize (map, mesh->colors, (uint64_t) mesh->nr_vertices * 12);
+    mesh->triangles = materialize (map, mesh->triangles, (uint64_t) mesh->nr_triangles * 12);
+}
+
+void rex_map_materialize_pointlist (const struct rex_map *map, struct rex_pointlist *plist)
+{
+    if (!map || !plist)
+        return;
+
+    plist->positions = materialize (map, plist->positions, (uint64_t) plist->nr_vertices * 12);
+    plist->colors = materialize (map, plist->colors, (uint64_t) plist->nr_colors * 12);
+}
+
+void rex_map_materialize_image (const struct rex_map *map, struct rex_image *img)
+{
+    if (!map || !img)
+        return;
+
+    img->data = materialize (map, img->data, img->sz);
+}
+
+void rex_map_release_mesh (const struct rex_map *map, struct rex_mesh *mesh)
+{
+    if (!mesh)
+        return;
+
+    RELEASE (map, mesh->positions);
+    RELEASE (map, mesh->normals);
+    RELEASE (map, mesh->tex_coords);
+    RELEASE (map, mesh->colors);
+    RELEASE (map, mesh->triangles);
+    rex_mesh_init (mesh);
+}
+
+void rex_map_release_pointlist (const struct rex_map *map, struct rex_pointlist *plist)
+{
+    if (!plist)
+        return;
+
+    RELEASE (map, plist->positions);
+    RELEASE (map, plist->colors);
+    rex_pointlist_init (plist);
+}
+
+void rex_map_release_image (const struct rex_map *map, struct rex_image *img)
+{
+    if (!img)
+        return;
+
+    RELEASE (map, img->data);
+}
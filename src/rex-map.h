@@ -0,0 +1,162 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Memory-mapped REX file access with borrowed block views
+ *
+ * Instead of reading the complete file into a heap buffer (see read_file_binary), the file
+ * gets mapped into the address space. The view functions fill the regular REX structures
+ * (rex_mesh, rex_pointlist, rex_image), but the attribute arrays point directly into the
+ * mapping. This avoids both the file buffer and the per-array copy of the regular read path.
+ *
+ * Float arrays can only be borrowed if they are properly aligned inside the file, which is
+ * the case for all files written by this library (see REX_BLOCK_ALIGNMENT). Otherwise the
+ * view falls back to an owned copy of this single array. Use rex_map_borrowed to check
+ * the ownership of an array. Borrowed arrays must not be freed and are only valid as long
+ * as the map is open. Call the materialize functions if the data must outlive the map, and
+ * the release functions to free whatever the view owns.
+ */
+
+#include <stdint.h>
+
+#include "rex-block.h"
+#include "rex-block-image.h"
+#include "rex-block-mesh.h"
+#include "rex-block-pointlist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A read-only mapping of a complete REX file
+ */
+struct rex_map
+{
+    uint8_t *data; //<! the start of the file content
+    uint64_t sz;   //<! the size of the file content in bytes
+    int mapped;    //<! 1 if data is memory-mapped, 0 if it is a heap buffer (fallback)
+};
+
+/**
+ * Maps the given file into memory. The mapping gets advised for sequential access.
+ * On platforms without mmap the file content is read into a heap buffer instead,
+ * which keeps the semantics of this API intact.
+ *
+ * \param filename the absolute path to the file
+ * \param map the map which gets filled
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_map_open (const char *filename, struct rex_map *map);
+
+/**
+ * Unmaps the file. All borrowed arrays become invalid.
+ */
+void rex_map_close (struct rex_map *map);
+
+/**
+ * Returns != 0 if the given pointer refers to memory inside the map.
+ */
+int rex_map_borrowed (const struct rex_map *map, const void *p);
+
+/**
+ * Reads the block header and creates a view of the block payload. Mesh, PointList and Image
+ * blocks are borrowed from the map, all other block types, compressed meshes and compact
+ * pointlists (see rex-block-mesh-compressed.h and rex-block-pointlist-compact.h) are
+ * decoded with rex_block_read.
+ * The pages of the block are advised to be needed soon.
+ *
+ * \param map the map containing the block
+ * \param ptr pointer to the beginning of a block (block header)
+ * \param block the block which gets filled
+ * \return the pointer to the next block or NULL in case of error
+ */
+uint8_t *rex_map_view_block (const struct rex_map *map, uint8_t *ptr, struct rex_block *block);
+
+/**
+ * Frees the block data which was created by rex_map_view_block. Borrowed arrays are left untouched.
+ */
+void rex_map_release_block (const struct rex_map *map, struct rex_block *block);
+
+/**
+ * Creates a mesh view. The ptr must point to the beginning of the mesh block payload
+ * (see rex_block_read_mesh).
+ *
+ * \param map the map containing the block
+ * \param ptr pointer to the block start
+ * \param mesh the rex_mesh structure which gets filled
+ * \return the pointer to the memory block after the rex_mesh block or NULL if the block exceeds the map,
+ *         the number of normals, texture coordinates or colors differs from nr_vertices or memory is missing
+ */
+uint8_t *rex_map_view_mesh (const struct rex_map *map, uint8_t *ptr, struct rex_mesh *mesh);
+
+/**
+ * Creates a pointlist view. The ptr must point to the beginning of the pointlist block payload.
+ *
+ * \param map the map containing the block
+ * \param ptr pointer to the block start
+ * \param plist the rex_pointlist structure which gets filled
+ * \return the pointer to the memory block after the rex_pointlist block or NULL if the block exceeds the map
+ */
+uint8_t *rex_map_view_pointlist (const struct rex_map *map, uint8_t *ptr, struct rex_pointlist *plist);
+
+/**
+ * Creates an image view. The ptr must point to the beginning of the image block payload and
+ * img->sz must be set (see rex_block_read_image). Image data is never copied.
+ *
+ * \param map the map containing the block
+ * \param ptr pointer to the block start
+ * \param img the rex_image structure which gets filled
+ * \return the pointer to the memory block after the rex_image block or NULL if the block exceeds the map
+ */
+uint8_t *rex_map_view_image (const struct rex_map *map, uint8_t *ptr, struct rex_image *img);
+
+/**
+ * Replaces all borrowed arrays of the mesh with owned copies. Afterwards the mesh is
+ * independent of the map and can be released with rex_mesh_free.
+ */
+void rex_map_materialize_mesh (const struct rex_map *map, struct rex_mesh *mesh);
+
+/**
+ * Replaces all borrowed arrays of the pointlist with owned copies.
+ */
+void rex_map_materialize_pointlist (const struct rex_map *map, struct rex_pointlist *plist);
+
+/**
+ * Replaces the borrowed image data with an owned copy.
+ */
+void rex_map_materialize_image (const struct rex_map *map, struct rex_image *img);
+
+/**
+ * Frees all owned arrays of a mesh view and resets the mesh.
+ */
+void rex_map_release_mesh (const struct rex_map *map, struct rex_mesh *mesh);
+
+/**
+ * Frees all owned arrays of a pointlist view and resets the pointlist.
+ */
+void rex_map_release_pointlist (const struct rex_map *map, struct rex_pointlist *plist);
+
+/**
+ * Frees the image data if it is owned.
+ */
+void rex_map_release_image (const struct rex_map *map, struct rex_image *img);
+
+#ifdef __cplusplus
+}
+#endif
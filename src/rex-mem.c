@@ -0,0 +1,284 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rex-alloc.h"
+#include "rex-mem.h"
+
+// the number of independently locked parts of the allocation table
+#define NR_SHARDS 64
+
+static const char *subsystem_names[REX_MEM_NR_SUBSYSTEMS]
+    = { "other", "io", "decode", "encode", "compression", "index", "application" };
+
+/**
+ * A tracked allocation
+ */
+struct entry
+{
+    uintptr_t p;        //<! the address of the allocation
+    uint64_t sz;        //<! the requested size
+    int subsystem;      //<! the subsystem which gets charged
+    struct entry *next; //<! the next entry of the bucket or the free list
+};
+
+/**
+ * A part of the allocation table, a chained hash table. The table and its entries are
+ * allocated with malloc, they must not be tracked themselves.
+ */
+struct shard
+{
+    pthread_mutex_t lock;   //<! protects the shard
+    struct entry **buckets; //<! the buckets, a power of two
+    size_t nr_buckets;      //<! the number of buckets
+    size_t nr_entries;      //<! the number of tracked allocations
+    struct entry *unused;   //<! released entries for reuse
+};
+
+struct counters
+{
+    _Atomic uint64_t current;
+    _Atomic uint64_t peak;
+    _Atomic uint64_t live;
+    _Atomic uint64_t allocs;
+};
+
+static atomic_int tracking;
+static atomic_int armed;
+static struct shard shards[NR_SHARDS];
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static struct counters counters[REX_MEM_NR_SUBSYSTEMS];
+static struct counters total;
+
+static _Thread_local int current = REX_MEM_OTHER;
+
+static void shards_init (void)
+{
+    for (int i = 0; i < NR_SHARDS; i++)
+        pthread_mutex_init (&shards[i].lock, NULL);
+}
+
+static inline uint64_t hash (uintptr_t p)
+{
+    return (uint64_t) (p >> 4) * 0x9e3779b97f4a7c15ull;
+}
+
+static inline struct shard *shard_of (uint64_t h)
+{
+    return &shards[h >> 58];
+}
+
+static int shard_grow (struct shard *s)
+{
+    size_t nr = s->nr_buckets ? s->nr_buckets * 2 : 1024;
+    struct entry **buckets = calloc (nr, sizeof (struct entry *));
+    if (!buckets)
+        return 0;
+
+    for (size_t b = 0; b < s->nr_buckets; b++)
+        for (struct entry *e = s->buckets[b], *next; e; e = next)
+        {
+            next = e->next;
+            size_t i = hash (e->p) & (nr - 1);
+            e->next = buckets[i];
+            buckets[i] = e;
+        }
+    free (s->buckets);
+    s->buckets = buckets;
+    s->nr_buckets = nr;
+    return 1;
+}
+
+static void charge (struct counters *c, uint64_t sz)
+{
+    uint64_t cur = atomic_fetch_add_explicit (&c->current, sz, memory_order_relaxed) + sz;
+    uint64_t peak = atomic_load_explicit (&c->peak, memory_order_relaxed);
+    while (cur > peak && !atomic_compare_exchange_weak_explicit (&c->peak, &peak, cur, memory_order_relaxed,
+            memory_order_relaxed))
+        ;
+    atomic_fetch_add_explicit (&c->live, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit (&c->allocs, 1, memory_order_relaxed);
+}
+
+static void discharge (struct counters *c, uint64_t sz)
+{
+    atomic_fetch_sub_explicit (&c->current, sz, memory_order_relaxed);
+    atomic_fetch_sub_explicit (&c->live, 1, memory_order_relaxed);
+}
+
+void rex_mem_track (void *p, size_t sz, int subsystem)
+{
+    if (!p)
+        return;
+    if (subsystem < 0)
+    {
+        if (!atomic_load_explicit (&tracking, memory_order_relaxed))
+            return;
+        subsystem = current;
+    }
+
+    uint64_t h = hash ((uintptr_t) p);
+    struct shard *s = shard_of (h);
+    pthread_mutex_lock (&s->lock);
+    struct entry *e = s->unused;
+    if (e)
+        s->unused = e->next;
+    else
+        e = malloc (sizeof (struct entry));
+    if (!e || (s->nr_entries >= s->nr_buckets && !shard_grow (s) && !s->nr_buckets))
+    {
+        free (e);
+        pthread_mutex_unlock (&s->lock);
+        return;
+    }
+
+    size_t b = h & (s->nr_buckets - 1);
+    e->p = (uintptr_t) p;
+    e->sz = sz;
+    e->subsystem = subsystem;
+    e->next = s->buckets[b];
+    s->buckets[b] = e;
+    s->nr_entries++;
+    pthread_mutex_unlock (&s->lock);
+
+    charge (&counters[subsystem], sz);
+    charge (&total, sz);
+}
+
+int rex_mem_untrack (void *p, uint64_t *sz)
+{
+    if (!p)
+        return -1;
+
+    uint64_t h = hash ((uintptr_t) p);
+    struct shard *s = shard_of (h);
+    pthread_mutex_lock (&s->lock);
+    struct entry **link = s->nr_buckets ? &s->buckets[h & (s->nr_buckets - 1)] : NULL;
+    while (link && *link && (*link)->p != (uintptr_t) p)
+        link = &(*link)->next;
+    if (!link || !*link)
+    {
+        pthread_mutex_unlock (&s->lock);
+        return -1;
+    }
+
+    struct entry *e = *link;
+    *link = e->next;
+    e->next = s->unused;
+    s->unused = e;
+    s->nr_entries--;
+    int subsystem = e->subsystem;
+    uint64_t esz = e->sz;
+    pthread_mutex_unlock (&s->lock);
+
+    discharge (&counters[subsystem], esz);
+    discharge (&total, esz);
+    if (sz)
+        *sz = esz;
+    return subsystem;
+}
+
+int rex_mem_armed (void)
+{
+    return atomic_load_explicit (&armed, memory_order_relaxed);
+}
+
+void rex_mem_tracking (int enable)
+{
+    if (enable)
+    {
+        pthread_once (&once, shards_init);
+        atomic_store (&armed, 1);
+    }
+    atomic_store (&tracking, enable != 0);
+}
+
+int rex_mem_tracking_enabled (void)
+{
+    return atomic_load_explicit (&tracking, memory_order_relaxed);
+}
+
+static void counters_get (struct counters *c, struct rex_mem_entry *e)
+{
+    e->current = atomic_load_explicit (&c->current, memory_order_relaxed);
+    e->peak = atomic_load_explicit (&c->peak, memory_order_relaxed);
+    e->live = atomic_load_explicit (&c->live, memory_order_relaxed);
+    e->allocs = atomic_load_explicit (&c->allocs, memory_order_relaxed);
+}
+
+void rex_mem_get (struct rex_mem_stats *stats)
+{
+    if (!stats) return;
+
+    for (int i = 0; i < REX_MEM_NR_SUBSYSTEMS; i++)
+        counters_get (&counters[i], &stats->subsystems[i]);
+    counters_get (&total, &stats->total);
+}
+
+void rex_mem_reset_peak (void)
+{
+    for (int i = 0; i < REX_MEM_NR_SUBSYSTEMS; i++)
+        atomic_store (&counters[i].peak, atomic_load (&counters[i].current));
+    atomic_store (&total.peak, atomic_load (&total.current));
+}
+
+const char *rex_mem_subsystem_name (int subsystem)
+{
+    return (subsystem >= 0 && subsystem < REX_MEM_NR_SUBSYSTEMS) ? subsystem_names[subsystem] : "unknown";
+}
+
+static void report_line (FILE *fp, const char *name, const struct rex_mem_entry *e)
+{
+    fprintf (fp, "%-12s %12.2f %12.2f %10llu %10llu\n", name, e->current / 1e6, e->peak / 1e6,
+             (unsigned long long) e->live, (unsigned long long) e->allocs);
+}
+
+void rex_mem_report (FILE *fp)
+{
+    if (!fp) return;
+
+    struct rex_mem_stats stats;
+    rex_mem_get (&stats);
+    fprintf (fp, "%-12s %12s %12s %10s %10s\n", "subsystem", "current MB", "peak MB", "live", "allocs");
+    for (int i = 0; i < REX_MEM_NR_SUBSYSTEMS; i++)
+        if (stats.subsystems[i].allocs)
+            report_line (fp, subsystem_names[i], &stats.subsystems[i]);
+    report_line (fp, "total", &stats.total);
+}
+
+int rex_mem_enter (int subsystem)
+{
+    int prev = current;
+    if (subsystem >= 0 && subsystem < REX_MEM_NR_SUBSYSTEMS)
+        current = subsystem;
+    return prev;
+}
+
+void rex_mem_leave (int prev)
+{
+    current = prev;
+}
+
+void *rex_mem_alloc (int subsystem, size_t sz)
+{
+    int prev = rex_mem_enter (subsystem);
+    void *p = rex_malloc (sz);
+    rex_mem_leave (prev);
+    return p;
+}
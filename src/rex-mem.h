@@ -0,0 +1,158 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Memory accounting per subsystem
+ *
+ * The accounting tracks all memory of the installed allocator (see rex-alloc.h) and reports
+ * the current and peak bytes and the number of live allocations per subsystem, e.g. to size
+ * the memory limits of conversion jobs. Every allocation is attributed to the subsystem of the
+ * calling thread at the time of the allocation, and is subtracted from the same subsystem
+ * when it is released, regardless of which code releases it.
+ *
+ * \code
+ * rex_mem_tracking (1);
+ * ... read or write REX files ...
+ * rex_mem_report (stdout);
+ * \endcode
+ *
+ * The library sets the subsystem while it reads files (REX_MEM_IO), decodes blocks
+ * (REX_MEM_DECODE), serializes blocks (REX_MEM_ENCODE), compresses or decompresses blocks
+ * (REX_MEM_COMPRESSION) and builds the index (REX_MEM_INDEX). Applications can attribute
+ * their own allocations with rex_mem_enter, everything else counts as REX_MEM_OTHER.
+ *
+ * Tracking should be switched on before the first allocation, memory which was allocated
+ * before is not accounted. The allocations are kept in a sharded hash table, so tracking
+ * costs a table update per allocation. If tracking is off, only a flag is checked.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The subsystems which memory is attributed to
+ */
+enum rex_mem_subsystem
+{
+    REX_MEM_OTHER       = 0, //<! everything which is not attributed
+    REX_MEM_IO          = 1, //<! file buffers
+    REX_MEM_DECODE      = 2, //<! decoded blocks (rex_block_read)
+    REX_MEM_ENCODE      = 3, //<! serialized blocks (rex_block_write_*)
+    REX_MEM_COMPRESSION = 4, //<! compressed and decompressed blocks
+    REX_MEM_INDEX       = 5, //<! the index of a REX file
+    REX_MEM_APPLICATION = 6, //<! attributed by the application
+    REX_MEM_NR_SUBSYSTEMS
+};
+
+/**
+ * The accounting of a single subsystem
+ */
+struct rex_mem_entry
+{
+    uint64_t current; //<! currently allocated bytes
+    uint64_t peak;    //<! maximum of current since tracking was enabled or rex_mem_reset_peak
+    uint64_t live;    //<! number of live allocations
+    uint64_t allocs;  //<! total number of allocations
+};
+
+/**
+ * A snapshot of the accounting
+ */
+struct rex_mem_stats
+{
+    struct rex_mem_entry subsystems[REX_MEM_NR_SUBSYSTEMS]; //<! indexed by rex_mem_subsystem
+    struct rex_mem_entry total;                            //<! all subsystems, the peak is the peak of the sum
+};
+
+/**
+ * Switches the tracking of new allocations on (enable != 0) or off. Memory which is tracked
+ * is accounted until it is released, also after switching tracking off.
+ */
+void rex_mem_tracking (int enable);
+
+/**
+ * Returns 1 if new allocations are tracked, else 0
+ */
+int rex_mem_tracking_enabled (void);
+
+/**
+ * Fills a snapshot of the accounting
+ */
+void rex_mem_get (struct rex_mem_stats *stats);
+
+/**
+ * Sets the peak of all subsystems to the current value, e.g. to measure the peak of a stage
+ */
+void rex_mem_reset_peak (void);
+
+/**
+ * Returns the name of the subsystem, e.g. "decode"
+ */
+const char *rex_mem_subsystem_name (int subsystem);
+
+/**
+ * Prints a table of the accounting
+ */
+void rex_mem_report (FILE *fp);
+
+/**
+ * Attributes the following allocations of the calling thread to the given subsystem
+ *
+ * \code
+ * int prev = rex_mem_enter (REX_MEM_APPLICATION);
+ * ...
+ * rex_mem_leave (prev);
+ * \endcode
+ *
+ * \param subsystem the subsystem (see rex_mem_subsystem)
+ * \return the previous subsystem, which must be passed to rex_mem_leave
+ */
+int rex_mem_enter (int subsystem);
+
+/**
+ * Restores the subsystem which was active before rex_mem_enter
+ */
+void rex_mem_leave (int prev);
+
+/**
+ * Allocates sz bytes with rex_malloc and attributes them to the given subsystem
+ */
+void *rex_mem_alloc (int subsystem, size_t sz);
+
+/**
+ * Hooks of the allocator functions (rex-alloc.c), not to be called otherwise. rex_mem_track
+ * accounts p to the given subsystem, a negative subsystem selects the subsystem of the
+ * calling thread if tracking is on. rex_mem_untrack removes p before it gets released and
+ * returns its subsystem and size, or -1 if p is not tracked.
+ */
+void rex_mem_track (void *p, size_t sz, int subsystem);
+int rex_mem_untrack (void *p, uint64_t *sz);
+
+/**
+ * Returns 1 if the allocator hooks have to be called, also after tracking was switched off
+ */
+int rex_mem_armed (void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,305 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "global.h"
+#include "rex-mesh-normals.h"
+#include "rex-trace.h"
+#include "status.h"
+#include "util.h"
+
+// number of triangles or vertices which are processed by one task
+#define NORMALS_CHUNK 16384
+
+struct normals_ctx
+{
+    const float *positions;
+    const uint32_t *triangles;
+    uint32_t nr_triangles;
+    uint32_t nr_vertices;
+    enum rex_normals_weighting weighting;
+    float *faces;              // weighted normal per triangle (area) or per corner (angle)
+    uint32_t *offsets;         // the corners of vertex v are corners[offsets[v]] ... corners[offsets[v + 1] - 1]
+    uint32_t *corners;
+    float *normals;
+};
+
+static inline void triangle_normal (const float *positions, const uint32_t *t, float *n)
+{
+    const float *a = &positions[(size_t) t[0] * 3];
+    const float *b = &positions[(size_t) t[1] * 3];
+    const float *c = &positions[(size_t) t[2] * 3];
+    float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+#ifdef __SSE2__
+/**
+ * Loads x, y, z of a vertex without reading behind the position array
+ */
+static inline __m128 vertex_load (const float *positions, uint32_t v)
+{
+    const float *p = &positions[(size_t) v * 3];
+    __m128 xy = _mm_loadl_pi (_mm_setzero_ps (), (const __m64 *) p);
+    return _mm_movelh_ps (xy, _mm_load_ss (p + 2));
+}
+
+/**
+ * Loads the given corner of 4 triangles and transposes them into x, y and z vectors
+ */
+static inline void corners_load (const float *positions, const uint32_t *t, int corner, __m128 *x, __m128 *y, __m128 *z)
+{
+    __m128 v0 = vertex_load (positions, t[corner]);
+    __m128 v1 = vertex_load (positions, t[3 + corner]);
+    __m128 v2 = vertex_load (positions, t[6 + corner]);
+    __m128 v3 = vertex_load (positions, t[9 + corner]);
+    _MM_TRANSPOSE4_PS (v0, v1, v2, v3);
+    *x = v0;
+    *y = v1;
+    *z = v2;
+}
+
+static inline void normal_store (float *dst, __m128 n)
+{
+    _mm_storel_pi ((__m64 *) dst, n);
+    _mm_store_ss (dst + 2, _mm_movehl_ps (n, n));
+}
+#endif
+
+/**
+ * Computes the area weighted normals (the cross products of the edges) of the triangles
+ * begin ... end - 1
+ */
+static void faces_area (struct normals_ctx *ctx, uint32_t begin, uint32_t end)
+{
+    const float *pos = ctx->positions;
+    uint32_t t = begin;
+#ifdef __SSE2__
+    for (; t + 4 <= end; t += 4)
+    {
+        const uint32_t *tri = &ctx->triangles[(size_t) t * 3];
+        __m128 ax, ay, az, bx, by, bz, cx, cy, cz;
+        corners_load (pos, tri, 0, &ax, &ay, &az);
+        corners_load (pos, tri, 1, &bx, &by, &bz);
+        corners_load (pos, tri, 2, &cx, &cy, &cz);
+
+        __m128 e1x = _mm_sub_ps (bx, ax), e1y = _mm_sub_ps (by, ay), e1z = _mm_sub_ps (bz, az);
+        __m128 e2x = _mm_sub_ps (cx, ax), e2y = _mm_sub_ps (cy, ay), e2z = _mm_sub_ps (cz, az);
+        __m128 nx = _mm_sub_ps (_mm_mul_ps (e1y, e2z), _mm_mul_ps (e1z, e2y));
+        __m128 ny = _mm_sub_ps (_mm_mul_ps (e1z, e2x), _mm_mul_ps (e1x, e2z));
+        __m128 nz = _mm_sub_ps (_mm_mul_ps (e1x, e2y), _mm_mul_ps (e1y, e2x));
+        __m128 nw = _mm_setzero_ps ();
+
+        _MM_TRANSPOSE4_PS (nx, ny, nz, nw);
+        float *dst = &ctx->faces[(size_t) t * 3];
+        normal_store (dst, nx);
+        normal_store (dst + 3, ny);
+        normal_store (dst + 6, nz);
+        normal_store (dst + 9, nw);
+    }
+#endif
+    for (; t < end; t++)
+        triangle_normal (pos, &ctx->triangles[(size_t) t * 3], &ctx->faces[(size_t) t * 3]);
+}
+
+/**
+ * Computes the angle weighted normals of the corners of the triangles begin ... end - 1
+ */
+static void faces_angle (struct normals_ctx *ctx, uint32_t begin, uint32_t end)
+{
+    const float *pos = ctx->positions;
+    for (uint32_t t = begin; t < end; t++)
+    {
+        const uint32_t *tri = &ctx->triangles[(size_t) t * 3];
+        float *dst = &ctx->faces[(size_t) t * 9];
+        float n[3];
+        triangle_normal (pos, tri, n);
+        float len = sqrtf (n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        for (int c = 0; c < 3; c++)
+        {
+            const float *p = &pos[(size_t) tri[c] * 3];
+            const float *p1 = &pos[(size_t) tri[(c + 1) % 3] * 3];
+            const float *p2 = &pos[(size_t) tri[(c + 2) % 3] * 3];
+            float d = (p1[0] - p[0]) * (p2[0] - p[0]) + (p1[1] - p[1]) * (p2[1] - p[1]) + (p1[2] - p[2]) * (p2[2] - p[2]);
+
+            // the length of the cross product is the same for all corners
+            float w = (len > 0.0f) ? atan2f (len, d) / len : 0.0f;
+            dst[c * 3] = n[0] * w;
+            dst[c * 3 + 1] = n[1] * w;
+            dst[c * 3 + 2] = n[2] * w;
+        }
+    }
+}
+
+static void faces_task (void *arg, uint32_t i)
+{
+    struct normals_ctx *ctx = arg;
+    uint32_t begin = i * NORMALS_CHUNK;
+    uint32_t end = (ctx->nr_triangles - begin > NORMALS_CHUNK) ? begin + NORMALS_CHUNK : ctx->nr_triangles;
+
+    if (ctx->weighting == REX_NORMALS_ANGLE)
+        faces_angle (ctx, begin, end);
+    else
+        faces_area (ctx, begin, end);
+}
+
+static void vertices_task (void *arg, uint32_t i)
+{
+    struct normals_ctx *ctx = arg;
+    uint32_t begin = i * NORMALS_CHUNK;
+    uint32_t end = (ctx->nr_vertices - begin > NORMALS_CHUNK) ? begin + NORMALS_CHUNK : ctx->nr_vertices;
+
+    // area weighted normals are stored per triangle, angle weighted per corner
+    uint32_t div = (ctx->weighting == REX_NORMALS_ANGLE) ? 1 : 3;
+    for (uint32_t v = begin; v < end; v++)
+    {
+        float n[3] = { 0.0f, 0.0f, 0.0f };
+        for (uint32_t k = ctx->offsets[v]; k < ctx->offsets[v + 1]; k++)
+        {
+            const float *f = &ctx->faces[(size_t) (ctx->corners[k] / div) * 3];
+            n[0] += f[0];
+            n[1] += f[1];
+            n[2] += f[2];
+        }
+
+        float *dst = &ctx->normals[(size_t) v * 3];
+        float len = sqrtf (n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len > 0.0f && isfinite (len))
+        {
+            dst[0] = n[0] / len;
+            dst[1] = n[1] / len;
+            dst[2] = n[2] / len;
+        }
+        else
+        {
+            dst[0] = 0.0f;
+            dst[1] = 0.0f;
+            dst[2] = 1.0f;
+        }
+    }
+}
+
+/**
+ * Builds the vertex to corner adjacency as compressed rows
+ */
+static void corners_build (struct normals_ctx *ctx)
+{
+    uint32_t *offsets = ctx->offsets;
+    uint32_t nr_indices = ctx->nr_triangles * 3;
+
+    memset (offsets, 0, ((size_t) ctx->nr_vertices + 1) * sizeof (uint32_t));
+    for (uint32_t i = 0; i < nr_indices; i++)
+        offsets[ctx->triangles[i] + 1]++;
+    for (uint32_t v = 0; v < ctx->nr_vertices; v++)
+        offsets[v + 1] += offsets[v];
+    for (uint32_t i = 0; i < nr_indices; i++)
+        ctx->corners[offsets[ctx->triangles[i]]++] = i;
+    for (uint32_t v = ctx->nr_vertices; v > 0; v--)
+        offsets[v] = offsets[v - 1];
+    offsets[0] = 0;
+}
+
+int rex_mesh_calc_normals (const struct rex_mesh *mesh, enum rex_normals_weighting weighting,
+                           struct rex_thread_pool *pool, float *normals)
+{
+    if (!mesh || !normals)
+        return REX_MISSING_PARAMETER;
+    if ((mesh->nr_vertices && !mesh->positions) || (mesh->nr_triangles && !mesh->triangles))
+    {
+        warn ("Mesh without positions or triangles");
+        return REX_MISSING_PARAMETER;
+    }
+    if (mesh->nr_triangles > UINT32_MAX / 3)
+    {
+        warn ("Mesh has too many triangles to calculate normals");
+        return REX_ERROR_INVALID_DATA;
+    }
+
+    size_t nr_indices = (size_t) mesh->nr_triangles * 3;
+    for (size_t i = 0; i < nr_indices; i++)
+        if (mesh->triangles[i] >= mesh->nr_vertices)
+        {
+            warn ("Triangle index %u exceeds the number of vertices", mesh->triangles[i]);
+            return REX_ERROR_INVALID_DATA;
+        }
+
+    struct rex_trace_span span = rex_trace_begin ("calc normals");
+    struct normals_ctx ctx =
+    {
+        .positions = mesh->positions,
+        .triangles = mesh->triangles,
+        .nr_triangles = mesh->nr_triangles,
+        .nr_vertices = mesh->nr_vertices,
+        .weighting = weighting,
+        .normals = normals
+    };
+    size_t nr_faces = (weighting == REX_NORMALS_ANGLE) ? nr_indices : mesh->nr_triangles;
+    ctx.faces = rex_malloc (nr_faces * 3 * sizeof (float) + 1);
+    ctx.offsets = rex_malloc (((size_t) mesh->nr_vertices + 1) * sizeof (uint32_t));
+    ctx.corners = rex_malloc (nr_indices * sizeof (uint32_t) + 1);
+    if (!ctx.faces || !ctx.offsets || !ctx.corners)
+    {
+        FREE (ctx.faces);
+        FREE (ctx.offsets);
+        FREE (ctx.corners);
+        rex_trace_end (&span);
+        return REX_ERROR_MEMORY;
+    }
+
+    rex_parallel_for (pool, (mesh->nr_triangles + NORMALS_CHUNK - 1) / NORMALS_CHUNK, faces_task, &ctx);
+    corners_build (&ctx);
+    rex_parallel_for (pool, (uint32_t) (((uint64_t) mesh->nr_vertices + NORMALS_CHUNK - 1) / NORMALS_CHUNK), vertices_task, &ctx);
+
+    FREE (ctx.faces);
+    FREE (ctx.offsets);
+    FREE (ctx.corners);
+    rex_trace_end (&span);
+    return REX_OK;
+}
+
+int rex_mesh_generate_normals (struct rex_mesh *mesh, enum rex_normals_weighting weighting,
+                               struct rex_thread_pool *pool)
+{
+    if (!mesh)
+        return REX_MISSING_PARAMETER;
+
+    float *normals = mesh->normals;
+    if (!normals)
+    {
+        normals = rex_malloc ((size_t) mesh->nr_vertices * 3 * sizeof (float) + 1);
+        if (!normals)
+            return REX_ERROR_MEMORY;
+    }
+
+    int ret = rex_mesh_calc_normals (mesh, weighting, pool, normals);
+    if (ret != REX_OK)
+    {
+        if (normals != mesh->normals)
+            FREE (normals);
+        return ret;
+    }
+    mesh->normals = normals;
+    return REX_OK;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Generation of smooth vertex normals
+ *
+ * Normals can be derived from the geometry, so they do not need to be stored in the file.
+ * The normal of a vertex is the normalized sum of the normals of the adjacent triangles,
+ * weighted either by the triangle area or by the angle of the triangle at the vertex. The
+ * angle weighting is independent of the tessellation, the area weighting is faster.
+ *
+ * The computation runs in two parallel passes without any write conflicts: the weighted
+ * triangle normals are computed per triangle (four triangles at a time with SSE2), then
+ * every vertex gathers the normals of its triangles from a vertex to triangle adjacency.
+ * The result is deterministic and does not depend on the number of threads.
+ *
+ * Vertices without adjacent triangles, or whose triangles cancel out, get the normal (0, 0, 1).
+ * Vertices at the same position with different attributes (seams) get separate normals.
+ */
+
+#include <stdint.h>
+
+#include "rex-block-mesh.h"
+#include "rex-thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The weighting of the triangle normals
+ */
+enum rex_normals_weighting
+{
+    REX_NORMALS_AREA = 0, //<! weighted by the triangle area
+    REX_NORMALS_ANGLE     //<! weighted by the angle of the triangle at the vertex
+};
+
+/**
+ * Computes the vertex normals of a mesh.
+ *
+ * \param mesh the mesh with positions and triangles
+ * \param weighting the weighting of the triangle normals
+ * \param pool the thread pool, NULL runs on the calling thread
+ * \param normals the array of 3 * nr_vertices floats which gets filled
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_calc_normals (const struct rex_mesh *mesh, enum rex_normals_weighting weighting,
+                           struct rex_thread_pool *pool, float *normals);
+
+/**
+ * Computes the vertex normals and stores them in the normals of the mesh. The array is
+ * allocated if the mesh has no normals, else the existing normals are overwritten.
+ *
+ * \param mesh the mesh which gets the normals
+ * \param weighting the weighting of the triangle normals
+ * \param pool the thread pool, NULL runs on the calling thread
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_generate_normals (struct rex_mesh *mesh, enum rex_normals_weighting weighting,
+                               struct rex_thread_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
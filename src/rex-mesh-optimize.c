@@ -0,0 +1,528 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "linmath.h"
+#include "rex-mesh-optimize.h"
+#include "rex-trace.h"
+#include "status.h"
+#include "util.h"
+
+/**
+ * The triangles which use a vertex, stored as compressed rows: the triangles of vertex v are
+ * tris[offsets[v]] ... tris[offsets[v + 1] - 1]
+ */
+struct adjacency
+{
+    uint32_t *offsets;
+    uint32_t *tris;
+};
+
+/**
+ * A triangle cluster with its sort key for the overdraw pass
+ */
+struct cluster_key
+{
+    float key;
+    uint32_t cluster;
+};
+
+static int mesh_check (const struct rex_mesh *mesh)
+{
+    if (!mesh)
+        return REX_MISSING_PARAMETER;
+    if (mesh->nr_triangles && !mesh->triangles)
+    {
+        warn ("Mesh without triangles");
+        return REX_MISSING_PARAMETER;
+    }
+
+    size_t nr_indices = (size_t) mesh->nr_triangles * 3;
+    for (size_t i = 0; i < nr_indices; i++)
+        if (mesh->triangles[i] >= mesh->nr_vertices)
+        {
+            warn ("Triangle index %u exceeds the number of vertices", mesh->triangles[i]);
+            return REX_ERROR_INVALID_DATA;
+        }
+    return REX_OK;
+}
+
+/**
+ * Simulates a FIFO cache with timestamps. A vertex is in the cache if less than cache_size
+ * vertices have been transformed since its own transformation. Returns 1 on a cache miss.
+ */
+static inline uint32_t cache_update (uint32_t *ts, uint32_t *time, uint32_t cache_size, uint32_t v)
+{
+    if (*time - ts[v] > cache_size)
+    {
+        ts[v] = (*time)++;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Invalidates all entries of the simulated cache
+ */
+static inline void cache_flush (uint32_t *time, uint32_t cache_size)
+{
+    *time += cache_size + 1;
+}
+
+static uint32_t *cache_create (uint32_t nr_vertices)
+{
+    uint32_t *ts = rex_malloc ((size_t) nr_vertices * sizeof (uint32_t) + 1);
+    if (ts)
+        memset (ts, 0, (size_t) nr_vertices * sizeof (uint32_t));
+    return ts;
+}
+
+static int adjacency_build (const struct rex_mesh *mesh, struct adjacency *adj)
+{
+    uint32_t nv = mesh->nr_vertices;
+    size_t nr_indices = (size_t) mesh->nr_triangles * 3;
+
+    adj->offsets = rex_malloc (((size_t) nv + 1) * sizeof (uint32_t));
+    adj->tris = rex_malloc (nr_indices * sizeof (uint32_t) + 1);
+    if (!adj->offsets || !adj->tris)
+    {
+        FREE (adj->offsets);
+        FREE (adj->tris);
+        return REX_ERROR_MEMORY;
+    }
+
+    memset (adj->offsets, 0, ((size_t) nv + 1) * sizeof (uint32_t));
+    for (size_t i = 0; i < nr_indices; i++)
+        adj->offsets[mesh->triangles[i] + 1]++;
+    for (uint32_t v = 0; v < nv; v++)
+        adj->offsets[v + 1] += adj->offsets[v];
+
+    // offsets[v] is used as insert position and restored afterwards
+    for (size_t i = 0; i < nr_indices; i++)
+        adj->tris[adj->offsets[mesh->triangles[i]]++] = (uint32_t) (i / 3);
+    for (uint32_t v = nv; v > 0; v--)
+        adj->offsets[v] = adj->offsets[v - 1];
+    adj->offsets[0] = 0;
+    return REX_OK;
+}
+
+void rex_mesh_optimize_params_init (struct rex_mesh_optimize_params *params)
+{
+    if (!params) return;
+
+    params->cache_size = REX_MESH_CACHE_SIZE;
+    params->overdraw = 0;
+    params->overdraw_threshold = 1.05f;
+    params->reorder_vertices = 1;
+}
+
+int rex_mesh_cache_stats (const struct rex_mesh *mesh, uint32_t cache_size, struct rex_mesh_cache_stats *stats)
+{
+    if (!stats)
+        return REX_MISSING_PARAMETER;
+    int ret = mesh_check (mesh);
+    if (ret != REX_OK)
+        return ret;
+    if (!cache_size)
+        cache_size = REX_MESH_CACHE_SIZE;
+
+    memset (stats, 0, sizeof (struct rex_mesh_cache_stats));
+    stats->cache_size = cache_size;
+    if (!mesh->nr_triangles)
+        return REX_OK;
+
+    uint32_t *ts = cache_create (mesh->nr_vertices);
+    if (!ts)
+        return REX_ERROR_MEMORY;
+
+    uint32_t time = cache_size + 1;
+    size_t nr_indices = (size_t) mesh->nr_triangles * 3;
+    for (size_t i = 0; i < nr_indices; i++)
+        stats->transforms += cache_update (ts, &time, cache_size, mesh->triangles[i]);
+
+    // every referenced vertex got a timestamp
+    uint32_t referenced = 0;
+    for (uint32_t v = 0; v < mesh->nr_vertices; v++)
+        referenced += (ts[v] != 0);
+
+    stats->acmr = (float) stats->transforms / mesh->nr_triangles;
+    stats->atvr = (float) stats->transforms / referenced;
+    FREE (ts);
+    return REX_OK;
+}
+
+/**
+ * Returns the next vertex with remaining triangles from the dead-end stack or, if the
+ * stack is exhausted, by scanning the vertices in input order. Returns -1 if all
+ * triangles have been emitted.
+ */
+static int64_t skip_dead_end (const uint32_t *live, const uint32_t *stack, size_t *nr_stack,
+                              uint32_t nr_vertices, uint32_t *cursor)
+{
+    while (*nr_stack)
+    {
+        uint32_t v = stack[--(*nr_stack)];
+        if (live[v])
+            return v;
+    }
+    for (; *cursor < nr_vertices; (*cursor)++)
+        if (live[*cursor])
+            return *cursor;
+    return -1;
+}
+
+int rex_mesh_optimize_vertex_cache (struct rex_mesh *mesh, uint32_t cache_size)
+{
+    int ret = mesh_check (mesh);
+    if (ret != REX_OK || !mesh->nr_triangles)
+        return ret;
+    if (!cache_size)
+        cache_size = REX_MESH_CACHE_SIZE;
+
+    uint32_t nv = mesh->nr_vertices;
+    size_t nr_indices = (size_t) mesh->nr_triangles * 3;
+
+    struct adjacency adj;
+    if (adjacency_build (mesh, &adj) != REX_OK)
+        return REX_ERROR_MEMORY;
+
+    uint32_t *live = rex_malloc ((size_t) nv * sizeof (uint32_t));
+    uint32_t *ts = cache_create (nv);
+    uint8_t *emitted = rex_malloc (mesh->nr_triangles);
+    uint32_t *dead_end = rex_malloc (nr_indices * sizeof (uint32_t));
+    uint32_t *candidates = rex_malloc (nr_indices * sizeof (uint32_t));
+    uint32_t *out = rex_malloc (nr_indices * sizeof (uint32_t));
+    if (!live || !ts || !emitted || !dead_end || !candidates || !out)
+    {
+        ret = REX_ERROR_MEMORY;
+        goto cleanup;
+    }
+
+    for (uint32_t v = 0; v < nv; v++)
+        live[v] = adj.offsets[v + 1] - adj.offsets[v];
+    memset (emitted, 0, mesh->nr_triangles);
+
+    uint32_t time = cache_size + 1;
+    uint32_t cursor = 0;
+    size_t nr_dead_end = 0;
+    size_t nr_out = 0;
+
+    // fan around the current vertex f, then continue with the vertex which is still in the
+    // cache and will not be evicted before its remaining triangles are emitted
+    int64_t f = skip_dead_end (live, dead_end, &nr_dead_end, nv, &cursor);
+    while (f >= 0)
+    {
+        size_t nr_candidates = 0;
+        for (uint32_t k = adj.offsets[f]; k < adj.offsets[f + 1]; k++)
+        {
+            uint32_t t = adj.tris[k];
+            if (emitted[t])
+                continue;
+            emitted[t] = 1;
+
+            for (int c = 0; c < 3; c++)
+            {
+                uint32_t v = mesh->triangles[(size_t) t * 3 + c];
+                out[nr_out++] = v;
+                dead_end[nr_dead_end++] = v;
+                candidates[nr_candidates++] = v;
+                live[v]--;
+                cache_update (ts, &time, cache_size, v);
+            }
+        }
+
+        int64_t best = -1;
+        uint32_t priority = 0;
+        for (size_t c = 0; c < nr_candidates; c++)
+        {
+            uint32_t v = candidates[c];
+            if (!live[v])
+                continue;
+
+            uint32_t age = time - ts[v];
+            uint32_t p = ((uint64_t) age + 2 * (uint64_t) live[v] <= cache_size) ? age : 0;
+            if (best < 0 || p > priority)
+            {
+                best = v;
+                priority = p;
+            }
+        }
+
+        f = (best >= 0) ? best : skip_dead_end (live, dead_end, &nr_dead_end, nv, &cursor);
+    }
+
+    memcpy (mesh->triangles, out, nr_indices * sizeof (uint32_t));
+
+cleanup:
+    FREE (adj.offsets);
+    FREE (adj.tris);
+    FREE (live);
+    FREE (ts);
+    FREE (emitted);
+    FREE (dead_end);
+    FREE (candidates);
+    FREE (out);
+    return ret;
+}
+
+static int cluster_key_cmp (const void *a, const void *b)
+{
+    const struct cluster_key *ka = a;
+    const struct cluster_key *kb = b;
+    if (ka->key != kb->key)
+        return (ka->key > kb->key) ? -1 : 1;
+    return (ka->cluster < kb->cluster) ? -1 : (ka->cluster > kb->cluster);
+}
+
+/**
+ * Splits the triangles into clusters. Hard boundaries are located where the cache has been
+ * flushed (all vertices of a triangle are misses), each of these clusters is split further
+ * wherever the ACMR of the part is within threshold of the ACMR of the whole cluster.
+ * Returns the number of clusters, the start triangles are stored in clusters, followed by
+ * the number of triangles as end marker.
+ */
+static uint32_t clusters_build (const struct rex_mesh *mesh, uint32_t cache_size, float threshold,
+                                uint32_t *ts, uint32_t *hard, uint32_t *clusters)
+{
+    const uint32_t *tri = mesh->triangles;
+    uint32_t nt = mesh->nr_triangles;
+    uint32_t time = cache_size + 1;
+
+    uint32_t nr_hard = 0;
+    for (uint32_t t = 0; t < nt; t++)
+    {
+        uint32_t misses = cache_update (ts, &time, cache_size, tri[t * 3])
+                          + cache_update (ts, &time, cache_size, tri[t * 3 + 1])
+                          + cache_update (ts, &time, cache_size, tri[t * 3 + 2]);
+        if (t == 0 || misses == 3)
+            hard[nr_hard++] = t;
+    }
+    hard[nr_hard] = nt;
+
+    uint32_t nr_clusters = 0;
+    for (uint32_t h = 0; h < nr_hard; h++)
+    {
+        uint32_t start = hard[h];
+        uint32_t end = hard[h + 1];
+
+        cache_flush (&time, cache_size);
+        uint64_t misses = 0;
+        for (uint32_t t = start; t < end; t++)
+            for (int c = 0; c < 3; c++)
+                misses += cache_update (ts, &time, cache_size, tri[t * 3 + c]);
+        float cluster_threshold = threshold * (float) misses / (end - start);
+
+        cache_flush (&time, cache_size);
+        clusters[nr_clusters++] = start;
+        misses = 0;
+        for (uint32_t t = start; t < end; t++)
+        {
+            for (int c = 0; c < 3; c++)
+                misses += cache_update (ts, &time, cache_size, tri[t * 3 + c]);
+
+            if (t + 1 < end && (float) misses <= cluster_threshold * (t + 1 - start))
+            {
+                clusters[nr_clusters++] = t + 1;
+                cache_flush (&time, cache_size);
+                misses = 0;
+                start = t + 1;
+            }
+        }
+    }
+    clusters[nr_clusters] = nt;
+    return nr_clusters;
+}
+
+int rex_mesh_optimize_overdraw (struct rex_mesh *mesh, uint32_t cache_size, float threshold)
+{
+    int ret = mesh_check (mesh);
+    if (ret != REX_OK || !mesh->nr_triangles)
+        return ret;
+    if (!mesh->positions)
+    {
+        warn ("Mesh without positions");
+        return REX_MISSING_PARAMETER;
+    }
+    if (!cache_size)
+        cache_size = REX_MESH_CACHE_SIZE;
+
+    uint32_t nt = mesh->nr_triangles;
+    size_t nr_indices = (size_t) nt * 3;
+    const float *pos = mesh->positions;
+
+    uint32_t *ts = cache_create (mesh->nr_vertices);
+    uint32_t *hard = rex_malloc (((size_t) nt + 1) * sizeof (uint32_t));
+    uint32_t *clusters = rex_malloc (((size_t) nt + 1) * sizeof (uint32_t));
+    struct cluster_key *keys = rex_malloc ((size_t) nt * sizeof (struct cluster_key));
+    uint32_t *out = rex_malloc (nr_indices * sizeof (uint32_t));
+    if (!ts || !hard || !clusters || !keys || !out)
+    {
+        ret = REX_ERROR_MEMORY;
+        goto cleanup;
+    }
+
+    uint32_t nr_clusters = clusters_build (mesh, cache_size, threshold, ts, hard, clusters);
+
+    // the center of the mesh is the average of all triangle corners
+    vec3 center = { 0.0f, 0.0f, 0.0f };
+    for (size_t i = 0; i < nr_indices; i++)
+        vec3_add (center, center, &pos[(size_t) mesh->triangles[i] * 3]);
+    vec3_scale (center, center, 1.0f / nr_indices);
+
+    // clusters which face away from the center are on the outside and drawn first
+    for (uint32_t c = 0; c < nr_clusters; c++)
+    {
+        vec3 centroid = { 0.0f, 0.0f, 0.0f };
+        vec3 normal = { 0.0f, 0.0f, 0.0f };
+        float area = 0.0f;
+
+        for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            const float *p0 = &pos[(size_t) mesh->triangles[t * 3] * 3];
+            const float *p1 = &pos[(size_t) mesh->triangles[t * 3 + 1] * 3];
+            const float *p2 = &pos[(size_t) mesh->triangles[t * 3 + 2] * 3];
+
+            vec3 e1, e2, n, mid;
+            vec3_sub (e1, p1, p0);
+            vec3_sub (e2, p2, p0);
+            vec3_mul_cross (n, e1, e2);
+            float a = vec3_len (n);
+
+            vec3_add (mid, p0, p1);
+            vec3_add (mid, mid, p2);
+            vec3_scale (mid, mid, a / 3.0f);
+            vec3_add (centroid, centroid, mid);
+            vec3_add (normal, normal, n);
+            area += a;
+        }
+
+        float key = 0.0f;
+        float len = vec3_len (normal);
+        if (area > 0.0f && len > 0.0f)
+        {
+            vec3_scale (centroid, centroid, 1.0f / area);
+            vec3_sub (centroid, centroid, center);
+            key = vec3_mul_inner (centroid, normal) / len;
+        }
+        keys[c].key = key;
+        keys[c].cluster = c;
+    }
+    qsort (keys, nr_clusters, sizeof (struct cluster_key), cluster_key_cmp);
+
+    size_t nr_out = 0;
+    for (uint32_t c = 0; c < nr_clusters; c++)
+    {
+        uint32_t start = clusters[keys[c].cluster];
+        uint32_t end = clusters[keys[c].cluster + 1];
+        memcpy (&out[nr_out], &mesh->triangles[(size_t) start * 3], (size_t) (end - start) * 3 * sizeof (uint32_t));
+        nr_out += (size_t) (end - start) * 3;
+    }
+    memcpy (mesh->triangles, out, nr_indices * sizeof (uint32_t));
+
+cleanup:
+    FREE (ts);
+    FREE (hard);
+    FREE (clusters);
+    FREE (keys);
+    FREE (out);
+    return ret;
+}
+
+static void attribute_permute (float *data, uint32_t components, const uint32_t *order, uint32_t nr_vertices, float *scratch)
+{
+    if (!data) return;
+
+    for (uint32_t i = 0; i < nr_vertices; i++)
+        for (uint32_t c = 0; c < components; c++)
+            scratch[(size_t) i * components + c] = data[(size_t) order[i] * components + c];
+    memcpy (data, scratch, (size_t) nr_vertices * components * sizeof (float));
+}
+
+int rex_mesh_optimize_vertex_fetch (struct rex_mesh *mesh)
+{
+    int ret = mesh_check (mesh);
+    if (ret != REX_OK || !mesh->nr_vertices)
+        return ret;
+
+    uint32_t nv = mesh->nr_vertices;
+    size_t nr_indices = (size_t) mesh->nr_triangles * 3;
+
+    // remap[old] = new, order[new] = old
+    uint32_t *remap = rex_malloc ((size_t) nv * sizeof (uint32_t));
+    uint32_t *order = rex_malloc ((size_t) nv * sizeof (uint32_t));
+    float *scratch = rex_malloc ((size_t) nv * 3 * sizeof (float));
+    if (!remap || !order || !scratch)
+    {
+        FREE (remap);
+        FREE (order);
+        FREE (scratch);
+        return REX_ERROR_MEMORY;
+    }
+    memset (remap, 0xff, (size_t) nv * sizeof (uint32_t));
+
+    uint32_t next = 0;
+    for (size_t i = 0; i < nr_indices; i++)
+    {
+        uint32_t v = mesh->triangles[i];
+        if (remap[v] == UINT32_MAX)
+        {
+            remap[v] = next;
+            order[next++] = v;
+        }
+        mesh->triangles[i] = remap[v];
+    }
+    for (uint32_t v = 0; v < nv; v++)
+        if (remap[v] == UINT32_MAX)
+        {
+            remap[v] = next;
+            order[next++] = v;
+        }
+
+    attribute_permute (mesh->positions, 3, order, nv, scratch);
+    attribute_permute (mesh->normals, 3, order, nv, scratch);
+    attribute_permute (mesh->tex_coords, 2, order, nv, scratch);
+    attribute_permute (mesh->colors, 3, order, nv, scratch);
+
+    FREE (remap);
+    FREE (order);
+    FREE (scratch);
+    return REX_OK;
+}
+
+int rex_mesh_optimize (struct rex_mesh *mesh, const struct rex_mesh_optimize_params *params,
+                       struct rex_mesh_cache_stats *before, struct rex_mesh_cache_stats *after)
+{
+    struct rex_mesh_optimize_params defaults;
+    rex_mesh_optimize_params_init (&defaults);
+    if (!params)
+        params = &defaults;
+
+    struct rex_trace_span span = rex_trace_begin ("optimize mesh");
+    int ret = before ? rex_mesh_cache_stats (mesh, params->cache_size, before) : mesh_check (mesh);
+    if (ret == REX_OK)
+        ret = rex_mesh_optimize_vertex_cache (mesh, params->cache_size);
+    if (ret == REX_OK && params->overdraw)
+        ret = rex_mesh_optimize_overdraw (mesh, params->cache_size, params->overdraw_threshold);
+    if (ret == REX_OK && params->reorder_vertices)
+        ret = rex_mesh_optimize_vertex_fetch (mesh);
+    if (ret == REX_OK && after)
+        ret = rex_mesh_cache_stats (mesh, params->cache_size, after);
+    rex_trace_end (&span);
+    return ret;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Reordering of meshes for the vertex cache, overdraw and vertex fetch of the GPU
+ *
+ * The order of the triangles and vertices does not change the geometry, but it has a large
+ * impact on the rendering speed of the clients. The optimization consists of three passes,
+ * which are applied in this order by rex_mesh_optimize:
+ *
+ * - the triangles are reordered for the post-transform vertex cache (Tipsify, see Sander et
+ *   al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007),
+ * - optionally, clusters of triangles are sorted to draw the outer surfaces first, which
+ *   reduces the overdraw; the cache efficiency is traded against the overdraw by a threshold,
+ * - the vertex attributes are reordered by the first use of the triangles, which gives a
+ *   sequential memory access when the vertices are fetched.
+ *
+ * The efficiency is measured by simulating a FIFO vertex cache. The ACMR (average cache miss
+ * ratio) is the number of transformed vertices per triangle, it ranges from 0.5 to 3. The
+ * ATVR (average transform to vertex ratio) is the number of transformed vertices per
+ * referenced vertex, the optimum is 1.
+ *
+ * The optimization is an opt-in pre-pass of the writers, the mesh is modified in place:
+ *
+ * \code
+ * struct rex_mesh_optimize_params params;
+ * rex_mesh_optimize_params_init (&params);
+ * params.overdraw = 1;
+ * if (rex_mesh_optimize (&mesh, &params, NULL, NULL) == REX_OK)
+ *     ptr = rex_block_write_mesh (id, header, &mesh, &sz);
+ * \endcode
+ */
+
+#include <stdint.h>
+
+#include "rex-block-mesh.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The default size of the simulated vertex cache
+ */
+#define REX_MESH_CACHE_SIZE 16
+
+/**
+ * The parameters of rex_mesh_optimize
+ */
+struct rex_mesh_optimize_params
+{
+    uint32_t cache_size;      //<! the size of the simulated vertex cache (default 16)
+    int overdraw;             //<! 1 to reorder the triangle clusters for overdraw (default 0)
+    float overdraw_threshold; //<! the accepted ACMR degradation by the overdraw pass (default 1.05)
+    int reorder_vertices;     //<! 1 to reorder the vertices for fetch locality (default 1)
+};
+
+/**
+ * The result of the vertex cache simulation
+ */
+struct rex_mesh_cache_stats
+{
+    uint32_t cache_size;  //<! the size of the simulated FIFO cache
+    uint64_t transforms;  //<! the number of cache misses (transformed vertices)
+    float acmr;           //<! the average cache miss ratio (transforms per triangle)
+    float atvr;           //<! the average transform to vertex ratio (transforms per referenced vertex)
+};
+
+/**
+ * Sets the default optimization parameters
+ */
+void rex_mesh_optimize_params_init (struct rex_mesh_optimize_params *params);
+
+/**
+ * Simulates a FIFO vertex cache of the given size on the triangles of the mesh.
+ *
+ * \param mesh the mesh which gets analyzed
+ * \param cache_size the size of the simulated cache, 0 uses the default size
+ * \param stats the statistics which get filled
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_cache_stats (const struct rex_mesh *mesh, uint32_t cache_size, struct rex_mesh_cache_stats *stats);
+
+/**
+ * Reorders the triangles of the mesh for the vertex cache (Tipsify). The vertices are
+ * not changed. The runtime is linear in the number of triangles.
+ *
+ * \param mesh the mesh which gets modified
+ * \param cache_size the size of the target vertex cache, 0 uses the default size
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_optimize_vertex_cache (struct rex_mesh *mesh, uint32_t cache_size);
+
+/**
+ * Reorders clusters of triangles, so that outer surfaces are drawn first. The clusters are
+ * derived from the current triangle order, which should be optimized for the vertex cache
+ * before. A cluster is split wherever the ACMR of the part is within threshold of the whole
+ * cluster, so a larger threshold gives more clusters and less overdraw. The mesh must have
+ * positions.
+ *
+ * \param mesh the mesh which gets modified
+ * \param cache_size the size of the target vertex cache, 0 uses the default size
+ * \param threshold the accepted ACMR degradation (e.g. 1.05)
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_optimize_overdraw (struct rex_mesh *mesh, uint32_t cache_size, float threshold);
+
+/**
+ * Reorders the vertex attributes by the first use of the triangles, the triangle indices get
+ * remapped. Unreferenced vertices are moved to the end.
+ *
+ * \param mesh the mesh which gets modified
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_optimize_vertex_fetch (struct rex_mesh *mesh);
+
+/**
+ * Applies all passes to the mesh as configured by the params. The cache statistics
+ * before and after the optimization are reported if before and after are not NULL.
+ *
+ * \param mesh the mesh which gets modified
+ * \param params the optimization parameters, NULL uses the defaults
+ * \param before the statistics of the original mesh (can be NULL)
+ * \param after the statistics of the optimized mesh (can be NULL)
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_optimize (struct rex_mesh *mesh, const struct rex_mesh_optimize_params *params,
+                       struct rex_mesh_cache_stats *before, struct rex_mesh_cache_stats *after);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,864 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "global.h"
+#include "rex-bounds.h"
+#include "rex-mesh-simplify.h"
+#include "rex-trace.h"
+#include "status.h"
+#include "util.h"
+
+#define NO_EDGE    UINT32_MAX        // the vertex has no open edge
+#define MULTI_EDGE (UINT32_MAX - 1)  // the vertex has more than one open edge
+
+// open border edges get a stronger quadric than the faces
+#define BORDER_WEIGHT 10.0
+
+// the number of key bits for sorting the collapses (sign, exponent and 7 mantissa bits)
+#define SORT_BITS 16
+
+enum vertex_kind
+{
+    KIND_MANIFOLD = 0,  // interior vertex, can be collapsed onto any neighbour
+    KIND_BORDER,        // on an open border, can be collapsed along the border
+    KIND_SEAM,          // on an attribute seam, both sides are collapsed along the seam
+    KIND_LOCKED         // never moves
+};
+
+/**
+ * The symmetric quadric p^T A p + 2 b^T p + c with the accumulated weight w
+ */
+struct quadric
+{
+    double a00, a11, a22, a01, a02, a12;
+    double b0, b1, b2;
+    double c;
+    double w;
+};
+
+struct collapse
+{
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+struct simplify_state
+{
+    uint32_t nr_vertices;
+    uint32_t *tri;        // the working triangles
+    size_t nr_indices;
+
+    double *pos;          // positions normalized to the unit cube
+    uint32_t *group;      // the first vertex with the same position
+    uint32_t *wedge;      // the next vertex with the same position (circular list)
+    uint8_t *kind;
+    uint32_t *open_out;   // the target of the open edge starting at the vertex
+    uint32_t *open_inc;   // the source of the open edge ending at the vertex
+    struct quadric *q;    // the quadric of every position group (stored at group[v])
+
+    uint32_t *offsets;    // vertex to triangle adjacency, see adjacency_build
+    uint32_t *adj;
+    uint32_t *remap;
+    uint8_t *locked;
+    struct collapse *collapses;
+    struct collapse *sorted;
+    uint32_t *histogram;
+};
+
+void rex_mesh_simplify_params_init (struct rex_mesh_simplify_params *params)
+{
+    if (!params) return;
+
+    params->target_ratio = 0.5f;
+    params->target_error = 0.01f;
+    params->lock_border = 0;
+}
+
+void rex_mesh_lod_params_init (struct rex_mesh_lod_params *params)
+{
+    if (!params) return;
+
+    params->nr_lods = 3;
+    params->ratio = 0.5f;
+    params->target_error = 0.01f;
+    params->lock_border = 0;
+}
+
+static void quadric_add (struct quadric *q, const struct quadric *r)
+{
+    q->a00 += r->a00; q->a11 += r->a11; q->a22 += r->a22;
+    q->a01 += r->a01; q->a02 += r->a02; q->a12 += r->a12;
+    q->b0 += r->b0; q->b1 += r->b1; q->b2 += r->b2;
+    q->c += r->c;
+    q->w += r->w;
+}
+
+/**
+ * Creates the weighted quadric of the plane n^T p + d = 0, n must be normalized
+ */
+static void quadric_plane (struct quadric *q, const double *n, double d, double w)
+{
+    q->a00 = w * n[0] * n[0]; q->a11 = w * n[1] * n[1]; q->a22 = w * n[2] * n[2];
+    q->a01 = w * n[0] * n[1]; q->a02 = w * n[0] * n[2]; q->a12 = w * n[1] * n[2];
+    q->b0 = w * n[0] * d; q->b1 = w * n[1] * d; q->b2 = w * n[2] * d;
+    q->c = w * d * d;
+    q->w = w;
+}
+
+/**
+ * Returns the weighted mean of the squared distances of p to the planes of the quadric
+ */
+static double quadric_error (const struct quadric *q, const double *p)
+{
+    double rx = q->a00 * p[0] + q->a01 * p[1] + q->a02 * p[2] + q->b0;
+    double ry = q->a01 * p[0] + q->a11 * p[1] + q->a12 * p[2] + q->b1;
+    double rz = q->a02 * p[0] + q->a12 * p[1] + q->a22 * p[2] + q->b2;
+    double r = rx * p[0] + ry * p[1] + rz * p[2] + q->b0 * p[0] + q->b1 * p[1] + q->b2 * p[2] + q->c;
+    return fabs (r) / ((q->w > 0.0) ? q->w : 1.0);
+}
+
+static inline void vec_sub (double *r, const double *a, const double *b)
+{
+    r[0] = a[0] - b[0];
+    r[1] = a[1] - b[1];
+    r[2] = a[2] - b[2];
+}
+
+static inline void vec_cross (double *r, const double *a, const double *b)
+{
+    r[0] = a[1] * b[2] - a[2] * b[1];
+    r[1] = a[2] * b[0] - a[0] * b[2];
+    r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline double vec_dot (const double *a, const double *b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/**
+ * Builds the vertex to triangle adjacency as compressed rows: the triangles of vertex v
+ * are adj[offsets[v]] ... adj[offsets[v + 1] - 1]
+ */
+static void adjacency_build (struct simplify_state *s)
+{
+    uint32_t *offsets = s->offsets;
+    memset (offsets, 0, ((size_t) s->nr_vertices + 1) * sizeof (uint32_t));
+    for (size_t i = 0; i < s->nr_indices; i++)
+        offsets[s->tri[i] + 1]++;
+    for (uint32_t v = 0; v < s->nr_vertices; v++)
+        offsets[v + 1] += offsets[v];
+    for (size_t i = 0; i < s->nr_indices; i++)
+        s->adj[offsets[s->tri[i]]++] = (uint32_t) (i / 3);
+    for (uint32_t v = s->nr_vertices; v > 0; v--)
+        offsets[v] = offsets[v - 1];
+    offsets[0] = 0;
+}
+
+/**
+ * Returns 1 if a triangle contains the directed edge a -> b
+ */
+static int has_edge (const struct simplify_state *s, uint32_t a, uint32_t b)
+{
+    for (uint32_t k = s->offsets[a]; k < s->offsets[a + 1]; k++)
+    {
+        const uint32_t *t = &s->tri[(size_t) s->adj[k] * 3];
+        if ((t[0] == a && t[1] == b) || (t[1] == a && t[2] == b) || (t[2] == a && t[0] == b))
+            return 1;
+    }
+    return 0;
+}
+
+static inline uint32_t hash_position (const float *p)
+{
+    uint32_t h[3];
+    memcpy (h, p, sizeof (h));
+    uint32_t x = (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+
+    // the low bits of float coordinates are often zero, they are mixed with the high bits
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    return x ^ (x >> 16);
+}
+
+/**
+ * Groups the referenced vertices with equal positions, the wedges of a group are linked
+ * in a circular list
+ */
+static int groups_build (struct simplify_state *s, const float *positions, const uint8_t *referenced)
+{
+    uint32_t nv = s->nr_vertices;
+    uint64_t nr_buckets = 16;
+    while (nr_buckets < 2 * (uint64_t) nv)
+        nr_buckets *= 2;
+
+    uint32_t *table = rex_malloc (nr_buckets * sizeof (uint32_t));
+    if (!table)
+        return REX_ERROR_MEMORY;
+    memset (table, 0xff, nr_buckets * sizeof (uint32_t));
+
+    for (uint32_t v = 0; v < nv; v++)
+    {
+        s->group[v] = v;
+        s->wedge[v] = v;
+        if (!referenced[v])
+            continue;
+
+        const float *p = &positions[(size_t) v * 3];
+        uint64_t b = hash_position (p) & (nr_buckets - 1);
+        while (table[b] != UINT32_MAX && memcmp (&positions[(size_t) table[b] * 3], p, 3 * sizeof (float)) != 0)
+            b = (b + 1) & (nr_buckets - 1);
+
+        if (table[b] == UINT32_MAX)
+            table[b] = v;
+        else
+        {
+            uint32_t g = table[b];
+            s->group[v] = g;
+            s->wedge[v] = s->wedge[g];
+            s->wedge[g] = v;
+        }
+    }
+    FREE (table);
+    return REX_OK;
+}
+
+static inline void open_edge_add (uint32_t *slot, uint32_t v)
+{
+    *slot = (*slot == NO_EDGE) ? v : MULTI_EDGE;
+}
+
+static inline int single_edge (uint32_t v)
+{
+    return v < MULTI_EDGE;
+}
+
+/**
+ * Finds the open edges, classifies the vertices and sets up the quadrics
+ */
+static void vertices_classify (struct simplify_state *s, const uint8_t *referenced, int lock_border)
+{
+    uint32_t nv = s->nr_vertices;
+    for (uint32_t v = 0; v < nv; v++)
+    {
+        s->open_out[v] = NO_EDGE;
+        s->open_inc[v] = NO_EDGE;
+        memset (&s->q[v], 0, sizeof (struct quadric));
+    }
+
+    for (size_t i = 0; i < s->nr_indices; i += 3)
+    {
+        const uint32_t *t = &s->tri[i];
+        const double *p0 = &s->pos[(size_t) t[0] * 3];
+        const double *p1 = &s->pos[(size_t) t[1] * 3];
+        const double *p2 = &s->pos[(size_t) t[2] * 3];
+
+        double e1[3], e2[3], n[3];
+        vec_sub (e1, p1, p0);
+        vec_sub (e2, p2, p0);
+        vec_cross (n, e1, e2);
+        double len = sqrt (vec_dot (n, n));
+        if (len > 0.0)
+        {
+            n[0] /= len; n[1] /= len; n[2] /= len;
+            struct quadric face;
+            quadric_plane (&face, n, -vec_dot (n, p0), 0.5 * len);
+            for (int c = 0; c < 3; c++)
+                quadric_add (&s->q[s->group[t[c]]], &face);
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            uint32_t a = t[c];
+            uint32_t b = t[(c + 1) % 3];
+            if (has_edge (s, b, a))
+                continue;
+
+            open_edge_add (&s->open_out[a], b);
+            open_edge_add (&s->open_inc[b], a);
+
+            // the plane through the open edge, perpendicular to the face
+            double e[3], m[3];
+            vec_sub (e, &s->pos[(size_t) b * 3], &s->pos[(size_t) a * 3]);
+            double elen = sqrt (vec_dot (e, e));
+            vec_cross (m, e, n);
+            double mlen = sqrt (vec_dot (m, m));
+            if (len > 0.0 && mlen > 0.0)
+            {
+                m[0] /= mlen; m[1] /= mlen; m[2] /= mlen;
+                struct quadric edge;
+                quadric_plane (&edge, m, -vec_dot (m, &s->pos[(size_t) a * 3]), BORDER_WEIGHT * elen);
+                quadric_add (&s->q[s->group[a]], &edge);
+                quadric_add (&s->q[s->group[b]], &edge);
+            }
+        }
+    }
+
+    memset (s->kind, KIND_LOCKED, nv);
+    for (uint32_t v = 0; v < nv; v++)
+    {
+        if (!referenced[v] || s->group[v] != v)
+            continue;
+
+        uint32_t w = s->wedge[v];
+        enum vertex_kind kind = KIND_LOCKED;
+        if (w == v)
+        {
+            if (s->open_out[v] == NO_EDGE && s->open_inc[v] == NO_EDGE)
+                kind = KIND_MANIFOLD;
+            else if (single_edge (s->open_out[v]) && single_edge (s->open_inc[v]) && !lock_border)
+                kind = KIND_BORDER;
+        }
+        else if (s->wedge[w] == v
+                 && single_edge (s->open_out[v]) && single_edge (s->open_inc[v])
+                 && single_edge (s->open_out[w]) && single_edge (s->open_inc[w])
+                 && s->group[s->open_out[v]] == s->group[s->open_inc[w]]
+                 && s->group[s->open_inc[v]] == s->group[s->open_out[w]])
+            kind = KIND_SEAM;
+
+        // all wedges of a position share the kind
+        uint32_t x = v;
+        do
+        {
+            s->kind[x] = kind;
+            x = s->wedge[x];
+        }
+        while (x != v);
+    }
+}
+
+static int can_collapse (const struct simplify_state *s, uint32_t from, uint32_t to)
+{
+    if (s->group[from] == s->group[to])
+        return 0;
+
+    switch (s->kind[from])
+    {
+    case KIND_MANIFOLD:
+        return 1;
+    case KIND_BORDER:
+        return (to == s->open_out[from] || to == s->open_inc[from])
+               && (s->kind[to] == KIND_BORDER || s->kind[to] == KIND_LOCKED);
+    case KIND_SEAM:
+        return (to == s->open_out[from] || to == s->open_inc[from])
+               && (s->kind[to] == KIND_SEAM || s->kind[to] == KIND_LOCKED);
+    default:
+        return 0;
+    }
+}
+
+static double collapse_cost (const struct simplify_state *s, uint32_t from, uint32_t to)
+{
+    struct quadric q = s->q[s->group[from]];
+    quadric_add (&q, &s->q[s->group[to]]);
+    return quadric_error (&q, &s->pos[(size_t) to * 3]);
+}
+
+/**
+ * Returns the wedge on the other side of a seam, which must be collapsed together with
+ * from -> to, or NO_EDGE if there is none.
+ */
+static uint32_t seam_partner (const struct simplify_state *s, uint32_t from, uint32_t to, uint32_t *partner_to)
+{
+    uint32_t partner = s->wedge[from];
+    uint32_t t = (to == s->open_out[from]) ? s->open_inc[partner] : s->open_out[partner];
+    if (!single_edge (t) || s->group[t] != s->group[to])
+        return NO_EDGE;
+    *partner_to = t;
+    return partner;
+}
+
+/**
+ * Returns 1 if one of the remaining triangles around from would flip or degenerate to
+ * a sliver by the collapse, the number of removed triangles is added to removed.
+ */
+static int collapse_flips (const struct simplify_state *s, uint32_t from, uint32_t to, uint32_t *removed)
+{
+    const double *pt = &s->pos[(size_t) to * 3];
+    uint32_t nr_removed = 0;
+
+    for (uint32_t k = s->offsets[from]; k < s->offsets[from + 1]; k++)
+    {
+        const uint32_t *t = &s->tri[(size_t) s->adj[k] * 3];
+        uint32_t v[3] = { s->remap[t[0]], s->remap[t[1]], s->remap[t[2]] };
+        if (v[0] == to || v[1] == to || v[2] == to)
+        {
+            nr_removed++;
+            continue;
+        }
+
+        int c = (v[0] == from) ? 0 : (v[1] == from) ? 1 : 2;
+        const double *p0 = &s->pos[(size_t) v[c] * 3];
+        const double *p1 = &s->pos[(size_t) v[(c + 1) % 3] * 3];
+        const double *p2 = &s->pos[(size_t) v[(c + 2) % 3] * 3];
+
+        double e1[3], e2[3], e3[3], n0[3], n1[3];
+        vec_sub (e1, p1, p0);
+        vec_sub (e2, p2, p0);
+        vec_cross (n0, e1, e2);
+        vec_sub (e1, p1, pt);
+        vec_sub (e3, p2, pt);
+        vec_cross (n1, e1, e3);
+
+        if (vec_dot (n0, n1) < 0.25 * sqrt (vec_dot (n0, n0) * vec_dot (n1, n1)))
+            return 1;
+    }
+
+    *removed += nr_removed;
+    return 0;
+}
+
+/**
+ * Moves the open edges of a border or seam vertex to the target of its collapse
+ */
+static void open_edges_collapse (struct simplify_state *s, uint32_t from, uint32_t to)
+{
+    if (to == s->open_out[from])
+        s->open_inc[to] = s->open_inc[from];
+    else if (to == s->open_inc[from])
+        s->open_out[to] = s->open_out[from];
+}
+
+static inline uint32_t collapse_key (double cost)
+{
+    // the bits of positive floats are ordered like their values
+    float f = (float) cost;
+    uint32_t bits;
+    memcpy (&bits, &f, sizeof (uint32_t));
+    return bits >> (32 - SORT_BITS);
+}
+
+/**
+ * Sorts the collapses by their cost with a counting sort on the upper bits of the cost.
+ * Collapses with a relative cost difference below 1% may remain unordered.
+ */
+static void collapses_sort (struct simplify_state *s, size_t nr_collapses)
+{
+    uint32_t *histogram = s->histogram;
+    memset (histogram, 0, (1u << SORT_BITS) * sizeof (uint32_t));
+    for (size_t i = 0; i < nr_collapses; i++)
+        histogram[collapse_key (s->collapses[i].cost)]++;
+
+    uint32_t sum = 0;
+    for (uint32_t k = 0; k < (1u << SORT_BITS); k++)
+    {
+        uint32_t count = histogram[k];
+        histogram[k] = sum;
+        sum += count;
+    }
+
+    for (size_t i = 0; i < nr_collapses; i++)
+        s->sorted[histogram[collapse_key (s->collapses[i].cost)]++] = s->collapses[i];
+
+    struct collapse *tmp = s->collapses;
+    s->collapses = s->sorted;
+    s->sorted = tmp;
+}
+
+/**
+ * Picks the collapses along the triangle edges, returns the number of collapses. Every edge
+ * a -> b gives the collapse of a onto b, the opposite edge gives the other direction. Open
+ * edges have no opposite, so the cheaper allowed direction is picked.
+ */
+static size_t collapses_pick (struct simplify_state *s)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < s->nr_indices; i++)
+    {
+        uint32_t a = s->tri[i];
+        uint32_t b = s->tri[i - i % 3 + (i + 1) % 3];
+
+        double cost = DBL_MAX;
+        struct collapse c = { 0 };
+        if (can_collapse (s, a, b))
+        {
+            c = (struct collapse) { a, b, collapse_cost (s, a, b) };
+            cost = c.cost;
+        }
+        if (s->open_out[a] == b && can_collapse (s, b, a))
+        {
+            double cost_ba = collapse_cost (s, b, a);
+            if (cost_ba < cost)
+            {
+                c = (struct collapse) { b, a, cost_ba };
+                cost = cost_ba;
+            }
+        }
+        if (cost < DBL_MAX)
+            s->collapses[n++] = c;
+    }
+    return n;
+}
+
+/**
+ * Performs the collapses of one pass in the order of their cost. Every vertex takes part in
+ * at most one collapse per pass. Returns the number of removed triangles.
+ */
+static uint32_t collapses_perform (struct simplify_state *s, size_t nr_collapses, uint32_t goal,
+                                   double error_limit, double *error)
+{
+    // the cheap half of the collapses is done first, the costs of the rest get updated
+    double soft_limit = s->collapses[nr_collapses / 2].cost;
+
+    uint32_t removed = 0;
+    for (size_t i = 0; i < nr_collapses && removed < goal; i++)
+    {
+        const struct collapse *c = &s->collapses[i];
+        if (c->cost > error_limit || (c->cost > soft_limit && removed))
+            break;
+
+        uint32_t from = c->from;
+        uint32_t to = c->to;
+        if (s->locked[from] || s->locked[to])
+            continue;
+
+        uint32_t partner = NO_EDGE;
+        uint32_t partner_to = NO_EDGE;
+        if (s->kind[from] == KIND_SEAM)
+        {
+            partner = seam_partner (s, from, to, &partner_to);
+            if (partner == NO_EDGE || s->locked[partner] || s->locked[partner_to])
+                continue;
+        }
+
+        uint32_t nr_removed = 0;
+        if (collapse_flips (s, from, to, &nr_removed)
+                || (partner != NO_EDGE && collapse_flips (s, partner, partner_to, &nr_removed)))
+            continue;
+
+        quadric_add (&s->q[s->group[to]], &s->q[s->group[from]]);
+        s->remap[from] = to;
+        s->locked[from] = s->locked[to] = 1;
+        if (s->kind[from] != KIND_MANIFOLD)
+            open_edges_collapse (s, from, to);
+        if (partner != NO_EDGE)
+        {
+            s->remap[partner] = partner_to;
+            s->locked[partner] = s->locked[partner_to] = 1;
+            open_edges_collapse (s, partner, partner_to);
+        }
+
+        removed += nr_removed;
+        if (c->cost > *error)
+            *error = c->cost;
+    }
+    return removed;
+}
+
+/**
+ * Applies the collapses of a pass to the triangles and drops the degenerate ones
+ */
+static void collapses_apply (struct simplify_state *s)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < s->nr_indices; i += 3)
+    {
+        uint32_t a = s->remap[s->tri[i]];
+        uint32_t b = s->remap[s->tri[i + 1]];
+        uint32_t c = s->remap[s->tri[i + 2]];
+        if (s->group[a] == s->group[b] || s->group[b] == s->group[c] || s->group[a] == s->group[c])
+            continue;
+
+        s->tri[n++] = a;
+        s->tri[n++] = b;
+        s->tri[n++] = c;
+    }
+    s->nr_indices = n;
+
+    for (uint32_t v = 0; v < s->nr_vertices; v++)
+    {
+        if (single_edge (s->open_out[v]))
+            s->open_out[v] = s->remap[s->open_out[v]];
+        if (single_edge (s->open_inc[v]))
+            s->open_inc[v] = s->remap[s->open_inc[v]];
+    }
+}
+
+static void state_free (struct simplify_state *s)
+{
+    FREE (s->tri);
+    FREE (s->pos);
+    FREE (s->group);
+    FREE (s->wedge);
+    FREE (s->kind);
+    FREE (s->open_out);
+    FREE (s->open_inc);
+    FREE (s->q);
+    FREE (s->offsets);
+    FREE (s->adj);
+    FREE (s->remap);
+    FREE (s->locked);
+    FREE (s->collapses);
+    FREE (s->sorted);
+    FREE (s->histogram);
+}
+
+static int state_create (struct simplify_state *s, const struct rex_mesh *mesh)
+{
+    uint32_t nv = mesh->nr_vertices;
+    size_t nr_indices = (size_t) mesh->nr_triangles * 3;
+
+    memset (s, 0, sizeof (struct simplify_state));
+    s->nr_vertices = nv;
+    s->nr_indices = nr_indices;
+    s->tri = rex_malloc (nr_indices * sizeof (uint32_t));
+    s->pos = rex_malloc ((size_t) nv * 3 * sizeof (double));
+    s->group = rex_malloc ((size_t) nv * sizeof (uint32_t));
+    s->wedge = rex_malloc ((size_t) nv * sizeof (uint32_t));
+    s->kind = rex_malloc (nv);
+    s->open_out = rex_malloc ((size_t) nv * sizeof (uint32_t));
+    s->open_inc = rex_malloc ((size_t) nv * sizeof (uint32_t));
+    s->q = rex_malloc ((size_t) nv * sizeof (struct quadric));
+    s->offsets = rex_malloc (((size_t) nv + 1) * sizeof (uint32_t));
+    s->adj = rex_malloc (nr_indices * sizeof (uint32_t));
+    s->remap = rex_malloc ((size_t) nv * sizeof (uint32_t));
+    s->locked = rex_malloc (nv);
+    s->collapses = rex_malloc (nr_indices * sizeof (struct collapse));
+    s->sorted = rex_malloc (nr_indices * sizeof (struct collapse));
+    s->histogram = rex_malloc ((1u << SORT_BITS) * sizeof (uint32_t));
+    if (!s->tri || !s->pos || !s->group || !s->wedge || !s->kind || !s->open_out || !s->open_inc
+            || !s->q || !s->offsets || !s->adj || !s->remap || !s->locked || !s->collapses
+            || !s->sorted || !s->histogram)
+    {
+        state_free (s);
+        return REX_ERROR_MEMORY;
+    }
+    memcpy (s->tri, mesh->triangles, nr_indices * sizeof (uint32_t));
+
+    // the positions are normalized, so that the error is relative to the extent
+    struct rex_bounds b;
+    rex_bounds_calc (mesh->positions, nv, NULL, &b);
+    double extent = fmax (b.max[0] - b.min[0], fmax (b.max[1] - b.min[1], b.max[2] - b.min[2]));
+    double scale = (extent > 0.0) ? 1.0 / extent : 1.0;
+    for (uint32_t v = 0; v < nv; v++)
+        for (int c = 0; c < 3; c++)
+            s->pos[(size_t) v * 3 + c] = (mesh->positions[(size_t) v * 3 + c] - b.min[c]) * scale;
+    return REX_OK;
+}
+
+static float *attribute_copy (const float *data, uint32_t components, const uint32_t *order, uint32_t nr_vertices)
+{
+    if (!data) return NULL;
+
+    float *copy = rex_malloc ((size_t) nr_vertices * components * sizeof (float) + 1);
+    if (!copy)
+        return NULL;
+    for (uint32_t i = 0; i < nr_vertices; i++)
+        memcpy (&copy[(size_t) i * components], &data[(size_t) order[i] * components], components * sizeof (float));
+    return copy;
+}
+
+/**
+ * Creates the result mesh from the remaining triangles, unreferenced vertices are dropped
+ */
+static int result_create (const struct rex_mesh *mesh, struct simplify_state *s, struct rex_mesh *result)
+{
+    // remap[old] = new, order[new] = old, the original vertex order is kept
+    uint32_t *order = s->group;
+    memset (s->remap, 0xff, (size_t) s->nr_vertices * sizeof (uint32_t));
+    for (size_t i = 0; i < s->nr_indices; i++)
+        s->remap[s->tri[i]] = 0;
+
+    uint32_t nr_used = 0;
+    for (uint32_t v = 0; v < s->nr_vertices; v++)
+        if (s->remap[v] != UINT32_MAX)
+        {
+            s->remap[v] = nr_used;
+            order[nr_used++] = v;
+        }
+
+    rex_mesh_init (result);
+    result->lod = mesh->lod;
+    result->max_lod = mesh->max_lod;
+    result->material_id = mesh->material_id;
+    memcpy (result->name, mesh->name, REX_MESH_NAME_MAX_SIZE);
+    result->nr_vertices = nr_used;
+    result->nr_triangles = (uint32_t) (s->nr_indices / 3);
+
+    result->positions = attribute_copy (mesh->positions, 3, order, nr_used);
+    result->normals = attribute_copy (mesh->normals, 3, order, nr_used);
+    result->tex_coords = attribute_copy (mesh->tex_coords, 2, order, nr_used);
+    result->colors = attribute_copy (mesh->colors, 3, order, nr_used);
+    result->triangles = rex_malloc (s->nr_indices * sizeof (uint32_t) + 1);
+    if (!result->positions || (mesh->normals && !result->normals) || (mesh->tex_coords && !result->tex_coords)
+            || (mesh->colors && !result->colors) || !result->triangles)
+    {
+        rex_mesh_free (result);
+        return REX_ERROR_MEMORY;
+    }
+
+    for (size_t i = 0; i < s->nr_indices; i++)
+        result->triangles[i] = s->remap[s->tri[i]];
+    return REX_OK;
+}
+
+int rex_mesh_simplify (const struct rex_mesh *mesh, struct rex_mesh *result,
+                       const struct rex_mesh_simplify_params *params, float *error)
+{
+    if (!mesh || !result)
+        return REX_MISSING_PARAMETER;
+    if ((mesh->nr_vertices && !mesh->positions) || (mesh->nr_triangles && !mesh->triangles))
+    {
+        warn ("Mesh without positions or triangles");
+        return REX_MISSING_PARAMETER;
+    }
+
+    struct rex_mesh_simplify_params defaults;
+    rex_mesh_simplify_params_init (&defaults);
+    if (!params)
+        params = &defaults;
+
+    size_t nr_indices = (size_t) mesh->nr_triangles * 3;
+    for (size_t i = 0; i < nr_indices; i++)
+        if (mesh->triangles[i] >= mesh->nr_vertices)
+        {
+            warn ("Triangle index %u exceeds the number of vertices", mesh->triangles[i]);
+            return REX_ERROR_INVALID_DATA;
+        }
+
+    struct rex_trace_span span = rex_trace_begin ("simplify mesh");
+    struct simplify_state s;
+    if (state_create (&s, mesh) != REX_OK)
+    {
+        rex_trace_end (&span);
+        return REX_ERROR_MEMORY;
+    }
+
+    // locked is used to mark the referenced vertices during the setup
+    memset (s.locked, 0, s.nr_vertices);
+    for (size_t i = 0; i < nr_indices; i++)
+        s.locked[s.tri[i]] = 1;
+
+    int ret = groups_build (&s, mesh->positions, s.locked);
+    if (ret == REX_OK)
+    {
+        adjacency_build (&s);
+        vertices_classify (&s, s.locked, params->lock_border);
+
+        uint32_t nr_triangles = mesh->nr_triangles;
+        double target = floor ((double) mesh->nr_triangles * fmin (fmax (params->target_ratio, 0.0f), 1.0f));
+        double error_limit = (double) params->target_error * params->target_error;
+        double max_error = 0.0;
+
+        while (nr_triangles > target)
+        {
+            size_t nr_collapses = collapses_pick (&s);
+            if (!nr_collapses)
+                break;
+            collapses_sort (&s, nr_collapses);
+
+            for (uint32_t v = 0; v < s.nr_vertices; v++)
+                s.remap[v] = v;
+            memset (s.locked, 0, s.nr_vertices);
+
+            uint32_t goal = nr_triangles - (uint32_t) target;
+            if (!collapses_perform (&s, nr_collapses, goal, error_limit, &max_error))
+                break;
+
+            collapses_apply (&s);
+            adjacency_build (&s);
+            nr_triangles = (uint32_t) (s.nr_indices / 3);
+        }
+
+        ret = result_create (mesh, &s, result);
+        if (error)
+            *error = (float) sqrt (max_error);
+    }
+
+    state_free (&s);
+    rex_trace_end (&span);
+    return ret;
+}
+
+struct lod_ctx
+{
+    const struct rex_mesh *mesh;
+    const struct rex_mesh_lod_params *params;
+    struct rex_mesh *lods;
+    int *status;
+};
+
+static void lod_task (void *arg, uint32_t i)
+{
+    struct lod_ctx *ctx = arg;
+    struct rex_mesh_simplify_params params =
+    {
+        .target_ratio = powf (ctx->params->ratio, (float) (i + 1)),
+        .target_error = ctx->params->target_error * (i + 1),
+        .lock_border = ctx->params->lock_border
+    };
+    ctx->status[i] = rex_mesh_simplify (ctx->mesh, &ctx->lods[i], &params, NULL);
+}
+
+int rex_mesh_lods (struct rex_mesh *mesh, const struct rex_mesh_lod_params *params,
+                   struct rex_thread_pool *pool, struct rex_mesh *lods, uint16_t *nr_lods)
+{
+    if (!mesh || !lods || !nr_lods)
+        return REX_MISSING_PARAMETER;
+
+    struct rex_mesh_lod_params defaults;
+    rex_mesh_lod_params_init (&defaults);
+    if (!params)
+        params = &defaults;
+
+    *nr_lods = 0;
+    if (!params->nr_lods)
+        return REX_OK;
+
+    int *status = rex_malloc (params->nr_lods * sizeof (int));
+    if (!status)
+        return REX_ERROR_MEMORY;
+
+    struct lod_ctx ctx = { .mesh = mesh, .params = params, .lods = lods, .status = status };
+    rex_parallel_for (pool, params->nr_lods, lod_task, &ctx);
+
+    // the chain ends at the first level which failed or is not coarser than its predecessor
+    int ret = REX_OK;
+    uint32_t nr_triangles = mesh->nr_triangles;
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < params->nr_lods; i++)
+    {
+        if (status[i] != REX_OK)
+        {
+            if (ret == REX_OK && n == i)
+                ret = status[i];
+            continue;
+        }
+        if (n == i && lods[i].nr_triangles < nr_triangles)
+        {
+            nr_triangles = lods[i].nr_triangles;
+            n++;
+        }
+        else
+            rex_mesh_free (&lods[i]);
+    }
+    FREE (status);
+
+    mesh->max_lod = n;
+    for (uint16_t i = 0; i < n; i++)
+    {
+        lods[i].lod = i + 1;
+        lods[i].max_lod = n;
+    }
+    *nr_lods = n;
+    return (n || ret == REX_OK) ? REX_OK : ret;
+}
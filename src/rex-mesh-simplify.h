@@ -0,0 +1,125 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Mesh simplification with quadric error metrics and generation of LOD chains
+ *
+ * The simplifier collapses edges in the order of their quadric error (see Garland and
+ * Heckbert, "Surface Simplification Using Quadric Error Metrics", 1997). A vertex is always
+ * collapsed onto one of its neighbours, so the simplified mesh uses a subset of the original
+ * vertices and the attributes need no interpolation.
+ *
+ * Vertices at the same position with different normals, texture coordinates or colors form
+ * a seam. A seam vertex is only collapsed along the seam and together with its counterpart
+ * on the other side, so the seams stay intact. Vertices on open borders are only collapsed
+ * along the border, they can be locked completely. Vertices where more than two seams or
+ * borders meet never move. Collapses which would flip a triangle are rejected.
+ *
+ * The simplification stops when the target ratio of triangles is reached or when the next
+ * collapse would exceed the target error. The error is the distance to the original surface
+ * relative to the extent of the mesh (the largest side of the bounding box).
+ *
+ * rex_mesh_lods generates a chain of coarser meshes for the lod and max_lod fields of the
+ * mesh blocks. The levels are simplified from the original mesh independently, so they can
+ * be generated in parallel on a thread pool. Clients can load the coarse levels first:
+ *
+ * \code
+ * struct rex_mesh_lod_params params;
+ * rex_mesh_lod_params_init (&params);
+ * struct rex_mesh lods[params.nr_lods];
+ * uint16_t nr_lods;
+ * rex_mesh_lods (&mesh, &params, pool, lods, &nr_lods);
+ * ptr = rex_block_write_mesh (id++, header, &mesh, &sz);
+ * for (uint16_t i = 0; i < nr_lods; i++)
+ *     ptr = rex_block_write_mesh (id++, header, &lods[i], &sz);
+ * \endcode
+ */
+
+#include <stdint.h>
+
+#include "rex-block-mesh.h"
+#include "rex-thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The parameters of rex_mesh_simplify
+ */
+struct rex_mesh_simplify_params
+{
+    float target_ratio;  //<! the ratio of triangles which should remain (default 0.5)
+    float target_error;  //<! the maximal error relative to the mesh extent (default 0.01)
+    int lock_border;     //<! 1 to keep all vertices of open borders (default 0)
+};
+
+/**
+ * The parameters of rex_mesh_lods
+ */
+struct rex_mesh_lod_params
+{
+    uint16_t nr_lods;    //<! the number of levels which get generated in addition to the mesh (default 3)
+    float ratio;         //<! the ratio of triangles between two successive levels (default 0.5)
+    float target_error;  //<! the maximal relative error of level 1, it grows linearly with the level (default 0.01)
+    int lock_border;     //<! 1 to keep all vertices of open borders (default 0)
+};
+
+/**
+ * Sets the default simplification parameters
+ */
+void rex_mesh_simplify_params_init (struct rex_mesh_simplify_params *params);
+
+/**
+ * Sets the default LOD parameters
+ */
+void rex_mesh_lod_params_init (struct rex_mesh_lod_params *params);
+
+/**
+ * Simplifies a mesh. The result is a new mesh which contains the remaining triangles in
+ * their original order and only the referenced vertices. Name, material_id, lod and
+ * max_lod are copied. The memory of the result must be released with rex_mesh_free.
+ *
+ * \param mesh the mesh which gets simplified
+ * \param result the simplified mesh which gets filled
+ * \param params the simplification parameters, NULL uses the defaults
+ * \param error the relative error of the result (can be NULL)
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_simplify (const struct rex_mesh *mesh, struct rex_mesh *result,
+                       const struct rex_mesh_simplify_params *params, float *error);
+
+/**
+ * Generates a chain of simplified meshes. Level i keeps ratio^i of the triangles of the
+ * mesh, the levels are numbered 1 ... nr_lods in the lod field. The chain ends early if a
+ * level cannot be simplified further within its error. The max_lod of the mesh and of all
+ * levels is set to the number of generated levels.
+ *
+ * \param mesh the mesh (level 0), max_lod gets updated
+ * \param params the LOD parameters, NULL uses the defaults
+ * \param pool the thread pool which simplifies the levels, NULL runs on the calling thread
+ * \param lods an array of params->nr_lods meshes which get filled, must be released with rex_mesh_free
+ * \param nr_lods the number of generated levels
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_lods (struct rex_mesh *mesh, const struct rex_mesh_lod_params *params,
+                   struct rex_thread_pool *pool, struct rex_mesh *lods, uint16_t *nr_lods);
+
+#ifdef __cplusplus
+}
+#endif
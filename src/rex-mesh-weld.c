@@ -0,0 +1,245 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <math.h>
+#include <string.h>
+
+#include "global.h"
+#include "rex-mesh-weld.h"
+#include "rex-trace.h"
+#include "status.h"
+#include "util.h"
+
+/**
+ * The spatial hash of the welded vertices. Every bucket contains a chain of vertices,
+ * different cells can share a bucket.
+ */
+struct weld_grid
+{
+    uint32_t *heads;   //<! the first vertex of every bucket
+    uint32_t *next;    //<! the next vertex in the same bucket
+    uint64_t mask;     //<! the number of buckets - 1
+    double inv_cell;   //<! the inverse cell size, 0 if the positions must be equal
+};
+
+void rex_mesh_weld_params_init (struct rex_mesh_weld_params *params)
+{
+    if (!params) return;
+
+    params->position_epsilon = 1e-5f;
+    params->normal_epsilon = 1e-3f;
+    params->tex_coord_epsilon = 1e-5f;
+    params->color_epsilon = 1e-3f;
+}
+
+/**
+ * Returns the grid cell of a coordinate. Without tolerance the bit pattern is used, so
+ * that only equal coordinates share a cell.
+ */
+static inline int64_t grid_cell (const struct weld_grid *grid, double x)
+{
+    if (grid->inv_cell == 0.0)
+    {
+        uint32_t bits;
+        float f = (float) x + 0.0f; // -0 becomes +0
+        memcpy (&bits, &f, sizeof (uint32_t));
+        return bits;
+    }
+
+    double c = floor (x * grid->inv_cell);
+    if (c < -4e18) c = -4e18;
+    if (c > 4e18) c = 4e18;
+    return (int64_t) c;
+}
+
+static inline uint64_t grid_bucket (const struct weld_grid *grid, int64_t x, int64_t y, int64_t z)
+{
+    uint64_t h = (uint64_t) x * 0x9E3779B97F4A7C15ull
+                 ^ (uint64_t) y * 0xC2B2AE3D27D4EB4Full
+                 ^ (uint64_t) z * 0x165667B19E3779F9ull;
+    return (h ^ (h >> 29)) & grid->mask;
+}
+
+static inline int attribute_match (const float *data, uint32_t components, float epsilon, uint32_t a, uint32_t b)
+{
+    if (!data || epsilon < 0.0f)
+        return 1;
+    for (uint32_t c = 0; c < components; c++)
+        if (!(fabsf (data[(size_t) a * components + c] - data[(size_t) b * components + c]) <= epsilon))
+            return 0;
+    return 1;
+}
+
+static inline int vertex_match (const struct rex_mesh *mesh, const struct rex_mesh_weld_params *params, uint32_t a, uint32_t b)
+{
+    const float *pa = &mesh->positions[(size_t) a * 3];
+    const float *pb = &mesh->positions[(size_t) b * 3];
+    float dx = pa[0] - pb[0];
+    float dy = pa[1] - pb[1];
+    float dz = pa[2] - pb[2];
+
+    return dx * dx + dy * dy + dz * dz <= params->position_epsilon * params->position_epsilon
+           && attribute_match (mesh->normals, 3, params->normal_epsilon, a, b)
+           && attribute_match (mesh->tex_coords, 2, params->tex_coord_epsilon, a, b)
+           && attribute_match (mesh->colors, 3, params->color_epsilon, a, b);
+}
+
+/**
+ * Finds a welded vertex which matches v in the cells overlapping the epsilon box around
+ * v. The cell size is twice the epsilon, so at most two cells per axis are searched.
+ */
+static uint32_t grid_find (const struct weld_grid *grid, const struct rex_mesh *mesh,
+                           const struct rex_mesh_weld_params *params, uint32_t v)
+{
+    const float *p = &mesh->positions[(size_t) v * 3];
+    double eps = (grid->inv_cell == 0.0) ? 0.0 : params->position_epsilon;
+    int64_t lo[3], hi[3];
+    for (int c = 0; c < 3; c++)
+    {
+        lo[c] = grid_cell (grid, (double) p[c] - eps);
+        hi[c] = grid_cell (grid, (double) p[c] + eps);
+    }
+
+    for (int64_t z = lo[2]; z <= hi[2]; z++)
+        for (int64_t y = lo[1]; y <= hi[1]; y++)
+            for (int64_t x = lo[0]; x <= hi[0]; x++)
+                for (uint32_t w = grid->heads[grid_bucket (grid, x, y, z)]; w != UINT32_MAX; w = grid->next[w])
+                    if (vertex_match (mesh, params, w, v))
+                        return w;
+    return UINT32_MAX;
+}
+
+static void grid_insert (struct weld_grid *grid, const struct rex_mesh *mesh, uint32_t v)
+{
+    const float *p = &mesh->positions[(size_t) v * 3];
+    uint64_t b = grid_bucket (grid, grid_cell (grid, p[0]), grid_cell (grid, p[1]), grid_cell (grid, p[2]));
+    grid->next[v] = grid->heads[b];
+    grid->heads[b] = v;
+}
+
+static void attribute_compact (float *data, uint32_t components, const uint32_t *remap, uint32_t nr_vertices)
+{
+    if (!data) return;
+
+    // the new index is never larger than the old one
+    for (uint32_t v = 0; v < nr_vertices; v++)
+        if (remap[v] != UINT32_MAX && remap[v] != v)
+            memcpy (&data[(size_t) remap[v] * components], &data[(size_t) v * components], components * sizeof (float));
+}
+
+int rex_mesh_weld (struct rex_mesh *mesh, const struct rex_mesh_weld_params *params)
+{
+    if (!mesh)
+        return REX_MISSING_PARAMETER;
+    if ((mesh->nr_vertices && !mesh->positions) || (mesh->nr_triangles && !mesh->triangles))
+    {
+        warn ("Mesh without positions or triangles");
+        return REX_MISSING_PARAMETER;
+    }
+
+    struct rex_mesh_weld_params defaults;
+    rex_mesh_weld_params_init (&defaults);
+    if (!params)
+        params = &defaults;
+
+    uint32_t nv = mesh->nr_vertices;
+    size_t nr_indices = (size_t) mesh->nr_triangles * 3;
+    for (size_t i = 0; i < nr_indices; i++)
+        if (mesh->triangles[i] >= nv)
+        {
+            warn ("Triangle index %u exceeds the number of vertices", mesh->triangles[i]);
+            return REX_ERROR_INVALID_DATA;
+        }
+    if (!nv)
+        return REX_OK;
+
+    struct rex_trace_span span = rex_trace_begin ("weld mesh");
+
+    struct weld_grid grid = { .inv_cell = (params->position_epsilon > 0.0f) ? 0.5 / params->position_epsilon : 0.0 };
+    uint64_t nr_buckets = 16;
+    while (nr_buckets < 2 * (uint64_t) nv)
+        nr_buckets *= 2;
+    grid.mask = nr_buckets - 1;
+    grid.heads = rex_malloc (nr_buckets * sizeof (uint32_t));
+    grid.next = rex_malloc ((size_t) nv * sizeof (uint32_t));
+    uint32_t *remap = rex_malloc ((size_t) nv * sizeof (uint32_t));
+    if (!grid.heads || !grid.next || !remap)
+    {
+        FREE (grid.heads);
+        FREE (grid.next);
+        FREE (remap);
+        rex_trace_end (&span);
+        return REX_ERROR_MEMORY;
+    }
+    memset (grid.heads, 0xff, nr_buckets * sizeof (uint32_t));
+
+    // remap[v] is the welded vertex of v, only welded vertices are in the grid
+    for (uint32_t v = 0; v < nv; v++)
+    {
+        const float *p = &mesh->positions[(size_t) v * 3];
+        if (!isfinite (p[0]) || !isfinite (p[1]) || !isfinite (p[2]))
+        {
+            remap[v] = v;
+            continue;
+        }
+
+        uint32_t w = grid_find (&grid, mesh, params, v);
+        if (w == UINT32_MAX)
+        {
+            grid_insert (&grid, mesh, v);
+            w = v;
+        }
+        remap[v] = w;
+    }
+    FREE (grid.heads);
+
+    // drop the degenerate triangles, next marks the referenced vertices
+    memset (grid.next, 0, (size_t) nv * sizeof (uint32_t));
+    uint32_t *used = grid.next;
+    size_t nr_kept = 0;
+    for (size_t i = 0; i < nr_indices; i += 3)
+    {
+        uint32_t a = remap[mesh->triangles[i]];
+        uint32_t b = remap[mesh->triangles[i + 1]];
+        uint32_t c = remap[mesh->triangles[i + 2]];
+        if (a == b || b == c || a == c)
+            continue;
+
+        mesh->triangles[nr_kept++] = a;
+        mesh->triangles[nr_kept++] = b;
+        mesh->triangles[nr_kept++] = c;
+        used[a] = used[b] = used[c] = 1;
+    }
+
+    // compact the referenced vertices, remap becomes old -> new index
+    uint32_t next = 0;
+    for (uint32_t v = 0; v < nv; v++)
+        remap[v] = used[v] ? next++ : UINT32_MAX;
+
+    attribute_compact (mesh->positions, 3, remap, nv);
+    attribute_compact (mesh->normals, 3, remap, nv);
+    attribute_compact (mesh->tex_coords, 2, remap, nv);
+    attribute_compact (mesh->colors, 3, remap, nv);
+    for (size_t i = 0; i < nr_kept; i++)
+        mesh->triangles[i] = remap[mesh->triangles[i]];
+
+    mesh->nr_vertices = next;
+    mesh->nr_triangles = (uint32_t) (nr_kept / 3);
+
+    FREE (grid.next);
+    FREE (remap);
+    rex_trace_end (&span);
+    return REX_OK;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Welding of duplicate vertices of a mesh
+ *
+ * Meshes from face-oriented sources contain one vertex per face corner, so the same
+ * position is stored several times. rex_mesh_weld merges all vertices whose attributes are
+ * equal within an epsilon. The position candidates are found with a spatial hash grid,
+ * so the runtime is linear in the number of vertices.
+ *
+ * The attributes of a merged vertex are taken from the vertex with the lowest index. The
+ * normals, texture coordinates and colors can be excluded from the comparison with a
+ * negative epsilon, then all vertices at the same position get merged (e.g. to get a
+ * connected mesh for smooth normals). Triangles which collapse to a line or point are
+ * removed, vertices which are not referenced by any triangle afterwards are dropped. The
+ * order of the remaining vertices and triangles is kept.
+ *
+ * The mesh is modified in place and must own its arrays (see rex-map.h), the arrays are
+ * not shrunk.
+ */
+
+#include <stdint.h>
+
+#include "rex-block-mesh.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The tolerances of rex_mesh_weld. A negative epsilon excludes the attribute from the comparison.
+ */
+struct rex_mesh_weld_params
+{
+    float position_epsilon;   //<! the maximum distance of merged positions (default 1e-5)
+    float normal_epsilon;     //<! the maximum difference per normal component (default 1e-3)
+    float tex_coord_epsilon;  //<! the maximum difference per texture coordinate component (default 1e-5)
+    float color_epsilon;      //<! the maximum difference per color component (default 1e-3)
+};
+
+/**
+ * Sets the default weld tolerances
+ */
+void rex_mesh_weld_params_init (struct rex_mesh_weld_params *params);
+
+/**
+ * Merges duplicate vertices, removes degenerate triangles and unreferenced vertices.
+ * The nr_vertices and nr_triangles of the mesh are updated.
+ *
+ * \param mesh the mesh which gets modified
+ * \param params the tolerances, NULL uses the defaults
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_mesh_weld (struct rex_mesh *mesh, const struct rex_mesh_weld_params *params);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,303 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <string.h>
+
+#include "rex-stats.h"
+
+static const char *type_names[REX_STATS_NR_TYPES]
+    = { "LineSet", "Text", "PointList", "Mesh", "Image", "MaterialStandard", "SceneNode", "Track",
+        "Index", "Group", "Compressed", "other" };
+
+const char *rex_stats_type_name (int type)
+{
+    return (type >= 0 && type < REX_STATS_NR_TYPES) ? type_names[type] : "unknown";
+}
+
+#ifdef REX_WITH_STATS
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+enum counter
+{
+    BLOCKS_READ,
+    BYTES_READ,
+    NS_READ,
+    BLOCKS_WRITTEN,
+    BYTES_WRITTEN,
+    NS_WRITTEN,
+    ALLOCS,
+    BYTES_ALLOCATED,
+    NR_COUNTERS
+};
+
+/**
+ * The counters of a single thread. Only the owning thread increments them, the atomics
+ * make the concurrent reads of rex_stats_get well-defined.
+ */
+struct slab
+{
+    _Atomic uint64_t c[REX_STATS_NR_TYPES][NR_COUNTERS]; //<! the counters
+    struct slab *next;                                   //<! the next slab of the list
+};
+
+static atomic_int enabled;
+static struct slab retired;         // counters of the threads which have exited
+static struct slab *slabs;          // slabs of all running threads
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+static _Thread_local struct slab *local;
+static _Thread_local int current = REX_STATS_OTHER; // the slot of the block which gets decoded
+static _Thread_local int pending_type = -1;         // the block which gets encoded
+static _Thread_local uint64_t pending_t0;
+
+static uint64_t now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void slab_clear (struct slab *s)
+{
+    for (int t = 0; t < REX_STATS_NR_TYPES; t++)
+        for (int i = 0; i < NR_COUNTERS; i++)
+            atomic_store_explicit (&s->c[t][i], 0, memory_order_relaxed);
+}
+
+static void slab_add (struct slab *dst, struct slab *src)
+{
+    for (int t = 0; t < REX_STATS_NR_TYPES; t++)
+        for (int i = 0; i < NR_COUNTERS; i++)
+            atomic_fetch_add_explicit (&dst->c[t][i], atomic_load_explicit (&src->c[t][i], memory_order_relaxed),
+                                       memory_order_relaxed);
+}
+
+/**
+ * Folds the counters of an exiting thread into the retired counters
+ */
+static void slab_release (void *arg)
+{
+    struct slab *s = arg;
+    pthread_mutex_lock (&lock);
+    slab_add (&retired, s);
+    for (struct slab **p = &slabs; *p; p = &(*p)->next)
+        if (*p == s)
+        {
+            *p = s->next;
+            break;
+        }
+    pthread_mutex_unlock (&lock);
+    free (s);
+}
+
+static void key_create (void)
+{
+    pthread_key_create (&key, slab_release);
+}
+
+/**
+ * Returns the slab of the calling thread. The slab is allocated with calloc, allocations of
+ * the installed allocator would be counted themselves.
+ */
+static struct slab *slab_get (void)
+{
+    if (local)
+        return local;
+
+    pthread_once (&once, key_create);
+    struct slab *s = calloc (1, sizeof (struct slab));
+    if (!s)
+        return NULL;
+
+    pthread_mutex_lock (&lock);
+    s->next = slabs;
+    slabs = s;
+    pthread_mutex_unlock (&lock);
+    pthread_setspecific (key, s);
+    return local = s;
+}
+
+static inline void count (int type, enum counter i, uint64_t v)
+{
+    struct slab *s = slab_get ();
+    if (s)
+        atomic_fetch_add_explicit (&s->c[type][i], v, memory_order_relaxed);
+}
+
+static inline int slot (uint16_t type)
+{
+    return (type < REX_STATS_OTHER) ? type : REX_STATS_OTHER;
+}
+
+int rex_stats_available (void)
+{
+    return 1;
+}
+
+void rex_stats_enable (int enable)
+{
+    atomic_store_explicit (&enabled, enable != 0, memory_order_relaxed);
+}
+
+int rex_stats_enabled (void)
+{
+    return atomic_load_explicit (&enabled, memory_order_relaxed);
+}
+
+void rex_stats_reset (void)
+{
+    pthread_mutex_lock (&lock);
+    for (struct slab *s = slabs; s; s = s->next)
+        slab_clear (s);
+    slab_clear (&retired);
+    pthread_mutex_unlock (&lock);
+}
+
+void rex_stats_get (struct rex_stats *stats)
+{
+    if (!stats) return;
+
+    struct slab sum;
+    slab_clear (&sum);
+    pthread_mutex_lock (&lock);
+    slab_add (&sum, &retired);
+    for (struct slab *s = slabs; s; s = s->next)
+        slab_add (&sum, s);
+    pthread_mutex_unlock (&lock);
+
+    for (int t = 0; t < REX_STATS_NR_TYPES; t++)
+    {
+        struct rex_stats_entry *e = &stats->types[t];
+        e->blocks_read = sum.c[t][BLOCKS_READ];
+        e->bytes_read = sum.c[t][BYTES_READ];
+        e->ns_read = sum.c[t][NS_READ];
+        e->blocks_written = sum.c[t][BLOCKS_WRITTEN];
+        e->bytes_written = sum.c[t][BYTES_WRITTEN];
+        e->ns_written = sum.c[t][NS_WRITTEN];
+        e->allocs = sum.c[t][ALLOCS];
+        e->bytes_allocated = sum.c[t][BYTES_ALLOCATED];
+    }
+}
+
+struct rex_stats_scope rex_stats_read_begin (uint16_t type, uint64_t sz)
+{
+    struct rex_stats_scope scope = { .type = -1, .prev = current, .sz = sz, .t0 = 0 };
+    if (!rex_stats_enabled ())
+        return scope;
+
+    scope.type = current = slot (type);
+    scope.t0 = now_ns ();
+    return scope;
+}
+
+void rex_stats_read_end (const struct rex_stats_scope *scope)
+{
+    if (scope->type < 0)
+        return;
+
+    count (scope->type, NS_READ, now_ns () - scope->t0);
+    count (scope->type, BLOCKS_READ, 1);
+    count (scope->type, BYTES_READ, scope->sz);
+    current = scope->prev;
+}
+
+void rex_stats_write_begin (uint16_t type)
+{
+    if (!rex_stats_enabled ())
+        return;
+
+    pending_type = slot (type);
+    pending_t0 = now_ns ();
+}
+
+void rex_stats_write_end (const uint8_t *block, uint64_t sz)
+{
+    uint16_t type;
+    memcpy (&type, block, sizeof (uint16_t));
+    int t = slot (type);
+    if (rex_stats_enabled ())
+    {
+        if (pending_type == t)
+            count (t, NS_WRITTEN, now_ns () - pending_t0);
+        count (t, BLOCKS_WRITTEN, 1);
+        count (t, BYTES_WRITTEN, sz);
+    }
+    pending_type = -1;
+}
+
+void rex_stats_alloc (size_t sz)
+{
+    if (!rex_stats_enabled ())
+        return;
+
+    count (current, ALLOCS, 1);
+    count (current, BYTES_ALLOCATED, sz);
+}
+
+#else
+
+int rex_stats_available (void)
+{
+    return 0;
+}
+
+void rex_stats_enable (int enable)
+{
+    (void) enable;
+}
+
+int rex_stats_enabled (void)
+{
+    return 0;
+}
+
+void rex_stats_reset (void)
+{
+}
+
+void rex_stats_get (struct rex_stats *stats)
+{
+    if (stats)
+        memset (stats, 0, sizeof (struct rex_stats));
+}
+
+#endif
+
+void rex_stats_dump (FILE *fp)
+{
+    if (!fp) return;
+
+    struct rex_stats stats;
+    rex_stats_get (&stats);
+
+    fprintf (fp, "%-16s %8s %10s %10s %8s %10s %10s %9s %10s\n", "type", "read", "MB", "ms",
+             "written", "MB", "ms", "allocs", "MB alloc");
+    for (int t = 0; t < REX_STATS_NR_TYPES; t++)
+    {
+        const struct rex_stats_entry *e = &stats.types[t];
+        if (!e->blocks_read && !e->blocks_written && !e->allocs)
+            continue;
+        fprintf (fp, "%-16s %8llu %10.2f %10.3f %8llu %10.2f %10.3f %9llu %10.2f\n", type_names[t],
+                 (unsigned long long) e->blocks_read, e->bytes_read / 1e6, e->ns_read / 1e6,
+                 (unsigned long long) e->blocks_written, e->bytes_written / 1e6, e->ns_written / 1e6,
+                 (unsigned long long) e->allocs, e->bytes_allocated / 1e6);
+    }
+}
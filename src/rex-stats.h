@@ -0,0 +1,159 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Performance counters per block type
+ *
+ * The counters attribute the time and the memory of the library to the block types, e.g. to
+ * find out if the ingest latency is caused by mesh, image or pointlist blocks. They are only
+ * available if the library is built with the STATS option (REX_WITH_STATS), and have to be
+ * switched on at runtime with rex_stats_enable. Otherwise the calls below are no-ops and the
+ * library does not pay for the counters.
+ *
+ * \code
+ * rex_stats_enable (1);
+ * ... read or write REX files ...
+ * rex_stats_dump (stdout);
+ * \endcode
+ *
+ * - a block counts as read after rex_block_read has decoded it, the time includes the allocations
+ * - a block counts as written once it is added to a REX header (rex_header_add_block), the time
+ *   is measured from writing its block header and only if both happen on the same thread
+ * - allocations of the installed allocator (see rex-alloc.h) are attributed to the block which is
+ *   decoded by the allocating thread, all other allocations are attributed to REX_STATS_OTHER
+ * - the inner block of a Compressed block is counted for both block types
+ *
+ * Every thread counts into its own set of atomic counters, so the counters do not contend
+ * between the threads of a rex_thread_pool. rex_stats_get sums them up.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rex-block.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Counter slot of everything which cannot be attributed to a block type
+ */
+#define REX_STATS_OTHER    (Compressed + 1)
+
+/**
+ * The number of counter slots, all block types and REX_STATS_OTHER
+ */
+#define REX_STATS_NR_TYPES (Compressed + 2)
+
+/**
+ * The counters of a single block type
+ */
+struct rex_stats_entry
+{
+    uint64_t blocks_read;     //<! number of decoded blocks
+    uint64_t bytes_read;      //<! decoded bytes including the block headers
+    uint64_t ns_read;         //<! cumulative decode time in nanoseconds
+    uint64_t blocks_written;  //<! number of blocks which were added to a REX header
+    uint64_t bytes_written;   //<! written bytes including the block headers
+    uint64_t ns_written;      //<! cumulative encode time in nanoseconds
+    uint64_t allocs;          //<! number of allocations (malloc, realloc, aligned_alloc)
+    uint64_t bytes_allocated; //<! requested bytes of all allocations
+};
+
+/**
+ * A snapshot of all counters
+ */
+struct rex_stats
+{
+    struct rex_stats_entry types[REX_STATS_NR_TYPES]; //<! counters indexed by rex_block_type
+};
+
+/**
+ * Returns 1 if the library was built with performance counters, else 0
+ */
+int rex_stats_available (void);
+
+/**
+ * Switches the counters on (enable != 0) or off. The counters are off by default.
+ */
+void rex_stats_enable (int enable);
+
+/**
+ * Returns 1 if the counters are switched on, else 0
+ */
+int rex_stats_enabled (void);
+
+/**
+ * Resets all counters to zero
+ */
+void rex_stats_reset (void);
+
+/**
+ * Fills a snapshot of all counters, the snapshot is zero if the counters are not available
+ */
+void rex_stats_get (struct rex_stats *stats);
+
+/**
+ * Returns the name of the given counter slot, e.g. "Mesh"
+ */
+const char *rex_stats_type_name (int type);
+
+/**
+ * Prints a table of all block types with non-zero counters
+ */
+void rex_stats_dump (FILE *fp);
+
+#ifdef REX_WITH_STATS
+
+/**
+ * The decode of a single block, used internally by rex_block_read
+ */
+struct rex_stats_scope
+{
+    int type;    //<! the counter slot, -1 if the counters are off
+    int prev;    //<! the slot of an enclosing decode
+    uint64_t sz; //<! the block size including the block header
+    uint64_t t0; //<! start time in nanoseconds
+};
+
+struct rex_stats_scope rex_stats_read_begin (uint16_t type, uint64_t sz);
+void rex_stats_read_end (const struct rex_stats_scope *scope);
+void rex_stats_write_begin (uint16_t type);
+void rex_stats_write_end (const uint8_t *block, uint64_t sz);
+void rex_stats_alloc (size_t sz);
+
+#define REX_STATS_READ_BEGIN(type,sz) struct rex_stats_scope rex_stats_scope_ = rex_stats_read_begin (type, sz)
+#define REX_STATS_READ_END()          rex_stats_read_end (&rex_stats_scope_)
+#define REX_STATS_WRITE_BEGIN(type)   rex_stats_write_begin (type)
+#define REX_STATS_WRITE_END(block,sz) rex_stats_write_end (block, sz)
+#define REX_STATS_ALLOC(sz)           rex_stats_alloc (sz)
+
+#else
+
+#define REX_STATS_READ_BEGIN(type,sz) ((void) 0)
+#define REX_STATS_READ_END()          ((void) 0)
+#define REX_STATS_WRITE_BEGIN(type)   ((void) 0)
+#define REX_STATS_WRITE_END(block,sz) ((void) 0)
+#define REX_STATS_ALLOC(sz)           ((void) 0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
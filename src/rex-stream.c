@@ -0,0 +1,323 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "rex-crc.h"
+#include "rex-mem.h"
+#include "rex-stream.h"
+#include "rex-validate.h"
+#include "status.h"
+#include "util.h"
+
+// fixed part of the REX header, the coordinate system block follows
+#define HEADER_FIXED_SIZE 64
+
+/**
+ * Waits until the descriptor is readable or rex_stream_close writes to the wakeup pipe,
+ * the latter is reported as read error
+ */
+static long fd_read (void *ctx, uint8_t *buf, size_t sz)
+{
+    struct rex_stream_reader *r = ctx;
+    struct pollfd fds[2] =
+    {
+        { .fd = r->fd, .events = POLLIN },
+        { .fd = r->wake[0], .events = POLLIN }
+    };
+
+    for (;;)
+    {
+        int ret = poll (fds, 2, -1);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0 || fds[1].revents)
+            return -1;
+        // end of stream and errors are reported by read
+        if (fds[0].revents)
+            break;
+    }
+
+    ssize_t n;
+    do
+        n = read (r->fd, buf, sz);
+    while (n < 0 && errno == EINTR);
+    return n;
+}
+
+/**
+ * Reads exactly sz bytes. Returns REX_OK, REX_END_OF_STREAM if the stream ended before
+ * the first byte or REX_ERROR_FILE_READ.
+ */
+static int read_full (struct rex_stream_reader *r, uint8_t *buf, size_t sz)
+{
+    size_t done = 0;
+    while (done < sz)
+    {
+        long n = r->read (r->ctx, buf + done, sz - done);
+        if (n == 0)
+            return done ? REX_ERROR_FILE_READ : REX_END_OF_STREAM;
+        if (n < 0)
+            return REX_ERROR_FILE_READ;
+        done += n;
+    }
+    return REX_OK;
+}
+
+/**
+ * Reads the next block into the slot
+ */
+static int read_block (struct rex_stream_reader *r, struct rex_stream_slot *slot)
+{
+    uint8_t head[REX_BLOCK_HEADER_SIZE];
+    int ret = read_full (r, head, REX_BLOCK_HEADER_SIZE);
+    if (ret != REX_OK)
+        return (ret == REX_END_OF_STREAM) ? REX_ERROR_FILE_READ : ret;
+
+    struct rex_block block;
+    rex_block_peek (head, &block);
+    if (block.sz > r->max_block_sz)
+    {
+        warn ("Block %lu in REX stream exceeds the maximum block size", (unsigned long) block.id);
+        return REX_ERROR_BLOCK_SIZE;
+    }
+
+    size_t sz = REX_BLOCK_HEADER_SIZE + (size_t) block.sz;
+    if (slot->capacity < sz)
+    {
+        int mem = rex_mem_enter (REX_MEM_IO);
+        uint8_t *data = rex_realloc (slot->data, sz);
+        rex_mem_leave (mem);
+        if (!data)
+            return REX_ERROR_MEMORY;
+        slot->data = data;
+        slot->capacity = sz;
+    }
+
+    memcpy (slot->data, head, REX_BLOCK_HEADER_SIZE);
+    ret = read_full (r, slot->data + REX_BLOCK_HEADER_SIZE, block.sz);
+    if (ret != REX_OK)
+        return ret;
+    r->crc = rex_crc32c (r->crc, slot->data, sz);
+
+    // stream input is untrusted, it is validated before the decoders see it
+    slot->valid = rex_validate_block (slot->data, sz) == REX_OK;
+    return REX_OK;
+}
+
+static void *read_ahead (void *arg)
+{
+    struct rex_stream_reader *r = arg;
+    int slot = 0;
+
+    for (uint32_t i = 0; i < rex_header_nr_datablocks (&r->header); i++)
+    {
+        pthread_mutex_lock (&r->lock);
+        while (r->slots[slot].filled && !r->stop)
+            pthread_cond_wait (&r->cond, &r->lock);
+        int stop = r->stop;
+        pthread_mutex_unlock (&r->lock);
+        if (stop)
+            return NULL;
+
+        // the slot is owned by this thread until it is marked as filled
+        int ret = read_block (r, &r->slots[slot]);
+
+        pthread_mutex_lock (&r->lock);
+        if (ret != REX_OK)
+        {
+            r->status = ret;
+            pthread_cond_broadcast (&r->cond);
+            pthread_mutex_unlock (&r->lock);
+            return NULL;
+        }
+        r->slots[slot].filled = 1;
+        r->nr_read++;
+        pthread_cond_broadcast (&r->cond);
+        pthread_mutex_unlock (&r->lock);
+        slot ^= 1;
+    }
+
+    pthread_mutex_lock (&r->lock);
+    if (r->header.crc && r->crc != r->header.crc)
+    {
+        warn ("CRC mismatch in REX stream");
+        r->status = REX_ERROR_CRC;
+    }
+    r->done = 1;
+    pthread_cond_broadcast (&r->cond);
+    pthread_mutex_unlock (&r->lock);
+    return NULL;
+}
+
+/**
+ * Reads the header and starts the read-ahead thread
+ */
+static int stream_start (struct rex_stream_reader *r)
+{
+    r->status = REX_OK;
+
+    uint8_t buf[REX_HEADER_SIZE];
+    int ret = read_full (r, buf, HEADER_FIXED_SIZE);
+    if (ret != REX_OK)
+        return REX_ERROR_FILE_READ;
+    if (memcmp (buf, REX_FILE_MAGIC, 4) != 0)
+        return REX_ERROR_WRONG_MAGIC;
+
+    rex_header_read (buf, &r->header);
+    if (r->header.start_addr < HEADER_FIXED_SIZE)
+        return REX_ERROR_FILE_READ;
+
+    // skip the coordinate system block
+    size_t left = r->header.start_addr - HEADER_FIXED_SIZE;
+    while (left > 0)
+    {
+        size_t n = (left < sizeof (buf)) ? left : sizeof (buf);
+        if (read_full (r, buf, n) != REX_OK)
+            return REX_ERROR_FILE_READ;
+        left -= n;
+    }
+
+    pthread_mutex_init (&r->lock, NULL);
+    pthread_cond_init (&r->cond, NULL);
+    if (pthread_create (&r->thread, NULL, read_ahead, r) != 0)
+    {
+        pthread_cond_destroy (&r->cond);
+        pthread_mutex_destroy (&r->lock);
+        return REX_SYSTEM_ERROR;
+    }
+    r->running = 1;
+    return REX_OK;
+}
+
+static void wake_close (struct rex_stream_reader *r)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (r->wake[i] >= 0)
+            close (r->wake[i]);
+        r->wake[i] = -1;
+    }
+}
+
+int rex_stream_open (struct rex_stream_reader *r, rex_stream_read_fn read, void *ctx, uint64_t max_block_sz)
+{
+    if (!r || !read)
+        return REX_MISSING_PARAMETER;
+
+    memset (r, 0, sizeof (struct rex_stream_reader));
+    r->read = read;
+    r->ctx = ctx;
+    r->fd = -1;
+    r->wake[0] = r->wake[1] = -1;
+    r->max_block_sz = max_block_sz ? max_block_sz : REX_STREAM_MAX_BLOCK_SIZE;
+    return stream_start (r);
+}
+
+int rex_stream_open_fd (struct rex_stream_reader *r, int fd, uint64_t max_block_sz)
+{
+    if (!r || fd < 0)
+        return REX_MISSING_PARAMETER;
+
+    memset (r, 0, sizeof (struct rex_stream_reader));
+    r->read = fd_read;
+    r->fd = fd;
+    r->ctx = r;
+    r->max_block_sz = max_block_sz ? max_block_sz : REX_STREAM_MAX_BLOCK_SIZE;
+    if (pipe (r->wake) != 0)
+        return REX_SYSTEM_ERROR;
+
+    int ret = stream_start (r);
+    if (ret != REX_OK)
+        wake_close (r);
+    return ret;
+}
+
+int rex_stream_next (struct rex_stream_reader *r, struct rex_block *block)
+{
+    if (!r || !block)
+        return REX_MISSING_PARAMETER;
+    if (!r->running)
+        return REX_ERROR_FILE_READ;
+
+    struct rex_stream_slot *slot = &r->slots[r->next_slot];
+
+    pthread_mutex_lock (&r->lock);
+    while (!slot->filled && !r->done && r->status == REX_OK)
+        pthread_cond_wait (&r->cond, &r->lock);
+    int filled = slot->filled;
+    int status = r->status;
+    pthread_mutex_unlock (&r->lock);
+
+    if (!filled)
+        return (status != REX_OK) ? status : REX_END_OF_STREAM;
+
+    // the slot is owned by the caller until it is released again
+    if (slot->valid)
+        rex_block_read (slot->data, block);
+    else
+    {
+        rex_block_peek (slot->data, block);
+        warn ("Invalid block %lu in REX stream, skipping.", (unsigned long) block->id);
+    }
+
+    pthread_mutex_lock (&r->lock);
+    slot->filled = 0;
+    pthread_cond_broadcast (&r->cond);
+    pthread_mutex_unlock (&r->lock);
+
+    r->next_slot ^= 1;
+    return REX_OK;
+}
+
+void rex_stream_close (struct rex_stream_reader *r)
+{
+    if (!r) return;
+
+    if (r->running)
+    {
+        pthread_mutex_lock (&r->lock);
+        r->stop = 1;
+        pthread_cond_broadcast (&r->cond);
+        pthread_mutex_unlock (&r->lock);
+
+        // interrupts a read which is blocked on an idle descriptor
+        if (r->wake[1] >= 0)
+        {
+            uint8_t byte = 1;
+            ssize_t n;
+            do
+                n = write (r->wake[1], &byte, 1);
+            while (n < 0 && errno == EINTR);
+        }
+
+        pthread_join (r->thread, NULL);
+        pthread_cond_destroy (&r->cond);
+        pthread_mutex_destroy (&r->lock);
+        r->running = 0;
+    }
+    wake_close (r);
+
+    for (int i = 0; i < 2; i++)
+    {
+        FREE (r->slots[i].data);
+        r->slots[i].capacity = 0;
+        r->slots[i].filled = 0;
+    }
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Streaming REX reader for non-seekable sources (pipes, sockets, stdin)
+ *
+ * The stream reader reads the REX header and afterwards one block after the other from
+ * a read callback or a file descriptor. The file never has to be kept in memory completely,
+ * only two block buffers are used: while the caller decodes block N, a background thread
+ * already reads block N+1 into the second buffer. The memory usage is bounded by twice the
+ * size of the largest block (plus the decoded data). Since the block sizes come from the
+ * stream, the reader fails with REX_ERROR_BLOCK_SIZE on blocks larger than the maximum block
+ * size which is given when the stream is opened.
+ *
+ * \code
+ * struct rex_stream_reader r;
+ * if (rex_stream_open_fd (&r, STDIN_FILENO, 0) != REX_OK)
+ *     die ("Cannot read REX stream");
+ * struct rex_block block;
+ * int ret;
+ * while ((ret = rex_stream_next (&r, &block)) == REX_OK)
+ * {
+ *     ...
+ *     rex_block_free (&block);
+ * }
+ * rex_stream_close (&r);
+ * \endcode
+ *
+ * The optional index block at the end of a file is not returned by the reader.
+ *
+ * The read-ahead thread checksums the blocks while reading them. If the header contains a
+ * CRC (see rex-crc.h) and it does not match, rex_stream_next returns REX_ERROR_CRC instead
+ * of REX_END_OF_STREAM after the last block, i.e. blocks which were already returned
+ * have to be discarded by the caller.
+ *
+ * Stream input is untrusted: every block is checked with rex_validate_block by the
+ * read-ahead thread. Invalid blocks are not decoded, they are returned with the type and id
+ * of the block header and NULL data, like blocks which rex_block_read cannot decode.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rex-block.h"
+#include "rex-header.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Read callback of the stream reader. Reads up to sz bytes into buf.
+ *
+ * \return the number of bytes read, 0 at the end of the stream or a negative value on error
+ */
+typedef long (*rex_stream_read_fn) (void *ctx, uint8_t *buf, size_t sz);
+
+/**
+ * Default maximum payload size of a block in a stream (1 GiB)
+ */
+#define REX_STREAM_MAX_BLOCK_SIZE (1ULL << 30)
+
+/**
+ * A buffer which holds one complete block (block header and payload)
+ */
+struct rex_stream_slot
+{
+    uint8_t *data;   //<! the block data
+    size_t capacity; //<! the allocated size of data
+    int filled;      //<! 1 if the slot contains a block which is not consumed yet
+    int valid;       //<! 1 if the block passed rex_validate_block
+};
+
+/**
+ * State of the stream reader
+ */
+struct rex_stream_reader
+{
+    struct rex_header header;           //<! the header of the stream, valid after rex_stream_open
+    rex_stream_read_fn read;            //<! the read callback
+    void *ctx;                          //<! the context of the read callback
+    int fd;                             //<! the file descriptor used by rex_stream_open_fd
+    int wake[2];                        //<! pipe which interrupts a blocking read of fd in rex_stream_close
+    uint64_t max_block_sz;              //<! the maximum payload size of a block
+
+    struct rex_stream_slot slots[2];    //<! double buffer
+    int next_slot;                      //<! the slot which is consumed next
+    uint32_t nr_read;                   //<! the number of blocks which are read from the source
+    uint32_t crc;                       //<! CRC-32C of the blocks read so far (owned by the read-ahead thread)
+    int done;                           //<! set by the read-ahead thread after the last block
+    int stop;                           //<! set by rex_stream_close
+    int status;                         //<! the first error of the read-ahead thread
+
+    pthread_t thread;                   //<! the read-ahead thread
+    pthread_mutex_t lock;               //<! protects slots, done, stop and status
+    pthread_cond_t cond;                //<! signals slot changes
+    int running;                        //<! 1 if the thread was started
+};
+
+/**
+ * Opens a stream with a read callback. The REX header is read synchronously,
+ * afterwards the read-ahead thread is started.
+ *
+ * \param r the reader
+ * \param read the read callback
+ * \param ctx the context which is passed to the read callback
+ * \param max_block_sz the maximum payload size of a block, 0 for REX_STREAM_MAX_BLOCK_SIZE
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_stream_open (struct rex_stream_reader *r, rex_stream_read_fn read, void *ctx, uint64_t max_block_sz);
+
+/**
+ * Opens a stream on a file descriptor (file, pipe, socket, ...). The descriptor is not
+ * closed by the reader.
+ *
+ * \param r the reader
+ * \param fd the file descriptor
+ * \param max_block_sz the maximum payload size of a block, 0 for REX_STREAM_MAX_BLOCK_SIZE
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_stream_open_fd (struct rex_stream_reader *r, int fd, uint64_t max_block_sz);
+
+/**
+ * Returns the next block of the stream. The block is decoded like rex_block_read and
+ * must be released by the caller with rex_block_free.
+ *
+ * \param r the reader
+ * \param block the block which gets filled
+ * \return REX_OK if a block was returned, REX_END_OF_STREAM after the last block,
+ *         REX_ERROR_CRC after the last block if the checksum does not match,
+ *         REX_ERROR_BLOCK_SIZE if a block exceeds the maximum block size, else an error code
+ */
+int rex_stream_next (struct rex_stream_reader *r, struct rex_block *block);
+
+/**
+ * Stops the read-ahead thread and releases all buffers. A read of a descriptor opened with
+ * rex_stream_open_fd is interrupted, so this call also returns if the source is an idle
+ * pipe or socket. A read callback (see rex_stream_open) cannot be interrupted, in this case
+ * the call waits until the callback returns.
+ */
+void rex_stream_close (struct rex_stream_reader *r);
+
+#ifdef __cplusplus
+}
+#endif
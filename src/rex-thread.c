@@ -0,0 +1,146 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <string.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "rex-thread.h"
+#include "util.h"
+
+/**
+ * Processes items of the current job until none are left. Must be called with the lock held.
+ */
+static void run_items (struct rex_thread_pool *pool)
+{
+    while (pool->next < pool->n)
+    {
+        uint32_t i = pool->next++;
+        pthread_mutex_unlock (&pool->lock);
+        pool->fn (pool->ctx, i);
+        pthread_mutex_lock (&pool->lock);
+    }
+}
+
+static void *worker (void *arg)
+{
+    struct rex_thread_pool *pool = arg;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock (&pool->lock);
+    for (;;)
+    {
+        while (!pool->stop && pool->generation == seen)
+            pthread_cond_wait (&pool->work, &pool->lock);
+        if (pool->stop)
+            break;
+
+        seen = pool->generation;
+        run_items (pool);
+        if (--pool->busy == 0)
+            pthread_cond_signal (&pool->idle);
+    }
+    pthread_mutex_unlock (&pool->lock);
+    return NULL;
+}
+
+struct rex_thread_pool *rex_thread_pool_create (uint32_t nr_threads)
+{
+    if (!nr_threads)
+    {
+        long nr_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+        nr_threads = (nr_cpus > 0) ? (uint32_t) nr_cpus : 1;
+    }
+
+    struct rex_thread_pool *pool = rex_malloc (sizeof (struct rex_thread_pool));
+    if (!pool)
+        return NULL;
+    memset (pool, 0, sizeof (struct rex_thread_pool));
+
+    pool->threads = rex_malloc (nr_threads * sizeof (pthread_t));
+    if (!pool->threads)
+    {
+        FREE (pool);
+        return NULL;
+    }
+
+    pthread_mutex_init (&pool->lock, NULL);
+    pthread_mutex_init (&pool->job_lock, NULL);
+    pthread_cond_init (&pool->work, NULL);
+    pthread_cond_init (&pool->idle, NULL);
+
+    // the calling thread is the first thread of every job
+    for (uint32_t i = 0; i < nr_threads - 1; i++)
+    {
+        if (pthread_create (&pool->threads[i], NULL, worker, pool) != 0)
+        {
+            warn ("Cannot create worker thread, using %u threads", i + 1);
+            break;
+        }
+        pool->nr_threads++;
+    }
+    return pool;
+}
+
+void rex_thread_pool_destroy (struct rex_thread_pool *pool)
+{
+    if (!pool) return;
+
+    pthread_mutex_lock (&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast (&pool->work);
+    pthread_mutex_unlock (&pool->lock);
+
+    for (uint32_t i = 0; i < pool->nr_threads; i++)
+        pthread_join (pool->threads[i], NULL);
+
+    pthread_cond_destroy (&pool->idle);
+    pthread_cond_destroy (&pool->work);
+    pthread_mutex_destroy (&pool->job_lock);
+    pthread_mutex_destroy (&pool->lock);
+    FREE (pool->threads);
+    FREE (pool);
+}
+
+void rex_parallel_for (struct rex_thread_pool *pool, uint32_t n, rex_task_fn fn, void *ctx)
+{
+    if (!fn) return;
+
+    if (!pool || !pool->nr_threads || n < 2)
+    {
+        for (uint32_t i = 0; i < n; i++)
+            fn (ctx, i);
+        return;
+    }
+
+    pthread_mutex_lock (&pool->job_lock);
+    pthread_mutex_lock (&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->n = n;
+    pool->next = 0;
+    pool->busy = pool->nr_threads;
+    pool->generation++;
+    pthread_cond_broadcast (&pool->work);
+
+    run_items (pool);
+    while (pool->busy)
+        pthread_cond_wait (&pool->idle, &pool->lock);
+
+    pool->fn = NULL;
+    pool->ctx = NULL;
+    pthread_mutex_unlock (&pool->lock);
+    pthread_mutex_unlock (&pool->job_lock);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief A minimal thread pool for data-parallel loops
+ *
+ * The pool keeps its worker threads alive between jobs, so it can be created once and be
+ * reused for many files. A job is a loop over n independent items; the items are handed out
+ * one at a time, so items with very different costs (e.g. small and large mesh blocks) are
+ * balanced automatically. The calling thread takes part in the loop.
+ *
+ * \code
+ * struct rex_thread_pool *pool = rex_thread_pool_create (0);
+ * rex_parallel_for (pool, n, decode_item, &ctx);
+ * rex_thread_pool_destroy (pool);
+ * \endcode
+ *
+ * Only one job can run on a pool at a time, concurrent calls of rex_parallel_for are
+ * serialized. The task function must not call rex_parallel_for on the same pool.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A task of a parallel loop, gets called once for every item i of the loop
+ */
+typedef void (*rex_task_fn) (void *ctx, uint32_t i);
+
+/**
+ * The thread pool
+ */
+struct rex_thread_pool
+{
+    uint32_t nr_threads;      //<! the number of worker threads (the caller is not counted)
+    pthread_t *threads;       //<! the worker threads
+
+    pthread_mutex_t lock;     //<! protects all fields below
+    pthread_cond_t work;      //<! signals a new job or the shutdown to the workers
+    pthread_cond_t idle;      //<! signals the caller that all workers have left the job
+    pthread_mutex_t job_lock; //<! serializes concurrent rex_parallel_for calls
+
+    uint64_t generation;      //<! incremented for every job
+    rex_task_fn fn;           //<! the task of the current job
+    void *ctx;                //<! the context of the current job
+    uint32_t n;               //<! the number of items of the current job
+    uint32_t next;            //<! the next item which gets handed out
+    uint32_t busy;            //<! the number of workers which are still in the current job
+    int stop;                 //<! set by rex_thread_pool_destroy
+};
+
+/**
+ * Creates a thread pool.
+ *
+ * \param nr_threads the total number of threads which work on a job including the calling
+ *        thread, 0 uses the number of online processors
+ * \return the pool or NULL in case of error
+ */
+struct rex_thread_pool *rex_thread_pool_create (uint32_t nr_threads);
+
+/**
+ * Stops all worker threads and frees the pool.
+ */
+void rex_thread_pool_destroy (struct rex_thread_pool *pool);
+
+/**
+ * Calls fn (ctx, i) for all i in [0, n) and returns after all calls have finished.
+ * The order of the calls is undefined. If pool is NULL, the loop runs on the calling thread.
+ *
+ * \param pool the thread pool, can be NULL
+ * \param n the number of items
+ * \param fn the task which gets called for every item
+ * \param ctx the context which is passed to the task
+ */
+void rex_parallel_for (struct rex_thread_pool *pool, uint32_t n, rex_task_fn fn, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rex-trace.h"
+#include "status.h"
+#include "util.h"
+
+enum state
+{
+    TRACE_UNINITIALIZED,
+    TRACE_OFF,
+    TRACE_ON
+};
+
+struct event
+{
+    const char *name; //<! the name of the span
+    uint64_t t0;      //<! start time in nanoseconds
+    uint64_t dur;     //<! duration in nanoseconds
+};
+
+/**
+ * The ring buffer of a single thread. Buffers are kept for the lifetime of the process,
+ * since the spans of exited worker threads are part of the trace.
+ */
+struct ring
+{
+    struct event events[REX_TRACE_CAPACITY]; //<! the recorded spans
+    _Atomic uint64_t head;                   //<! the number of spans which were recorded
+    uint32_t tid;                            //<! the thread number in the trace
+    struct ring *next;                       //<! the next ring of the list
+};
+
+static atomic_int state;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ring *rings;
+static uint32_t nr_rings;
+static char *trace_file;
+static uint64_t trace_t0;
+
+static _Thread_local struct ring *local;
+
+static uint64_t now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void trace_exit (void)
+{
+    if (atomic_load (&state) == TRACE_ON)
+        rex_trace_stop ();
+}
+
+/**
+ * Starts tracing if the REX_TRACE environment variable is set
+ */
+static void trace_init (void)
+{
+    const char *filename = getenv ("REX_TRACE");
+    int expected = TRACE_UNINITIALIZED;
+    if (filename && *filename && rex_trace_start (filename) == REX_OK)
+        atexit (trace_exit);
+    else
+        atomic_compare_exchange_strong (&state, &expected, TRACE_OFF);
+}
+
+/**
+ * Returns the ring of the calling thread, the ring is allocated with calloc to keep the
+ * tracing out of the allocation counters (see rex-stats.h)
+ */
+static struct ring *ring_get (void)
+{
+    if (local)
+        return local;
+
+    struct ring *r = calloc (1, sizeof (struct ring));
+    if (!r)
+        return NULL;
+
+    pthread_mutex_lock (&lock);
+    r->tid = ++nr_rings;
+    r->next = rings;
+    rings = r;
+    pthread_mutex_unlock (&lock);
+    return local = r;
+}
+
+int rex_trace_start (const char *filename)
+{
+    if (!filename)
+        return REX_MISSING_PARAMETER;
+
+    char *name = strdup (filename);
+    if (!name)
+        return REX_ERROR_MEMORY;
+
+    pthread_mutex_lock (&lock);
+    free (trace_file);
+    trace_file = name;
+    for (struct ring *r = rings; r; r = r->next)
+        atomic_store (&r->head, 0);
+    trace_t0 = now_ns ();
+    atomic_store (&state, TRACE_ON);
+    pthread_mutex_unlock (&lock);
+    return REX_OK;
+}
+
+static void write_string (FILE *fp, const char *s)
+{
+    fputc ('"', fp);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fputc ('\\', fp);
+        if ((unsigned char) *s >= 0x20)
+            fputc (*s, fp);
+    }
+    fputc ('"', fp);
+}
+
+int rex_trace_stop (void)
+{
+    pthread_mutex_lock (&lock);
+    if (atomic_load (&state) != TRACE_ON)
+    {
+        pthread_mutex_unlock (&lock);
+        return REX_OK;
+    }
+    atomic_store (&state, TRACE_OFF);
+
+    FILE *fp = fopen (trace_file, "w");
+    if (!fp)
+    {
+        warn ("Cannot open trace file %s", trace_file);
+        pthread_mutex_unlock (&lock);
+        return REX_ERROR_FILE_OPEN;
+    }
+
+    int pid = (int) getpid ();
+    int first = 1;
+    fprintf (fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (struct ring *r = rings; r; r = r->next)
+    {
+        fprintf (fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                 first ? "" : ",", pid, r->tid, r->tid);
+        first = 0;
+
+        uint64_t head = atomic_load_explicit (&r->head, memory_order_acquire);
+        uint64_t start = (head > REX_TRACE_CAPACITY) ? head - REX_TRACE_CAPACITY : 0;
+        for (uint64_t i = start; i < head; i++)
+        {
+            const struct event *e = &r->events[i % REX_TRACE_CAPACITY];
+            if (e->t0 < trace_t0)
+                continue;
+            fprintf (fp, ",\n{\"name\":");
+            write_string (fp, e->name);
+            fprintf (fp, ",\"cat\":\"rex\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                     (e->t0 - trace_t0) / 1e3, e->dur / 1e3, pid, r->tid);
+        }
+        atomic_store (&r->head, 0);
+    }
+    fprintf (fp, "\n]}\n");
+
+    int ret = (fclose (fp) == 0) ? REX_OK : REX_ERROR_FILE_WRITE;
+    pthread_mutex_unlock (&lock);
+    return ret;
+}
+
+int rex_trace_enabled (void)
+{
+    int s = atomic_load_explicit (&state, memory_order_relaxed);
+    if (s == TRACE_UNINITIALIZED)
+    {
+        pthread_once (&once, trace_init);
+        s = atomic_load (&state);
+    }
+    return s == TRACE_ON;
+}
+
+struct rex_trace_span rex_trace_begin (const char *name)
+{
+    struct rex_trace_span span = { .name = NULL, .t0 = 0 };
+    if (rex_trace_enabled () && name)
+    {
+        span.name = name;
+        span.t0 = now_ns ();
+    }
+    return span;
+}
+
+void rex_trace_end (struct rex_trace_span *span)
+{
+    if (!span || !span->name)
+        return;
+
+    uint64_t t1 = now_ns ();
+    struct ring *r = ring_get ();
+    if (!r || atomic_load_explicit (&state, memory_order_relaxed) != TRACE_ON)
+        return;
+
+    uint64_t head = atomic_load_explicit (&r->head, memory_order_relaxed);
+    struct event *e = &r->events[head % REX_TRACE_CAPACITY];
+    e->name = span->name;
+    e->t0 = span->t0;
+    e->dur = t1 - span->t0;
+    atomic_store_explicit (&r->head, head + 1, memory_order_release);
+    span->name = NULL;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Timeline tracing in the Chrome trace-event format
+ *
+ * Trace spans record the sequence of the file reads, header parsing, block decoding and the
+ * conversion stages of the tools on all threads. The trace gets written as JSON file which
+ * can be loaded into chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Tracing is switched on by setting the environment variable REX_TRACE to the name of the
+ * trace file, the file is written when the program exits:
+ *
+ * \code
+ * REX_TRACE=trace.json rex-info model.rex
+ * \endcode
+ *
+ * Alternatively, tracing can be controlled with rex_trace_start and rex_trace_stop. A span
+ * covers the code between rex_trace_begin and rex_trace_end on the same thread:
+ *
+ * \code
+ * struct rex_trace_span span = rex_trace_begin ("convert mesh");
+ * ...
+ * rex_trace_end (&span);
+ * \endcode
+ *
+ * Every thread records into its own ring buffer of REX_TRACE_CAPACITY spans, if a thread records
+ * more spans the oldest ones are overwritten. If tracing is off, a span costs a single atomic
+ * load. The span names are not copied and must be string literals.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The number of spans which are kept per thread
+ */
+#define REX_TRACE_CAPACITY 65536
+
+/**
+ * A span which is in progress
+ */
+struct rex_trace_span
+{
+    const char *name; //<! the name of the span, NULL if tracing is off
+    uint64_t t0;      //<! start time in nanoseconds
+};
+
+/**
+ * Starts recording a trace, previously recorded spans are discarded. The trace is written
+ * to filename by rex_trace_stop.
+ *
+ * \param filename the name of the JSON trace file
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_trace_start (const char *filename);
+
+/**
+ * Stops recording and writes the trace file. The threads of the process should not be
+ * recording spans at this point, since their ring buffers are read.
+ *
+ * \return REX_OK on success, else an error code (see status.h)
+ */
+int rex_trace_stop (void);
+
+/**
+ * Returns 1 if a trace is recorded, else 0
+ */
+int rex_trace_enabled (void);
+
+/**
+ * Begins a span on the calling thread
+ */
+struct rex_trace_span rex_trace_begin (const char *name);
+
+/**
+ * Ends a span and records it
+ */
+void rex_trace_end (struct rex_trace_span *span);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,440 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "global.h"
+#include "rex-block-compressed.h"
+#include "rex-block-image.h"
+#include "rex-block-mesh-compressed.h"
+#include "rex-block-pointlist-compact.h"
+#include "rex-block.h"
+#include "rex-trace.h"
+#include "rex-validate.h"
+#include "status.h"
+#include "util.h"
+
+#define INVALID(...) do { warn (__VA_ARGS__); return REX_ERROR_INVALID_DATA; } while (0)
+
+/**
+ * Returns != 0 if all n floats are finite (no NaN or Inf), the data can be unaligned
+ */
+static int floats_finite (const uint8_t *ptr, uint64_t n)
+{
+    uint64_t i = 0;
+    uint32_t bad = 0;
+
+#ifdef __SSE2__
+    // the exponent of NaN and Inf has all bits set
+    const __m128i exp = _mm_set1_epi32 (0x7f800000);
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) (ptr + 4 * i)), exp);
+        acc = _mm_or_si128 (acc, _mm_cmpeq_epi32 (v, exp));
+    }
+    bad = _mm_movemask_epi8 (acc);
+#endif
+
+    for (; i < n; i++)
+    {
+        uint32_t v;
+        memcpy (&v, ptr + 4 * i, sizeof (uint32_t));
+        bad |= (v & 0x7f800000) == 0x7f800000;
+    }
+    return !bad;
+}
+
+/**
+ * Returns the largest of n unsigned 32 bit values, 0 if n is 0
+ */
+static uint32_t max_u32 (const uint8_t *ptr, uint64_t n)
+{
+    uint64_t i = 0;
+    uint32_t max = 0;
+
+#ifdef __SSE2__
+    // SSE2 has no unsigned compare, the values are biased into the signed range
+    const __m128i bias = _mm_set1_epi32 (INT32_MIN);
+    __m128i vmax = bias;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) (ptr + 4 * i)), bias);
+        __m128i gt = _mm_cmpgt_epi32 (v, vmax);
+        vmax = _mm_or_si128 (_mm_and_si128 (gt, v), _mm_andnot_si128 (gt, vmax));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128 ((__m128i *) lanes, _mm_xor_si128 (vmax, bias));
+    for (int j = 0; j < 4; j++)
+        max = (lanes[j] > max) ? lanes[j] : max;
+#endif
+
+    for (; i < n; i++)
+    {
+        uint32_t v;
+        memcpy (&v, ptr + 4 * i, sizeof (uint32_t));
+        max = (v > max) ? v : max;
+    }
+    return max;
+}
+
+static int validate_lineset (const uint8_t *ptr, uint32_t sz)
+{
+    uint32_t nr_vertices;
+    if (sz < 5 * sizeof (uint32_t))
+        INVALID ("LineSet block is too small");
+    memcpy (&nr_vertices, ptr + 4 * sizeof (float), sizeof (uint32_t));
+    if (5 * sizeof (uint32_t) + (uint64_t) nr_vertices * 12 > sz)
+        INVALID ("LineSet vertices exceed the block");
+    if (!floats_finite (ptr, 4) || !floats_finite (ptr + 20, (uint64_t) nr_vertices * 3))
+        INVALID ("LineSet contains NaN or Inf");
+    return REX_OK;
+}
+
+static int validate_text (const uint8_t *ptr, uint32_t sz)
+{
+    // color, position and font size are followed by the text length
+    uint16_t len;
+    if (sz < 8 * sizeof (float) + sizeof (uint16_t))
+        INVALID ("Text block is too small");
+    memcpy (&len, ptr + 8 * sizeof (float), sizeof (uint16_t));
+    if (8 * sizeof (float) + sizeof (uint16_t) + (uint64_t) len > sz)
+        INVALID ("Text exceeds the block");
+    if (!floats_finite (ptr, 8))
+        INVALID ("Text contains NaN or Inf");
+    return REX_OK;
+}
+
+static int validate_pointlist (const uint8_t *ptr, uint32_t sz, uint16_t version)
+{
+    uint32_t nr_vertices, nr_colors;
+    if (sz < 2 * sizeof (uint32_t))
+        INVALID ("PointList block is too small");
+    memcpy (&nr_vertices, ptr, sizeof (uint32_t));
+    memcpy (&nr_colors, ptr + sizeof (uint32_t), sizeof (uint32_t));
+    if (nr_colors && nr_colors != nr_vertices)
+        INVALID ("PointList has %u colors for %u vertices", nr_colors, nr_vertices);
+
+    if (version == REX_POINTLIST_VERSION_COMPACT)
+    {
+        // the integer coordinates are checked by the decoder
+        if (sz < REX_POINTLIST_COMPACT_HEADER_SIZE)
+            INVALID ("Compact PointList block is too small");
+        double transform[6];
+        memcpy (transform, ptr + 12, sizeof (transform));
+        for (int i = 0; i < 6; i++)
+            if (!isfinite (transform[i]))
+                INVALID ("Compact PointList contains NaN or Inf");
+        return REX_OK;
+    }
+
+    if (2 * sizeof (uint32_t) + ((uint64_t) nr_vertices + nr_colors) * 12 > sz)
+        INVALID ("PointList arrays exceed the block");
+    if (!floats_finite (ptr + 8, ((uint64_t) nr_vertices + nr_colors) * 3))
+        INVALID ("PointList contains NaN or Inf");
+    return REX_OK;
+}
+
+static int validate_mesh (const uint8_t *ptr, uint32_t sz, uint16_t version)
+{
+    if (sz < REX_MESH_HEADER_SIZE)
+        INVALID ("Mesh block is too small");
+
+    struct rex_mesh mesh;
+    struct rex_mesh_layout layout;
+    rex_mesh_header_read ((uint8_t *) ptr, &mesh, &layout);
+    uint64_t nr_vertices = mesh.nr_vertices;
+
+    if ((layout.nr_normals && layout.nr_normals != nr_vertices)
+            || (layout.nr_texcoords && layout.nr_texcoords != nr_vertices)
+            || (layout.nr_colors && layout.nr_colors != nr_vertices))
+        INVALID ("Mesh attribute counts do not match %lu vertices", (unsigned long) nr_vertices);
+    if (!memchr (mesh.name, '\0', REX_MESH_NAME_MAX_SIZE))
+        INVALID ("Mesh name is not terminated");
+
+    // the quantized sections are checked by the decoder
+    if (version == REX_MESH_VERSION_COMPRESSED)
+    {
+        if (sz < REX_MESH_HEADER_SIZE + REX_MESH_QUANT_HEADER_SIZE)
+            INVALID ("Compressed mesh block is too small");
+        return REX_OK;
+    }
+
+    // the sections are read in sequence, the start offsets must agree with it
+    uint64_t sizes[5] = { nr_vertices * 12, (uint64_t) layout.nr_normals * 12, (uint64_t) layout.nr_texcoords * 8,
+                          (uint64_t) layout.nr_colors * 12, (uint64_t) mesh.nr_triangles * 12
+                        };
+    uint64_t start = REX_MESH_HEADER_SIZE;
+    for (int i = 0; i < 5; i++)
+    {
+        if (layout.start[i] != start && sizes[i])
+            INVALID ("Mesh section %d has an invalid start offset", i);
+        start += sizes[i];
+    }
+    if (start > sz)
+        INVALID ("Mesh arrays exceed the block");
+
+    uint64_t nr_floats = (start - REX_MESH_HEADER_SIZE - sizes[REX_MESH_SECTION_TRIANGLES]) / 4;
+    if (!floats_finite (ptr + REX_MESH_HEADER_SIZE, nr_floats))
+        INVALID ("Mesh contains NaN or Inf");
+
+    uint64_t nr_indices = (uint64_t) mesh.nr_triangles * 3;
+    if (nr_indices && (!nr_vertices || max_u32 (ptr + start - sizes[REX_MESH_SECTION_TRIANGLES], nr_indices) >= nr_vertices))
+        INVALID ("Mesh triangle index exceeds %lu vertices", (unsigned long) nr_vertices);
+    return REX_OK;
+}
+
+static int validate_image (const uint8_t *ptr, uint32_t sz)
+{
+    uint32_t compression;
+    if (sz < sizeof (uint32_t))
+        INVALID ("Image block is too small");
+    memcpy (&compression, ptr, sizeof (uint32_t));
+    if (compression > Png)
+        INVALID ("Image has an unknown compression %u", compression);
+    return REX_OK;
+}
+
+static int validate_material (const uint8_t *ptr, uint32_t sz)
+{
+    if (sz < REX_MATERIAL_STANDARD_SIZE)
+        INVALID ("Material block is too small");
+
+    // three colors with texture id, followed by ns and alpha
+    for (int i = 0; i < 3; i++)
+        if (!floats_finite (ptr + 20 * i, 3))
+            INVALID ("Material contains NaN or Inf");
+    if (!floats_finite (ptr + 60, 2))
+        INVALID ("Material contains NaN or Inf");
+    return REX_OK;
+}
+
+static int validate_scenenode (const uint8_t *ptr, uint32_t sz)
+{
+    // geometry id and name, followed by translation, rotation and scale
+    uint32_t transform = sizeof (uint64_t) + REX_SCENENODE_NAME_MAX_SIZE;
+    if (sz < transform + 10 * sizeof (float))
+        INVALID ("SceneNode block is too small");
+    if (!floats_finite (ptr + transform, 10))
+        INVALID ("SceneNode contains NaN or Inf");
+    return REX_OK;
+}
+
+static int validate_track (const uint8_t *ptr, uint32_t sz)
+{
+    uint32_t nr_points;
+    uint32_t points = sizeof (uint32_t) + sizeof (uint64_t);
+    if (sz < points)
+        INVALID ("Track block is too small");
+    memcpy (&nr_points, ptr, sizeof (uint32_t));
+    if (points + (uint64_t) nr_points * 7 * sizeof (float) > sz)
+        INVALID ("Track points exceed the block");
+    if (!floats_finite (ptr + points, (uint64_t) nr_points * 7))
+        INVALID ("Track contains NaN or Inf");
+    return REX_OK;
+}
+
+static int validate_group (const uint8_t *ptr, uint32_t sz)
+{
+    uint32_t nr_members;
+    if (sz < sizeof (uint32_t))
+        INVALID ("Group block is too small");
+    memcpy (&nr_members, ptr, sizeof (uint32_t));
+    if (sizeof (uint32_t) + (uint64_t) nr_members * sizeof (uint64_t) > sz)
+        INVALID ("Group members exceed the block");
+    return REX_OK;
+}
+
+static int validate_compressed (const uint8_t *ptr, uint32_t sz)
+{
+    uint16_t codec, type, padding;
+    if (sz < REX_COMPRESSED_HEADER_SIZE)
+        INVALID ("Compressed block is too small");
+    memcpy (&codec, ptr, sizeof (uint16_t));
+    memcpy (&type, ptr + sizeof (uint16_t), sizeof (uint16_t));
+    memcpy (&padding, ptr + 3 * sizeof (uint16_t), sizeof (uint16_t));
+    if (codec == REX_CODEC_NONE || codec > REX_CODEC_ZSTD || type == Compressed)
+        INVALID ("Compressed block has an invalid codec or type");
+    if (padding > sz - REX_COMPRESSED_HEADER_SIZE)
+        INVALID ("Compressed block padding exceeds the block");
+    return REX_OK;
+}
+
+int rex_validate_block (const uint8_t *block, uint64_t sz)
+{
+    if (!block || sz < REX_BLOCK_HEADER_SIZE)
+        INVALID ("Block header exceeds the buffer");
+
+    struct rex_block b;
+    rex_block_peek ((uint8_t *) block, &b);
+    if (b.sz > sz - REX_BLOCK_HEADER_SIZE)
+        INVALID ("Block %lu exceeds the buffer", (unsigned long) b.id);
+
+    const uint8_t *ptr = block + REX_BLOCK_HEADER_SIZE;
+    switch (b.type)
+    {
+        case LineSet:
+            return validate_lineset (ptr, b.sz);
+        case Text:
+            return validate_text (ptr, b.sz);
+        case PointList:
+            return validate_pointlist (ptr, b.sz, b.version);
+        case Mesh:
+            return validate_mesh (ptr, b.sz, b.version);
+        case Image:
+            return validate_image (ptr, b.sz);
+        case MaterialStandard:
+            return validate_material (ptr, b.sz);
+        case SceneNode:
+            return validate_scenenode (ptr, b.sz);
+        case Track:
+            return validate_track (ptr, b.sz);
+        case Group:
+            return validate_group (ptr, b.sz);
+        case Compressed:
+            return validate_compressed (ptr, b.sz);
+        default:
+            return REX_OK;
+    }
+}
+
+/**
+ * Returns != 0 if offset is one of the n ascending block offsets
+ */
+static int is_block_start (const uint64_t *starts, uint32_t n, uint64_t offset)
+{
+    uint32_t lo = 0, hi = n;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (starts[mid] < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < n && starts[lo] == offset;
+}
+
+/**
+ * Checks that every index entry points to the start of one of the validated data blocks
+ * and that the block has the same header
+ */
+static int validate_index (const uint8_t *buf, uint64_t sz, const struct rex_header *header,
+                           const uint64_t *starts, uint32_t nr_blocks)
+{
+    uint64_t addr = header->index_addr;
+    if (addr < header->start_addr || addr > sz || sz - addr < REX_BLOCK_HEADER_SIZE + sizeof (uint32_t))
+        INVALID ("Index block exceeds the buffer");
+
+    struct rex_block b;
+    rex_block_peek ((uint8_t *) buf + addr, &b);
+    uint32_t nr_entries;
+    memcpy (&nr_entries, buf + addr + REX_BLOCK_HEADER_SIZE, sizeof (uint32_t));
+    if (b.type != Index || b.sz > sz - addr - REX_BLOCK_HEADER_SIZE
+            || sizeof (uint32_t) + (uint64_t) nr_entries * REX_INDEX_ENTRY_SIZE > b.sz)
+        INVALID ("Invalid index block");
+
+    const uint8_t *ptr = buf + addr + REX_BLOCK_HEADER_SIZE + sizeof (uint32_t);
+    for (uint32_t i = 0; i < nr_entries; i++, ptr += REX_INDEX_ENTRY_SIZE)
+    {
+        struct rex_block e;
+        uint64_t offset;
+        memcpy (&e.id, ptr, sizeof (uint64_t));
+        memcpy (&offset, ptr + 8, sizeof (uint64_t));
+        memcpy (&e.sz, ptr + 16, sizeof (uint32_t));
+        memcpy (&e.type, ptr + 20, sizeof (uint16_t));
+        memcpy (&e.version, ptr + 22, sizeof (uint16_t));
+
+        if (offset < header->start_addr || offset > sz || sz - offset < REX_BLOCK_HEADER_SIZE)
+            INVALID ("Index entry %u exceeds the buffer", i);
+        if (!is_block_start (starts, nr_blocks, offset))
+            INVALID ("Index entry %u does not point to a data block", i);
+        rex_block_peek ((uint8_t *) buf + offset, &b);
+        if (b.type != e.type || b.version != e.version || b.sz != e.sz || b.id != e.id
+                || b.sz > sz - offset - REX_BLOCK_HEADER_SIZE)
+            INVALID ("Index entry %u does not match the block", i);
+    }
+    return REX_OK;
+}
+
+static int validate_file (uint8_t *buf, uint64_t sz, struct rex_header *header)
+{
+    // the main header without the coordinate system block has 64 bytes
+    if (sz < 64 || memcmp (buf, REX_FILE_MAGIC, 4) != 0)
+        INVALID ("Not a REX file");
+    rex_header_read (buf, header);
+
+    if (header->start_addr < 64 || header->start_addr > sz
+            || header->sz_all_datablocks > sz - header->start_addr)
+        INVALID ("Data blocks exceed the buffer");
+
+    // every block has at least a header, which bounds the offsets recorded for the index
+    uint32_t nr_blocks = rex_header_nr_datablocks (header);
+    if (nr_blocks > header->sz_all_datablocks / REX_BLOCK_HEADER_SIZE)
+        INVALID ("Number of data blocks exceeds the buffer");
+    uint64_t *starts = NULL;
+    if (header->index_addr && nr_blocks)
+    {
+        starts = rex_malloc ((size_t) nr_blocks * sizeof (uint64_t));
+        if (!starts)
+        {
+            warn ("Cannot allocate memory");
+            return REX_ERROR_MEMORY;
+        }
+    }
+
+    const uint8_t *ptr = buf + header->start_addr;
+    const uint8_t *end = ptr + header->sz_all_datablocks;
+    int ret = REX_OK;
+    for (uint32_t i = 0; i < nr_blocks; i++)
+    {
+        ret = rex_validate_block (ptr, end - ptr);
+        if (ret != REX_OK)
+            break;
+        if (starts)
+            starts[i] = ptr - buf;
+        ptr = rex_block_skip ((uint8_t *) ptr);
+    }
+    if (ret == REX_OK && ptr != end)
+    {
+        warn ("Size of all data blocks does not match the header");
+        ret = REX_ERROR_INVALID_DATA;
+    }
+
+    if (ret == REX_OK && header->index_addr)
+        ret = validate_index (buf, sz, header, starts, nr_blocks);
+    FREE (starts);
+    if (ret != REX_OK)
+        return ret;
+
+    header->trusted = 1;
+    return REX_OK;
+}
+
+int rex_validate (uint8_t *buf, uint64_t sz, struct rex_header *header)
+{
+    if (!buf || !header)
+        return REX_MISSING_PARAMETER;
+
+    struct rex_trace_span span = rex_trace_begin ("validate");
+    int ret = validate_file (buf, sz, header);
+    rex_trace_end (&span);
+    return ret;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2018 Robotic Eyes GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.*
+ */
+#pragma once
+
+/**
+ * \file
+ * \brief Validation of untrusted REX files
+ *
+ * The decode functions (rex_block_read and friends) trust the buffer completely: counts and
+ * offsets are taken from the file as they are. Files from untrusted sources must be
+ * validated once with rex_validate before they are decoded. The validation checks in a
+ * single pass over the buffer
+ *
+ * - the REX header (magic, start address, size and number of data blocks),
+ * - the bounds of all data blocks and of the index block,
+ * - that every index entry points to the start of one of the data blocks,
+ * - the consistency of the block headers (counts and offsets against the block size),
+ * - the triangle indices of meshes against the number of vertices,
+ * - that all float arrays are free of NaN and Inf values.
+ *
+ * Afterwards the header is marked as trusted, the iterator and the index skip their own
+ * bounds checks for such buffers. Compressed meshes, compact pointlists and compressed blocks
+ * are checked by their decoders because their content is only known after decoding, the
+ * inner block of a compressed block is validated with rex_validate_block.
+ *
+ * Blocks of unknown type are accepted if they are inside the buffer.
+ */
+
+#include <stdint.h>
+
+#include "rex-header.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Validates a complete REX file and reads its header. The float arrays and the triangle
+ * indices are checked with SSE2 if available.
+ *
+ * \param buf pointer to the beginning of the REX file
+ * \param sz size of the buffer
+ * \param header the header which gets filled and marked as trusted on success
+ * \return REX_OK if the file is valid, else REX_ERROR_INVALID_DATA (see status.h)
+ */
+int rex_validate (uint8_t *buf, uint64_t sz, struct rex_header *header);
+
+/**
+ * Validates a single data block including its block header.
+ *
+ * \param block pointer to the beginning of the block (block header)
+ * \param sz the number of bytes which are available at block
+ * \return REX_OK if the block is valid, else REX_ERROR_INVALID_DATA (see status.h)
+ */
+int rex_validate_block (const uint8_t *block, uint64_t sz);
+
+#ifdef __cplusplus
+}
+#endif
@@ -20,13 +20,36 @@
 #include "linmath.h"
 #include "util.h"
 
+#include "rex-alloc.h"
+#include "rex-arena.h"
+#include "rex-batch.h"
+#include "rex-block-compressed.h"
+#include "rex-block-group.h"
 #include "rex-block-image.h"
 #include "rex-block-lineset.h"
 #include "rex-block-material.h"
+#include "rex-block-mesh-compressed.h"
 #include "rex-block-mesh.h"
+#include "rex-block-pointlist-compact.h"
 #include "rex-block-pointlist.h"
 #include "rex-block-scenenode.h"
 #include "rex-block-text.h"
 #include "rex-block-track.h"
 #include "rex-block.h"
+#include "rex-bounds.h"
+#include "rex-crc.h"
+#include "rex-group.h"
 #include "rex-header.h"
+#include "rex-index.h"
+#include "rex-iov.h"
+#include "rex-map.h"
+#include "rex-mem.h"
+#include "rex-mesh-normals.h"
+#include "rex-mesh-optimize.h"
+#include "rex-mesh-simplify.h"
+#include "rex-mesh-weld.h"
+#include "rex-stats.h"
+#include "rex-stream.h"
+#include "rex-thread.h"
+#include "rex-trace.h"
+#include "rex-validate.h"
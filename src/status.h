@@ -18,11 +18,16 @@
 #define REX_OK                                  0
 #define REX_NOT_IMPLEMENTED                     1
 #define REX_MISSING_PARAMETER                   2
+#define REX_END_OF_STREAM                       3
 
 #define REX_ERROR_FILE_OPEN                     10
 #define REX_ERROR_FILE_READ                     11
 #define REX_ERROR_FILE_WRITE                    12
 #define REX_ERROR_WRONG_MAGIC                   13
+#define REX_ERROR_WRONG_ORDER                   14
+#define REX_ERROR_BLOCK_SIZE                    15
+#define REX_ERROR_CRC                           16
+#define REX_ERROR_INVALID_DATA                  17
 
 #define REX_SYSTEM_ERROR                        500
 #define REX_ERROR_MEMORY                        501
@@ -30,6 +30,8 @@
 #endif
 
 
+#include "rex-mem.h"
+#include "rex-trace.h"
 #include "util.h"
 
 static void verr (const char *fmt, va_list ap)
@@ -80,7 +82,7 @@ char *read_file_ascii (const char *filename)
     fseek (f, 0, SEEK_END);
     long length = ftell (f);
     fseek (f, 0, SEEK_SET);
-    char *buffer = (char *) malloc (length + 1);
+    char *buffer = (char *) rex_malloc (length + 1);
     buffer[length] = '\0';
     fread (buffer, 1, length, f);
     fclose (f);
@@ -91,11 +93,13 @@ uint8_t *read_file_binary (const char *filename, long *sz)
 {
     FILE *f = fopen (filename, "rb");
     if (f == NULL) return NULL;
+    struct rex_trace_span span = rex_trace_begin ("read file");
     fseek (f, 0, SEEK_END);
     *sz = ftell (f);
     fseek (f, 0, SEEK_SET);
-    uint8_t *buffer = (uint8_t *) malloc (*sz);
+    uint8_t *buffer = (uint8_t *) rex_mem_alloc (REX_MEM_IO, *sz);
     size_t ret = fread (buffer, 1, *sz, f);
+    rex_trace_end (&span);
     if (ret != *sz)
     {
         FREE (buffer);
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "rex-alloc.h"
 #include "status.h"
 
 #ifdef __cplusplus
@@ -82,7 +83,22 @@ if (buf == NULL) \
     return NULL; \
 }
 
-#define FREE(m) do { free(m); m = NULL; } while(0);
+/**
+ * Checks that the total size of a serialized block (including the block header) fits
+ * into the 32 bit size field of the block header. Larger geometry must be split into
+ * multiple blocks (see rex-group.h).
+ */
+#define BLOCK_SIZE_CHECK(sz) \
+if ((uint64_t) (sz) - REX_BLOCK_HEADER_SIZE > REX_BLOCK_MAX_SIZE) \
+{ \
+    warn ("Block exceeds the maximum block size of 4 GiB"); \
+    return NULL; \
+}
+
+/**
+ * Releases memory with the installed REX allocator (see rex-alloc.h) and resets the pointer
+ */
+#define FREE(m) do { rex_free(m); m = NULL; } while(0);
 
 #define rex_write(p,s,n,fp) \
 { \
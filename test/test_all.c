@@ -1,5 +1,7 @@
 #include <check.h>
+#include <float.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "rex.h"
 
@@ -25,14 +27,14 @@ void generate_mesh (struct rex_mesh *mesh)
     mesh->nr_vertices = 3;
     mesh->nr_triangles = 1;
 
-    mesh->positions = malloc (12 * 3);
+    mesh->positions = rex_malloc (12 * 3);
     vec3 v1 = { 0.0, 0.0, 0.0 };
     vec3 v2 = { 1.0, 0.0, 0.0 };
     vec3 v3 = { 0.5, 1.0, 0.0 };
     memcpy (mesh->positions, v1, 12);
     memcpy (&mesh->positions[3], v2, 12);
     memcpy (&mesh->positions[6], v3, 12);
-    mesh->triangles = malloc (12);
+    mesh->triangles = rex_malloc (12);
     mesh->triangles[0] = 0;
     mesh->triangles[1] = 1;
     mesh->triangles[2] = 2;
@@ -41,6 +43,51 @@ void generate_mesh (struct rex_mesh *mesh)
     sprintf (mesh->name, "test");
 }
 
+void generate_grid (struct rex_mesh *mesh, uint32_t n)
+{
+    ck_assert (mesh != NULL && n > 1);
+
+    rex_mesh_init (mesh);
+
+    // vertices are stored in reverse order to differ from the first use order
+    mesh->nr_vertices = n * n;
+    mesh->nr_triangles = 2 * (n - 1) * (n - 1);
+    mesh->positions = rex_malloc (12 * mesh->nr_vertices);
+    mesh->normals = rex_malloc (12 * mesh->nr_vertices);
+    mesh->tex_coords = rex_malloc (8 * mesh->nr_vertices);
+    mesh->colors = rex_malloc (12 * mesh->nr_vertices);
+    mesh->triangles = rex_malloc (12 * mesh->nr_triangles);
+    for (uint32_t y = 0; y < n; y++)
+        for (uint32_t x = 0; x < n; x++)
+        {
+            uint32_t v = mesh->nr_vertices - 1 - (y * n + x);
+            float h = 0.1f * sinf ((float) x) * cosf ((float) y);
+            vec3 p = { (float) x, (float) y, h };
+            vec3 nor = { -0.1f * cosf ((float) x) * cosf ((float) y), 0.1f * sinf ((float) x) * sinf ((float) y), 1.0f };
+            vec3_norm (nor, nor);
+            memcpy (&mesh->positions[v * 3], p, 12);
+            memcpy (&mesh->normals[v * 3], nor, 12);
+            mesh->tex_coords[v * 2] = (float) x / (n - 1);
+            mesh->tex_coords[v * 2 + 1] = (float) y / (n - 1);
+            mesh->colors[v * 3] = (float) x / (n - 1);
+            mesh->colors[v * 3 + 1] = (float) y / (n - 1);
+            mesh->colors[v * 3 + 2] = 0.5f;
+        }
+
+    uint32_t *t = mesh->triangles;
+    for (uint32_t y = 0; y < n - 1; y++)
+        for (uint32_t x = 0; x < n - 1; x++)
+        {
+            uint32_t a = mesh->nr_vertices - 1 - (y * n + x);
+            uint32_t b = a - 1;
+            uint32_t c = a - n;
+            uint32_t d = c - 1;
+            *t++ = a; *t++ = b; *t++ = c;
+            *t++ = b; *t++ = d; *t++ = c;
+        }
+    sprintf (mesh->name, "grid");
+}
+
 void generate_material (struct rex_material_standard *mat)
 {
     ck_assert (mat != NULL);
@@ -73,7 +120,7 @@ void generate_lineset (struct rex_lineset *ls)
     vec3 v2 = { 1.0, 0.0, 0.0 };
     vec3 v3 = { 1.0, 1.0, 0.0 };
     vec3 v4 = { 0.0, 1.0, 0.0 };
-    ls->vertices = malloc (12 * 5);
+    ls->vertices = rex_malloc (12 * 5);
     memset (ls->vertices, 0, 12 * 5);
 
     memcpy (ls->vertices, v1, 12);
@@ -90,7 +137,7 @@ void generate_pointlist (struct rex_pointlist *p, int color)
 
     p->nr_vertices = 100;
 
-    p->positions = malloc (12 * p->nr_vertices);
+    p->positions = rex_malloc (12 * p->nr_vertices);
     int i = 0;
     for (int y = 0; y < 10; y++)
     {
@@ -105,7 +152,7 @@ void generate_pointlist (struct rex_pointlist *p, int color)
     if (color)
     {
         p->nr_colors = 100;
-        p->colors = malloc (12 * p->nr_colors);
+        p->colors = rex_malloc (12 * p->nr_colors);
         for (int i = 0; i < (int) p->nr_colors * 3; i += 3)
         {
             p->colors[i] = 0.8f;
@@ -196,6 +243,666 @@ START_TEST (test_rex_writer_mesh)
 }
 END_TEST
 
+static void *small_malloc (size_t sz, void *ctx)
+{
+    (void) ctx;
+    return (sz > 1024) ? NULL : malloc (sz);
+}
+
+static void *small_aligned_alloc (size_t alignment, size_t sz, void *ctx)
+{
+    (void) ctx;
+    void *p = NULL;
+    if (sz > 1024)
+        return NULL;
+    return (posix_memalign (&p, alignment, sz ? sz : 1) == 0) ? p : NULL;
+}
+
+START_TEST (test_rex_track)
+{
+    // odd number of points to cover the scalar tail of the vector kernels
+    uint32_t n = 1027;
+    float *points = rex_malloc (12 * n);
+    float *normals = rex_malloc (12 * n);
+    float *confidences = rex_malloc (4 * n);
+    for (uint32_t i = 0; i < 3 * n; i++)
+    {
+        points[i] = (float) i;
+        normals[i] = -(float) i;
+    }
+    for (uint32_t i = 0; i < n; i++)
+        confidences[i] = 0.5f + (float) i;
+    struct rex_track track = { .nr_points = n, .timestamp = 1234567890123ll, .points = points,
+                               .normals = normals, .confidences = confidences };
+
+    long sz;
+    uint8_t *ptr = rex_block_write_track (7, NULL, &track, &sz);
+    ck_assert (sz == rex_block_size_track (&track));
+
+    // compare the interleaved records with a scalar reference
+    const uint8_t *records = ptr + REX_BLOCK_HEADER_SIZE + sizeof (uint32_t) + sizeof (uint64_t);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        float r[7];
+        memcpy (r, records + i * sizeof (r), sizeof (r));
+        for (int c = 0; c < 3; c++)
+        {
+            ck_assert (r[c] == points[i * 3 + c]);
+            ck_assert (r[3 + c] == normals[i * 3 + c]);
+        }
+        ck_assert (r[6] == confidences[i]);
+    }
+
+    struct rex_block_iov t;
+    ck_assert (rex_block_iov_track (7, NULL, &track, &t) == REX_OK);
+    ck_assert (memcmp (t.iov[1].base, records, t.iov[1].len) == 0);
+    rex_block_iov_free (&t);
+
+    struct rex_block block;
+    ck_assert (rex_block_read (ptr, &block) == ptr + sz);
+    ck_assert (block.type == Track);
+    struct rex_track *rtrack = block.data;
+    ck_assert (rtrack->nr_points == n && rtrack->timestamp == track.timestamp);
+    ck_assert (memcmp (rtrack->points, points, 12 * n) == 0);
+    ck_assert (memcmp (rtrack->normals, normals, 12 * n) == 0);
+    ck_assert (memcmp (rtrack->confidences, confidences, 4 * n) == 0);
+    rex_block_free (&block);
+
+    // a failed allocation of the arrays fails the block
+    struct rex_allocator allocator = *rex_get_allocator();
+    allocator.malloc = small_malloc;
+    allocator.aligned_alloc = small_aligned_alloc;
+    ck_assert (rex_set_allocator (&allocator) == REX_OK);
+    ck_assert (rex_block_read (ptr, &block) == ptr + sz);
+    ck_assert (block.type == Track && block.data == NULL);
+    long fsz;
+    ck_assert (rex_block_write_track (7, NULL, &track, &fsz) == NULL);
+    ck_assert (rex_set_allocator (NULL) == REX_OK);
+
+    // a block too small for the point count is rejected before the count is read
+    uint8_t *small = rex_malloc (REX_BLOCK_HEADER_SIZE + 2);
+    memset (small, 0, REX_BLOCK_HEADER_SIZE + 2);
+    struct rex_block sblock = { .type = Track, .version = 1, .sz = 2, .id = 7 };
+    rex_block_header_write (small, &sblock);
+    ck_assert (rex_block_read (small, &block) == small + REX_BLOCK_HEADER_SIZE + 2);
+    ck_assert (block.type == Track && block.data == NULL);
+    FREE (small);
+
+    FREE (ptr);
+    FREE (points);
+    FREE (normals);
+    FREE (confidences);
+}
+END_TEST
+
+START_TEST (test_rex_stats)
+{
+    struct rex_mesh mesh;
+    generate_grid (&mesh, 8);
+    struct rex_header *header = rex_header_create();
+
+    rex_stats_enable (1);
+    rex_stats_reset ();
+    long sz;
+    uint8_t *ptr = rex_block_write_mesh (0, header, &mesh, &sz);
+    struct rex_block block;
+    ck_assert (rex_block_read (ptr, &block) == ptr + sz);
+    rex_block_free (&block);
+    rex_stats_enable (0);
+
+    // counters are off again
+    ck_assert (rex_block_read (ptr, &block) == ptr + sz);
+    rex_block_free (&block);
+
+    struct rex_stats stats;
+    rex_stats_get (&stats);
+    const struct rex_stats_entry *e = &stats.types[Mesh];
+    if (rex_stats_available ())
+    {
+        ck_assert (e->blocks_read == 1 && e->bytes_read == (uint64_t) sz);
+        ck_assert (e->blocks_written == 1 && e->bytes_written == (uint64_t) sz);
+        ck_assert (e->allocs >= 5 && e->bytes_allocated >= (uint64_t) mesh.nr_vertices * 44);
+        ck_assert (stats.types[REX_STATS_OTHER].allocs >= 1);
+        ck_assert (stats.types[Text].blocks_read == 0);
+    }
+    else
+        ck_assert (e->blocks_read == 0 && !rex_stats_enabled ());
+
+    FREE (ptr);
+    FREE (header);
+    rex_mesh_free (&mesh);
+}
+END_TEST
+
+START_TEST (test_rex_trace)
+{
+    char filename[64];
+    snprintf (filename, sizeof (filename), "/tmp/rex-trace-%d.json", (int) getpid());
+    ck_assert (rex_trace_start (filename) == REX_OK);
+    ck_assert (rex_trace_enabled ());
+
+    // decode the template on the threads of a pool
+    struct rex_thread_pool *pool = rex_thread_pool_create (2);
+    sprintf (tmp, "%s/%s", TEST_DATA_PATH, REX_TEMPLATE);
+    struct rex_map map;
+    ck_assert (rex_map_open (tmp, &map) == REX_OK);
+    struct rex_header header;
+    rex_header_read (map.data, &header);
+    struct rex_block *blocks;
+    uint32_t nr_blocks;
+    ck_assert (rex_block_read_all (map.data, map.sz, &header, pool, &blocks, &nr_blocks) == REX_OK);
+    rex_blocks_free (blocks, nr_blocks);
+    struct rex_trace_span span = rex_trace_begin ("test \"span\"");
+    rex_trace_end (&span);
+    ck_assert (rex_trace_stop () == REX_OK);
+    ck_assert (!rex_trace_enabled ());
+
+    // spans are not recorded after stop
+    span = rex_trace_begin ("after stop");
+    ck_assert (span.name == NULL);
+    rex_trace_end (&span);
+
+    long sz;
+    char *json = (char *) read_file_binary (filename, &sz);
+    ck_assert (json != NULL);
+    json = rex_realloc (json, sz + 1);
+    json[sz] = '\0';
+    ck_assert (strncmp (json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 39) == 0);
+    ck_assert (strstr (json, "\"name\":\"read header\"") != NULL);
+    ck_assert (strstr (json, "\"name\":\"read index\"") != NULL);
+    ck_assert (strstr (json, "\"name\":\"decode Mesh\"") != NULL);
+    ck_assert (strstr (json, "\"name\":\"test \\\"span\\\"\"") != NULL);
+    ck_assert (strstr (json, "after stop") == NULL);
+
+    // one header, one index, the decoded blocks and the test span
+    uint32_t nr_spans = 0;
+    for (const char *p = json; (p = strstr (p, "\"ph\":\"X\"")) != NULL; p++)
+        nr_spans++;
+    ck_assert (nr_spans == 3 + nr_blocks);
+    ck_assert (json[sz - 3] == ']' && json[sz - 2] == '}');
+
+    FREE (json);
+    unlink (filename);
+    rex_map_close (&map);
+    rex_thread_pool_destroy (pool);
+}
+END_TEST
+
+START_TEST (test_rex_mem)
+{
+    struct rex_mesh mesh;
+    generate_grid (&mesh, 8);
+
+    rex_mem_tracking (1);
+    struct rex_mem_stats before, after;
+    rex_mem_get (&before);
+
+    long sz;
+    uint8_t *ptr = rex_block_write_mesh (0, NULL, &mesh, &sz);
+    struct rex_block block;
+    rex_block_read (ptr, &block);
+    rex_mem_get (&after);
+    ck_assert (after.subsystems[REX_MEM_ENCODE].current - before.subsystems[REX_MEM_ENCODE].current == (uint64_t) sz);
+    ck_assert (after.subsystems[REX_MEM_ENCODE].live - before.subsystems[REX_MEM_ENCODE].live == 1);
+    uint64_t decoded = after.subsystems[REX_MEM_DECODE].current - before.subsystems[REX_MEM_DECODE].current;
+    ck_assert (decoded >= (uint64_t) mesh.nr_vertices * 44 + mesh.nr_triangles * 12);
+    ck_assert (after.total.peak >= after.total.current);
+
+    // memory is charged to the subsystem of the allocation, also if released elsewhere
+    rex_block_free (&block);
+    FREE (ptr);
+    rex_mem_get (&after);
+    for (int i = 0; i < REX_MEM_NR_SUBSYSTEMS; i++)
+    {
+        ck_assert (after.subsystems[i].current == before.subsystems[i].current);
+        ck_assert (after.subsystems[i].live == before.subsystems[i].live);
+    }
+    ck_assert (after.subsystems[REX_MEM_DECODE].peak >= before.subsystems[REX_MEM_DECODE].current + decoded);
+
+    // realloc keeps the subsystem, foreign memory is ignored
+    int prev = rex_mem_enter (REX_MEM_APPLICATION);
+    uint8_t *p = rex_malloc (100);
+    rex_mem_leave (prev);
+    p = rex_realloc (p, 1000);
+    const struct rex_allocator *allocator = rex_get_allocator ();
+    uint8_t *foreign = allocator->malloc (10, allocator->ctx);
+    FREE (foreign);
+    rex_mem_get (&after);
+    ck_assert (after.subsystems[REX_MEM_APPLICATION].current - before.subsystems[REX_MEM_APPLICATION].current == 1000);
+    ck_assert (after.subsystems[REX_MEM_APPLICATION].live - before.subsystems[REX_MEM_APPLICATION].live == 1);
+
+    // tracked memory is accounted after tracking is switched off
+    rex_mem_tracking (0);
+    FREE (p);
+    rex_mem_get (&after);
+    ck_assert (after.subsystems[REX_MEM_APPLICATION].current == before.subsystems[REX_MEM_APPLICATION].current);
+    ck_assert (!rex_mem_tracking_enabled ());
+
+    rex_mesh_free (&mesh);
+}
+END_TEST
+
+static int u64_cmp (const void *a, const void *b)
+{
+    uint64_t ua = *(const uint64_t *) a;
+    uint64_t ub = *(const uint64_t *) b;
+    return (ua > ub) - (ua < ub);
+}
+
+/**
+ * Sorted keys of the grid triangles, which are independent of the triangle and vertex order
+ */
+static uint64_t *grid_triangle_keys (const struct rex_mesh *mesh)
+{
+    uint64_t *keys = rex_malloc (mesh->nr_triangles * sizeof (uint64_t));
+    for (uint32_t t = 0; t < mesh->nr_triangles; t++)
+    {
+        const float *p0 = &mesh->positions[mesh->triangles[t * 3] * 3];
+        const float *p1 = &mesh->positions[mesh->triangles[t * 3 + 1] * 3];
+        const float *p2 = &mesh->positions[mesh->triangles[t * 3 + 2] * 3];
+        uint64_t sx = (uint64_t) (p0[0] + p1[0] + p2[0]);
+        uint64_t sy = (uint64_t) (p0[1] + p1[1] + p2[1]);
+        float z = (p1[0] - p0[0]) * (p2[1] - p0[1]) - (p1[1] - p0[1]) * (p2[0] - p0[0]);
+        keys[t] = ((sx << 20) | sy) << 1 | (z > 0.0f);
+    }
+    qsort (keys, mesh->nr_triangles, sizeof (uint64_t), u64_cmp);
+    return keys;
+}
+
+START_TEST (test_rex_mesh_optimize)
+{
+    const uint32_t n = 32;
+    struct rex_mesh mesh;
+    generate_grid (&mesh, n);
+
+    // scatter the triangles, so that the input order is bad for the cache
+    uint32_t seed = 1;
+    for (uint32_t t = mesh.nr_triangles - 1; t > 0; t--)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint32_t o = (seed >> 8) % (t + 1);
+        for (int c = 0; c < 3; c++)
+        {
+            uint32_t tmp = mesh.triangles[t * 3 + c];
+            mesh.triangles[t * 3 + c] = mesh.triangles[o * 3 + c];
+            mesh.triangles[o * 3 + c] = tmp;
+        }
+    }
+    uint64_t *keys = grid_triangle_keys (&mesh);
+
+    struct rex_mesh_optimize_params params;
+    rex_mesh_optimize_params_init (&params);
+    struct rex_mesh_cache_stats before, after;
+    ck_assert (rex_mesh_optimize (&mesh, &params, &before, &after) == REX_OK);
+    ck_assert (before.cache_size == REX_MESH_CACHE_SIZE && after.cache_size == REX_MESH_CACHE_SIZE);
+    ck_assert (before.acmr > 2.0f);
+    ck_assert (after.acmr < 0.8f);
+    ck_assert (after.atvr < before.atvr && after.atvr >= 1.0f);
+
+    // the same triangles with the same winding, the attributes moved with the vertices
+    uint64_t *optimized = grid_triangle_keys (&mesh);
+    ck_assert (memcmp (keys, optimized, mesh.nr_triangles * sizeof (uint64_t)) == 0);
+    FREE (optimized);
+    for (uint32_t v = 0; v < mesh.nr_vertices; v++)
+    {
+        ck_assert (mesh.tex_coords[v * 2] == mesh.positions[v * 3] / (n - 1));
+        ck_assert (mesh.colors[v * 3 + 1] == mesh.positions[v * 3 + 1] / (n - 1));
+    }
+
+    // vertices are ordered by first use
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < mesh.nr_triangles * 3; i++)
+    {
+        ck_assert (mesh.triangles[i] <= next);
+        if (mesh.triangles[i] == next)
+            next++;
+    }
+    ck_assert (next == mesh.nr_vertices);
+
+    // the overdraw pass keeps the triangles and trades little cache efficiency
+    params.overdraw = 1;
+    struct rex_mesh_cache_stats overdraw;
+    ck_assert (rex_mesh_optimize (&mesh, &params, NULL, &overdraw) == REX_OK);
+    optimized = grid_triangle_keys (&mesh);
+    ck_assert (memcmp (keys, optimized, mesh.nr_triangles * sizeof (uint64_t)) == 0);
+    ck_assert (overdraw.acmr < 1.0f);
+    FREE (optimized);
+
+    mesh.triangles[7] = mesh.nr_vertices;
+    ck_assert (rex_mesh_optimize (&mesh, NULL, NULL, NULL) == REX_ERROR_INVALID_DATA);
+    ck_assert (rex_mesh_cache_stats (&mesh, 0, &after) == REX_ERROR_INVALID_DATA);
+
+    FREE (keys);
+    rex_mesh_free (&mesh);
+}
+END_TEST
+
+/**
+ * Splits the grid into one vertex per triangle corner, every second corner is moved by
+ * less than the weld tolerance. One degenerate triangle and one unused vertex are appended.
+ */
+static void generate_split_grid (struct rex_mesh *mesh, uint32_t n)
+{
+    struct rex_mesh grid;
+    generate_grid (&grid, n);
+
+    rex_mesh_init (mesh);
+    mesh->nr_triangles = grid.nr_triangles + 1;
+    mesh->nr_vertices = mesh->nr_triangles * 3 + 1;
+    mesh->positions = rex_malloc (12 * mesh->nr_vertices);
+    mesh->normals = rex_malloc (12 * mesh->nr_vertices);
+    mesh->tex_coords = rex_malloc (8 * mesh->nr_vertices);
+    mesh->triangles = rex_malloc (12 * mesh->nr_triangles);
+    for (uint32_t i = 0; i < mesh->nr_vertices; i++)
+    {
+        uint32_t v = (i < grid.nr_triangles * 3) ? grid.triangles[i] : grid.triangles[i % 3];
+        memcpy (&mesh->positions[i * 3], &grid.positions[v * 3], 12);
+        memcpy (&mesh->normals[i * 3], &grid.normals[v * 3], 12);
+        memcpy (&mesh->tex_coords[i * 2], &grid.tex_coords[v * 2], 8);
+        if (i % 2)
+            mesh->positions[i * 3] += 2e-6f;
+        if (i < mesh->nr_triangles * 3)
+            mesh->triangles[i] = i;
+    }
+
+    // the last triangle collapses to the edge of the first triangle
+    mesh->triangles[grid.nr_triangles * 3 + 2] = 1;
+    rex_mesh_free (&grid);
+}
+
+START_TEST (test_rex_mesh_weld)
+{
+    const uint32_t n = 16;
+    struct rex_mesh grid;
+    generate_grid (&grid, n);
+    uint64_t *keys = grid_triangle_keys (&grid);
+
+    struct rex_mesh mesh;
+    generate_split_grid (&mesh, n);
+    ck_assert (rex_mesh_weld (&mesh, NULL) == REX_OK);
+    ck_assert (mesh.nr_vertices == grid.nr_vertices);
+    ck_assert (mesh.nr_triangles == grid.nr_triangles);
+    uint64_t *welded = grid_triangle_keys (&mesh);
+    ck_assert (memcmp (keys, welded, mesh.nr_triangles * sizeof (uint64_t)) == 0);
+    FREE (welded);
+    for (uint32_t v = 0; v < mesh.nr_vertices; v++)
+        ck_assert (fabsf (mesh.tex_coords[v * 2 + 1] - mesh.positions[v * 3 + 1] / (n - 1)) < 1e-6f);
+    rex_mesh_free (&mesh);
+
+    // a texture seam keeps the vertices apart, unless texture coordinates are ignored
+    generate_split_grid (&mesh, n);
+    for (uint32_t i = 0; i < 3; i++)
+        mesh.tex_coords[i * 2] += 0.5f;
+    ck_assert (rex_mesh_weld (&mesh, NULL) == REX_OK);
+    ck_assert (mesh.nr_vertices == grid.nr_vertices + 3);
+    rex_mesh_free (&mesh);
+
+    generate_split_grid (&mesh, n);
+    for (uint32_t i = 0; i < 3; i++)
+        mesh.tex_coords[i * 2] += 0.5f;
+    struct rex_mesh_weld_params params;
+    rex_mesh_weld_params_init (&params);
+    params.tex_coord_epsilon = -1.0f;
+    ck_assert (rex_mesh_weld (&mesh, &params) == REX_OK);
+    ck_assert (mesh.nr_vertices == grid.nr_vertices);
+
+    // without tolerance only the exact duplicates are merged
+    params.position_epsilon = 0.0f;
+    rex_mesh_free (&mesh);
+    generate_split_grid (&mesh, n);
+    ck_assert (rex_mesh_weld (&mesh, &params) == REX_OK);
+    ck_assert (mesh.nr_vertices > grid.nr_vertices && mesh.nr_vertices < 3 * grid.nr_triangles);
+
+    FREE (keys);
+    rex_mesh_free (&mesh);
+    rex_mesh_free (&grid);
+}
+END_TEST
+
+START_TEST (test_rex_mesh_simplify)
+{
+    const uint32_t n = 32;
+    const uint32_t s = n / 2;
+    struct rex_mesh grid;
+    generate_grid (&grid, n);
+
+    struct rex_mesh_simplify_params params;
+    rex_mesh_simplify_params_init (&params);
+    params.target_ratio = 0.25f;
+    params.target_error = 1.0f;
+    struct rex_mesh lod;
+    float error;
+    ck_assert (rex_mesh_simplify (&grid, &lod, &params, &error) == REX_OK);
+    ck_assert (lod.nr_triangles <= grid.nr_triangles / 4 + 2 && lod.nr_triangles > 0);
+    ck_assert (error > 0.0f && error <= 1.0f);
+    ck_assert (!strcmp (lod.name, grid.name));
+
+    // the vertices are a subset of the grid with consistent attributes, the corners are kept
+    uint32_t corners = 0;
+    for (uint32_t v = 0; v < lod.nr_vertices; v++)
+    {
+        float x = lod.positions[v * 3];
+        float y = lod.positions[v * 3 + 1];
+        ck_assert (lod.tex_coords[v * 2] == x / (n - 1) && lod.tex_coords[v * 2 + 1] == y / (n - 1));
+        corners += (x == 0 || x == n - 1) && (y == 0 || y == n - 1);
+    }
+    ck_assert (corners == 4);
+    for (uint32_t i = 0; i < lod.nr_triangles * 3; i++)
+        ck_assert (lod.triangles[i] < lod.nr_vertices);
+    rex_mesh_free (&lod);
+
+    // the error limit stops the simplification early
+    params.target_error = 1e-4f;
+    ck_assert (rex_mesh_simplify (&grid, &lod, &params, &error) == REX_OK);
+    ck_assert (lod.nr_triangles > grid.nr_triangles / 4 && error <= 1e-4f);
+    rex_mesh_free (&lod);
+
+    // a texture seam along x = s, the vertices right of the seam have u >= 1
+    struct rex_mesh seam;
+    rex_mesh_init (&seam);
+    seam.nr_vertices = grid.nr_vertices + n;
+    seam.nr_triangles = grid.nr_triangles;
+    seam.positions = rex_malloc (12 * seam.nr_vertices);
+    seam.tex_coords = rex_malloc (8 * seam.nr_vertices);
+    seam.triangles = rex_malloc (12 * seam.nr_triangles);
+    memcpy (seam.positions, grid.positions, 12 * grid.nr_vertices);
+    memcpy (seam.tex_coords, grid.tex_coords, 8 * grid.nr_vertices);
+    memcpy (seam.triangles, grid.triangles, 12 * grid.nr_triangles);
+    uint32_t *wedge = rex_malloc (4 * grid.nr_vertices);
+    for (uint32_t v = 0, next = grid.nr_vertices; v < grid.nr_vertices; v++)
+    {
+        wedge[v] = v;
+        if (seam.positions[v * 3] == s)
+        {
+            wedge[v] = next++;
+            memcpy (&seam.positions[wedge[v] * 3], &seam.positions[v * 3], 12);
+            memcpy (&seam.tex_coords[wedge[v] * 2], &seam.tex_coords[v * 2], 8);
+        }
+        if (seam.positions[v * 3] >= s)
+            seam.tex_coords[wedge[v] * 2] += 1.0f;
+    }
+    for (uint32_t t = 0; t < seam.nr_triangles; t++)
+    {
+        uint32_t *tri = &seam.triangles[t * 3];
+        float x = seam.positions[tri[0] * 3] + seam.positions[tri[1] * 3] + seam.positions[tri[2] * 3];
+        if (x > 3 * s)
+            for (int c = 0; c < 3; c++)
+                tri[c] = wedge[tri[c]];
+    }
+
+    params.target_ratio = 0.0f;
+    params.target_error = 0.05f;
+    ck_assert (rex_mesh_simplify (&seam, &lod, &params, NULL) == REX_OK);
+    ck_assert (lod.nr_triangles < seam.nr_triangles / 8);
+    uint32_t on_seam = 0;
+    for (uint32_t t = 0; t < lod.nr_triangles; t++)
+    {
+        int right = lod.tex_coords[lod.triangles[t * 3] * 2] >= 1.0f;
+        for (int c = 0; c < 3; c++)
+        {
+            uint32_t v = lod.triangles[t * 3 + c];
+            ck_assert ((lod.tex_coords[v * 2] >= 1.0f) == right);
+            ck_assert (right ? lod.positions[v * 3] >= s : lod.positions[v * 3] <= s);
+            on_seam += lod.positions[v * 3] == s;
+        }
+    }
+    ck_assert (on_seam >= 4);
+    rex_mesh_free (&lod);
+    rex_mesh_free (&seam);
+    FREE (wedge);
+
+    // the LOD chain is numbered and can be written as additional mesh blocks
+    struct rex_mesh_lod_params lod_params;
+    rex_mesh_lod_params_init (&lod_params);
+    lod_params.target_error = 1.0f;
+    struct rex_mesh lods[3];
+    uint16_t nr_lods;
+    struct rex_thread_pool *pool = rex_thread_pool_create (4);
+    ck_assert (rex_mesh_lods (&grid, &lod_params, pool, lods, &nr_lods) == REX_OK);
+    rex_thread_pool_destroy (pool);
+    ck_assert (nr_lods == 3 && grid.max_lod == 3);
+    uint32_t nr_triangles = grid.nr_triangles;
+    for (uint16_t i = 0; i < nr_lods; i++)
+    {
+        ck_assert (lods[i].lod == i + 1 && lods[i].max_lod == 3);
+        ck_assert (lods[i].nr_triangles < nr_triangles);
+        nr_triangles = lods[i].nr_triangles;
+
+        long sz;
+        uint8_t *ptr = rex_block_write_mesh (i + 1, NULL, &lods[i], &sz);
+        struct rex_block block;
+        ck_assert (rex_block_read (ptr, &block) != NULL);
+        struct rex_mesh *read = block.data;
+        ck_assert (read->lod == i + 1 && read->max_lod == 3 && read->nr_triangles == lods[i].nr_triangles);
+        rex_block_free (&block);
+        FREE (ptr);
+        rex_mesh_free (&lods[i]);
+    }
+    rex_mesh_free (&grid);
+}
+END_TEST
+
+START_TEST (test_rex_mesh_normals)
+{
+    // more triangles and vertices than a single task handles
+    const uint32_t n = 130;
+    struct rex_mesh grid;
+    generate_grid (&grid, n);
+    float *expected = rex_malloc (12 * grid.nr_vertices);
+    memcpy (expected, grid.normals, 12 * grid.nr_vertices);
+
+    struct rex_thread_pool *pool = rex_thread_pool_create (4);
+    ck_assert (rex_mesh_generate_normals (&grid, REX_NORMALS_AREA, pool) == REX_OK);
+    for (uint32_t v = 0; v < grid.nr_vertices; v++)
+        ck_assert (vec3_mul_inner (&grid.normals[v * 3], &expected[v * 3]) > 0.99f);
+
+    // the result does not depend on the number of threads
+    float *serial = rex_malloc (12 * grid.nr_vertices);
+    ck_assert (rex_mesh_calc_normals (&grid, REX_NORMALS_AREA, NULL, serial) == REX_OK);
+    ck_assert (!memcmp (serial, grid.normals, 12 * grid.nr_vertices));
+    ck_assert (rex_mesh_calc_normals (&grid, REX_NORMALS_ANGLE, pool, grid.normals) == REX_OK);
+    ck_assert (rex_mesh_calc_normals (&grid, REX_NORMALS_ANGLE, NULL, serial) == REX_OK);
+    ck_assert (!memcmp (serial, grid.normals, 12 * grid.nr_vertices));
+    rex_thread_pool_destroy (pool);
+    FREE (serial);
+    FREE (expected);
+
+    grid.triangles[7] = grid.nr_vertices;
+    ck_assert (rex_mesh_calc_normals (&grid, REX_NORMALS_AREA, NULL, grid.normals) == REX_ERROR_INVALID_DATA);
+    rex_mesh_free (&grid);
+
+    // a large sliver in the xz plane and a small right triangle in the xy plane share vertex 0,
+    // vertex 5 is not referenced
+    struct rex_mesh mesh;
+    rex_mesh_init (&mesh);
+    float positions[] = { 0, 0, 0, 1, 0, 0, 0, 1, 0, 10, 0, 0, 10, 0, 1, 5, 5, 5 };
+    uint32_t triangles[] = { 0, 1, 2, 0, 3, 4 };
+    mesh.nr_vertices = 6;
+    mesh.nr_triangles = 2;
+    mesh.positions = positions;
+    mesh.triangles = triangles;
+
+    float normals[18];
+    ck_assert (rex_mesh_calc_normals (&mesh, REX_NORMALS_AREA, NULL, normals) == REX_OK);
+    ck_assert (normals[1] < -0.9f);
+    ck_assert (normals[5] == 1.0f && normals[8] == 1.0f && normals[10] == -1.0f);
+    ck_assert (normals[15] == 0.0f && normals[16] == 0.0f && normals[17] == 1.0f);
+    ck_assert (rex_mesh_calc_normals (&mesh, REX_NORMALS_ANGLE, NULL, normals) == REX_OK);
+    ck_assert (normals[2] > 0.9f);
+}
+END_TEST
+
+START_TEST (test_rex_bounds)
+{
+    // more points than a single task handles and a tail which does not fill a SIMD block
+    const uint64_t n = 3 * 1024 * 1024 + 5;
+    float *pos = rex_malloc (n * 12);
+    for (uint64_t i = 0; i < n * 3; i++)
+        pos[i] = (float) ((i * 7919) % 100003) - 50000.0f * (i % 3);
+    pos[n * 3 - 2] = 1e6f;
+    pos[7] = NAN;
+
+    float min[4] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+    float max[4] = { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    double sum[3] = { 0.0, 0.0, 0.0 };
+    for (uint64_t i = 0; i < n * 3; i++)
+    {
+        if (pos[i] < min[i % 3]) min[i % 3] = pos[i];
+        if (pos[i] > max[i % 3]) max[i % 3] = pos[i];
+    }
+
+    struct rex_thread_pool *pool = rex_thread_pool_create (4);
+    struct rex_bounds serial, parallel;
+    ck_assert (rex_bounds_calc (pos, n, NULL, &serial) == REX_OK);
+    ck_assert (rex_bounds_calc (pos, n, pool, &parallel) == REX_OK);
+    ck_assert (!memcmp (serial.min, min, 12) && !memcmp (serial.max, max, 12));
+    ck_assert (!memcmp (&serial, &parallel, sizeof (struct rex_bounds)));
+    ck_assert (max[1] == 1e6f);
+
+    // the ranges of other component counts
+    for (uint32_t comps = 1; comps <= 4; comps++)
+    {
+        uint64_t m = n * 3 / comps;
+        float rmin[4], rmax[4];
+        ck_assert (rex_attribute_range (pos, m, comps, pool, rmin, rmax) == REX_OK);
+        for (uint32_t c = 0; c < comps; c++)
+        {
+            float lo = FLT_MAX, hi = -FLT_MAX;
+            for (uint64_t i = c; i < m * comps; i += comps)
+            {
+                if (pos[i] < lo) lo = pos[i];
+                if (pos[i] > hi) hi = pos[i];
+            }
+            ck_assert (rmin[c] == lo && rmax[c] == hi);
+        }
+    }
+    ck_assert (rex_attribute_range (pos, n, 5, NULL, min, max) == REX_ERROR_INVALID_DATA);
+
+    pos[7] = 0.0f;
+    for (uint64_t i = 0; i < n * 3; i++)
+        sum[i % 3] += pos[i];
+    float centroid[3], centroid_parallel[3];
+    ck_assert (rex_centroid_calc (pos, n, NULL, centroid) == REX_OK);
+    ck_assert (rex_centroid_calc (pos, n, pool, centroid_parallel) == REX_OK);
+    ck_assert (!memcmp (centroid, centroid_parallel, 12));
+    for (int c = 0; c < 3; c++)
+        ck_assert (fabs (centroid[c] - sum[c] / n) <= 1e-6 * fabs (sum[c] / n));
+    rex_thread_pool_destroy (pool);
+    FREE (pos);
+
+    // empty bounds are neutral for the union
+    struct rex_bounds empty, b;
+    ck_assert (rex_bounds_calc (NULL, 0, NULL, &empty) == REX_OK);
+    ck_assert (rex_bounds_is_empty (&empty));
+    rex_bounds_union (&b, &empty, &serial);
+    ck_assert (!rex_bounds_is_empty (&b) && !memcmp (&b, &serial, sizeof (struct rex_bounds)));
+    float p[3] = { 2e6f, -1e6f, 0.0f };
+    ck_assert (rex_bounds_calc (p, 1, NULL, &empty) == REX_OK);
+    rex_bounds_union (&b, &b, &empty);
+    ck_assert (b.max[0] == 2e6f && b.min[1] == -1e6f && b.max[1] == 1e6f);
+}
+END_TEST
+
 START_TEST (test_rex_writer_lineset_and_text)
 {
     struct rex_header *header = rex_header_create();
@@ -220,13 +927,14 @@ START_TEST (test_rex_writer_lineset_and_text)
     };
     long text_sz;
     uint8_t *text_ptr = rex_block_write_text (1 /*id*/, header, &text, &text_sz);
-    ck_assert_msg (text_sz == 57, "actual %d", text_sz);
-    ck_assert_msg (header->sz_all_datablocks == 153, "actual %d", header->sz_all_datablocks);
+    // 57 bytes, padded to the block alignment
+    ck_assert_msg (text_sz == 60, "actual %d", text_sz);
+    ck_assert_msg (header->sz_all_datablocks == 156, "actual %d", header->sz_all_datablocks);
     ck_assert (text_ptr != NULL);
 
     long header_sz;
     uint8_t *header_ptr = rex_header_write (header, &header_sz);
-    ck_assert (header_sz == 86);
+    ck_assert (header_sz == REX_HEADER_SIZE && header_sz % REX_BLOCK_ALIGNMENT == 0);
 
     const char *filename = "test_lineset_and_text.rex";
     FILE *fp = fopen (filename, "wb");
@@ -287,6 +995,1519 @@ START_TEST (test_rex_reader)
 }
 END_TEST
 
+START_TEST (test_rex_map_view)
+{
+    sprintf (tmp, "%s/%s", TEST_DATA_PATH, REX_TEMPLATE);
+    struct rex_map map;
+    ck_assert (rex_map_open (tmp, &map) == REX_OK);
+    ck_assert (map.sz == 516);
+
+    struct rex_header header;
+    uint8_t *ptr = rex_header_read (map.data, &header);
+    check_template_header (&header);
+
+    struct rex_block block;
+    ptr = rex_map_view_block (&map, ptr, &block);
+    ck_assert (ptr == map.data + 86 + 16 + block.sz);
+    ck_assert (block.type == Mesh);
+
+    struct rex_mesh *mesh = block.data;
+    ck_assert (mesh->nr_vertices == 3);
+    ck_assert (mesh->nr_triangles == 1);
+    ck_assert (strcmp (mesh->name, "mesh") == 0);
+    ck_assert (mesh->positions[3] == 1.0f);
+
+    // owned copies must survive the map
+    rex_map_materialize_mesh (&map, mesh);
+    ck_assert (!rex_map_borrowed (&map, mesh->positions));
+    ck_assert (!rex_map_borrowed (&map, mesh->triangles));
+    rex_map_close (&map);
+
+    ck_assert (mesh->positions[3] == 1.0f);
+    ck_assert (mesh->triangles[2] == 2);
+    rex_mesh_free (mesh);
+    FREE (block.data);
+
+    // a mesh with fewer normals than vertices and an image block without compression field are rejected
+    struct rex_mesh grid;
+    generate_grid (&grid, 4);
+    long sz;
+    uint8_t *buf = rex_block_write_mesh (0, NULL, &grid, &sz);
+    uint32_t nr_normals = grid.nr_vertices - 1;
+    memcpy (buf + REX_BLOCK_HEADER_SIZE + 8, &nr_normals, sizeof (uint32_t));
+    struct rex_map heap = { .data = buf, .sz = sz, .mapped = 0 };
+    ck_assert (rex_map_view_block (&heap, buf, &block) == NULL && block.data == NULL);
+
+    uint16_t type = Image;
+    uint32_t block_sz = 2;
+    memcpy (buf, &type, sizeof (uint16_t));
+    memcpy (buf + 4, &block_sz, sizeof (uint32_t));
+    ck_assert (rex_map_view_block (&heap, buf, &block) == NULL && block.data == NULL);
+    FREE (buf);
+
+    // blocks of a written file are aligned, so a mesh behind a text block of odd length is borrowed
+    struct rex_header *wheader = rex_header_create ();
+    struct rex_text text = { .font_size = 12.0f, .data = "odd" };
+    long text_sz, mesh_sz, header_sz;
+    uint8_t *text_ptr = rex_block_write_text (0, wheader, &text, &text_sz);
+    uint8_t *mesh_ptr = rex_block_write_mesh (1, wheader, &grid, &mesh_sz);
+    uint8_t *header_ptr = rex_header_write (wheader, &header_sz);
+    char filename[64];
+    snprintf (filename, sizeof (filename), "/tmp/rex-map-%d.rex", (int) getpid ());
+    FILE *fp = fopen (filename, "wb");
+    ck_assert (fp != NULL);
+    fwrite (header_ptr, header_sz, 1, fp);
+    fwrite (text_ptr, text_sz, 1, fp);
+    fwrite (mesh_ptr, mesh_sz, 1, fp);
+    fclose (fp);
+
+    ck_assert (rex_map_open (filename, &map) == REX_OK);
+    ptr = rex_header_read (map.data, &header);
+    ptr = rex_map_view_block (&map, ptr, &block);
+    ck_assert (block.type == Text);
+    rex_map_release_block (&map, &block);
+    ptr = rex_map_view_block (&map, ptr, &block);
+    ck_assert (block.type == Mesh);
+    mesh = block.data;
+    ck_assert (mesh->nr_vertices == grid.nr_vertices);
+    ck_assert ((uint8_t *) mesh->positions >= map.data && (uint8_t *) mesh->positions < map.data + map.sz);
+    ck_assert (rex_map_borrowed (&map, mesh->normals));
+    ck_assert (memcmp (mesh->positions, grid.positions, grid.nr_vertices * 12) == 0);
+    rex_map_release_block (&map, &block);
+    rex_map_close (&map);
+    unlink (filename);
+
+    FREE (text_ptr);
+    FREE (mesh_ptr);
+    FREE (header_ptr);
+    FREE (wheader);
+    rex_mesh_free (&grid);
+}
+END_TEST
+
+START_TEST (test_rex_block_iter)
+{
+    sprintf (tmp, "%s/%s", TEST_DATA_PATH, REX_TEMPLATE);
+    long sz;
+    uint8_t *buf = read_file_binary (tmp, &sz);
+    ck_assert (buf != NULL);
+
+    struct rex_header header;
+    rex_header_read (buf, &header);
+
+    struct rex_block block;
+    ck_assert (rex_block_peek (buf + 86, &block) == buf + 86 + 16);
+    ck_assert (block.type == Mesh);
+    ck_assert (block.data == NULL);
+    ck_assert (rex_block_skip (buf + 86) == buf + 86 + 16 + block.sz);
+
+    // all blocks
+    struct rex_block_iter it;
+    rex_block_iter_init (&it, buf, sz, &header);
+    int n = 0;
+    uint8_t *ptr;
+    while ((ptr = rex_block_iter_next (&it, &block)) != NULL)
+        ck_assert (block.id == (uint64_t) n++);
+    ck_assert (n == 4);
+
+    // type filter
+    rex_block_iter_init (&it, buf, sz, &header);
+    rex_block_iter_filter (&it, REX_BLOCK_MASK (MaterialStandard) | REX_BLOCK_MASK (Track), NULL, 0);
+    ck_assert (rex_block_iter_next (&it, &block) == buf + 278);
+    ck_assert (block.type == MaterialStandard);
+    ck_assert (rex_block_iter_next (&it, &block) == buf + 486);
+    ck_assert (block.type == Track);
+    ck_assert (rex_block_iter_next (&it, &block) == NULL);
+
+    // id filter
+    uint64_t ids[] = { 0, 2, 42 };
+    rex_block_iter_init (&it, buf, sz, &header);
+    rex_block_iter_filter (&it, REX_BLOCK_MASK_ALL, ids, 3);
+    ck_assert (rex_block_iter_next (&it, &block) != NULL);
+    ck_assert (block.id == 0);
+    ck_assert (rex_block_iter_next (&it, &block) != NULL);
+    ck_assert (block.id == 2);
+    ck_assert (rex_block_iter_next (&it, &block) == NULL);
+
+    // truncated buffer
+    rex_block_iter_init (&it, buf, 300, &header);
+    ck_assert (rex_block_iter_next (&it, &block) != NULL);
+    ck_assert (rex_block_iter_next (&it, &block) == NULL);
+
+    FREE (buf);
+}
+END_TEST
+
+START_TEST (test_rex_mesh_writer)
+{
+    struct rex_mesh mesh;
+    generate_mesh (&mesh);
+    mesh.normals = rex_malloc (12 * 3);
+    for (int i = 0; i < 9; i++)
+        mesh.normals[i] = (i % 3 == 2) ? 1.0f : 0.0f;
+
+    struct rex_header *header = rex_header_create();
+    long mesh_sz;
+    uint8_t *mesh_ptr = rex_block_write_mesh (7 /*id*/, header, &mesh, &mesh_sz);
+
+    // same mesh in chunks
+    struct rex_header *sheader = rex_header_create();
+    FILE *fp = tmpfile();
+    ck_assert (fp != NULL);
+    ck_assert (rex_header_patch (fp, sheader) == REX_OK);
+    fseek (fp, 0, SEEK_END);
+
+    struct rex_mesh_writer w;
+    ck_assert (rex_mesh_writer_begin (&w, fp, 7, sheader, &mesh) == REX_OK);
+    ck_assert (rex_mesh_writer_append_positions (&w, mesh.positions, 2) == REX_OK);
+    ck_assert (rex_mesh_writer_append_positions (&w, mesh.positions + 6, 1) == REX_OK);
+    ck_assert (rex_mesh_writer_append_normals (&w, mesh.normals, 1) == REX_OK);
+    ck_assert (rex_mesh_writer_append_normals (&w, mesh.normals + 3, 2) == REX_OK);
+    ck_assert (rex_mesh_writer_append_triangles (&w, mesh.triangles, 1) == REX_OK);
+    long sz;
+    ck_assert (rex_mesh_writer_end (&w, &sz) == REX_OK);
+    ck_assert (sz == mesh_sz);
+    ck_assert (sheader->nr_datablocks == 1);
+    ck_assert (sheader->sz_all_datablocks == header->sz_all_datablocks);
+    ck_assert (sheader->crc == header->crc);
+    ck_assert (ftell (fp) == REX_HEADER_SIZE + sz);
+
+    ck_assert (rex_header_patch (fp, sheader) == REX_OK);
+    uint8_t *buf = rex_malloc (REX_HEADER_SIZE + sz);
+    rewind (fp);
+    ck_assert (fread (buf, REX_HEADER_SIZE + sz, 1, fp) == 1);
+    ck_assert (memcmp (buf + REX_HEADER_SIZE, mesh_ptr, mesh_sz) == 0);
+
+    struct rex_header rheader;
+    rex_header_read (buf, &rheader);
+    ck_assert (rheader.nr_datablocks == 1);
+    ck_assert (rheader.sz_all_datablocks == (uint64_t) sz);
+    fclose (fp);
+
+    // sections must be in file order
+    fp = tmpfile();
+    ck_assert (rex_mesh_writer_begin (&w, fp, 8, NULL, NULL) == REX_OK);
+    ck_assert (rex_mesh_writer_append_triangles (&w, mesh.triangles, 1) == REX_OK);
+    ck_assert (rex_mesh_writer_append_positions (&w, mesh.positions, 3) == REX_ERROR_WRONG_ORDER);
+    ck_assert (rex_mesh_writer_end (&w, NULL) == REX_ERROR_WRONG_ORDER);
+    fclose (fp);
+
+    FREE (buf);
+    FREE (mesh_ptr);
+    FREE (header);
+    FREE (sheader);
+    rex_mesh_free (&mesh);
+}
+END_TEST
+
+START_TEST (test_rex_mesh_compressed)
+{
+    struct rex_mesh mesh;
+    generate_grid (&mesh, 64);
+    mesh.material_id = 5;
+
+    struct rex_header *header = rex_header_create();
+    long raw_sz, sz;
+    uint8_t *raw = rex_block_write_mesh (0, NULL, &mesh, &raw_sz);
+    uint8_t *ptr = rex_block_write_mesh_compressed (0, header, &mesh, NULL, &sz);
+    ck_assert (ptr != NULL);
+    ck_assert (header->nr_datablocks == 1 && header->sz_all_datablocks == (uint64_t) sz);
+    ck_assert (sz * 3 < raw_sz);
+
+    struct rex_block block;
+    ck_assert (rex_block_read (ptr, &block) == ptr + sz);
+    ck_assert (block.type == Mesh && block.version == REX_MESH_VERSION_COMPRESSED);
+    struct rex_mesh *dec = block.data;
+    ck_assert (dec != NULL);
+    ck_assert (dec->nr_vertices == mesh.nr_vertices && dec->nr_triangles == mesh.nr_triangles);
+    ck_assert (dec->material_id == 5 && strcmp (dec->name, "grid") == 0);
+
+    // the vertices are reordered, compare the attributes of all triangle corners
+    for (uint32_t i = 0; i < mesh.nr_triangles * 3; i++)
+    {
+        uint32_t a = mesh.triangles[i];
+        uint32_t b = dec->triangles[i];
+        for (int c = 0; c < 3; c++)
+        {
+            ck_assert (fabsf (mesh.positions[a * 3 + c] - dec->positions[b * 3 + c]) < 1e-3f);
+            ck_assert (fabsf (mesh.normals[a * 3 + c] - dec->normals[b * 3 + c]) < 2e-2f);
+            ck_assert (fabsf (mesh.colors[a * 3 + c] - dec->colors[b * 3 + c]) < 3e-3f);
+        }
+        for (int c = 0; c < 2; c++)
+            ck_assert (fabsf (mesh.tex_coords[a * 2 + c] - dec->tex_coords[b * 2 + c]) < 2e-4f);
+    }
+
+    // normals of the lower hemisphere and degenerate normals
+    struct rex_mesh tri;
+    generate_mesh (&tri);
+    float normals[] = { 0.0f, 0.0f, -1.0f, 0.6f, -0.8f, 0.0f, 0.0f, 0.0f, 0.0f };
+    tri.normals = normals;
+    struct rex_mesh_compression params;
+    rex_mesh_compression_init (&params);
+    params.normal_bits = 16;
+    long tri_sz;
+    uint8_t *tri_ptr = rex_block_write_mesh_compressed (1, NULL, &tri, &params, &tri_sz);
+    struct rex_block tri_block;
+    rex_block_read (tri_ptr, &tri_block);
+    struct rex_mesh *tri_dec = tri_block.data;
+    ck_assert (tri_dec->normals[2] == -1.0f);
+    ck_assert (fabsf (tri_dec->normals[3] - 0.6f) < 1e-4f && fabsf (tri_dec->normals[4] + 0.8f) < 1e-4f);
+    ck_assert (tri_dec->normals[8] == 1.0f);
+    rex_block_free (&tri_block);
+    tri.normals = NULL;
+    FREE (tri_ptr);
+    rex_mesh_free (&tri);
+
+    // invalid parameters and indices
+    params.position_bits = 25;
+    ck_assert (rex_block_write_mesh_compressed (1, NULL, &mesh, &params, &tri_sz) == NULL);
+    mesh.triangles[5] = mesh.nr_vertices;
+    ck_assert (rex_block_write_mesh_compressed (1, NULL, &mesh, NULL, &tri_sz) == NULL);
+
+    // a truncated triangle section is detected
+    rex_block_free (&block);
+    uint32_t block_sz = 200 + 3 * mesh.nr_vertices * 6;
+    memcpy (ptr + 4, &block_sz, sizeof (uint32_t));
+    rex_block_read (ptr, &block);
+    ck_assert (block.data == NULL);
+
+    FREE (raw);
+    FREE (ptr);
+    FREE (header);
+    rex_mesh_free (&mesh);
+}
+END_TEST
+
+START_TEST (test_rex_pointlist_compact)
+{
+    // 1003 points, not a multiple of the SIMD width
+    struct rex_pointlist plist;
+    rex_pointlist_init (&plist);
+    plist.nr_vertices = plist.nr_colors = 1003;
+    plist.positions = rex_malloc (plist.nr_vertices * 12);
+    plist.colors = rex_malloc (plist.nr_colors * 12);
+    for (uint32_t i = 0; i < plist.nr_vertices; i++)
+    {
+        plist.positions[3 * i] = 1000.0f + 0.01f * i;
+        plist.positions[3 * i + 1] = -5.0f + 0.5f * (i % 7);
+        plist.positions[3 * i + 2] = 42.0f;
+        plist.colors[3 * i] = (i % 256) / 255.0f;
+        plist.colors[3 * i + 1] = 1.0f;
+        plist.colors[3 * i + 2] = 0.0f;
+    }
+
+    uint8_t bits[2] = { 16, 32 };
+    float tolerance[2] = { 2e-4f, 1e-4f };
+    for (int b = 0; b < 2; b++)
+    {
+        long sz;
+        uint8_t *ptr = rex_block_write_pointlist_compact (7, NULL, &plist, bits[b], &sz);
+        ck_assert (ptr != NULL);
+        ck_assert (sz == rex_block_size_pointlist_compact (&plist, bits[b]));
+        long unpadded = REX_BLOCK_HEADER_SIZE + REX_POINTLIST_COMPACT_HEADER_SIZE + 1003 * (3 * bits[b] / 8 + 3);
+        ck_assert (sz == unpadded + REX_BLOCK_PADDING (unpadded));
+
+        struct rex_block block;
+        ck_assert (rex_block_read (ptr, &block) != NULL);
+        ck_assert (block.type == PointList);
+        ck_assert (block.version == REX_POINTLIST_VERSION_COMPACT);
+        struct rex_pointlist *rplist = block.data;
+        ck_assert (rplist != NULL);
+        ck_assert (rplist->nr_vertices == 1003 && rplist->nr_colors == 1003);
+        for (uint32_t i = 0; i < 3 * plist.nr_vertices; i++)
+        {
+            ck_assert (fabsf (rplist->positions[i] - plist.positions[i]) < tolerance[b]);
+            ck_assert (fabsf (rplist->colors[i] - plist.colors[i]) < 0.5f / 255.0f);
+        }
+        rex_block_free (&block);
+
+        // truncated block
+        uint32_t block_sz = unpadded - REX_BLOCK_HEADER_SIZE - 1;
+        memcpy (ptr + 4, &block_sz, sizeof (uint32_t));
+        ck_assert (rex_block_read (ptr, &block) != NULL);
+        ck_assert (block.data == NULL);
+        FREE (ptr);
+    }
+
+    long sz;
+    ck_assert (rex_block_write_pointlist_compact (7, NULL, &plist, 24, &sz) == NULL);
+
+    // a NaN first point does not collapse the bounding box
+    float x0 = plist.positions[0];
+    plist.positions[0] = NAN;
+    uint8_t *nptr = rex_block_write_pointlist_compact (7, NULL, &plist, 32, &sz);
+    ck_assert (nptr != NULL);
+    struct rex_block nblock;
+    rex_block_read (nptr, &nblock);
+    struct rex_pointlist *nplist = nblock.data;
+    ck_assert (nplist != NULL);
+    for (uint32_t i = 1; i < 3 * plist.nr_vertices; i++)
+        ck_assert (fabsf (nplist->positions[i] - plist.positions[i]) < 1e-4f);
+    rex_block_free (&nblock);
+    FREE (nptr);
+    plist.positions[0] = x0;
+
+    // a group of compact pointlists is reassembled to the float pointlist
+    struct rex_header *header = rex_header_create();
+    struct rex_index idx;
+    rex_index_init (&idx);
+    FILE *fp = tmpfile();
+    ck_assert (fp != NULL);
+    struct rex_group_writer w;
+    rex_group_writer_init (&w, fileno (fp), header, &idx);
+    w.pointlist_bits = 16;
+    w.max_block_sz = REX_POINTLIST_COMPACT_HEADER_SIZE + 300 * 9;
+    uint64_t id = 0;
+    ck_assert (rex_group_write_pointlist (&w, &id, &plist) == REX_OK);
+    ck_assert (id == 5);
+    ck_assert (idx.nr_entries == 5);
+    for (uint32_t i = 1; i < idx.nr_entries; i++)
+        ck_assert (idx.entries[i].version == REX_POINTLIST_VERSION_COMPACT);
+
+    rex_index_free (&idx);
+
+    long header_sz;
+    uint8_t *header_ptr = rex_header_write (header, &header_sz);
+    ck_assert (pwrite (fileno (fp), header_ptr, header_sz, 0) == header_sz);
+    FREE (header_ptr);
+
+    uint8_t *buf = rex_malloc (w.offset);
+    ck_assert (pread (fileno (fp), buf, w.offset, 0) == (ssize_t) w.offset);
+    struct rex_header rheader;
+    rex_header_read (buf, &rheader);
+    ck_assert (rex_index_read (buf, w.offset, &rheader, &idx) == REX_OK);
+
+    struct rex_block group, block;
+    rex_block_read (buf + rex_index_find (&idx, 0)->offset, &group);
+    ck_assert (group.type == Group);
+    ck_assert (rex_group_read (buf, &idx, &group, &block) == REX_OK);
+    struct rex_pointlist *rplist = block.data;
+    ck_assert (block.type == PointList);
+    ck_assert (rplist->nr_vertices == 1003 && rplist->nr_colors == 1003);
+    float sum = 0.0f, rsum = 0.0f;
+    for (uint32_t i = 0; i < plist.nr_vertices; i++)
+    {
+        sum += plist.positions[3 * i + 1];
+        rsum += rplist->positions[3 * i + 1];
+    }
+    ck_assert (fabsf (sum - rsum) < 0.1f);
+    rex_block_free (&block);
+    rex_block_free (&group);
+
+    FREE (buf);
+    fclose (fp);
+    rex_index_free (&idx);
+    FREE (header);
+    rex_pointlist_free (&plist);
+}
+END_TEST
+
+START_TEST (test_rex_block_compressed)
+{
+    struct rex_mesh mesh;
+    generate_grid (&mesh, 64);
+
+    // without codec the blocks are only added to the header
+    struct rex_header *header = rex_header_create();
+    long sz;
+    uint8_t *ptr = rex_block_write_mesh (3, NULL, &mesh, &sz);
+    long raw_sz = sz;
+    uint8_t *raw = ptr;
+    ck_assert (rex_block_compress (header, &ptr, &sz, NULL) == REX_OK);
+    ck_assert (ptr == raw && sz == raw_sz);
+    ck_assert (header->nr_datablocks == 1 && header->sz_all_datablocks == (uint64_t) sz);
+    FREE (header);
+
+    uint16_t codec;
+    ck_assert (rex_codec_from_name ("none", &codec) == REX_OK && codec == REX_CODEC_NONE);
+    ck_assert (rex_codec_from_name ("brotli", &codec) == REX_NOT_IMPLEMENTED);
+
+    for (uint16_t c = REX_CODEC_LZ4; c <= REX_CODEC_ZSTD; c++)
+    {
+        struct rex_codec_params params;
+        rex_codec_params_init (&params, c);
+        if (!rex_codec_available (c))
+        {
+            ck_assert (rex_block_compress (NULL, &ptr, &sz, &params) == REX_NOT_IMPLEMENTED);
+            continue;
+        }
+
+        // a mesh and a text block are compressed in parallel
+        struct rex_text text = { .font_size = 24.0f, .data = "compressed" };
+        uint8_t *blocks[2];
+        long szs[2];
+        blocks[0] = rex_block_write_mesh (3, NULL, &mesh, &szs[0]);
+        blocks[1] = rex_block_write_text (4, NULL, &text, &szs[1]);
+        long text_sz = szs[1];
+
+        header = rex_header_create();
+        struct rex_thread_pool *pool = rex_thread_pool_create (2);
+        ck_assert (rex_blocks_compress (pool, header, blocks, szs, 2, &params) == REX_OK);
+        rex_thread_pool_destroy (pool);
+        ck_assert (szs[0] < raw_sz);
+        ck_assert (szs[1] <= text_sz);
+        ck_assert (header->nr_datablocks == 2 && header->sz_all_datablocks == (uint64_t) (szs[0] + szs[1]));
+
+        struct rex_block block;
+        rex_block_peek (blocks[0], &block);
+        ck_assert (block.type == Compressed && block.id == 3);
+        ck_assert (rex_block_read (blocks[0], &block) == blocks[0] + szs[0]);
+        ck_assert (block.type == Mesh && block.id == 3 && block.sz == raw_sz - REX_BLOCK_HEADER_SIZE);
+        struct rex_mesh *dec = block.data;
+        ck_assert (dec != NULL && dec->nr_vertices == mesh.nr_vertices);
+        ck_assert (memcmp (dec->positions, mesh.positions, mesh.nr_vertices * 12) == 0);
+        ck_assert (memcmp (dec->triangles, mesh.triangles, mesh.nr_triangles * 12) == 0);
+        rex_block_free (&block);
+
+        // corrupt payload
+        blocks[0][szs[0] / 2] ^= 0xff;
+        blocks[0][szs[0] / 2 + 1] ^= 0xff;
+        rex_block_read (blocks[0], &block);
+        if (block.type == Compressed)
+            ck_assert (block.data == NULL);
+        else
+            rex_block_free (&block);
+
+        FREE (blocks[0]);
+        FREE (blocks[1]);
+        FREE (header);
+    }
+    FREE (ptr);
+
+    // a trained dictionary helps with many small blocks of similar content
+    if (rex_codec_available (REX_CODEC_ZSTD))
+    {
+        enum { nr_samples = 200 };
+        uint8_t *samples[nr_samples];
+        size_t sizes[nr_samples];
+        char str[64];
+        for (int i = 0; i < nr_samples; i++)
+        {
+            snprintf (str, sizeof (str), "sample text %d of the dictionary training %d", i, i * 7);
+            struct rex_text text = { .position = { i, 2 * i, 0 }, .font_size = 12.0f, .data = str };
+            long text_sz;
+            samples[i] = rex_block_write_text (i, NULL, &text, &text_sz);
+            sizes[i] = text_sz;
+        }
+        uint8_t dict[4096];
+        size_t dict_sz = sizeof (dict);
+        ck_assert (rex_codec_train_dict ((const uint8_t * const *) samples, sizes, nr_samples, dict, &dict_sz) == REX_OK);
+        ck_assert (rex_codec_add_dict (42, dict, dict_sz) == REX_OK);
+
+        struct rex_codec_params params;
+        rex_codec_params_init (&params, REX_CODEC_ZSTD);
+        params.dict_id = 42;
+        long text_sz = sizes[7];
+        sz = sizes[7];
+        ck_assert (rex_block_compress (NULL, &samples[7], &sz, &params) == REX_OK);
+        ck_assert (sz < text_sz);
+
+        struct rex_block block;
+        rex_block_read (samples[7], &block);
+        ck_assert (block.type == Text && block.data != NULL);
+        ck_assert (strcmp (((struct rex_text *) block.data)->data, "sample text 7 of the dictionary training 49") == 0);
+        rex_block_free (&block);
+
+        rex_codec_clear_dicts();
+        rex_block_read (samples[7], &block);
+        ck_assert (block.type == Compressed && block.data == NULL);
+
+        for (int i = 0; i < nr_samples; i++)
+            FREE (samples[i]);
+    }
+    rex_mesh_free (&mesh);
+}
+END_TEST
+
+struct batch_result
+{
+    struct rex_batch_file *files;
+    uint32_t nr_blocks[16];
+};
+
+static void batch_decode (void *ctx, struct rex_batch_file *file)
+{
+    struct batch_result *res = ctx;
+    struct rex_header header;
+    if (file->status != REX_OK || !rex_header_read (file->data, &header))
+        return;
+
+    struct rex_block_iter it;
+    struct rex_block block;
+    rex_block_iter_init (&it, file->data, file->sz, &header);
+    while (rex_block_iter_next (&it, &block))
+        res->nr_blocks[file - res->files]++;
+}
+
+START_TEST (test_rex_batch)
+{
+    // 15 files with a different number of text blocks and one missing file
+    char names[16][64];
+    struct rex_batch_file files[16];
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        snprintf (names[i], sizeof (names[i]), "/tmp/rex-batch-%d-%u.rex", (int) getpid(), i);
+        memset (&files[i], 0, sizeof (struct rex_batch_file));
+        files[i].filename = names[i];
+        if (i == 15)
+            continue;
+
+        struct rex_header *header = rex_header_create();
+        struct rex_text text = { .font_size = 12.0f, .data = "batch" };
+        FILE *fp = fopen (names[i], "wb");
+        ck_assert (fp != NULL);
+        fseek (fp, REX_HEADER_SIZE, SEEK_SET);
+        for (uint32_t j = 0; j <= i; j++)
+        {
+            long sz;
+            uint8_t *ptr = rex_block_write_text (j, header, &text, &sz);
+            fwrite (ptr, sz, 1, fp);
+            FREE (ptr);
+        }
+        long header_sz;
+        uint8_t *header_ptr = rex_header_write (header, &header_sz);
+        fseek (fp, 0, SEEK_SET);
+        fwrite (header_ptr, header_sz, 1, fp);
+        fclose (fp);
+        FREE (header_ptr);
+        FREE (header);
+    }
+
+    struct rex_thread_pool *pool = rex_thread_pool_create (4);
+    uint32_t flags[2] = { 0, REX_BATCH_NO_URING };
+    for (int f = 0; f < 2; f++)
+    {
+        struct batch_result res = { .files = files };
+        memset (res.nr_blocks, 0, sizeof (res.nr_blocks));
+        ck_assert (rex_batch_read (pool, files, 16, flags[f], batch_decode, &res) == REX_ERROR_FILE_OPEN);
+        for (uint32_t i = 0; i < 15; i++)
+        {
+            ck_assert (files[i].status == REX_OK);
+            ck_assert (res.nr_blocks[i] == i + 1);
+            rex_free (files[i].data);
+        }
+        ck_assert (files[15].status == REX_ERROR_FILE_OPEN && files[15].data == NULL);
+        ck_assert (res.nr_blocks[15] == 0);
+    }
+    rex_thread_pool_destroy (pool);
+
+    for (uint32_t i = 0; i < 15; i++)
+        remove (names[i]);
+}
+END_TEST
+
+START_TEST (test_rex_validate)
+{
+    struct rex_mesh mesh;
+    generate_grid (&mesh, 16);
+    struct rex_text text = { .font_size = 12.0f, .data = "valid" };
+
+    struct rex_header *header = rex_header_create();
+    struct rex_index idx;
+    rex_index_init (&idx);
+    long mesh_sz, text_sz, header_sz, idx_sz;
+    uint8_t *mesh_ptr = rex_block_write_mesh (0, header, &mesh, &mesh_sz);
+    uint8_t *text_ptr = rex_block_write_text (1, header, &text, &text_sz);
+    rex_index_add_block (&idx, mesh_ptr);
+    rex_index_add_block (&idx, text_ptr);
+    uint8_t *idx_ptr = rex_block_write_index (header, &idx, &idx_sz);
+    uint8_t *header_ptr = rex_header_write (header, &header_sz);
+
+    uint64_t sz = header_sz + mesh_sz + text_sz + idx_sz;
+    uint8_t *buf = rex_malloc (sz);
+    memcpy (buf, header_ptr, header_sz);
+    memcpy (buf + header_sz, mesh_ptr, mesh_sz);
+    memcpy (buf + header_sz + mesh_sz, text_ptr, text_sz);
+    memcpy (buf + header_sz + mesh_sz + text_sz, idx_ptr, idx_sz);
+    FREE (mesh_ptr);
+    FREE (text_ptr);
+    FREE (idx_ptr);
+    FREE (header_ptr);
+    FREE (header);
+    rex_index_free (&idx);
+
+    struct rex_header rheader;
+    ck_assert (rex_validate (buf, sz, &rheader) == REX_OK);
+    ck_assert (rheader.trusted);
+    ck_assert (rex_index_read (buf, sz, &rheader, &idx) == REX_OK);
+    ck_assert (idx.nr_entries == 2);
+    rex_index_free (&idx);
+
+    // truncated file, wrong magic
+    ck_assert (rex_validate (buf, sz - 1, &rheader) == REX_ERROR_INVALID_DATA);
+    ck_assert (rex_validate (buf, header_sz + mesh_sz, &rheader) == REX_ERROR_INVALID_DATA);
+    buf[0] = 'X';
+    ck_assert (rex_validate (buf, sz, &rheader) == REX_ERROR_INVALID_DATA);
+    buf[0] = 'R';
+
+    // triangle index out of range, the last triangle is checked by the scalar tail
+    uint8_t *mesh_data = buf + header_sz + REX_BLOCK_HEADER_SIZE;
+    uint8_t *tri = mesh_data + REX_MESH_HEADER_SIZE + mesh.nr_vertices * (12 + 12 + 8 + 12);
+    uint32_t index = mesh.nr_vertices, orig;
+    uint32_t nr_indices = mesh.nr_triangles * 3;
+    uint32_t pos[2] = { 0, nr_indices - 1 };
+    for (int i = 0; i < 2; i++)
+    {
+        memcpy (&orig, tri + 4 * pos[i], 4);
+        memcpy (tri + 4 * pos[i], &index, 4);
+        ck_assert (rex_validate (buf, sz, &rheader) == REX_ERROR_INVALID_DATA);
+        ck_assert (!rheader.trusted);
+        memcpy (tri + 4 * pos[i], &orig, 4);
+    }
+
+    // NaN position and Inf color
+    float nan = NAN, inf = INFINITY, forig;
+    uint8_t *color = mesh_data + REX_MESH_HEADER_SIZE + mesh.nr_vertices * (12 + 12 + 8) + 5 * 4;
+    memcpy (&forig, mesh_data + REX_MESH_HEADER_SIZE + 4, 4);
+    memcpy (mesh_data + REX_MESH_HEADER_SIZE + 4, &nan, 4);
+    ck_assert (rex_validate (buf, sz, &rheader) == REX_ERROR_INVALID_DATA);
+    memcpy (mesh_data + REX_MESH_HEADER_SIZE + 4, &forig, 4);
+    memcpy (&forig, color, 4);
+    memcpy (color, &inf, 4);
+    ck_assert (rex_validate (buf, sz, &rheader) == REX_ERROR_INVALID_DATA);
+    memcpy (color, &forig, 4);
+
+    // inconsistent counts and an index entry which does not match its block
+    uint32_t nr_normals = 1;
+    memcpy (&orig, mesh_data + 8, 4);
+    memcpy (mesh_data + 8, &nr_normals, 4);
+    ck_assert (rex_validate (buf, sz, &rheader) == REX_ERROR_INVALID_DATA);
+    memcpy (mesh_data + 8, &orig, 4);
+    uint8_t *entry = buf + sz - 2 * REX_INDEX_ENTRY_SIZE;
+    entry[8]++;
+    ck_assert (rex_validate (buf, sz, &rheader) == REX_ERROR_INVALID_DATA);
+    entry[8]--;
+
+    ck_assert (rex_validate (buf, sz, &rheader) == REX_OK);
+    FREE (buf);
+    rex_mesh_free (&mesh);
+
+    // index entry pointing into an image which holds the header of a huge mesh
+    uint8_t fake[REX_BLOCK_HEADER_SIZE + REX_MESH_HEADER_SIZE] = { 0 };
+    struct rex_block fblock = { .type = Mesh, .version = 1, .sz = REX_MESH_HEADER_SIZE, .id = 5 };
+    rex_block_header_write (fake, &fblock);
+    uint32_t nr_vertices = 10000000;
+    memcpy (fake + REX_BLOCK_HEADER_SIZE + 4, &nr_vertices, 4);
+    struct rex_image img = { .compression = Raw24, .data = fake, .sz = sizeof (fake) };
+    header = rex_header_create();
+    rex_index_init (&idx);
+    long img_sz;
+    uint8_t *img_ptr = rex_block_write_image (4, header, &img, &img_sz);
+    rex_index_add_block (&idx, img_ptr);
+    rex_index_add_block (&idx, fake);
+    idx.entries[1].offset = idx.entries[0].offset + REX_BLOCK_HEADER_SIZE + sizeof (uint32_t);
+    idx_ptr = rex_block_write_index (header, &idx, &idx_sz);
+    header_ptr = rex_header_write (header, &header_sz);
+
+    sz = header_sz + img_sz + idx_sz;
+    buf = rex_malloc (sz);
+    memcpy (buf, header_ptr, header_sz);
+    memcpy (buf + header_sz, img_ptr, img_sz);
+    memcpy (buf + header_sz + img_sz, idx_ptr, idx_sz);
+    ck_assert (rex_validate (buf, sz, &rheader) == REX_ERROR_INVALID_DATA);
+    ck_assert (!rheader.trusted);
+
+    // unknown image compression
+    ck_assert (rex_validate_block (img_ptr, img_sz) == REX_OK);
+    uint32_t compression = Png + 1;
+    memcpy (img_ptr + REX_BLOCK_HEADER_SIZE, &compression, 4);
+    ck_assert (rex_validate_block (img_ptr, img_sz) == REX_ERROR_INVALID_DATA);
+
+    FREE (img_ptr);
+    FREE (idx_ptr);
+    FREE (header_ptr);
+    FREE (header);
+    rex_index_free (&idx);
+    FREE (buf);
+}
+END_TEST
+
+START_TEST (test_rex_block_iov)
+{
+    struct rex_mesh mesh;
+    generate_mesh (&mesh);
+    struct rex_pointlist plist;
+    generate_pointlist (&plist, 1);
+    struct rex_lineset ls;
+    generate_lineset (&ls);
+
+    struct rex_header *header = rex_header_create();
+    long mesh_sz, plist_sz, ls_sz;
+    uint8_t *mesh_ptr = rex_block_write_mesh (0, header, &mesh, &mesh_sz);
+    uint8_t *plist_ptr = rex_block_write_pointlist (1, header, &plist, &plist_sz);
+    uint8_t *ls_ptr = rex_block_write_lineset (2, header, &ls, &ls_sz);
+    ck_assert (rex_block_size_mesh (&mesh) == mesh_sz);
+    ck_assert (rex_block_size_pointlist (&plist) == plist_sz);
+    ck_assert (rex_block_size_lineset (&ls) == ls_sz);
+
+    struct rex_header *vheader = rex_header_create();
+    struct rex_block_iov b[3];
+    ck_assert (rex_block_iov_mesh (0, vheader, &mesh, &b[0]) == REX_OK);
+    ck_assert (rex_block_iov_pointlist (1, vheader, &plist, &b[1]) == REX_OK);
+    ck_assert (rex_block_iov_lineset (2, vheader, &ls, &b[2]) == REX_OK);
+    ck_assert (b[0].sz == mesh_sz);
+    ck_assert (b[0].iov[1].base == mesh.positions);
+    ck_assert (vheader->nr_datablocks == 3);
+    ck_assert (vheader->sz_all_datablocks == header->sz_all_datablocks);
+    ck_assert (vheader->crc == header->crc);
+
+    // write the blocks in reverse order to their precomputed offsets
+    FILE *fp = tmpfile();
+    ck_assert (fp != NULL);
+    int fd = fileno (fp);
+    ck_assert (rex_file_writev (fd, mesh_sz + plist_sz, b[2].iov, b[2].nr_iov) == REX_OK);
+    ck_assert (rex_file_writev (fd, mesh_sz, b[1].iov, b[1].nr_iov) == REX_OK);
+    ck_assert (rex_file_writev (fd, 0, b[0].iov, b[0].nr_iov) == REX_OK);
+
+    long sz = mesh_sz + plist_sz + ls_sz;
+    uint8_t *buf = rex_malloc (sz);
+    ck_assert (fread (buf, sz, 1, fp) == 1);
+    ck_assert (memcmp (buf, mesh_ptr, mesh_sz) == 0);
+    ck_assert (memcmp (buf + mesh_sz, plist_ptr, plist_sz) == 0);
+    ck_assert (memcmp (buf + mesh_sz + plist_sz, ls_ptr, ls_sz) == 0);
+    fclose (fp);
+
+    // tracks are interleaved into scratch memory
+    float points[] = { 1, 2, 3, 4, 5, 6 };
+    float normals[] = { 0, 0, 1, 0, 1, 0 };
+    float confidences[] = { 0.5f, 0.25f };
+    struct rex_track track = { .nr_points = 2, .timestamp = 42, .points = points, .normals = normals, .confidences = confidences };
+    struct rex_block_iov t;
+    ck_assert (rex_block_iov_track (3, NULL, &track, &t) == REX_OK);
+    ck_assert (t.sz == rex_block_size_track (&track));
+    ck_assert (t.nr_iov == 2);
+    const float *data = t.iov[1].base;
+    ck_assert (data[7] == 4.0f && data[11] == 1.0f && data[13] == 0.25f);
+    rex_block_iov_free (&t);
+
+    FREE (buf);
+    FREE (mesh_ptr);
+    FREE (plist_ptr);
+    FREE (ls_ptr);
+    FREE (header);
+    FREE (vheader);
+    FREE (ls.vertices);
+    FREE (plist.positions);
+    FREE (plist.colors);
+    rex_mesh_free (&mesh);
+}
+END_TEST
+
+START_TEST (test_rex_arena)
+{
+    struct rex_arena arena;
+    rex_arena_init (&arena, 4096);
+
+    uint8_t *a = rex_arena_alloc (&arena, 3);
+    uint8_t *b = rex_arena_alloc (&arena, 5);
+    ck_assert (a != NULL && b != NULL);
+    ck_assert (((uintptr_t) b % REX_ARENA_ALIGNMENT) == 0);
+    ck_assert (b == a + REX_ARENA_ALIGNMENT);
+
+    // large allocations do not waste the current chunk
+    uint8_t *large = rex_arena_alloc (&arena, 100000);
+    ck_assert (large != NULL);
+    memset (large, 1, 100000);
+    ck_assert (rex_arena_alloc (&arena, 8) == b + REX_ARENA_ALIGNMENT);
+
+    rex_arena_reset (&arena);
+    ck_assert (rex_arena_alloc (&arena, 8) == a);
+
+    // decode the whole file from the arena
+    sprintf (tmp, "%s/%s", TEST_DATA_PATH, REX_TEMPLATE);
+    long sz;
+    uint8_t *buf = read_file_binary (tmp, &sz);
+    struct rex_header header;
+    uint8_t *ptr = rex_header_read (buf, &header);
+    struct rex_block blocks[4];
+    for (int i = 0; i < 4; i++)
+        ptr = rex_block_read_arena (ptr, &blocks[i], &arena);
+    ck_assert (ptr == buf + sz);
+
+    struct rex_mesh *mesh = blocks[0].data;
+    ck_assert (mesh->nr_vertices == 3);
+    ck_assert (mesh->positions[3] == 1.0f);
+    ck_assert (((struct rex_material_standard *) blocks[1].data)->ka_red == 1.0f);
+    rex_arena_free (&arena);
+
+    // the same with malloc, released per block
+    ptr = buf + header.start_addr;
+    ptr = rex_block_read (ptr, &blocks[0]);
+    ck_assert (((struct rex_mesh *) blocks[0].data)->nr_triangles == 1);
+    rex_block_free (&blocks[0]);
+    ck_assert (blocks[0].data == NULL);
+
+    FREE (buf);
+}
+END_TEST
+
+struct alloc_stats
+{
+    long nr_allocs;
+    long nr_frees;
+};
+
+static void *counting_malloc (size_t sz, void *ctx)
+{
+    ((struct alloc_stats *) ctx)->nr_allocs++;
+    return malloc (sz);
+}
+
+static void *counting_realloc (void *p, size_t sz, void *ctx)
+{
+    if (!p)
+        ((struct alloc_stats *) ctx)->nr_allocs++;
+    return realloc (p, sz);
+}
+
+static void counting_free (void *p, void *ctx)
+{
+    if (p)
+        ((struct alloc_stats *) ctx)->nr_frees++;
+    free (p);
+}
+
+static void *counting_aligned_alloc (size_t alignment, size_t sz, void *ctx)
+{
+    ((struct alloc_stats *) ctx)->nr_allocs++;
+    void *p = NULL;
+    return (posix_memalign (&p, alignment, sz) == 0) ? p : NULL;
+}
+
+START_TEST (test_rex_allocator)
+{
+    struct alloc_stats stats = { 0, 0 };
+    struct rex_allocator allocator =
+    {
+        .malloc = counting_malloc,
+        .realloc = counting_realloc,
+        .free = counting_free,
+        .aligned_alloc = counting_aligned_alloc,
+        .ctx = &stats
+    };
+    ck_assert (rex_set_allocator (&allocator) == REX_OK);
+    ck_assert (rex_get_allocator()->ctx == &stats);
+
+    sprintf (tmp, "%s/%s", TEST_DATA_PATH, REX_TEMPLATE);
+    long sz;
+    uint8_t *buf = read_file_binary (tmp, &sz);
+    ck_assert (stats.nr_allocs == 1);
+
+    struct rex_header header;
+    uint8_t *ptr = rex_header_read (buf, &header);
+    struct rex_block block;
+    rex_block_read (ptr, &block);
+    struct rex_mesh *mesh = block.data;
+    ck_assert (((uintptr_t) mesh->positions % REX_ARRAY_ALIGNMENT) == 0);
+    ck_assert (((uintptr_t) mesh->triangles % REX_ARRAY_ALIGNMENT) == 0);
+
+    long mesh_sz;
+    uint8_t *mesh_ptr = rex_block_write_mesh (0, NULL, mesh, &mesh_sz);
+    ck_assert (mesh_ptr != NULL);
+
+    struct rex_index idx;
+    ck_assert (rex_index_read (buf, sz, &header, &idx) == REX_OK);
+    rex_index_free (&idx);
+
+    FREE (mesh_ptr);
+    rex_block_free (&block);
+    FREE (buf);
+    ck_assert (stats.nr_allocs > 4);
+    ck_assert_msg (stats.nr_allocs == stats.nr_frees, "%ld allocs, %ld frees", stats.nr_allocs, stats.nr_frees);
+
+    // incomplete allocators are rejected
+    allocator.aligned_alloc = NULL;
+    ck_assert (rex_set_allocator (&allocator) == REX_MISSING_PARAMETER);
+    ck_assert (rex_set_allocator (NULL) == REX_OK);
+    ck_assert (rex_get_allocator()->ctx == NULL);
+}
+END_TEST
+
+struct mem_source
+{
+    uint8_t *buf;
+    long sz;
+    long pos;
+};
+
+// delivers at most 7 bytes per call to exercise partial reads
+static long mem_read (void *ctx, uint8_t *buf, size_t sz)
+{
+    struct mem_source *src = ctx;
+    long n = src->sz - src->pos;
+    if (n > 7)
+        n = 7;
+    if (n > (long) sz)
+        n = sz;
+    memcpy (buf, src->buf + src->pos, n);
+    src->pos += n;
+    return n;
+}
+
+START_TEST (test_rex_stream)
+{
+    sprintf (tmp, "%s/%s", TEST_DATA_PATH, REX_TEMPLATE);
+    long sz;
+    uint8_t *buf = read_file_binary (tmp, &sz);
+
+    // file descriptor of a pipe
+    int fds[2];
+    ck_assert (pipe (fds) == 0);
+    ck_assert (write (fds[1], buf, sz) == sz);
+    close (fds[1]);
+
+    struct rex_stream_reader r;
+    ck_assert (rex_stream_open_fd (&r, fds[0], 0) == REX_OK);
+    check_template_header (&r.header);
+
+    struct rex_block block;
+    ck_assert (rex_stream_next (&r, &block) == REX_OK);
+    ck_assert (block.type == Mesh);
+    ck_assert (((struct rex_mesh *) block.data)->nr_vertices == 3);
+    rex_block_free (&block);
+    for (int i = 1; i < 4; i++)
+    {
+        ck_assert (rex_stream_next (&r, &block) == REX_OK);
+        ck_assert (block.id == (uint64_t) i);
+        rex_block_free (&block);
+    }
+    ck_assert (rex_stream_next (&r, &block) == REX_END_OF_STREAM);
+    rex_stream_close (&r);
+    close (fds[0]);
+
+    // callback with partial reads
+    struct mem_source src = { buf, sz, 0 };
+    ck_assert (rex_stream_open (&r, mem_read, &src, 0) == REX_OK);
+    int n = 0;
+    int ret;
+    while ((ret = rex_stream_next (&r, &block)) == REX_OK)
+    {
+        n++;
+        rex_block_free (&block);
+    }
+    ck_assert (ret == REX_END_OF_STREAM);
+    ck_assert (n == 4);
+    rex_stream_close (&r);
+
+    // truncated stream
+    struct mem_source cut = { buf, 300, 0 };
+    ck_assert (rex_stream_open (&r, mem_read, &cut, 0) == REX_OK);
+    ck_assert (rex_stream_next (&r, &block) == REX_OK);
+    rex_block_free (&block);
+    ck_assert (rex_stream_next (&r, &block) == REX_ERROR_FILE_READ);
+    rex_stream_close (&r);
+
+    // stop reading early
+    src.pos = 0;
+    ck_assert (rex_stream_open (&r, mem_read, &src, 0) == REX_OK);
+    rex_stream_close (&r);
+
+    // close interrupts the read of an idle pipe
+    ck_assert (pipe (fds) == 0);
+    ck_assert (write (fds[1], buf, 86) == 86);
+    ck_assert (rex_stream_open_fd (&r, fds[0], 0) == REX_OK);
+    rex_stream_close (&r);
+    close (fds[0]);
+    close (fds[1]);
+
+    // a triangle index beyond the vertices of the first mesh is rejected before decoding
+    uint32_t mesh_sz;
+    memcpy (&mesh_sz, buf + 86 + 4, sizeof (uint32_t));
+    uint32_t index = 100;
+    memcpy (buf + 86 + 16 + mesh_sz - 4, &index, sizeof (uint32_t));
+    src.pos = 0;
+    ck_assert (rex_stream_open (&r, mem_read, &src, 0) == REX_OK);
+    ck_assert (rex_stream_next (&r, &block) == REX_OK);
+    ck_assert (block.type == Mesh && block.data == NULL);
+    ck_assert (rex_stream_next (&r, &block) == REX_OK);
+    ck_assert (block.id == 1 && block.data != NULL);
+    rex_block_free (&block);
+    rex_stream_close (&r);
+
+    // blocks larger than the maximum block size fail the stream before they are allocated
+    src.pos = 0;
+    ck_assert (rex_stream_open (&r, mem_read, &src, mesh_sz - 1) == REX_OK);
+    ck_assert (rex_stream_next (&r, &block) == REX_ERROR_BLOCK_SIZE);
+    ck_assert (r.slots[0].data == NULL);
+    rex_stream_close (&r);
+
+    // a text block which is too small for its fields is returned without data
+    uint8_t text[REX_BLOCK_HEADER_SIZE + 4] = { 0 };
+    struct rex_block tblock = { .type = Text, .version = 1, .sz = 4, .id = 9 };
+    rex_block_header_write (text, &tblock);
+    struct rex_header *theader = rex_header_create();
+    rex_header_add_block (theader, text, sizeof (text));
+    long theader_sz;
+    uint8_t *theader_ptr = rex_header_write (theader, &theader_sz);
+    uint8_t *tbuf = rex_malloc (theader_sz + sizeof (text));
+    memcpy (tbuf, theader_ptr, theader_sz);
+    memcpy (tbuf + theader_sz, text, sizeof (text));
+    struct mem_source tsrc = { tbuf, theader_sz + sizeof (text), 0 };
+    ck_assert (rex_stream_open (&r, mem_read, &tsrc, 0) == REX_OK);
+    ck_assert (rex_stream_next (&r, &block) == REX_OK);
+    ck_assert (block.type == Text && block.id == 9 && block.data == NULL);
+    ck_assert (rex_stream_next (&r, &block) == REX_END_OF_STREAM);
+    rex_stream_close (&r);
+    FREE (tbuf);
+    FREE (theader_ptr);
+    FREE (theader);
+
+    buf[0] = 'X';
+    src.pos = 0;
+    ck_assert (rex_stream_open (&r, mem_read, &src, 0) == REX_ERROR_WRONG_MAGIC);
+
+    FREE (buf);
+}
+END_TEST
+
+static void mark_item (void *ctx, uint32_t i)
+{
+    uint32_t *hits = ctx;
+    hits[i]++;
+}
+
+START_TEST (test_rex_crc)
+{
+    // check value of the CRC-32C catalogue
+    ck_assert (rex_crc32c (0, "123456789", 9) == 0xe3069283);
+
+    uint8_t data[20000];
+    for (uint32_t i = 0; i < sizeof (data); i++)
+        data[i] = (uint8_t) (i * 31 + (i >> 7));
+    uint32_t crc = rex_crc32c (0, data, sizeof (data));
+    ck_assert (rex_crc32c (rex_crc32c (0, data, 13), data + 13, sizeof (data) - 13) == crc);
+    ck_assert (rex_crc32c_combine (rex_crc32c (0, data, 5000), rex_crc32c (0, data + 5000, 15000), 15000) == crc);
+    ck_assert (rex_crc32c_combine (crc, 0, 0) == crc);
+
+    // the header accumulates the CRC of all data blocks
+    struct rex_mesh mesh;
+    generate_mesh (&mesh);
+    struct rex_lineset ls;
+    generate_lineset (&ls);
+
+    struct rex_header *header = rex_header_create();
+    long mesh_sz, ls_sz, header_sz;
+    uint8_t *mesh_ptr = rex_block_write_mesh (0, header, &mesh, &mesh_sz);
+    uint8_t *ls_ptr = rex_block_write_lineset (1, header, &ls, &ls_sz);
+    uint8_t *header_ptr = rex_header_write (header, &header_sz);
+    ck_assert (header->crc != 0);
+
+    long sz = header_sz + mesh_sz + ls_sz;
+    uint8_t *buf = rex_malloc (sz);
+    memcpy (buf, header_ptr, header_sz);
+    memcpy (buf + header_sz, mesh_ptr, mesh_sz);
+    memcpy (buf + header_sz + mesh_sz, ls_ptr, ls_sz);
+    ck_assert (rex_crc32c (0, buf + header_sz, mesh_sz + ls_sz) == header->crc);
+
+    struct rex_header rheader;
+    rex_header_read (buf, &rheader);
+    ck_assert (rheader.crc == header->crc);
+    ck_assert (rex_crc_verify (buf, sz, &rheader) == REX_OK);
+
+    // a single flipped bit is detected by the map and the stream reader
+    buf[sz - 1] ^= 0x10;
+    ck_assert (rex_crc_verify (buf, sz, &rheader) == REX_ERROR_CRC);
+
+    struct mem_source src = { buf, sz, 0 };
+    struct rex_stream_reader r;
+    struct rex_block block;
+    int ret;
+    ck_assert (rex_stream_open (&r, mem_read, &src, 0) == REX_OK);
+    while ((ret = rex_stream_next (&r, &block)) == REX_OK)
+        rex_block_free (&block);
+    ck_assert (ret == REX_ERROR_CRC);
+    rex_stream_close (&r);
+
+    // files without CRC are not verified
+    buf[sz - 1] ^= 0x10;
+    rheader.crc = 0;
+    ck_assert (rex_crc_verify (buf, sz, &rheader) == REX_OK);
+    rheader.crc = header->crc;
+    ck_assert (rex_crc_verify (buf, sz - 1, &rheader) == REX_ERROR_FILE_READ);
+    uint64_t all = rheader.sz_all_datablocks;
+    rheader.sz_all_datablocks = UINT64_MAX - rheader.start_addr + 1;
+    ck_assert (rex_crc_verify (buf, sz, &rheader) == REX_ERROR_FILE_READ);
+    rheader.sz_all_datablocks = all;
+
+    FREE (buf);
+    FREE (header_ptr);
+    FREE (mesh_ptr);
+    FREE (ls_ptr);
+    FREE (header);
+    FREE (ls.vertices);
+    rex_mesh_free (&mesh);
+}
+END_TEST
+
+START_TEST (test_rex_block_read_all)
+{
+    struct rex_thread_pool *pool = rex_thread_pool_create (4);
+    ck_assert (pool != NULL);
+
+    // every item is processed exactly once, also for repeated jobs
+    uint32_t hits[1000];
+    memset (hits, 0, sizeof (hits));
+    for (int job = 0; job < 3; job++)
+        rex_parallel_for (pool, 1000, mark_item, hits);
+    for (int i = 0; i < 1000; i++)
+        ck_assert (hits[i] == 3);
+
+    sprintf (tmp, "%s/%s", TEST_DATA_PATH, REX_TEMPLATE);
+    struct rex_map map;
+    ck_assert (rex_map_open (tmp, &map) == REX_OK);
+    struct rex_header header;
+    rex_header_read (map.data, &header);
+
+    struct rex_block *blocks;
+    uint32_t nr_blocks;
+    ck_assert (rex_block_read_all (map.data, map.sz, &header, pool, &blocks, &nr_blocks) == REX_OK);
+    ck_assert (nr_blocks == 4);
+    ck_assert (blocks[0].type == Mesh);
+    ck_assert (((struct rex_mesh *) blocks[0].data)->nr_vertices == 3);
+    for (uint32_t i = 1; i < nr_blocks; i++)
+        ck_assert (blocks[i].id == i);
+    rex_blocks_free (blocks, nr_blocks);
+    rex_map_close (&map);
+
+    // many blocks, the result is in file order
+    struct rex_header *wheader = rex_header_create();
+    struct rex_lineset ls;
+    generate_lineset (&ls);
+    const uint32_t nr = 200;
+    uint8_t *buf = rex_malloc (REX_HEADER_SIZE + nr * rex_block_size_lineset (&ls));
+    long sz = REX_HEADER_SIZE;
+    for (uint32_t i = 0; i < nr; i++)
+    {
+        long block_sz;
+        ls.nr_vertices = 1 + i % 5;
+        uint8_t *ptr = rex_block_write_lineset (i, wheader, &ls, &block_sz);
+        memcpy (buf + sz, ptr, block_sz);
+        sz += block_sz;
+        FREE (ptr);
+    }
+    long header_sz;
+    uint8_t *header_ptr = rex_header_write (wheader, &header_sz);
+    memcpy (buf, header_ptr, header_sz);
+
+    rex_header_read (buf, &header);
+    ck_assert (rex_block_read_all (buf, sz, &header, pool, &blocks, &nr_blocks) == REX_OK);
+    ck_assert (nr_blocks == nr);
+    for (uint32_t i = 0; i < nr; i++)
+    {
+        ck_assert (blocks[i].type == LineSet);
+        ck_assert (blocks[i].id == i);
+        ck_assert (((struct rex_lineset *) blocks[i].data)->nr_vertices == 1 + i % 5);
+    }
+    rex_blocks_free (blocks, nr_blocks);
+
+    // without a pool the blocks are decoded on the calling thread
+    ck_assert (rex_block_read_all (buf, sz, &header, NULL, &blocks, &nr_blocks) == REX_OK);
+    ck_assert (nr_blocks == nr);
+    ck_assert (blocks[nr - 1].id == nr - 1);
+    rex_blocks_free (blocks, nr_blocks);
+
+    rex_thread_pool_destroy (pool);
+    FREE (buf);
+    FREE (header_ptr);
+    FREE (wheader);
+    FREE (ls.vertices);
+}
+END_TEST
+
+START_TEST (test_rex_group)
+{
+    // more than 65535 blocks
+    struct rex_header *header = rex_header_create();
+    for (int i = 0; i < 70000; i++)
+        rex_header_add_block_crc (header, REX_BLOCK_HEADER_SIZE, 0);
+    ck_assert (header->nr_datablocks == 65535);
+    ck_assert (rex_header_nr_datablocks (header) == 70000);
+
+    long header_sz;
+    uint8_t *header_ptr = rex_header_write (header, &header_sz);
+    struct rex_header rheader;
+    rex_header_read (header_ptr, &rheader);
+    ck_assert (rex_header_nr_datablocks (&rheader) == 70000);
+    ck_assert (rheader.sz_all_datablocks == 70000 * REX_BLOCK_HEADER_SIZE);
+    FREE (header_ptr);
+    FREE (header);
+
+    // pointlist on a 10x10x10 grid, the color encodes the position
+    struct rex_pointlist plist;
+    rex_pointlist_init (&plist);
+    plist.nr_vertices = plist.nr_colors = 1000;
+    plist.positions = rex_malloc (1000 * 12);
+    plist.colors = rex_malloc (1000 * 12);
+    float sum = 0.0f;
+    for (int i = 0; i < 1000; i++)
+    {
+        plist.positions[3 * i] = plist.colors[3 * i] = i % 10;
+        plist.positions[3 * i + 1] = plist.colors[3 * i + 1] = (i / 10) % 10;
+        plist.positions[3 * i + 2] = plist.colors[3 * i + 2] = i / 100;
+        sum += plist.positions[3 * i] + plist.positions[3 * i + 1] + plist.positions[3 * i + 2];
+    }
+
+    struct rex_pointlist *pparts;
+    uint32_t nr_parts;
+    ck_assert (rex_pointlist_split (&plist, 300, &pparts, &nr_parts) == REX_OK);
+    ck_assert (nr_parts == 4);
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < nr_parts; i++)
+    {
+        ck_assert (pparts[i].nr_vertices <= 300);
+        ck_assert (pparts[i].positions == plist.positions + 3 * total);
+        total += pparts[i].nr_vertices;
+    }
+    ck_assert (total == 1000);
+    for (int i = 0; i < 3000; i++)
+        ck_assert (plist.positions[i] == plist.colors[i]);
+    FREE (pparts);
+
+    // 20x20 quads, every part gets the vertices of its triangles only
+    struct rex_mesh mesh;
+    rex_mesh_init (&mesh);
+    mesh.nr_vertices = 21 * 21;
+    mesh.nr_triangles = 20 * 20 * 2;
+    mesh.positions = rex_malloc (mesh.nr_vertices * 12);
+    mesh.normals = rex_malloc (mesh.nr_vertices * 12);
+    mesh.triangles = rex_malloc (mesh.nr_triangles * 12);
+    for (uint32_t i = 0; i < mesh.nr_vertices; i++)
+    {
+        float v[3] = { i % 21, i / 21, 0.0f };
+        float n[3] = { 0.0f, 0.0f, 1.0f };
+        memcpy (mesh.positions + 3 * i, v, 12);
+        memcpy (mesh.normals + 3 * i, n, 12);
+    }
+    float corner_sum = 0.0f;
+    for (uint32_t y = 0, t = 0; y < 20; y++)
+    {
+        for (uint32_t x = 0; x < 20; x++, t += 6)
+        {
+            uint32_t v = y * 21 + x;
+            uint32_t tri[6] = { v, v + 1, v + 22, v, v + 22, v + 21 };
+            memcpy (mesh.triangles + t, tri, sizeof (tri));
+            for (int j = 0; j < 6; j++)
+                corner_sum += mesh.positions[3 * tri[j]] + mesh.positions[3 * tri[j] + 1];
+        }
+    }
+
+    struct rex_mesh *mparts;
+    ck_assert (rex_mesh_split (&mesh, 200, &mparts, &nr_parts) == REX_OK);
+    ck_assert (nr_parts == 4);
+    for (uint32_t i = 0; i < nr_parts; i++)
+    {
+        ck_assert (mparts[i].nr_triangles == 200);
+        ck_assert (mparts[i].nr_vertices < 21 * 21);
+        for (uint32_t j = 0; j < mparts[i].nr_triangles * 3; j++)
+            ck_assert (mparts[i].triangles[j] < mparts[i].nr_vertices);
+        ck_assert (mparts[i].normals[2] == 1.0f);
+        rex_mesh_free (&mparts[i]);
+    }
+    FREE (mparts);
+
+    // write both with a small block size and reassemble them
+    header = rex_header_create();
+    struct rex_index idx;
+    rex_index_init (&idx);
+    FILE *fp = tmpfile();
+    ck_assert (fp != NULL);
+
+    struct rex_group_writer w;
+    rex_group_writer_init (&w, fileno (fp), header, &idx);
+    w.max_block_sz = 8 + 300 * 24;
+    uint64_t id = 10;
+    ck_assert (rex_group_write_pointlist (&w, &id, &plist) == REX_OK);
+    ck_assert (id == 10 + 1 + 4);
+    w.max_block_sz = 4096;
+    ck_assert (rex_group_write_mesh (&w, &id, &mesh) == REX_OK);
+    ck_assert (rex_header_nr_datablocks (header) == idx.nr_entries);
+    ck_assert (w.offset == REX_HEADER_SIZE + header->sz_all_datablocks);
+
+    long idx_sz;
+    uint8_t *idx_ptr = rex_block_write_index (header, &idx, &idx_sz);
+    header_ptr = rex_header_write (header, &header_sz);
+    ck_assert (pwrite (fileno (fp), header_ptr, header_sz, 0) == header_sz);
+    ck_assert (pwrite (fileno (fp), idx_ptr, idx_sz, w.offset) == idx_sz);
+    rex_index_free (&idx);
+
+    long sz = w.offset + idx_sz;
+    uint8_t *buf = rex_malloc (sz);
+    ck_assert (pread (fileno (fp), buf, sz, 0) == sz);
+    fclose (fp);
+
+    rex_header_read (buf, &rheader);
+    ck_assert (rex_index_read (buf, sz, &rheader, &idx) == REX_OK);
+    for (uint32_t i = 0; i < idx.nr_entries; i++)
+        ck_assert (idx.entries[i].sz <= 4096 || idx.entries[i].type == PointList);
+
+    const struct rex_index_entry *e = rex_index_find (&idx, 10);
+    ck_assert (e != NULL && e->type == Group);
+    struct rex_block group;
+    rex_block_read (buf + e->offset, &group);
+    ck_assert (((struct rex_group *) group.data)->nr_members == 4);
+
+    struct rex_block block;
+    ck_assert (rex_group_read (buf, &idx, &group, &block) == REX_OK);
+    ck_assert (block.type == PointList);
+    ck_assert (block.id == 10);
+    struct rex_pointlist *rplist = block.data;
+    ck_assert (rplist->nr_vertices == 1000 && rplist->nr_colors == 1000);
+    float rsum = 0.0f;
+    for (int i = 0; i < 3000; i++)
+    {
+        ck_assert (rplist->positions[i] == rplist->colors[i]);
+        rsum += rplist->positions[i];
+    }
+    ck_assert (rsum == sum);
+    rex_block_free (&block);
+    rex_block_free (&group);
+
+    e = rex_index_find (&idx, 15);
+    ck_assert (e != NULL && e->type == Group);
+    rex_block_read (buf + e->offset, &group);
+    ck_assert (((struct rex_group *) group.data)->nr_members > 1);
+    ck_assert (rex_group_read (buf, &idx, &group, &block) == REX_OK);
+    ck_assert (block.type == Mesh);
+    struct rex_mesh *rmesh = block.data;
+    ck_assert (rmesh->nr_triangles == mesh.nr_triangles);
+    ck_assert (rmesh->normals != NULL);
+    float rcorner_sum = 0.0f;
+    for (uint32_t i = 0; i < rmesh->nr_triangles * 3; i++)
+    {
+        ck_assert (rmesh->triangles[i] < rmesh->nr_vertices);
+        rcorner_sum += rmesh->positions[3 * rmesh->triangles[i]] + rmesh->positions[3 * rmesh->triangles[i] + 1];
+    }
+    ck_assert (rcorner_sum == corner_sum);
+    rex_block_free (&block);
+    rex_block_free (&group);
+
+    // a member count which exceeds the block and a failed allocation of the members
+    uint64_t members[200] = { 0 };
+    struct rex_group big = { .nr_members = 200, .members = members };
+    long gsz;
+    uint8_t *gptr = rex_block_write_group (20, NULL, &big, &gsz);
+    uint32_t nr_members = 201;
+    memcpy (gptr + REX_BLOCK_HEADER_SIZE, &nr_members, sizeof (uint32_t));
+    ck_assert (rex_block_read (gptr, &group) == gptr + gsz);
+    ck_assert (group.type == Group && group.data == NULL);
+    nr_members = 200;
+    memcpy (gptr + REX_BLOCK_HEADER_SIZE, &nr_members, sizeof (uint32_t));
+    struct rex_allocator allocator = *rex_get_allocator();
+    allocator.malloc = small_malloc;
+    allocator.aligned_alloc = small_aligned_alloc;
+    ck_assert (rex_set_allocator (&allocator) == REX_OK);
+    ck_assert (rex_block_read (gptr, &group) == gptr + gsz);
+    ck_assert (group.type == Group && group.data == NULL);
+    ck_assert (rex_block_write_group (20, NULL, &big, &gsz) == NULL);
+    ck_assert (rex_set_allocator (NULL) == REX_OK);
+    FREE (gptr);
+
+    rex_index_free (&idx);
+    rex_pointlist_free (&plist);
+    rex_mesh_free (&mesh);
+    FREE (buf);
+    FREE (idx_ptr);
+    FREE (header_ptr);
+    FREE (header);
+}
+END_TEST
+
+START_TEST (test_rex_index)
+{
+    // fallback: template has no index block, hop over block headers
+    sprintf (tmp, "%s/%s", TEST_DATA_PATH, REX_TEMPLATE);
+    struct rex_map map;
+    ck_assert (rex_map_open (tmp, &map) == REX_OK);
+
+    struct rex_header header;
+    rex_header_read (map.data, &header);
+    ck_assert (header.index_addr == 0);
+
+    struct rex_index idx;
+    ck_assert (rex_index_read (map.data, map.sz, &header, &idx) == REX_OK);
+    ck_assert (idx.nr_entries == 4);
+    ck_assert (idx.entries[0].offset == 86);
+    ck_assert (idx.entries[0].type == Mesh);
+    rex_index_free (&idx);
+    rex_map_close (&map);
+
+    // written index block
+    struct rex_header *wheader = rex_header_create();
+    struct rex_lineset ls;
+    generate_lineset (&ls);
+    long ls_sz;
+    uint8_t *ls_ptr = rex_block_write_lineset (5 /*id*/, wheader, &ls, &ls_sz);
+
+    struct rex_material_standard mat;
+    generate_material (&mat);
+    long mat_sz;
+    uint8_t *mat_ptr = rex_block_write_material (2 /*id*/, wheader, &mat, &mat_sz);
+
+    rex_index_init (&idx);
+    rex_index_add_block (&idx, ls_ptr);
+    rex_index_add_block (&idx, mat_ptr);
+    long idx_sz;
+    uint8_t *idx_ptr = rex_block_write_index (wheader, &idx, &idx_sz);
+    ck_assert (idx_sz == 16 + 4 + 2 * 24);
+    ck_assert (wheader->index_addr == REX_HEADER_SIZE + (uint64_t) (ls_sz + mat_sz));
+    rex_index_free (&idx);
+
+    long header_sz;
+    uint8_t *header_ptr = rex_header_write (wheader, &header_sz);
+    ck_assert (header_sz == REX_HEADER_SIZE);
+
+    long sz = header_sz + ls_sz + mat_sz + idx_sz;
+    uint8_t *buf = rex_malloc (sz);
+    memcpy (buf, header_ptr, header_sz);
+    memcpy (buf + header_sz, ls_ptr, ls_sz);
+    memcpy (buf + header_sz + ls_sz, mat_ptr, mat_sz);
+    memcpy (buf + header_sz + ls_sz + mat_sz, idx_ptr, idx_sz);
+
+    rex_header_read (buf, &header);
+    ck_assert (header.nr_datablocks == 2);
+    ck_assert (header.index_addr == wheader->index_addr);
+    ck_assert (rex_index_read (buf, sz, &header, &idx) == REX_OK);
+    ck_assert (idx.nr_entries == 2);
+
+    const struct rex_index_entry *e = rex_index_find (&idx, 2);
+    ck_assert (e != NULL);
+    ck_assert (e->type == MaterialStandard);
+    ck_assert (e->offset == REX_HEADER_SIZE + (uint64_t) ls_sz);
+
+    struct rex_block block;
+    ck_assert (rex_block_read (buf + e->offset, &block) == buf + e->offset + mat_sz);
+    ck_assert (block.id == 2);
+    ck_assert (((struct rex_material_standard *) block.data)->alpha == 1.0f);
+    FREE (block.data);
+
+    e = rex_index_find (&idx, 5);
+    ck_assert (e != NULL);
+    ck_assert (e->type == LineSet);
+    ck_assert (e->offset == REX_HEADER_SIZE);
+    ck_assert (rex_index_find (&idx, 3) == NULL);
+    rex_index_free (&idx);
+
+    // offsets which wrap around are rejected, the index is built from the block headers
+    uint64_t huge = UINT64_MAX - 8;
+    memcpy (buf + header.index_addr + 16 + 4 + 8, &huge, sizeof (uint64_t));
+    ck_assert (rex_index_read (buf, sz, &header, &idx) == REX_OK);
+    ck_assert (idx.nr_entries == 2 && idx.entries[0].offset == REX_HEADER_SIZE);
+    rex_index_free (&idx);
+    header.index_addr = huge;
+    ck_assert (rex_index_read (buf, sz, &header, &idx) == REX_OK);
+    ck_assert (idx.nr_entries == 2 && idx.entries[1].offset == REX_HEADER_SIZE + (uint64_t) ls_sz);
+
+    rex_index_free (&idx);
+    FREE (buf);
+    FREE (ls.vertices);
+    FREE (ls_ptr);
+    FREE (mat_ptr);
+    FREE (idx_ptr);
+    FREE (header_ptr);
+    FREE (wheader);
+}
+END_TEST
+
 Suite *test_suite()
 {
     Suite *s;
@@ -302,8 +2523,33 @@ Suite *test_suite()
     /* io test case */
     tc_io = tcase_create ("io");
     tcase_add_test (tc_io, test_rex_reader);
+    tcase_add_test (tc_io, test_rex_map_view);
+    tcase_add_test (tc_io, test_rex_index);
+    tcase_add_test (tc_io, test_rex_validate);
+    tcase_add_test (tc_io, test_rex_block_iter);
+    tcase_add_test (tc_io, test_rex_arena);
+    tcase_add_test (tc_io, test_rex_allocator);
+    tcase_add_test (tc_io, test_rex_stream);
+    tcase_add_test (tc_io, test_rex_crc);
+    tcase_add_test (tc_io, test_rex_block_read_all);
+    tcase_add_test (tc_io, test_rex_batch);
+    tcase_add_test (tc_io, test_rex_group);
     tcase_add_test (tc_io, test_rex_writer_mesh);
+    tcase_add_test (tc_io, test_rex_mesh_writer);
+    tcase_add_test (tc_io, test_rex_mesh_compressed);
+    tcase_add_test (tc_io, test_rex_pointlist_compact);
+    tcase_add_test (tc_io, test_rex_block_compressed);
+    tcase_add_test (tc_io, test_rex_block_iov);
     tcase_add_test (tc_io, test_rex_writer_lineset_and_text);
+    tcase_add_test (tc_io, test_rex_track);
+    tcase_add_test (tc_io, test_rex_stats);
+    tcase_add_test (tc_io, test_rex_trace);
+    tcase_add_test (tc_io, test_rex_mem);
+    tcase_add_test (tc_io, test_rex_mesh_optimize);
+    tcase_add_test (tc_io, test_rex_mesh_weld);
+    tcase_add_test (tc_io, test_rex_mesh_simplify);
+    tcase_add_test (tc_io, test_rex_mesh_normals);
+    tcase_add_test (tc_io, test_rex_bounds);
     tcase_add_test (tc_io, test_rex_writer_pointlist_color);
     tcase_add_test (tc_io, test_rex_writer_pointlist_nocolor);
 
@@ -33,66 +33,34 @@ int main (int argc, char **argv)
     //sanity check?
     int64_t requested_id = atoi (argv[2]);
 
-    long sz;
-    uint8_t *buf = read_file_binary (argv[1], &sz);
-    if (buf == NULL)
+    struct rex_map map;
+    if (rex_map_open (argv[1], &map) != REX_OK)
         die ("Cannot open REX file %s\n", argv[1]);
 
     struct rex_header header;
-    uint8_t *ptr = rex_header_read (buf, &header);
+    uint8_t *ptr = rex_header_read (map.data, &header);
     if (ptr == NULL)
         die ("Cannot read REX header");
 
-    for (int i = 0; i < header.nr_datablocks; i++)
+    // only the pages of the requested block are touched
+    struct rex_index idx;
+    if (rex_index_read (map.data, map.sz, &header, &idx) != REX_OK)
+        die ("Cannot read REX index");
+
+    // compressed blocks are decoded, the inner block type is checked afterwards
+    const struct rex_index_entry *entry = rex_index_find (&idx, (uint64_t) requested_id);
+    if (entry && (entry->type == Image || entry->type == Compressed))
     {
-        //TODO move pointer without reading the block for speedup
         struct rex_block block;
-        ptr = rex_block_read (ptr, &block);
-
-        //dump selected block
-        if (block.id == (uint64_t) requested_id)
-        {
-            if (block.type == Image)
-            {
-                struct rex_image *img = block.data;
-                fwrite (img->data, sizeof (uint8_t), img->sz, stdout);
-            }
-        }
+        rex_map_view_block (&map, map.data + entry->offset, &block);
 
-        //free allocated memory
-        if (block.type == Image)
-        {
-            struct rex_image *img = block.data;
-            FREE (img->data);
-            FREE (block.data);
-        }
-        else if (block.type == LineSet)
-        {
-            struct rex_lineset *ls = block.data;
-            FREE (ls->vertices);
-            FREE (block.data);
-        }
-        else if (block.type == PointList)
-        {
-            struct rex_pointlist *p = block.data;
-            FREE (p->positions);
-            FREE (block.data);
-        }
-        else if (block.type == Text)
-        {
-            FREE (block.data);
-        }
-        else if (block.type == Mesh)
-        {
-            struct rex_mesh *mesh = block.data;
-            rex_mesh_free (mesh);
-            FREE (block.data);
-        }
-        else if (block.type == MaterialStandard)
-        {
-            FREE (block.data);
-        }
+        struct rex_image *img = (block.type == Image) ? block.data : NULL;
+        if (img)
+            fwrite (img->data, sizeof (uint8_t), img->sz, stdout);
+        rex_map_release_block (&map, &block);
     }
-    FREE (buf);
+
+    rex_index_free (&idx);
+    rex_map_close (&map);
     return 0;
 }
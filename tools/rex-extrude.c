@@ -51,7 +51,7 @@ float *read_csv_array (char *filename, unsigned int *numelements)
     if (num_read_elements == 0)
         die ("error reading %s\n", filename);
 
-    float *array = malloc (num_read_elements * sizeof (float));
+    float *array = rex_malloc (num_read_elements * sizeof (float));
 
     unsigned int i = 0;
 
@@ -135,11 +135,11 @@ int main (int argc, char **argv)
                                                          };
         anchorpoints_array_size = sizeof (anchorpoints_default) / sizeof (anchorpoints_default[0]);
 
-        points = malloc (points_array_size * sizeof (float));
+        points = rex_malloc (points_array_size * sizeof (float));
         if (!points)
             die ("Allocating default points memory failed");
 
-        anchorpoints = malloc (anchorpoints_array_size * sizeof (float));
+        anchorpoints = rex_malloc (anchorpoints_array_size * sizeof (float));
         if (!anchorpoints)
             die ("Allocating default anchorpoints memory failed");
 
@@ -196,6 +196,15 @@ int main (int argc, char **argv)
     long mesh_sz;
     uint8_t *mesh_ptr = rex_block_write_mesh (2 /*id*/, header, &mesh, &mesh_sz);
 
+    // write index
+    struct rex_index idx;
+    rex_index_init (&idx);
+    rex_index_add_block (&idx, img_ptr);
+    rex_index_add_block (&idx, mat_ptr);
+    rex_index_add_block (&idx, mesh_ptr);
+    long idx_sz;
+    uint8_t *idx_ptr = rex_block_write_index (header, &idx, &idx_sz);
+
     long header_sz;
     uint8_t *header_ptr = rex_header_write (header, &header_sz);
 
@@ -203,11 +212,14 @@ int main (int argc, char **argv)
     fwrite (img_ptr, img_sz, 1, fp);
     fwrite (mat_ptr, mat_sz, 1, fp);
     fwrite (mesh_ptr, mesh_sz, 1, fp);
+    fwrite (idx_ptr, idx_sz, 1, fp);
     fclose (fp);
 
+    rex_index_free (&idx);
     FREE (img_ptr);
     FREE (mat_ptr);
     FREE (mesh_ptr);
+    FREE (idx_ptr);
     FREE (header_ptr);
     return 0;
 }
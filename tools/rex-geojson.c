@@ -105,7 +105,7 @@ void geojson_read_feature (const cJSON *f, struct rex_lineset *ls)
 
         // generate a lineset for each polygon
         ls->nr_vertices = cJSON_GetArraySize (pts);
-        ls->vertices = malloc (ls->nr_vertices * 12);
+        ls->vertices = rex_malloc (ls->nr_vertices * 12);
         int c = 0;
         cJSON_ArrayForEach (pt, pts)
         {
@@ -192,6 +192,9 @@ void geojson_convert (const char *filename, const char *rexfile)
     const cJSON *f = NULL;
     uint64_t id = 0;
 
+    struct rex_index idx;
+    rex_index_init (&idx);
+
     cJSON_ArrayForEach (f, features)
     {
         cJSON *type = cJSON_GetObjectItemCaseSensitive (f, "type");
@@ -206,6 +209,7 @@ void geojson_convert (const char *filename, const char *rexfile)
 
             long ls_sz;
             uint8_t *ls_ptr = rex_block_write_lineset (id++, header, &ls, &ls_sz);
+            rex_index_add_block (&idx, ls_ptr);
             fwrite (ls_ptr, ls_sz, 1, fp);
             FREE (ls_ptr);
             FREE (ls.vertices);
@@ -214,11 +218,16 @@ void geojson_convert (const char *filename, const char *rexfile)
             printf ("Not supported type: %s\n", type->valuestring);
     }
 
+    // Write index
+    long idx_sz;
+    uint8_t *idx_ptr = rex_block_write_index (header, &idx, &idx_sz);
+    fwrite (idx_ptr, idx_sz, 1, fp);
+    FREE (idx_ptr);
+    rex_index_free (&idx);
+
     // Write correct header
-    fseek (fp, 0, SEEK_SET);
-    header_ptr = rex_header_write (header, &header_sz);
-    fwrite (header_ptr, header_sz, 1, fp);
-    FREE (header_ptr);
+    if (rex_header_patch (fp, header) != REX_OK)
+        warn ("Cannot write REX header");
 
 end:
     cJSON_Delete (json);
@@ -16,17 +16,35 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "rex.h"
 
 static const char *rex_data_types[]
-    = { "LineSet", "Text", "PointList", "Mesh", "Image", "MaterialStandard", "PeopleSimulation" };
+    = { "LineSet", "Text", "PointList", "Mesh", "Image", "MaterialStandard", "SceneNode", "Track", "Index", "Group", "Compressed" };
 
 static const char *rex_image_types[] = { "Raw", "Jpg", "Png" };
 
 void usage (const char *exec)
 {
-    die ("usage: %s filename.rex\n", exec);
+    die ("usage: %s [-l] [--stats] [--mem-report] filename.rex\n"
+         "  -l            list the block headers only, block payloads are not read\n"
+         "  --stats       print the performance counters per block type\n"
+         "  --mem-report  print the memory accounting per subsystem\n"
+         "Use - as filename to read from stdin\n", exec);
+}
+
+void rex_dump_stats (void)
+{
+    printf ("\nperformance counters\n");
+    rex_stats_dump (stdout);
+}
+
+void rex_dump_mem (void)
+{
+    printf ("\nmemory\n");
+    rex_mem_report (stdout);
 }
 
 void rex_dump_header (struct rex_header *header)
@@ -34,16 +52,22 @@ void rex_dump_header (struct rex_header *header)
 
     printf ("═══════════════════════════════════════════\n");
     printf ("version                %20d\n", header->version);
-    printf ("nr_datablocks          %20d\n", header->nr_datablocks);
+    printf ("nr_datablocks          %20u\n", rex_header_nr_datablocks (header));
     printf ("start_addr             %20d\n", header->start_addr);
     printf ("sz_all_datablocks      %20lu\n", header->sz_all_datablocks);
+    printf ("index                  %20s\n", (header->index_addr) ? "yes" : "no");
+    if (header->crc)
+        printf ("crc                    %20x\n", header->crc);
+    else
+        printf ("crc                                 not set\n");
 }
 
-void rex_dump_block_header (struct rex_block *block)
+void rex_dump_block_header (struct rex_block *block, uint64_t offset)
 {
     printf ("═══════════════════════════════════════════\n");
     printf ("id                     %20lu\n", block->id);
-    printf ("type                   %20s\n", rex_data_types[block->type]);
+    printf ("offset                 %20lu\n", offset);
+    printf ("type                   %20s\n", (block->type < LEN (rex_data_types)) ? rex_data_types[block->type] : "unknown");
     printf ("version                %20d\n", block->version);
     printf ("sz                     %20d\n", block->sz);
 }
@@ -109,82 +133,183 @@ void rex_dump_mesh_block (struct rex_mesh *mesh)
     /* rex_mesh_dump_obj(mesh); */
 }
 
+void rex_dump_block (struct rex_block *block)
+{
+    // blocks which failed the validation or are not supported are not decoded
+    if (!block->data)
+    {
+        printf ("invalid block\n");
+        return;
+    }
+
+    if (block->type == LineSet)
+    {
+        struct rex_lineset *ls = block->data;
+        rex_dump_lineset_block (ls);
+    }
+    else if (block->type == PointList)
+    {
+        struct rex_pointlist *p = block->data;
+        rex_dump_pointlist_block (p);
+    }
+    else if (block->type == Text)
+    {
+        struct rex_text *text = block->data;
+        printf ("position %22.2f %5.2f %5.2f\n", text->position[0], text->position[1], text->position[2]);
+        printf ("fontSize    %31.1f\n", text->font_size);
+        printf ("text        %31s\n", text->data);
+        printf ("red         %31.1f\n", text->red);
+        printf ("green       %31.1f\n", text->green);
+        printf ("blue        %31.1f\n", text->blue);
+        printf ("alpha       %31.1f\n", text->alpha);
+    }
+    else if (block->type == Mesh)
+    {
+        struct rex_mesh *mesh = block->data;
+        rex_dump_mesh_block (mesh);
+    }
+    else if (block->type == MaterialStandard)
+    {
+        struct rex_material_standard *mat = block->data;
+        rex_dump_material_block (mat);
+    }
+    else if (block->type == Image)
+    {
+        struct rex_image *img = block->data;
+        printf ("compression %31s\n", rex_image_types[img->compression]);
+        printf ("image size  %31ld\n", block->sz - sizeof (uint32_t));
+    }
+    else if (block->type == Group)
+    {
+        struct rex_group *group = block->data;
+        printf ("nr_members             %20u\n", group->nr_members);
+        for (uint32_t i = 0; i < group->nr_members; i++)
+            printf ("member                 %20lu\n", group->members[i]);
+    }
+}
+
+/**
+ * Reads the REX file from stdin, e.g. from a pipe
+ */
+int rex_dump_stream (int list_only)
+{
+    struct rex_stream_reader r;
+    if (rex_stream_open_fd (&r, STDIN_FILENO, 0) != REX_OK)
+        die ("Cannot read REX stream from stdin\n");
+
+    rex_dump_header (&r.header);
+
+    int ret;
+    struct rex_block block;
+    uint64_t offset = r.header.start_addr;
+    while ((ret = rex_stream_next (&r, &block)) == REX_OK)
+    {
+        rex_dump_block_header (&block, offset);
+        if (!list_only)
+            rex_dump_block (&block);
+        offset += REX_BLOCK_HEADER_SIZE + block.sz;
+        rex_block_free (&block);
+    }
+    rex_stream_close (&r);
+
+    if (ret == REX_ERROR_CRC)
+        die ("CRC mismatch, the REX stream is corrupt\n");
+    if (ret != REX_END_OF_STREAM)
+        die ("Cannot read REX block from stdin\n");
+    printf ("═══════════════════════════════════════════\n");
+    return 0;
+}
+
 int main (int argc, char **argv)
 {
     printf ("═══════════════════════════════════════════\n");
     printf ("        %s %s (c) Robotic Eyes\n", rex_name, VERSION);
     printf ("═══════════════════════════════════════════\n\n");
 
-    if (argc < 2)
+    int list_only = 0;
+    int stats = 0;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1]; arg++)
+    {
+        if (strcmp (argv[arg], "-l") == 0)
+            list_only = 1;
+        else if (strcmp (argv[arg], "--stats") == 0)
+            stats = 1;
+        else if (strcmp (argv[arg], "--mem-report") == 0)
+        {
+            rex_mem_tracking (1);
+            atexit (rex_dump_mem);
+        }
+        else
+            usage (argv[0]);
+    }
+    if (arg != argc - 1)
         usage (argv[0]);
 
-    long sz;
-    uint8_t *buf = read_file_binary (argv[1], &sz);
-    if (buf == NULL)
-        die ("Cannot open REX file %s\n", argv[1]);
+    if (stats && !rex_stats_available ())
+        warn ("Performance counters are not available, rebuild with -DSTATS=ON");
+    else if (stats)
+    {
+        rex_stats_enable (1);
+        atexit (rex_dump_stats);
+    }
+
+    const char *filename = argv[arg];
+    if (strcmp (filename, "-") == 0)
+        return rex_dump_stream (list_only);
+
+    struct rex_map map;
+    if (rex_map_open (filename, &map) != REX_OK)
+        die ("Cannot open REX file %s\n", filename);
 
     struct rex_header header;
-    uint8_t *ptr = rex_header_read (buf, &header);
+    uint8_t *ptr = rex_header_read (map.data, &header);
     if (ptr == NULL)
         die ("Cannot read REX header");
 
     rex_dump_header (&header);
 
-    for (int i = 0; i < header.nr_datablocks; i++)
+    if (list_only)
     {
+        struct rex_block_iter it;
         struct rex_block block;
-        ptr = rex_block_read (ptr, &block);
-        rex_dump_block_header (&block);
+        rex_block_iter_init (&it, map.data, map.sz, &header);
+        while ((ptr = rex_block_iter_next (&it, &block)) != NULL)
+            rex_dump_block_header (&block, ptr - map.data);
 
-        if (block.type == LineSet)
-        {
-            struct rex_lineset *ls = block.data;
-            rex_dump_lineset_block (ls);
-            FREE (ls->vertices);
-            FREE (block.data);
-        }
-        else if (block.type == PointList)
-        {
-            struct rex_pointlist *p = block.data;
-            rex_dump_pointlist_block (p);
-            FREE (p->positions);
-            FREE (block.data);
-        }
-        else if (block.type == Text)
-        {
-            struct rex_text *text = block.data;
-            printf ("position %22.2f %5.2f %5.2f\n", text->position[0], text->position[1], text->position[2]);
-            printf ("fontSize    %31.1f\n", text->font_size);
-            printf ("text        %31s\n", text->data);
-            printf ("red         %31.1f\n", text->red);
-            printf ("green       %31.1f\n", text->green);
-            printf ("blue        %31.1f\n", text->blue);
-            printf ("alpha       %31.1f\n", text->alpha);
-            FREE (block.data);
-        }
-        else if (block.type == Mesh)
-        {
-            struct rex_mesh *mesh = block.data;
-            rex_dump_mesh_block (mesh);
-            rex_mesh_free (mesh);
-            FREE (block.data);
-        }
-        else if (block.type == MaterialStandard)
-        {
-            struct rex_material_standard *mat = block.data;
-            rex_dump_material_block (mat);
-            FREE (block.data);
-        }
-        else if (block.type == Image)
-        {
-            struct rex_image *img = block.data;
-            printf ("compression %31s\n", rex_image_types[img->compression]);
-            printf ("image size  %31ld\n", block.sz - sizeof (uint32_t));
-            FREE (img->data);
-            FREE (block.data);
-        }
+        rex_map_close (&map);
+        printf ("═══════════════════════════════════════════\n");
+        return 0;
+    }
+
+    // invalid files are not decoded, the checksum is only computed for valid files
+    int valid = rex_validate (map.data, map.sz, &header) == REX_OK;
+    printf ("valid                  %20s\n", valid ? "yes" : "no");
+    if (!valid)
+    {
+        rex_map_close (&map);
+        printf ("═══════════════════════════════════════════\n");
+        return 1;
+    }
+
+    int crc_status = rex_crc_verify (map.data, map.sz, &header);
+    if (header.crc)
+        printf ("crc valid              %20s\n", (crc_status == REX_OK) ? "yes" : "no");
+
+    struct rex_index idx;
+    if (rex_index_read (map.data, map.sz, &header, &idx) != REX_OK)
+        die ("Cannot read REX index");
+
+    for (uint32_t i = 0; i < idx.nr_entries; i++)
+    {
+        struct rex_block block;
+        ptr = rex_block_read (map.data + idx.entries[i].offset, &block);
+        rex_dump_block_header (&block, idx.entries[i].offset);
+        rex_dump_block (&block);
+        rex_block_free (&block);
     }
-    FREE (buf);
+    rex_index_free (&idx);
+    rex_map_close (&map);
     printf ("═══════════════════════════════════════════\n");
     return 0;
 }
@@ -29,12 +29,17 @@
 #define MIN_VAL (0.0f)
 #define MAX_VAL (1000.0f)
 
-/* Current limitation for point list */
-#define MAX_POINTS (100000)
-
 void usage (const char *exec)
 {
-    die ("usage: %s lasfile rexfile\n", exec);
+    die ("usage: %s [-c] [--mem-report] lasfile rexfile\n"
+         "  -c            write compact pointlists with 16 bit positions and 8 bit colors\n"
+         "  --mem-report  print the memory accounting per subsystem on exit\n", exec);
+}
+
+void mem_report (void)
+{
+    printf ("\nmemory\n");
+    rex_mem_report (stdout);
 }
 
 int main (int argc, char **argv)
@@ -44,6 +49,22 @@ int main (int argc, char **argv)
     printf ("═══════════════════════════════════════════\n");
     printf ("Generating REX file from LAS file ...\n\n");
 
+    uint8_t pointlist_bits = 0;
+    while (argc > 1 && argv[1][0] == '-')
+    {
+        if (strcmp (argv[1], "-c") == 0)
+            pointlist_bits = 16;
+        else if (strcmp (argv[1], "--mem-report") == 0)
+        {
+            rex_mem_tracking (1);
+            atexit (mem_report);
+        }
+        else
+            usage (argv[0]);
+        argc--;
+        argv++;
+    }
+
     if (argc < 3)
         usage (argv[0]);
 
@@ -51,18 +72,26 @@ int main (int argc, char **argv)
     las = las_open (argv[1], "rb");
     las_header_display (las, stdout);
 
-    int c = 0;
-    int max_points = fmin (MAX_POINTS, las->number_of_point_records);
-    int i = 0;
+    // the number of points of a pointlist is a 32 bit value
+    if (las->number_of_point_records > UINT32_MAX)
+        die ("Too many points in LAS file\n");
+    uint32_t max_points = las->number_of_point_records;
+    uint32_t c = 0;
+    size_t i = 0;
 
     struct rex_header *header = rex_header_create();
     struct rex_pointlist pointlist;
     rex_pointlist_init (&pointlist);
 
+    // the points of the LAS file are kept until the REX file is written
+    int mem = rex_mem_enter (REX_MEM_APPLICATION);
     pointlist.nr_vertices = max_points;
     pointlist.nr_colors = max_points;
-    pointlist.positions = malloc (12 * pointlist.nr_vertices);
-    pointlist.colors = malloc (12 * pointlist.nr_colors);
+    pointlist.positions = rex_malloc ((size_t) 12 * pointlist.nr_vertices);
+    pointlist.colors = rex_malloc ((size_t) 12 * pointlist.nr_colors);
+    rex_mem_leave (mem);
+    if (!pointlist.positions || !pointlist.colors)
+        die ("Cannot allocate memory for %u points\n", max_points);
 
     mat4x4 mat =
     {
@@ -71,10 +100,11 @@ int main (int argc, char **argv)
         {0,  1,  0,  0},
         {0,  0,  0,  1}
     };
+    struct rex_trace_span span = rex_trace_begin ("read LAS");
     while (las_read (las))
     {
         double x, y, z;
-        if (c++ > max_points - 1)
+        if (c++ >= max_points)
             break;
 
         // transform into our REX internal coordinate system
@@ -105,27 +135,47 @@ int main (int argc, char **argv)
     }
 
     las_close (las);
+    rex_trace_end (&span);
+    pointlist.nr_vertices = pointlist.nr_colors = i / 3;
 
     FILE *fp = fopen (argv[2], "wb");
     if (!fp)
         die ("Cannot open REX file %s for writing\n", argv[2]);
 
-    long p_sz;
-    uint8_t *p_ptr = rex_block_write_pointlist (0 /*id*/, header, &pointlist, &p_sz);
+    struct rex_index idx;
+    rex_index_init (&idx);
 
-    printf ("\nSuccessfully converted %d points.\n", pointlist.nr_vertices);
+    // the point arrays are written directly, without a serialized copy; pointlists
+    // which exceed the block size are split into a group of blocks
+    struct rex_group_writer w;
+    rex_group_writer_init (&w, fileno (fp), header, &idx);
+    w.pointlist_bits = pointlist_bits;
+    uint64_t id = 0;
+    span = rex_trace_begin ("write pointlist");
+    if (rex_group_write_pointlist (&w, &id, &pointlist) != REX_OK)
+        die ("Cannot write pointlist to REX file %s\n", argv[2]);
+    rex_trace_end (&span);
+
+    printf ("\nSuccessfully converted %u points.\n", pointlist.nr_vertices);
+
+    long idx_sz;
+    uint8_t *idx_ptr = rex_block_write_index (header, &idx, &idx_sz);
 
     long header_sz;
     uint8_t *header_ptr = rex_header_write (header, &header_sz);
 
-    FREE (pointlist.positions);
-    FREE (pointlist.colors);
-
-    fwrite (header_ptr, header_sz, 1, fp);
-    fwrite (p_ptr, p_sz, 1, fp);
+    struct rex_iov header_iov = { header_ptr, header_sz };
+    struct rex_iov idx_iov = { idx_ptr, idx_sz };
+    int fd = fileno (fp);
+    if (rex_file_writev (fd, 0, &header_iov, 1) != REX_OK
+            || rex_file_writev (fd, w.offset, &idx_iov, 1) != REX_OK)
+        die ("Cannot write REX file %s\n", argv[2]);
     fclose (fp);
 
-    FREE (p_ptr);
+    FREE (pointlist.positions);
+    FREE (pointlist.colors);
+    rex_index_free (&idx);
+    FREE (idx_ptr);
     FREE (header_ptr);
     return 0;
 }
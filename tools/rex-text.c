@@ -68,6 +68,9 @@ int main (int argc, char **argv)
 
     struct rex_header *header = rex_header_create();
 
+    struct rex_index idx;
+    rex_index_init (&idx);
+
     uint8_t *text_data[LEN (data)];
     long text_data_sz[LEN (data)];
     for (int i = 0; i < LEN (data); i++)
@@ -75,8 +78,12 @@ int main (int argc, char **argv)
         printf ("Adding text: %s\n", data[i].data);
         uint8_t *text_ptr = rex_block_write_text (i, header, &data[i], &text_data_sz[i]);
         text_data[i] = text_ptr;
+        rex_index_add_block (&idx, text_ptr);
     }
 
+    long idx_sz;
+    uint8_t *idx_ptr = rex_block_write_index (header, &idx, &idx_sz);
+
     long header_sz;
     uint8_t *header_ptr = rex_header_write (header, &header_sz);
 
@@ -87,9 +94,12 @@ int main (int argc, char **argv)
         fwrite (text_data[i], text_data_sz[i], 1, fp);
         FREE (text_data[i]);
     }
+    fwrite (idx_ptr, idx_sz, 1, fp);
 
     fclose (fp);
 
+    rex_index_free (&idx);
+    FREE (idx_ptr);
     FREE (header_ptr);
     FREE (header);
     return 0;
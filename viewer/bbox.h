@@ -16,6 +16,8 @@
 #pragma once
 
 #include "linmath.h"
+#include "rex-bounds.h"
+#include "status.h"
 #include <float.h>
 
 struct bbox
@@ -41,3 +43,19 @@ static inline void bbox_union (struct bbox *r, struct bbox *a, struct bbox *b)
     r->max[1] = fmax (a->max[1], b->max[1]);
     r->max[2] = fmax (a->max[2], b->max[2]);
 }
+
+/**
+ * Computes the bounding box of n positions (3 floats each), the pool can be NULL
+ */
+static inline void bbox_calc (struct bbox *bb, const float *positions, uint64_t n, struct rex_thread_pool *pool)
+{
+    if (!bb) return;
+
+    struct rex_bounds b;
+    bbox_init (bb);
+    if (rex_bounds_calc (positions, n, pool, &b) != REX_OK)
+        return;
+
+    vec3_dup (bb->min, b.min);
+    vec3_dup (bb->max, b.max);
+}
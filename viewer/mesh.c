@@ -88,13 +88,6 @@ void mesh_render (struct mesh *m, struct shader *s, mat4x4 model, struct camera
     glBindVertexArray (0);
 }
 
-inline static void get_vertex (vec3 *pos, float *positions, uint32_t index)
-{
-    (*pos) [0] = positions[index * 3];
-    (*pos) [1] = positions[index * 3 + 1];
-    (*pos) [2] = positions[index * 3 + 2];
-}
-
 /**
  * Ptr is pointing to a valid memory which will be used to store normal information
  */
@@ -106,45 +99,12 @@ static void mesh_calc_normals (float *ptr, struct rex_mesh *rm)
         memcpy (ptr, rm->normals, 12 * rm->nr_vertices);
     else
         memset (ptr, 0, 12 * rm->nr_vertices);
-
-#if 0
-    //  currently no normal are calculated
-    vec3 v0, v1, v2;
-    vec3 a, b;
-    vec3 r;
-    for (int i = 0; i < rm->nr_triangles * 3; i += 3, ptr += 3)
-    {
-        get_vertex (&v0, rm->positions, rm->triangles[i]);
-        get_vertex (&v1, rm->positions, rm->triangles[i + 1]);
-        get_vertex (&v2, rm->positions, rm->triangles[i + 2]);
-
-        vec3_sub (a, v1, v0);
-        vec3_sub (b, v2, v0);
-        vec3_mul_cross (r, a, b);
-        vec3_norm (ptr, r);
-        /* printf ("norm: %f %f %f\n", n[0], n[1], n[2]); */
-        /* fflush (stdout); */
-    }
-#endif
 }
 
 static void mesh_calc_bbox (struct mesh *m, struct rex_mesh *rm)
 {
     if (!m || !rm) return;
-    bbox_init (&m->bb);
-    for (int i = 0; i < rm->nr_vertices * 3; i += 3)
-    {
-        // x
-        if (rm->positions[i] > m->bb.max[0]) m->bb.max[0] = rm->positions[i];
-        if (rm->positions[i] < m->bb.min[0]) m->bb.min[0] = rm->positions[i];
-        // y
-        if (rm->positions[i + 1] > m->bb.max[1]) m->bb.max[1] = rm->positions[i + 1];
-        if (rm->positions[i + 1] < m->bb.min[1]) m->bb.min[1] = rm->positions[i + 1];
-        // z
-        if (rm->positions[i + 2] > m->bb.max[2]) m->bb.max[2] = rm->positions[i + 2];
-        if (rm->positions[i + 2] < m->bb.min[2]) m->bb.min[2] = rm->positions[i + 2];
-
-    }
+    bbox_calc (&m->bb, rm->positions, rm->nr_vertices, NULL);
     printf ("Mesh bounding box:\n");
     vec3_dump ("  min", m->bb.min);
     vec3_dump ("  max", m->bb.max);
@@ -162,7 +122,7 @@ void mesh_set_rex_mesh (struct mesh *m, struct rex_mesh *data)
 
     GLuint elem_size = 9; // pos, normals, color
     size_t mem = sizeof (GLfloat) * m->nr_vertices * elem_size;
-    GLfloat *vertices = malloc (mem);
+    GLfloat *vertices = rex_malloc (mem);
     memset (vertices, 0, mem);
 
     GLfloat *ptr = vertices;
@@ -182,7 +142,7 @@ void mesh_set_rex_mesh (struct mesh *m, struct rex_mesh *data)
     }
 
     // triangles
-    uint32_t *indices = malloc (sizeof (uint32_t) * m->nr_triangles * 3);
+    uint32_t *indices = rex_malloc (sizeof (uint32_t) * m->nr_triangles * 3);
     indices = memcpy (indices, data->triangles, 12 * data->nr_triangles);
 
     mesh_load_vao (m, elem_size, vertices, indices);
@@ -44,7 +44,9 @@ void mesh_group_add_mesh (struct mesh_group *g, struct mesh *m)
 {
     if (!g) return;
     list_insert (g->meshes, m);
-    mesh_group_calc_bbox (g);
+
+    // the bounding box only grows, so it is extended instead of recomputed
+    bbox_union (&g->bb, &g->bb, &m->bb);
 }
 
 void mesh_group_remove_mesh (struct mesh_group *g, struct mesh *m)
@@ -22,6 +22,9 @@
 #include "points.h"
 #include "util.h"
 
+// point clouds with more points get their bounding box computed on all cores
+#define POINTS_PARALLEL_BBOX (1 << 22)
+
 void points_init (struct points *p)
 {
     if (!p) return;
@@ -81,20 +84,9 @@ void points_render (struct points *p, struct shader *s, struct camera *cam, mat4
 static void points_calc_bbox (struct points *p, struct rex_pointlist *rp)
 {
     if (!p || !rp) return;
-    bbox_init (&p->bb);
-    for (int i = 0; i < rp->nr_vertices * 3; i += 3)
-    {
-        // x
-        if (rp->positions[i] > p->bb.max[0]) p->bb.max[0] = rp->positions[i];
-        if (rp->positions[i] < p->bb.min[0]) p->bb.min[0] = rp->positions[i];
-        // y
-        if (rp->positions[i + 1] > p->bb.max[1]) p->bb.max[1] = rp->positions[i + 1];
-        if (rp->positions[i + 1] < p->bb.min[1]) p->bb.min[1] = rp->positions[i + 1];
-        // z
-        if (rp->positions[i + 2] > p->bb.max[2]) p->bb.max[2] = rp->positions[i + 2];
-        if (rp->positions[i + 2] < p->bb.min[2]) p->bb.min[2] = rp->positions[i + 2];
-
-    }
+    struct rex_thread_pool *pool = (rp->nr_vertices > POINTS_PARALLEL_BBOX) ? rex_thread_pool_create (0) : NULL;
+    bbox_calc (&p->bb, rp->positions, rp->nr_vertices, pool);
+    rex_thread_pool_destroy (pool);
     printf ("points bounding box:\n");
     vec3_dump ("  min", p->bb.min);
     vec3_dump ("  max", p->bb.max);
@@ -123,7 +115,7 @@ void points_set_rex_pointlist (struct points *p, struct rex_pointlist *data)
 
     GLuint elem_size = 6; // pos, color
     size_t mem = sizeof (GLfloat) * p->nr_vertices * elem_size;
-    GLfloat *vertices = malloc (mem);
+    GLfloat *vertices = rex_malloc (mem);
     memset (vertices, 0, mem);
 
     GLfloat *ptr = vertices;
@@ -86,7 +86,7 @@ void polyline_set_rex_lineset (struct polyline *p, struct rex_lineset *data)
 
     GLuint elem_size = 3;
     size_t mem = sizeof (GLfloat) * p->nr_vertices * elem_size;
-    GLfloat *vertices = malloc (mem);
+    GLfloat *vertices = rex_malloc (mem);
     memset (vertices, 0, mem);
 
     GLfloat *ptr = vertices;
@@ -36,7 +36,14 @@ char resource_search_path[256];
 
 void usage (const char *exec)
 {
-    die ("usage: %s filename.rex\n", exec);
+    die ("usage: %s [--mem-report] filename.rex\n"
+         "  --mem-report  print the memory accounting per subsystem after loading and on exit\n", exec);
+}
+
+void mem_report (void)
+{
+    printf ("\nmemory\n");
+    rex_mem_report (stdout);
 }
 
 char *get_valid_resource_path()
@@ -79,7 +86,6 @@ void addmesh (struct rex_mesh *mesh, struct scene *s)
     mesh_init (m);
     mesh_set_rex_mesh (m, mesh);
     scene_add_mesh (s, m);
-    rex_mesh_free (mesh);
 }
 
 void addpoints (struct rex_pointlist *plist, struct scene *s)
@@ -131,42 +137,90 @@ int loadrex (const char *file, struct scene *s)
         die ("Cannot open REX file %s\n", file);
 
     struct rex_header header;
-    uint8_t *ptr = rex_header_read (buf, &header);
+    rex_header_read (buf, &header);
+
+    // the blocks are independent, decode them on all cores and add them in file order
+    struct rex_thread_pool *pool = rex_thread_pool_create (0);
+    struct rex_block *blocks;
+    uint32_t nr_blocks;
+    if (rex_block_read_all (buf, sz, &header, pool, &blocks, &nr_blocks) != REX_OK)
+        die ("Cannot read REX blocks");
+
+    // split meshes and pointlists are reassembled, the group block is replaced by the
+    // complete geometry and the parts are skipped (blocks are in the order of the index)
+    struct rex_index idx;
+    if (rex_index_read (buf, sz, &header, &idx) != REX_OK)
+        die ("Cannot read REX index");
+    uint8_t *grouped = rex_malloc (nr_blocks + 1);
+    if (!grouped)
+        die ("Cannot allocate memory");
+    memset (grouped, 0, nr_blocks + 1);
+    for (uint32_t i = 0; i < nr_blocks; i++)
+    {
+        if (blocks[i].type != Group || !blocks[i].data)
+            continue;
+
+        struct rex_block whole;
+        if (rex_group_read (buf, &idx, &blocks[i], &whole) != REX_OK)
+        {
+            warn ("Cannot reassemble group %lu, showing its parts", (unsigned long) blocks[i].id);
+            continue;
+        }
+
+        struct rex_group *group = blocks[i].data;
+        for (uint32_t m = 0; m < group->nr_members; m++)
+        {
+            const struct rex_index_entry *e = rex_index_find (&idx, group->members[m]);
+            if (e)
+                grouped[e - idx.entries] = 1;
+        }
+        rex_block_free (&blocks[i]);
+        blocks[i] = whole;
+    }
+    rex_index_free (&idx);
+    FREE (buf);
+
+    // meshes without normals (e.g. stripped to save file size) get smooth normals
+    for (uint32_t i = 0; i < nr_blocks; i++)
+    {
+        struct rex_mesh *mesh = blocks[i].data;
+        if (blocks[i].type == Mesh && mesh && !mesh->normals && !grouped[i]
+                && rex_mesh_generate_normals (mesh, REX_NORMALS_AREA, pool) != REX_OK)
+            warn ("Cannot generate normals for mesh block %u", i);
+    }
+    rex_thread_pool_destroy (pool);
 
     struct list *materials;
     materials = list_create();
 
     int geometry = 0;
-    for (int i = 0; i < header.nr_datablocks; i++)
+    for (uint32_t i = 0; i < nr_blocks; i++)
     {
-        struct rex_block block;
-        ptr = rex_block_read (ptr, &block);
+        struct rex_block *block = &blocks[i];
 
-        if (block.type == Mesh)
+        if (grouped[i])
+            continue;
+        else if (block->type == Mesh)
         {
-            addmesh (block.data, s);
-            rex_mesh_free (block.data);
-            FREE (block.data);
+            addmesh (block->data, s);
             geometry++;
         }
-        else if (block.type == PointList)
+        else if (block->type == PointList)
         {
-            addpoints (block.data, s);
-            FREE (block.data);
+            addpoints (block->data, s);
             geometry++;
         }
-        else if (block.type == LineSet)
+        else if (block->type == LineSet)
         {
-            addlines (block.data, s);
-            FREE (block.data);
+            addlines (block->data, s);
             geometry++;
         }
-        else if (block.type == MaterialStandard)
-        {
-            addmaterial(block.id, block.data, materials);
-            FREE (block.data);
-        }
+        else if (block->type == MaterialStandard)
+            addmaterial(block->id, block->data, materials);
     }
+    // the geometry is copied to the GPU, so the decoded blocks are only needed temporarily
+    rex_blocks_free (blocks, nr_blocks);
+    FREE (grouped);
 
     // Assign materials to meshes
     struct node *cur = materials->head;
@@ -206,15 +260,23 @@ int main (int argc, char **argv)
     char *resource_path = get_valid_resource_path();
     printf ("Resource path: %s\n", resource_path);
 
-    if (argc < 2)
+    int report = (argc > 2 && strcmp (argv[1], "--mem-report") == 0);
+    if (argc < 2 + report)
         usage (argv[0]);
+    if (report)
+    {
+        rex_mem_tracking (1);
+        atexit (mem_report);
+    }
 
     gameengine_init();
 
     struct scene *s = scene_create (resource_path);
 
-    if (loadrex (argv[1], s))
+    if (loadrex (argv[1 + report], s))
         die ("Unable to load REX file");
+    if (report)
+        mem_report ();
 
     gameengine_start (s);
     gameengine_cleanup();